@@ -92,7 +92,8 @@ export function getVitepressSidebar(blog?: DefaultTheme.SidebarItem[]): DefaultT
                         {text: "GPU", link: "/inspect/gpu"},
                         {text: "GGUF", link: "/inspect/gguf"},
                         {text: "Measure", link: "/inspect/measure"},
-                        {text: "Estimate", link: "/inspect/estimate"}
+                        {text: "Estimate", link: "/inspect/estimate"},
+                        {text: "Benchmark", link: "/inspect/benchmark"}
                     ]
                 }
             ]
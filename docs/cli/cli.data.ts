@@ -8,6 +8,7 @@ import { BuildCommand } from "../../src/cli/commands/source/commands/BuildComman
 import { ClearCommand } from "../../src/cli/commands/source/commands/ClearCommand.js";
 import { InspectMeasureCommand } from "../../src/cli/commands/inspect/commands/InspectMeasureCommand.js";
 import { InspectEstimateCommand } from "../../src/cli/commands/inspect/commands/InspectEstimateCommand.js";
+import { InspectBenchmarkCommand } from "../../src/cli/commands/inspect/commands/InspectBenchmarkCommand.js";
 import { cliBinName, npxRunPrefix } from "../../src/config.js";
 import { htmlEscape } from "../../.vitepress/utils/htmlEscape.js";
 import { getCommandHtmlDoc } from "../../.vitepress/utils/getCommandHtmlDoc.js";
@@ -44,6 +45,9 @@ export default {
                 }),
                 estimate: await getCommandHtmlDoc(InspectEstimateCommand, {
                     parentCommand: InspectCommand
+                }),
+                benchmark: await getCommandHtmlDoc(InspectBenchmarkCommand, {
+                    parentCommand: InspectCommand
                 })
             },
             source: {
@@ -1,11 +1,16 @@
 #include <thread>
+#include <chrono>
 #include <algorithm>
 #include <cmath>
 #include "common/common.h"
 #include "llama-vocab.h"
+#include "llama-context.h"
 #include "llama.h"
 
 #include "addonGlobals.h"
+#include "globals/addonExecutor.h"
+#include "utils/vectorMath.h"
+#include "utils/cpuAffinity.h"
 #include "AddonModel.h"
 #include "AddonModelLora.h"
 #include "AddonGrammarEvaluationState.h"
@@ -31,12 +36,37 @@ static uint64_t calculateBatchMemorySize(int32_t n_tokens_alloc, int32_t embd, i
     return totalSize;
 }
 
-class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
+// the state size of a newly created context doesn't include the KV cache, since no cells are used yet,
+// so the size of the KV cache (or the recurrent state) is taken from the buffers its memory allocated,
+// together with the compute buffers that are reserved when the context is created.
+// only host buffers are counted, since buffers offloaded to the GPU aren't part of the process memory
+static void getHostContextBuffersSize(const llama_context* ctx, uint64_t& kvCacheSize, uint64_t& computeBuffersSize) {
+    kvCacheSize = 0;
+    computeBuffersSize = 0;
+
+    for (const auto& [bufferType, memoryBreakdown] : ctx->memory_breakdown()) {
+        if (bufferType != nullptr && ggml_backend_buft_is_host(bufferType)) {
+            kvCacheSize += memoryBreakdown.context;
+            computeBuffersSize += memoryBreakdown.compute;
+        }
+    }
+}
+
+// a single major page fault can be caused by unrelated work of the process,
+// but many of them during a batch decode mean that the model weights are being read from the disk
+static const uint64_t pagingMajorPageFaultsThreshold = 8;
+
+static int64_t getSteadyTimeUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class AddonContextDecodeBatchWorker : public AddonAsyncWorker {
     public:
         AddonContext* ctx;
+        bool aborted = false;
 
         AddonContextDecodeBatchWorker(const Napi::Env& env, AddonContext* ctx)
-            : Napi::AsyncWorker(env, "AddonContextDecodeBatchWorker"),
+            : AddonAsyncWorker(env, "AddonContextDecodeBatchWorker", AddonExecutorLane::compute),
               ctx(ctx),
               deferred(Napi::Promise::Deferred::New(env)) {
             ctx->Ref();
@@ -52,12 +82,48 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
     protected:
         Napi::Promise::Deferred deferred;
 
+        // an aborted decode may have already stored some of the batch ubatches in the KV cache,
+        // so the cells of the batch are removed to keep the context state consistent with the state before the batch
+        void rollbackBatch() {
+            std::unordered_map<llama_seq_id, llama_pos> sequenceFirstPositions;
+            for (int32_t i = 0; i < ctx->batch.n_tokens; i++) {
+                const llama_seq_id sequenceId = ctx->batch.seq_id[i][0];
+                auto it = sequenceFirstPositions.find(sequenceId);
+
+                if (it == sequenceFirstPositions.end()) {
+                    sequenceFirstPositions[sequenceId] = ctx->batch.pos[i];
+                } else {
+                    it->second = std::min(it->second, ctx->batch.pos[i]);
+                }
+            }
+
+            for (const auto& [sequenceId, firstPosition] : sequenceFirstPositions) {
+                llama_memory_seq_rm(llama_get_memory(ctx->ctx), sequenceId, firstPosition, -1);
+            }
+        }
+
         void Execute() {
             try {
+                if (ctx->isBatchDecodeAborted()) {
+                    aborted = true;
+                    return;
+                }
+
+                PageFaultCounts pageFaultsBefore;
+                ctx->pageFaultsAvailable = getProcessPageFaults(pageFaultsBefore);
+                ScopedDecodeWindow decodeWindow;
+                const int64_t decodeStartTime = getSteadyTimeUs();
+
                 // Perform the evaluation using llama_decode.
-                int r = llama_decode(ctx->ctx, ctx->batch);
+                ctx->batchDecodeRunning = true;
+                int r = ctx->decode(ctx->batch);
+                ctx->batchDecodeRunning = false;
 
-                if (r != 0) {
+                if (r == 2) {
+                    rollbackBatch();
+                    aborted = true;
+                    return;
+                } else if (r != 0) {
                     if (r == 1) {
                         SetError("could not find a KV slot for the batch (try reducing the size of the batch or increase the context)");
                     } else {
@@ -68,26 +134,33 @@ class AddonContextDecodeBatchWorker : public Napi::AsyncWorker {
                 }
 
                 llama_synchronize(ctx->ctx);
+
+                PageFaultCounts pageFaultsAfter;
+                getProcessPageFaults(pageFaultsAfter);
+                const bool overlapped = decodeWindow.end();
+                ctx->recordBatchDecode(getSteadyTimeUs() - decodeStartTime, pageFaultsBefore, pageFaultsAfter, overlapped);
             } catch (const std::exception& e) {
+                ctx->batchDecodeRunning = false;
                 SetError(e.what());
             } catch(...) {
+                ctx->batchDecodeRunning = false;
                 SetError("Unknown error when calling \"llama_decode\"");
             }
         }
         void OnOK() {
-            deferred.Resolve(Env().Undefined());
+            deferred.Resolve(Napi::Boolean::New(Env(), !aborted));
         }
         void OnError(const Napi::Error& err) {
             deferred.Reject(err.Value());
         }
 };
 
-class AddonContextLoadContextWorker : public Napi::AsyncWorker {
+class AddonContextLoadContextWorker : public AddonAsyncWorker {
     public:
         AddonContext* context;
 
         AddonContextLoadContextWorker(const Napi::Env& env, AddonContext* context)
-            : Napi::AsyncWorker(env, "AddonContextLoadContextWorker"),
+            : AddonAsyncWorker(env, "AddonContextLoadContextWorker", AddonExecutorLane::load),
               context(context),
               deferred(Napi::Promise::Deferred::New(env)) {
             context->Ref();
@@ -105,9 +178,20 @@ class AddonContextLoadContextWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                context->ctx = llama_init_from_model(context->model->model, context->context_params);
+                {
+                    ScopedThreadAffinity threadAffinity(context->affinityCpus);
+                    context->ctx = llama_init_from_model(context->model->model, context->context_params);
+                }
 
                 context->contextLoaded = context->ctx != nullptr && context->ctx != NULL;
+
+                if (context->contextLoaded && context->threadPool != nullptr) {
+                    llama_attach_threadpool(context->ctx, context->threadPool->threadpool, context->threadPool->threadpool);
+                }
+
+                if (context->contextLoaded) {
+                    llama_set_abort_callback(context->ctx, AddonContext::abortDecodeCallback, context);
+                }
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -116,9 +200,12 @@ class AddonContextLoadContextWorker : public Napi::AsyncWorker {
         }
         void OnOK() {
             if (context->contextLoaded) {
-                uint64_t contextMemorySize = llama_state_get_size(context->ctx);
+                uint64_t kvCacheMemorySize = 0;
+                getHostContextBuffersSize(context->ctx, kvCacheMemorySize, context->computeBuffersMemorySize);
+                uint64_t contextMemorySize = llama_state_get_size(context->ctx) + kvCacheMemorySize;
                 adjustNapiExternalMemoryAdd(Env(), contextMemorySize);
                 context->loadedContextMemorySize = contextMemorySize;
+                context->kvCacheMemorySize = kvCacheMemorySize;
             }
 
             deferred.Resolve(Napi::Boolean::New(Env(), context->contextLoaded));
@@ -127,12 +214,12 @@ class AddonContextLoadContextWorker : public Napi::AsyncWorker {
             deferred.Reject(err.Value());
         }
 };
-class AddonContextUnloadContextWorker : public Napi::AsyncWorker {
+class AddonContextUnloadContextWorker : public AddonAsyncWorker {
     public:
         AddonContext* context;
 
         AddonContextUnloadContextWorker(const Napi::Env& env, AddonContext* context)
-            : Napi::AsyncWorker(env, "AddonContextUnloadContextWorker"),
+            : AddonAsyncWorker(env, "AddonContextUnloadContextWorker", AddonExecutorLane::load),
               context(context),
               deferred(Napi::Promise::Deferred::New(env)) {
             context->Ref();
@@ -150,22 +237,8 @@ class AddonContextUnloadContextWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                llama_free(context->ctx);
-                context->contextLoaded = false;
-
-                try {
-                    if (context->has_batch) {
-                        llama_batch_free(context->batch);
-                        context->has_batch = false;
-                        context->batch_n_tokens = 0;
-                    }
-
-                    context->dispose();
-                } catch (const std::exception& e) {
-                    SetError(e.what());
-                } catch(...) {
-                    SetError("Unknown error when calling \"llama_batch_free\"");
-                }
+                // the references of the context are released on the JS thread, in `OnOK` and `OnError`
+                context->disposeNativeResources();
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -173,27 +246,24 @@ class AddonContextUnloadContextWorker : public Napi::AsyncWorker {
             }
         }
         void OnOK() {
-            adjustNapiExternalMemorySubtract(Env(), context->loadedContextMemorySize);
-            context->loadedContextMemorySize = 0;
-
-            adjustNapiExternalMemorySubtract(Env(), context->batchMemorySize);
-            context->batchMemorySize = 0;
-
+            context->releaseReferences();
             deferred.Resolve(Env().Undefined());
         }
         void OnError(const Napi::Error& err) {
+            context->releaseReferences();
             deferred.Reject(err.Value());
         }
 };
 
 
-class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
+class AddonContextSampleTokenWorker : public AddonAsyncWorker {
     public:
         AddonContext* ctx;
         AddonSampler* sampler;
         bool arrayResult = false;
         bool returnProbabilities = false;
         bool returnConfidence = false;
+        bool learnNgram = true;
         float tokenConfidence = -1;
         bool has_probabilities = false;
         size_t probabilities_size;
@@ -204,7 +274,7 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
         bool no_output = false;
 
         AddonContextSampleTokenWorker(const Napi::CallbackInfo& info, AddonContext* ctx)
-            : Napi::AsyncWorker(info.Env(), "AddonContextSampleTokenWorker"),
+            : AddonAsyncWorker(info.Env(), "AddonContextSampleTokenWorker", AddonExecutorLane::compute),
               ctx(ctx),
               deferred(Napi::Promise::Deferred::New(info.Env())) {
             ctx->Ref();
@@ -214,6 +284,7 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
             arrayResult = info.Length() > 2 && info[2].IsBoolean();
             returnProbabilities = arrayResult ? info[2].As<Napi::Boolean>().Value() : false;
             returnConfidence = arrayResult && info.Length() > 3 && info[3].IsBoolean() ? info[3].As<Napi::Boolean>().Value() : false;
+            learnNgram = info.Length() > 4 && info[4].IsBoolean() ? info[4].As<Napi::Boolean>().Value() : true;
             sampler->Ref();
         }
         ~AddonContextSampleTokenWorker() {
@@ -249,24 +320,13 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
                 return;
             }
 
-            sampler->rebuildChainIfNeeded();
-
-            const auto * logits = llama_get_logits_ith(ctx->ctx, batchLogitIndex);
-            const int n_vocab = llama_vocab_n_tokens(ctx->model->vocab);
-
-            auto & candidates = sampler->tokenCandidates;
-            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
-                candidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+            const float* logits = ctx->getLogits(batchLogitIndex);
+            if (logits == nullptr) {
+                SetError("No logits are available for the given batch index");
+                return;
             }
 
-            llama_token_data_array cur_p = {
-                /* .data       = */ candidates.data(),
-                /* .size       = */ candidates.size(),
-                /* .selected   = */ -1,
-                /* .sorted     = */ false,
-            };
-
-            llama_sampler_apply(sampler->chain, &cur_p);
+            auto cur_p = sampler->applyChain(logits);
 
             if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
                 no_output = true;
@@ -347,7 +407,7 @@ class AddonContextSampleTokenWorker : public Napi::AsyncWorker {
             }
 
             try {
-                sampler->acceptToken(new_token_id);
+                sampler->acceptToken(new_token_id, learnNgram);
                 result = new_token_id;
             } catch (const std::exception& e) {
                 SetError(std::string("Failed to accept token in sampler: ") + e.what());
@@ -414,6 +474,12 @@ AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Ad
             context_params.n_ubatch = context_params.n_batch; // the batch queue is managed in the JS side, so there's no need for managing it on the C++ side
         }
 
+        // a smaller physical batch size makes `llama_decode` split each batch into micro-batches,
+        // which reduces the size of the compute buffers at the cost of evaluating large batches in more steps
+        if (options.Has("ubatchSize")) {
+            context_params.n_ubatch = std::min(context_params.n_batch, options.Get("ubatchSize").As<Napi::Number>().Uint32Value());
+        }
+
         if (options.Has("sequences")) {
             context_params.n_seq_max = options.Get("sequences").As<Napi::Number>().Uint32Value();
         }
@@ -439,6 +505,31 @@ AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Ad
             context_params.n_threads_batch = resolved_n_threads;
         }
 
+        if (options.Has("batchThreads")) {
+            const auto n_threads_batch = options.Get("batchThreads").As<Napi::Number>().Int32Value();
+            context_params.n_threads_batch = n_threads_batch == 0
+                ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
+                : n_threads_batch;
+        }
+
+        if (options.Has("cpus")) {
+            Napi::Uint32Array cpus = options.Get("cpus").As<Napi::Uint32Array>();
+            affinityCpus.assign(cpus.Data(), cpus.Data() + cpus.ElementLength());
+        }
+
+        if (options.Has("threadPool")) {
+            threadPool = Napi::ObjectWrap<AddonThreadPool>::Unwrap(options.Get("threadPool").As<Napi::Object>());
+
+            if (threadPool->disposed) {
+                threadPool = nullptr;
+                Napi::Error::New(info.Env(), "Thread pool is disposed").ThrowAsJavaScriptException();
+                return;
+            }
+
+            threadPool->Ref();
+            threadPool->attachContext();
+        }
+
         if (options.Has("performanceTracking")) {
             context_params.no_perf = !(options.Get("performanceTracking").As<Napi::Boolean>().Value());
         }
@@ -446,13 +537,29 @@ AddonContext::AddonContext(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Ad
         if (options.Has("swaFullCache")) {
             context_params.swa_full = options.Get("swaFullCache").As<Napi::Boolean>().Value();
         }
+
+        if (options.Has("kvCacheKeyType")) {
+            context_params.type_k = static_cast<ggml_type>(options.Get("kvCacheKeyType").As<Napi::Number>().Int32Value());
+        }
+
+        if (options.Has("kvCacheValueType")) {
+            context_params.type_v = static_cast<ggml_type>(options.Get("kvCacheValueType").As<Napi::Number>().Int32Value());
+        }
     }
+
+    context_params.n_threads = resolveThreads(context_params.n_threads);
+    context_params.n_threads_batch = resolveThreads(context_params.n_threads_batch);
 }
 AddonContext::~AddonContext() {
     dispose();
 }
 
 void AddonContext::dispose() {
+    disposeNativeResources();
+    releaseReferences();
+}
+
+void AddonContext::disposeNativeResources() {
     if (disposed) {
         return;
     }
@@ -461,28 +568,251 @@ void AddonContext::dispose() {
     if (contextLoaded) {
         contextLoaded = false;
         llama_free(ctx);
+    }
+
+    if (batch_capacity > 0) {
+        llama_batch_free(batch);
+        has_batch = false;
+        batch_n_tokens = 0;
+        batch_capacity = 0;
+    }
 
-        adjustNapiExternalMemorySubtract(Env(), loadedContextMemorySize);
-        loadedContextMemorySize = 0;
+    if (loraGroupBatch_n_tokens > 0) {
+        llama_batch_free(loraGroupBatch);
+        loraGroupBatch_n_tokens = 0;
+    }
+}
+
+void AddonContext::releaseReferences() {
+    if (referencesReleased) {
+        return;
     }
 
+    referencesReleased = true;
+
+    adjustNapiExternalMemorySubtract(Env(), loadedContextMemorySize);
+    loadedContextMemorySize = 0;
+    kvCacheMemorySize = 0;
+    computeBuffersMemorySize = 0;
+
+    adjustNapiExternalMemorySubtract(Env(), batchMemorySize);
+    batchMemorySize = 0;
+
     model->Unref();
 
-    disposeBatch();
+    for (auto& [sequenceId, loras] : sequenceLoras) {
+        for (auto& [lora, scale] : loras) {
+            lora->Unref();
+        }
+    }
+    sequenceLoras.clear();
+
+    // the threadpool can only be freed after the native context that uses it is freed
+    if (threadPool != nullptr) {
+        threadPool->detachContext();
+        threadPool->Unref();
+        threadPool = nullptr;
+    }
 }
 void AddonContext::disposeBatch() {
-    if (!has_batch) {
+    if (batch_capacity == 0) {
         return;
     }
 
     llama_batch_free(batch);
     has_batch = false;
     batch_n_tokens = 0;
+    batch_capacity = 0;
 
     adjustNapiExternalMemorySubtract(Env(), batchMemorySize);
     batchMemorySize = 0;
 }
 
+AddonThreadPoolComputeLock AddonContext::lockThreadPool() {
+    return AddonThreadPoolComputeLock(threadPool);
+}
+
+int32_t AddonContext::resolveThreads(int32_t threads) {
+    // a thread pool can't run more threads than it has
+    if (threadPool != nullptr) {
+        return std::min(threads, threadPool->params.n_threads);
+    }
+
+    return threads;
+}
+
+void AddonContext::applyLoras(llama_seq_id sequenceId) {
+    if (lorasApplied && appliedLorasSequenceId == sequenceId) {
+        return;
+    }
+
+    llama_clear_adapter_lora(ctx);
+    for (const auto& [lora, scale] : contextLoras) {
+        llama_set_adapter_lora(ctx, lora->lora_adapter, scale);
+    }
+
+    auto sequenceLorasIt = sequenceLoras.find(sequenceId);
+    if (sequenceLorasIt != sequenceLoras.end()) {
+        for (const auto& [lora, scale] : sequenceLorasIt->second) {
+            llama_set_adapter_lora(ctx, lora->lora_adapter, scale);
+        }
+    }
+
+    appliedLorasSequenceId = sequenceId;
+    lorasApplied = true;
+}
+
+void AddonContext::clearSequenceLoras(llama_seq_id sequenceId) {
+    auto sequenceLorasIt = sequenceLoras.find(sequenceId);
+    if (sequenceLorasIt == sequenceLoras.end()) {
+        return;
+    }
+
+    for (auto& [lora, scale] : sequenceLorasIt->second) {
+        lora->Unref();
+    }
+
+    sequenceLoras.erase(sequenceLorasIt);
+
+    if (appliedLorasSequenceId == sequenceId) {
+        lorasApplied = false;
+    }
+}
+
+int32_t AddonContext::decode(const llama_batch& batch) {
+    auto threadPoolLock = lockThreadPool();
+    hasGroupedLogits = false;
+
+    if (sequenceLoras.empty() || batch.token == nullptr || batch.n_tokens == 0) {
+        applyLoras(-1);
+        return llama_decode(ctx, batch);
+    }
+
+    // rows of sequences without their own adapters are grouped under -1
+    std::vector<llama_seq_id> rowGroups(batch.n_tokens);
+    std::vector<llama_seq_id> groups;
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        const llama_seq_id sequenceId = batch.seq_id[i][0];
+        rowGroups[i] = sequenceLoras.find(sequenceId) != sequenceLoras.end() ? sequenceId : -1;
+
+        if (std::find(groups.begin(), groups.end(), rowGroups[i]) == groups.end()) {
+            groups.push_back(rowGroups[i]);
+        }
+    }
+
+    if (groups.size() == 1) {
+        applyLoras(groups[0]);
+        return llama_decode(ctx, batch);
+    }
+
+    if (loraGroupBatch_n_tokens < batch.n_tokens) {
+        if (loraGroupBatch_n_tokens > 0) {
+            llama_batch_free(loraGroupBatch);
+        }
+
+        loraGroupBatch = llama_batch_init(batch.n_tokens, 0, 1);
+        loraGroupBatch_n_tokens = batch.n_tokens;
+    }
+
+    const int32_t n_vocab = llama_vocab_n_tokens(model->vocab);
+    int32_t logitRowsCount = 0;
+    groupedLogitsRows.assign(batch.n_tokens, -1);
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        if (batch.logits[i]) {
+            groupedLogitsRows[i] = logitRowsCount++;
+        }
+    }
+    groupedLogits.resize(static_cast<size_t>(logitRowsCount) * n_vocab);
+
+    std::vector<int32_t> groupRows;
+    for (size_t groupIndex = 0; groupIndex < groups.size(); groupIndex++) {
+        const llama_seq_id group = groups[groupIndex];
+        common_batch_clear(loraGroupBatch);
+        groupRows.clear();
+
+        for (int32_t i = 0; i < batch.n_tokens; i++) {
+            if (rowGroups[i] != group) {
+                continue;
+            }
+
+            common_batch_add(loraGroupBatch, batch.token[i], batch.pos[i], { batch.seq_id[i][0] }, batch.logits[i] != 0);
+            groupRows.push_back(i);
+        }
+
+        applyLoras(group);
+
+        const int32_t r = llama_decode(ctx, loraGroupBatch);
+        if (r != 0) {
+            rollbackLoraGroups(batch, rowGroups, groups, groupIndex + 1);
+            return r;
+        }
+
+        for (size_t groupRow = 0; groupRow < groupRows.size(); groupRow++) {
+            const int32_t logitsRow = groupedLogitsRows[groupRows[groupRow]];
+            if (logitsRow < 0) {
+                continue;
+            }
+
+            const float* logits = llama_get_logits_ith(ctx, groupRow);
+            if (logits != nullptr) {
+                std::copy(logits, logits + n_vocab, groupedLogits.begin() + static_cast<size_t>(logitsRow) * n_vocab);
+            }
+        }
+    }
+
+    hasGroupedLogits = true;
+    groupedLogitsBatch_n_tokens = batch.n_tokens;
+
+    return 0;
+}
+
+// removes the tokens of the first `groupsCount` groups of a batch from the KV cache,
+// so a failed grouped decode leaves the state as it was before the batch, like a failed `llama_decode` does
+void AddonContext::rollbackLoraGroups(
+    const llama_batch& batch,
+    const std::vector<llama_seq_id>& rowGroups,
+    const std::vector<llama_seq_id>& groups,
+    size_t groupsCount
+) {
+    const auto groupsEnd = groups.begin() + groupsCount;
+    std::unordered_map<llama_seq_id, llama_pos> sequenceFirstPositions;
+
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        if (std::find(groups.begin(), groupsEnd, rowGroups[i]) == groupsEnd) {
+            continue;
+        }
+
+        const llama_seq_id sequenceId = batch.seq_id[i][0];
+        auto it = sequenceFirstPositions.find(sequenceId);
+
+        if (it == sequenceFirstPositions.end()) {
+            sequenceFirstPositions[sequenceId] = batch.pos[i];
+        } else {
+            it->second = std::min(it->second, batch.pos[i]);
+        }
+    }
+
+    for (const auto& [sequenceId, firstPosition] : sequenceFirstPositions) {
+        llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, firstPosition, -1);
+    }
+}
+
+float* AddonContext::getLogits(int32_t batchIndex) {
+    if (!hasGroupedLogits) {
+        return llama_get_logits_ith(ctx, batchIndex);
+    }
+
+    if (batchIndex < 0) {
+        batchIndex += groupedLogitsBatch_n_tokens;
+    }
+
+    if (batchIndex < 0 || batchIndex >= groupedLogitsBatch_n_tokens || groupedLogitsRows[batchIndex] < 0) {
+        return nullptr;
+    }
+
+    return groupedLogits.data() + static_cast<size_t>(groupedLogitsRows[batchIndex]) * llama_vocab_n_tokens(model->vocab);
+}
+
 Napi::Value AddonContext::Init(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
@@ -527,25 +857,31 @@ Napi::Value AddonContext::InitBatch(const Napi::CallbackInfo& info) {
         return info.Env().Undefined();
     }
 
-    if (has_batch) {
-        llama_batch_free(batch);
-    }
-
     int32_t n_tokens = info[0].As<Napi::Number>().Int32Value();
 
-    batch = llama_batch_init(n_tokens, 0, 1);
-    has_batch = true;
-    batch_n_tokens = n_tokens;
+    // the batch buffers are reused between batches and only grow (geometrically, up to the batch size of the context),
+    // so alternating between small and large batches doesn't reallocate them every time
+    if (n_tokens > batch_capacity) {
+        if (batch_capacity > 0) {
+            llama_batch_free(batch);
+        }
+
+        const int32_t capacity = std::max(n_tokens, std::min(batch_capacity * 2, (int32_t)llama_n_batch(ctx)));
+        batch = llama_batch_init(capacity, 0, 1);
+        batch_capacity = capacity;
 
-    uint64_t newBatchMemorySize = calculateBatchMemorySize(n_tokens, llama_model_n_embd(model->model), context_params.n_batch);
-    if (newBatchMemorySize > batchMemorySize) {
-        adjustNapiExternalMemoryAdd(Env(), newBatchMemorySize - batchMemorySize);
-        batchMemorySize = newBatchMemorySize;
-    } else if (newBatchMemorySize < batchMemorySize) {
-        adjustNapiExternalMemorySubtract(Env(), batchMemorySize - newBatchMemorySize);
-        batchMemorySize = newBatchMemorySize;
+        uint64_t newBatchMemorySize = calculateBatchMemorySize(capacity, 0, 1);
+        if (newBatchMemorySize > batchMemorySize) {
+            adjustNapiExternalMemoryAdd(Env(), newBatchMemorySize - batchMemorySize);
+            batchMemorySize = newBatchMemorySize;
+        }
+    } else {
+        common_batch_clear(batch);
     }
 
+    has_batch = true;
+    batch_n_tokens = n_tokens;
+
     return info.Env().Undefined();
 }
 Napi::Value AddonContext::DisposeBatch(const Napi::CallbackInfo& info) {
@@ -596,6 +932,7 @@ Napi::Value AddonContext::DisposeSequence(const Napi::CallbackInfo& info) {
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
 
     bool result = llama_memory_seq_rm(llama_get_memory(ctx), sequenceId, -1, -1);
+    clearSequenceLoras(sequenceId);
 
     if (!result) {
         Napi::Error::New(info.Env(), "Failed to dispose sequence").ThrowAsJavaScriptException();
@@ -633,20 +970,64 @@ Napi::Value AddonContext::ShiftSequenceTokenCells(const Napi::CallbackInfo& info
 
     return info.Env().Undefined();
 }
-Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::EraseSequenceTokenRanges(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    Napi::Uint32Array ranges = info[1].As<Napi::Uint32Array>(); // sorted, non-overlapping [start, end) pairs
+    int32_t endPos = info[2].As<Napi::Number>().Int32Value();
 
+    llama_memory_t memory = llama_get_memory(ctx);
+    const size_t rangesLength = ranges.ElementLength() - (ranges.ElementLength() % 2);
 
-    const auto minPosition = llama_memory_seq_pos_min(llama_get_memory(ctx), sequenceId);
+    // recurrent states can't have ranges removed from the middle of a sequence
+    if (llama_model_is_recurrent(model->model) || llama_model_is_hybrid(model->model)) {
+        return Napi::Boolean::New(info.Env(), false);
+    }
 
-    return Napi::Number::New(info.Env(), minPosition);
+    // all the ranges are validated before anything is changed, so a rejected call leaves the sequence as it was
+    for (size_t i = 0; i < rangesLength; i += 2) {
+        const uint32_t startPos = ranges[i];
+        const uint32_t rangeEndPos = ranges[i + 1];
+        const uint32_t previousRangeEndPos = i == 0 ? 0 : ranges[i - 1];
+
+        if (startPos >= rangeEndPos || startPos < previousRangeEndPos || rangeEndPos > (uint32_t)std::max(0, endPos)) {
+            return Napi::Boolean::New(info.Env(), false);
+        }
+    }
+
+    int32_t removedTokens = 0;
+
+    // the cells of all the ranges are removed and the cells after each range are shifted back in a single call,
+    // so no evaluation can run on a partially shifted sequence
+    for (size_t i = 0; i < rangesLength; i += 2) {
+        const int32_t startPos = ranges[i];
+        const int32_t rangeEndPos = ranges[i + 1];
+
+        if (!llama_memory_seq_rm(memory, sequenceId, startPos, rangeEndPos)) {
+            // removing a validated range from an attention KV cache doesn't fail,
+            // but if it does, the sequence is cleared so it's never left partially shifted
+            llama_memory_seq_rm(memory, sequenceId, -1, -1);
+            return Napi::Boolean::New(info.Env(), false);
+        }
+
+        removedTokens += rangeEndPos - startPos;
+
+        const int32_t nextRangeStartPos = (i + 2 < rangesLength)
+            ? (int32_t)ranges[i + 2]
+            : endPos;
+
+        if (nextRangeStartPos > rangeEndPos && removedTokens > 0) {
+            llama_memory_seq_add(memory, sequenceId, rangeEndPos, nextRangeStartPos, -removedTokens);
+        }
+    }
+
+    return Napi::Boolean::New(info.Env(), true);
 }
-Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
@@ -655,104 +1036,773 @@ Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo
     int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
 
 
-    const auto maxPosition = llama_memory_seq_pos_max(llama_get_memory(ctx), sequenceId);
+    const auto minPosition = llama_memory_seq_pos_min(llama_get_memory(ctx), sequenceId);
 
-    return Napi::Number::New(info.Env(), maxPosition);
-}
-Napi::Value AddonContext::DecodeBatch(const Napi::CallbackInfo& info) {
-    AddonContextDecodeBatchWorker* worker = new AddonContextDecodeBatchWorker(info.Env(), this);
-    worker->Queue();
-    return worker->GetPromise();
-}
-Napi::Value AddonContext::SampleToken(const Napi::CallbackInfo& info) {
-    AddonContextSampleTokenWorker* worker = new AddonContextSampleTokenWorker(info, this);
-    worker->Queue();
-    return worker->GetPromise();
+    return Napi::Number::New(info.Env(), minPosition);
 }
-
-Napi::Value AddonContext::GetEmbedding(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    int32_t inputTokensLength = info[0].As<Napi::Number>().Int32Value();
-    int32_t maxVectorSize = (info.Length() > 1 && info[1].IsNumber()) ? info[1].As<Napi::Number>().Int32Value() : 0;
-
-    if (inputTokensLength <= 0) {
-        Napi::Error::New(info.Env(), "Invalid input tokens length").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
-
-    const int n_embd = llama_model_n_embd(model->model);
-    const enum llama_pooling_type pooling_type = llama_pooling_type(ctx);
-    const auto* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE ? NULL : llama_get_embeddings_seq(ctx, 0);
-    if (embeddings == NULL) {
-        embeddings = llama_get_embeddings_ith(ctx, inputTokensLength - 1);
-    }
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
 
-    if (embeddings == NULL) {
-        Napi::Error::New(info.Env(), std::string("Failed to get embeddings for token ") + std::to_string(inputTokensLength - 1)).ThrowAsJavaScriptException();
-        return info.Env().Undefined();
-    }
 
-    size_t resultSize = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
-    Napi::Float64Array result = Napi::Float64Array::New(info.Env(), resultSize);
-    for (size_t i = 0; i < resultSize; i++) {
-        result[i] = embeddings[i];
-    }
+    const auto maxPosition = llama_memory_seq_pos_max(llama_get_memory(ctx), sequenceId);
 
-    return result;
+    return Napi::Number::New(info.Env(), maxPosition);
 }
-
-Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
+Napi::Value AddonContext::GetKvCacheUsage(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
         return info.Env().Undefined();
     }
 
-    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
-}
-
-Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+    llama_memory_t memory = llama_get_memory(ctx);
+    const uint32_t contextSize = llama_n_ctx(ctx);
+    const uint32_t sequencesCount = std::max(1u, llama_n_seq_max(ctx));
+    const int64_t sequenceContextSize = contextSize / sequencesCount;
+
+    // every sequence takes 3 items: cells count, min position, max position.
+    // the positions of a sequence are contiguous (erased ranges are always shifted), so its cells count is derived from its positions range
+    Napi::Int32Array sequences = Napi::Int32Array::New(info.Env(), sequencesCount * 3);
+    int64_t usedCells = 0;
+    int64_t largestSequenceFreeCells = 0;
+
+    for (uint32_t i = 0; i < sequencesCount; i++) {
+        const llama_pos minPosition = llama_memory_seq_pos_min(memory, i);
+        const llama_pos maxPosition = llama_memory_seq_pos_max(memory, i);
+        const int32_t cells = (minPosition < 0 || maxPosition < 0)
+            ? 0
+            : (maxPosition - minPosition + 1);
+
+        sequences[i * 3] = cells;
+        sequences[i * 3 + 1] = minPosition;
+        sequences[i * 3 + 2] = maxPosition;
+
+        usedCells += cells;
+        largestSequenceFreeCells = std::max(largestSequenceFreeCells, sequenceContextSize - cells);
     }
 
-    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
-}
+    usedCells = std::min<int64_t>(usedCells, contextSize);
+    const int64_t freeCells = contextSize - usedCells;
 
-Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
-    if (disposed) {
-        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
-        return info.Env().Undefined();
+    // when the KV cache isn't unified, every sequence has its own budget of cells, so only the free cells of its own budget
+    // can be used to grow it.
+    // `0` means that all the free cells can be used by a single sequence, and values closer to `1` mean that the free cells
+    // are split between the budgets of many sequences
+    if (context_params.kv_unified || sequencesCount == 1) {
+        largestSequenceFreeCells = freeCells;
     }
 
-    const auto threads = info[0].As<Napi::Number>().Int32Value();
-    const auto resolvedThreads = threads == 0
-        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
-        : threads;
+    const double budgetSkew = freeCells <= 0
+        ? 0
+        : std::max(0.0, 1.0 - (double)std::min(largestSequenceFreeCells, freeCells) / (double)freeCells);
 
-    if (llama_n_threads(ctx) != resolvedThreads) {
-        llama_set_n_threads(ctx, resolvedThreads, resolvedThreads);
-    }
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("sequences", sequences);
+    result.Set("usedCells", Napi::Number::New(info.Env(), usedCells));
+    result.Set("freeCells", Napi::Number::New(info.Env(), freeCells));
+    result.Set("budgetSkew", Napi::Number::New(info.Env(), budgetSkew));
 
-    return info.Env().Undefined();
+    return result;
 }
 
-class AddonContextSaveSequenceStateToFileWorker : public Napi::AsyncWorker {
+class AddonContextDefragmentKvCacheWorker : public AddonAsyncWorker {
     public:
-        AddonContext* context;
-        std::string filepath;
-        llama_seq_id sequenceId;
-        std::vector<llama_token> tokens;
-        size_t savedFileSize = 0;
+        AddonContext* ctx;
+        std::vector<llama_seq_id> lostSequenceIds;
 
-        AddonContextSaveSequenceStateToFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
-            : Napi::AsyncWorker(info.Env(), "AddonContextSaveSequenceStateToFileWorker"),
-              context(context),
-              deferred(Napi::Promise::Deferred::New(info.Env())) {
+        AddonContextDefragmentKvCacheWorker(const Napi::Env& env, AddonContext* ctx)
+            : AddonAsyncWorker(env, "AddonContextDefragmentKvCacheWorker", AddonExecutorLane::compute),
+              ctx(ctx),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            ctx->Ref();
+        }
+        ~AddonContextDefragmentKvCacheWorker() {
+            ctx->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            const uint32_t sequencesCount = std::max(1u, llama_n_seq_max(ctx->ctx));
+
+            // when the KV cache isn't unified, every sequence has its own cells that other sequences can't use,
+            // so there's nothing to compact between the sequences
+            if (!ctx->context_params.kv_unified && sequencesCount > 1) {
+                return;
+            }
+
+            // `llama.cpp` has no public API to move KV cache cells, so the cells of each sequence are copied out,
+            // removed, and written back, which places them in the lowest free cells of the KV cache
+            llama_memory_t memory = llama_get_memory(ctx->ctx);
+            std::vector<uint8_t> sequenceState;
+
+            for (uint32_t i = 0; i < sequencesCount; i++) {
+                const llama_seq_id sequenceId = (llama_seq_id)i;
+                if (llama_memory_seq_pos_max(memory, sequenceId) < 0) {
+                    continue;
+                }
+
+                const size_t stateSize = llama_state_seq_get_size(ctx->ctx, sequenceId);
+                if (sequenceState.size() < stateSize) {
+                    sequenceState.resize(stateSize);
+                }
+
+                const size_t writtenSize = llama_state_seq_get_data(ctx->ctx, sequenceState.data(), stateSize, sequenceId);
+                if (writtenSize == 0) {
+                    continue;
+                }
+
+                llama_memory_seq_rm(memory, sequenceId, -1, -1);
+                if (llama_state_seq_set_data(ctx->ctx, sequenceState.data(), writtenSize, sequenceId) == 0) {
+                    llama_memory_seq_rm(memory, sequenceId, -1, -1);
+                    lostSequenceIds.push_back(sequenceId);
+                }
+            }
+        }
+        void OnOK() {
+            Napi::Int32Array result = Napi::Int32Array::New(Env(), lostSequenceIds.size());
+            for (size_t i = 0; i < lostSequenceIds.size(); i++) {
+                result[i] = lostSequenceIds[i];
+            }
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::DefragmentKvCache(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    auto* worker = new AddonContextDefragmentKvCacheWorker(info.Env(), this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::DecodeBatch(const Napi::CallbackInfo& info) {
+    abortBatchDecode = false;
+    batchDecodeDeadline = 0;
+
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+
+        if (options.Has("timeout")) {
+            const double timeout = options.Get("timeout").As<Napi::Number>().DoubleValue();
+            batchDecodeDeadline = getSteadyTimeUs() + std::max((int64_t)1, (int64_t)(timeout * 1000));
+        }
+    }
+
+    AddonContextDecodeBatchWorker* worker = new AddonContextDecodeBatchWorker(info.Env(), this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::AbortDecodeBatch(const Napi::CallbackInfo& info) {
+    abortBatchDecode = true;
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonContext::GetDecodeStats(const Napi::CallbackInfo& info) {
+    AddonContextDecodeStats stats;
+    {
+        std::lock_guard<std::mutex> lock(decodeStatsMutex);
+        stats = decodeStats;
+    }
+
+    Napi::Float64Array result = Napi::Float64Array::New(info.Env(), 12);
+    double* data = result.Data();
+    data[0] = (double)stats.batches;
+    data[1] = (double)stats.time;
+    data[2] = (double)stats.majorPageFaults;
+    data[3] = (double)stats.minorPageFaults;
+    data[4] = (double)stats.pagedBatches;
+    data[5] = (double)stats.lastTime;
+    data[6] = (double)stats.lastMajorPageFaults;
+    data[7] = (double)stats.lastMinorPageFaults;
+    data[8] = pageFaultsAvailable ? 1 : 0;
+    data[9] = stats.batches > 0 && !stats.lastOverlapped && stats.lastMajorPageFaults >= pagingMajorPageFaultsThreshold ? 1 : 0;
+    data[10] = (double)stats.overlappedBatches;
+    data[11] = stats.lastOverlapped ? 1 : 0;
+
+    return result;
+}
+
+void AddonContext::recordBatchDecode(
+    uint64_t time, const PageFaultCounts& pageFaultsBefore, const PageFaultCounts& pageFaultsAfter, bool overlapped
+) {
+    const uint64_t majorPageFaults = pageFaultsAfter.major >= pageFaultsBefore.major
+        ? pageFaultsAfter.major - pageFaultsBefore.major
+        : 0;
+    const uint64_t minorPageFaults = pageFaultsAfter.minor >= pageFaultsBefore.minor
+        ? pageFaultsAfter.minor - pageFaultsBefore.minor
+        : 0;
+
+    std::lock_guard<std::mutex> lock(decodeStatsMutex);
+    decodeStats.batches++;
+    decodeStats.time += time;
+    decodeStats.lastTime = time;
+    decodeStats.lastMajorPageFaults = majorPageFaults;
+    decodeStats.lastMinorPageFaults = minorPageFaults;
+    decodeStats.lastOverlapped = overlapped;
+
+    if (overlapped) {
+        // the faults may belong to the decode of the other context
+        decodeStats.overlappedBatches++;
+        return;
+    }
+
+    decodeStats.majorPageFaults += majorPageFaults;
+    decodeStats.minorPageFaults += minorPageFaults;
+
+    if (majorPageFaults >= pagingMajorPageFaultsThreshold) {
+        decodeStats.pagedBatches++;
+    }
+}
+
+bool AddonContext::isBatchDecodeAborted() {
+    if (abortBatchDecode) {
+        return true;
+    }
+
+    const int64_t deadline = batchDecodeDeadline;
+    return deadline != 0 && getSteadyTimeUs() >= deadline;
+}
+
+bool AddonContext::abortDecodeCallback(void* data) {
+    AddonContext* context = static_cast<AddonContext*>(data);
+
+    // only batch decodes are abortable, since other evaluations (like embeddings) don't roll back their state
+    return context->batchDecodeRunning && context->isBatchDecodeAborted();
+}
+
+Napi::Value AddonContext::SampleToken(const Napi::CallbackInfo& info) {
+    AddonContextSampleTokenWorker* worker = new AddonContextSampleTokenWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::GetEmbedding(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t inputTokensLength = info[0].As<Napi::Number>().Int32Value();
+    int32_t maxVectorSize = (info.Length() > 1 && info[1].IsNumber()) ? info[1].As<Napi::Number>().Int32Value() : 0;
+
+    if (inputTokensLength <= 0) {
+        Napi::Error::New(info.Env(), "Invalid input tokens length").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const int n_embd = llama_model_n_embd(model->model);
+    const enum llama_pooling_type pooling_type = llama_pooling_type(ctx);
+    const auto* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE ? NULL : llama_get_embeddings_seq(ctx, 0);
+    if (embeddings == NULL) {
+        embeddings = llama_get_embeddings_ith(ctx, inputTokensLength - 1);
+    }
+
+    if (embeddings == NULL) {
+        Napi::Error::New(info.Env(), std::string("Failed to get embeddings for token ") + std::to_string(inputTokensLength - 1)).ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    size_t resultSize = maxVectorSize == 0 ? n_embd : std::min(n_embd, maxVectorSize);
+    Napi::Float64Array result = Napi::Float64Array::New(info.Env(), resultSize);
+    for (size_t i = 0; i < resultSize; i++) {
+        result[i] = embeddings[i];
+    }
+
+    return result;
+}
+
+enum class AddonEmbeddingOutputType {
+    float32,
+    int8,
+    binary,
+
+    // the rank score of each input as a probability, for ranking contexts
+    rank
+};
+
+class AddonContextComputeEmbeddingsWorker : public AddonAsyncWorker {
+    public:
+        AddonContext* ctx;
+        std::vector<std::vector<llama_token>> inputs;
+        int32_t maxVectorSize = 0;
+        bool normalize = false;
+        AddonEmbeddingOutputType outputType = AddonEmbeddingOutputType::float32;
+        size_t resultVectorSize = 0;
+        std::vector<float> result;
+        std::vector<int8_t> int8Result;
+        std::vector<float> int8ResultScales;
+        std::vector<uint8_t> binaryResult;
+
+        AddonContextComputeEmbeddingsWorker(const Napi::CallbackInfo& info, AddonContext* ctx, bool ranking = false)
+            : AddonAsyncWorker(info.Env(), "AddonContextComputeEmbeddingsWorker", AddonExecutorLane::compute),
+              ctx(ctx),
+              outputType(ranking ? AddonEmbeddingOutputType::rank : AddonEmbeddingOutputType::float32),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
+
+            Napi::Array inputsArray = info[0].As<Napi::Array>();
+            inputs.resize(inputsArray.Length());
+            for (uint32_t i = 0; i < inputsArray.Length(); i++) {
+                Napi::Uint32Array inputTokens = inputsArray.Get(i).As<Napi::Uint32Array>();
+                auto& tokens = inputs[i];
+
+                tokens.resize(inputTokens.ElementLength());
+                for (size_t j = 0; j < tokens.size(); j++) {
+                    tokens[j] = static_cast<llama_token>(inputTokens[j]);
+                }
+            }
+
+            if (!ranking && info.Length() > 1 && info[1].IsObject()) {
+                Napi::Object options = info[1].As<Napi::Object>();
+
+                if (options.Has("maxVectorSize")) {
+                    maxVectorSize = options.Get("maxVectorSize").As<Napi::Number>().Int32Value();
+                }
+
+                if (options.Has("normalize")) {
+                    normalize = options.Get("normalize").As<Napi::Boolean>().Value();
+                }
+
+                if (options.Has("outputType")) {
+                    const auto outputTypeName = options.Get("outputType").As<Napi::String>().Utf8Value();
+
+                    if (outputTypeName == "int8") {
+                        outputType = AddonEmbeddingOutputType::int8;
+                    } else if (outputTypeName == "binary") {
+                        outputType = AddonEmbeddingOutputType::binary;
+                    }
+                }
+            }
+        }
+        ~AddonContextComputeEmbeddingsWorker() {
+            ctx->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                ComputeEmbeddings();
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_decode\"");
+            }
+        }
+
+        void ComputeEmbeddings() {
+            const int32_t n_embd = llama_model_n_embd(ctx->model->model);
+            const int32_t n_batch = llama_n_batch(ctx->ctx);
+            const int32_t n_seq_max = std::max(1, (int32_t)llama_n_seq_max(ctx->ctx));
+            const enum llama_pooling_type pooling_type = llama_pooling_type(ctx->ctx);
+            const auto memory = llama_get_memory(ctx->ctx);
+
+            resultVectorSize = maxVectorSize <= 0 ? n_embd : std::min(n_embd, maxVectorSize);
+            const size_t binaryVectorSize = (resultVectorSize + 7) / 8;
+            std::vector<float> normalizedVector;
+
+            if (outputType == AddonEmbeddingOutputType::float32) {
+                result.resize(resultVectorSize * inputs.size());
+            } else if (outputType == AddonEmbeddingOutputType::int8) {
+                int8Result.resize(resultVectorSize * inputs.size());
+                int8ResultScales.resize(inputs.size());
+                normalizedVector.resize(resultVectorSize);
+            } else if (outputType == AddonEmbeddingOutputType::binary) {
+                binaryResult.resize(binaryVectorSize * inputs.size());
+            } else if (outputType == AddonEmbeddingOutputType::rank) {
+                if (pooling_type != LLAMA_POOLING_TYPE_RANK) {
+                    SetError("Computing rankings is only supported for ranking contexts");
+                    return;
+                }
+
+                result.resize(inputs.size());
+            }
+
+            for (size_t i = 0; i < inputs.size(); i++) {
+                if (inputs[i].empty()) {
+                    SetError(std::string("Input ") + std::to_string(i) + " is empty");
+                    return;
+                } else if (inputs[i].size() > (size_t)n_batch) {
+                    SetError(
+                        std::string("Input ") + std::to_string(i) + " is longer than the batch size (" + std::to_string(inputs[i].size()) +
+                        " > " + std::to_string(n_batch) + ")"
+                    );
+                    return;
+                }
+            }
+
+            llama_batch batch = llama_batch_init(n_batch, 0, 1);
+            std::vector<int32_t> lastTokenBatchIndexes;
+            lastTokenBatchIndexes.reserve(n_seq_max);
+
+            // every input is evaluated on its own sequence, so a single decode can evaluate as many inputs as fit in the batch
+            for (size_t inputIndex = 0; inputIndex < inputs.size();) {
+                const size_t firstInputIndex = inputIndex;
+                common_batch_clear(batch);
+                lastTokenBatchIndexes.clear();
+
+                while (inputIndex < inputs.size() && (int32_t)lastTokenBatchIndexes.size() < n_seq_max &&
+                       batch.n_tokens + inputs[inputIndex].size() <= (size_t)n_batch
+                ) {
+                    const llama_seq_id sequenceId = lastTokenBatchIndexes.size();
+                    const auto& tokens = inputs[inputIndex];
+
+                    if (memory != nullptr) {
+                        llama_memory_seq_rm(memory, sequenceId, -1, -1);
+                    }
+
+                    for (size_t i = 0; i < tokens.size(); i++) {
+                        common_batch_add(batch, tokens[i], i, { sequenceId }, i == tokens.size() - 1);
+                    }
+
+                    lastTokenBatchIndexes.push_back(batch.n_tokens - 1);
+                    inputIndex++;
+                }
+
+                // the sequences of this batch are temporary, so only the context adapters apply to them
+                ctx->applyLoras(-1);
+
+                auto threadPoolLock = ctx->lockThreadPool();
+                ScopedDecodeWindow decodeWindow;
+                int r = llama_decode(ctx->ctx, batch);
+                if (r != 0) {
+                    llama_batch_free(batch);
+                    SetError(r == 1
+                        ? "could not find a KV slot for the batch (try reducing the size of the batch or increase the context)"
+                        : "Eval has failed"
+                    );
+                    return;
+                }
+
+                llama_synchronize(ctx->ctx);
+
+                for (size_t i = 0; i < lastTokenBatchIndexes.size(); i++) {
+                    const auto* embeddings = pooling_type == LLAMA_POOLING_TYPE_NONE ? NULL : llama_get_embeddings_seq(ctx->ctx, i);
+                    if (embeddings == NULL) {
+                        embeddings = llama_get_embeddings_ith(ctx->ctx, lastTokenBatchIndexes[i]);
+                    }
+
+                    if (embeddings == NULL) {
+                        llama_batch_free(batch);
+                        SetError(std::string("Failed to get embeddings for input ") + std::to_string(firstInputIndex + i));
+                        return;
+                    }
+
+                    const size_t resultIndex = firstInputIndex + i;
+                    if (outputType == AddonEmbeddingOutputType::float32) {
+                        float* resultVector = result.data() + resultIndex * resultVectorSize;
+                        if (normalize) {
+                            // normalizing after the truncation keeps truncated (Matryoshka) vectors unit length
+                            common_embd_normalize(embeddings, resultVector, resultVectorSize, 2);
+                        } else {
+                            std::copy(embeddings, embeddings + resultVectorSize, resultVector);
+                        }
+                    } else if (outputType == AddonEmbeddingOutputType::int8) {
+                        // int8 vectors are always normalized, so the scales of different vectors are comparable
+                        common_embd_normalize(embeddings, normalizedVector.data(), resultVectorSize, 2);
+                        int8ResultScales[resultIndex] = quantizeVectorToInt8(
+                            normalizedVector.data(),
+                            resultVectorSize,
+                            int8Result.data() + resultIndex * resultVectorSize
+                        );
+                    } else if (outputType == AddonEmbeddingOutputType::binary) {
+                        // normalization doesn't change the sign of the values, so it's not needed here
+                        binarizeVector(embeddings, resultVectorSize, binaryResult.data() + resultIndex * binaryVectorSize);
+                    } else if (outputType == AddonEmbeddingOutputType::rank) {
+                        // the rank pooling output of a sequence is its relevance logit
+                        result[resultIndex] = 1.0f / (1.0f + std::exp(-embeddings[0]));
+                    }
+                }
+
+                if (memory != nullptr) {
+                    for (size_t i = 0; i < lastTokenBatchIndexes.size(); i++) {
+                        llama_memory_seq_rm(memory, i, -1, -1);
+                    }
+                }
+            }
+
+            llama_batch_free(batch);
+        }
+        void OnOK() {
+            if (outputType == AddonEmbeddingOutputType::int8) {
+                Napi::Int8Array vectorsArray = Napi::Int8Array::New(Env(), int8Result.size());
+                std::copy(int8Result.begin(), int8Result.end(), vectorsArray.Data());
+
+                Napi::Float32Array scalesArray = Napi::Float32Array::New(Env(), int8ResultScales.size());
+                std::copy(int8ResultScales.begin(), int8ResultScales.end(), scalesArray.Data());
+
+                Napi::Object resultObject = Napi::Object::New(Env());
+                resultObject.Set("vectors", vectorsArray);
+                resultObject.Set("scales", scalesArray);
+
+                deferred.Resolve(resultObject);
+                return;
+            } else if (outputType == AddonEmbeddingOutputType::binary) {
+                Napi::Uint8Array resultArray = Napi::Uint8Array::New(Env(), binaryResult.size());
+                std::copy(binaryResult.begin(), binaryResult.end(), resultArray.Data());
+
+                deferred.Resolve(resultArray);
+                return;
+            }
+
+            Napi::Float32Array resultArray = Napi::Float32Array::New(Env(), result.size());
+            std::copy(result.begin(), result.end(), resultArray.Data());
+
+            deferred.Resolve(resultArray);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::ComputeEmbeddings(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextComputeEmbeddingsWorker* worker = new AddonContextComputeEmbeddingsWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonContext::ComputeRankings(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextComputeEmbeddingsWorker* worker = new AddonContextComputeEmbeddingsWorker(info, this, true);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonContext::GetStateSize(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_state_get_size(ctx));
+}
+
+Napi::Value AddonContext::GetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_n_threads(ctx));
+}
+
+Napi::Value AddonContext::SetThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const auto threads = info[0].As<Napi::Number>().Int32Value();
+    const auto resolvedThreads = resolveThreads(threads == 0
+        ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
+        : threads);
+
+    // single-token decodes run on `n_threads` and batches of multiple tokens run on `n_threads_batch`
+    auto resolvedBatchThreads = resolvedThreads;
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        const auto batchThreads = info[1].As<Napi::Number>().Int32Value();
+        resolvedBatchThreads = resolveThreads(batchThreads == 0
+            ? std::max((int32_t)std::thread::hardware_concurrency(), std::max(cpu_get_num_math(), 1))
+            : batchThreads);
+    }
+
+    if (llama_n_threads(ctx) != resolvedThreads || llama_n_threads_batch(ctx) != resolvedBatchThreads) {
+        llama_set_n_threads(ctx, resolvedThreads, resolvedBatchThreads);
+    }
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonContext::GetBatchThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    return Napi::Number::From(info.Env(), llama_n_threads_batch(ctx));
+}
+
+class AddonContextTuneThreadsWorker : public AddonAsyncWorker {
+    public:
+        AddonContext* ctx;
+        std::vector<int32_t> candidates;
+        llama_token token;
+        int32_t batchTokens;
+        int32_t generationSteps;
+        std::vector<double> batchTimes;
+        std::vector<double> generationTimes;
+
+        AddonContextTuneThreadsWorker(
+            const Napi::Env& env, AddonContext* ctx, std::vector<int32_t> candidates, llama_token token, int32_t batchTokens,
+            int32_t generationSteps
+        )
+            : AddonAsyncWorker(env, "AddonContextTuneThreadsWorker", AddonExecutorLane::compute),
+              ctx(ctx),
+              candidates(std::move(candidates)),
+              token(token),
+              batchTokens(batchTokens),
+              generationSteps(generationSteps),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            ctx->Ref();
+        }
+        ~AddonContextTuneThreadsWorker() {
+            ctx->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        // evaluates a batch of `batchTokens` tokens followed by `generationSteps` single-token decodes on sequence 0,
+        // and returns the time each took per token, in milliseconds
+        bool measure(llama_batch& batch, double& batchTime, double& generationTime) {
+            const llama_seq_id sequenceId = 0;
+            ScopedDecodeWindow decodeWindow;
+
+            common_batch_clear(batch);
+            for (int32_t i = 0; i < batchTokens; i++) {
+                common_batch_add(batch, token, i, { sequenceId }, i == batchTokens - 1);
+            }
+
+            auto startTime = std::chrono::steady_clock::now();
+            if (ctx->decode(batch) != 0) {
+                return false;
+            }
+            llama_synchronize(ctx->ctx);
+            batchTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / batchTokens;
+
+            startTime = std::chrono::steady_clock::now();
+            for (int32_t i = 0; i < generationSteps; i++) {
+                common_batch_clear(batch);
+                common_batch_add(batch, token, batchTokens + i, { sequenceId }, true);
+
+                if (ctx->decode(batch) != 0) {
+                    return false;
+                }
+                llama_synchronize(ctx->ctx);
+            }
+            generationTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / generationSteps;
+
+            llama_memory_seq_rm(llama_get_memory(ctx->ctx), sequenceId, -1, -1);
+            return true;
+        }
+
+        void Execute() {
+            try {
+                const int32_t originalThreads = llama_n_threads(ctx->ctx);
+                const int32_t originalBatchThreads = llama_n_threads_batch(ctx->ctx);
+                llama_batch batch = llama_batch_init(batchTokens, 0, 1);
+
+                double batchTime = 0;
+                double generationTime = 0;
+
+                // warm up, so the first candidate doesn't pay for loading the weights into the CPU caches and memory
+                bool succeeded = measure(batch, batchTime, generationTime);
+
+                for (size_t i = 0; i < candidates.size() && succeeded; i++) {
+                    const int32_t threads = ctx->resolveThreads(candidates[i]);
+                    llama_set_n_threads(ctx->ctx, threads, threads);
+
+                    succeeded = measure(batch, batchTime, generationTime);
+                    batchTimes.push_back(batchTime);
+                    generationTimes.push_back(generationTime);
+                }
+
+                llama_batch_free(batch);
+                llama_memory_seq_rm(llama_get_memory(ctx->ctx), 0, -1, -1);
+                llama_set_n_threads(ctx->ctx, originalThreads, originalBatchThreads);
+
+                if (!succeeded) {
+                    SetError("Failed to evaluate the thread tuning batch");
+                }
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"llama_decode\"");
+            }
+        }
+        void OnOK() {
+            Napi::Float64Array resultBatchTimes = Napi::Float64Array::New(Env(), batchTimes.size());
+            Napi::Float64Array resultGenerationTimes = Napi::Float64Array::New(Env(), generationTimes.size());
+            for (size_t i = 0; i < batchTimes.size(); i++) {
+                resultBatchTimes[i] = batchTimes[i];
+                resultGenerationTimes[i] = generationTimes[i];
+            }
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("batchTimes", resultBatchTimes);
+            result.Set("generationTimes", resultGenerationTimes);
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonContext::TuneThreads(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array candidatesArray = info[0].As<Napi::Uint32Array>();
+    std::vector<int32_t> candidates(candidatesArray.Data(), candidatesArray.Data() + candidatesArray.ElementLength());
+    const llama_token token = info[1].As<Napi::Number>().Int32Value();
+    const int32_t generationSteps = std::max(1, info[3].As<Napi::Number>().Int32Value());
+    const int32_t sequenceContextSize = (int32_t)(llama_n_ctx(ctx) / std::max(1u, llama_n_seq_max(ctx)));
+    const int32_t batchTokens = std::max(1, std::min({
+        info[2].As<Napi::Number>().Int32Value(),
+        (int32_t)llama_n_batch(ctx),
+        sequenceContextSize - generationSteps
+    }));
+
+    auto* worker = new AddonContextTuneThreadsWorker(info.Env(), this, std::move(candidates), token, batchTokens, generationSteps);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonContextSaveSequenceStateToFileWorker : public AddonAsyncWorker {
+    public:
+        AddonContext* context;
+        std::string filepath;
+        llama_seq_id sequenceId;
+        std::vector<llama_token> tokens;
+        size_t savedFileSize = 0;
+
+        AddonContextSaveSequenceStateToFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
+            : AddonAsyncWorker(info.Env(), "AddonContextSaveSequenceStateToFileWorker", AddonExecutorLane::io),
+              context(context),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
             context->Ref();
 
             filepath = info[0].As<Napi::String>().Utf8Value();
@@ -806,7 +1856,7 @@ Napi::Value AddonContext::SaveSequenceStateToFile(const Napi::CallbackInfo& info
     return worker->GetPromise();
 }
 
-class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
+class AddonContextLoadSequenceStateFromFileWorker : public AddonAsyncWorker {
     public:
         AddonContext* context;
         std::string filepath;
@@ -815,7 +1865,7 @@ class AddonContextLoadSequenceStateFromFileWorker : public Napi::AsyncWorker {
         std::vector<llama_token> tokens;
 
         AddonContextLoadSequenceStateFromFileWorker(const Napi::CallbackInfo& info, AddonContext* context)
-            : Napi::AsyncWorker(info.Env(), "AddonContextLoadSequenceStateFromFileWorker"),
+            : AddonAsyncWorker(info.Env(), "AddonContextLoadSequenceStateFromFileWorker", AddonExecutorLane::io),
               context(context),
               deferred(Napi::Promise::Deferred::New(info.Env())) {
             context->Ref();
@@ -896,6 +1946,11 @@ Napi::Value AddonContext::EnsureDraftContextIsCompatibleForSpeculative(const Nap
     const auto currentVocab = model->vocab;
     const auto draftVocab = draftContext->model->vocab;
 
+    // identical vocabularies are always compatible
+    if (model->vocabFingerprint != 0 && model->vocabFingerprint == draftContext->model->vocabFingerprint) {
+        return info.Env().Undefined();
+    }
+
     if (llama_vocab_type(currentVocab) != llama_vocab_type(draftVocab)) {
         Napi::Error::New(info.Env(), "Speculative draft model vocabulary type must match the target model vocabulary type").ThrowAsJavaScriptException();
         return info.Env().Undefined();
@@ -942,11 +1997,434 @@ Napi::Value AddonContext::EnsureDraftContextIsCompatibleForSpeculative(const Nap
     return info.Env().Undefined();
 }
 
+enum class AddonSpeculativeAcceptance {
+    exact,
+    rejectionSampling
+};
+
+// sets the probabilities of the candidates that are left after applying a sampler chain
+static void computeCandidateProbabilities(llama_token_data_array& cur_p) {
+    float maxLogit = -INFINITY;
+    for (size_t i = 0; i < cur_p.size; i++) {
+        maxLogit = std::max(maxLogit, cur_p.data[i].logit);
+    }
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < cur_p.size; i++) {
+        cur_p.data[i].p = maxLogit == -INFINITY ? 0.0f : expf(cur_p.data[i].logit - maxLogit);
+        sum += cur_p.data[i].p;
+    }
+
+    for (size_t i = 0; i < cur_p.size; i++) {
+        cur_p.data[i].p = sum > 0 ? cur_p.data[i].p / sum : 0.0f;
+    }
+}
+
+// accepts the draft token with a probability of `min(1, p(token) / q(token))`,
+// and otherwise samples a token from the residual distribution `max(0, p(x) - q(x))`,
+// so the generated tokens follow the target distribution `p` regardless of the draft distribution `q`
+static llama_token rejectionSampleDraftToken(
+    const llama_token_data_array& cur_p,
+    llama_token draftToken,
+    const std::vector<llama_token_data>& draftDistribution,
+    std::vector<float>& draftProbabilities,
+    std::mt19937& rng
+) {
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (const auto& candidate : draftDistribution) {
+        draftProbabilities[candidate.id] = candidate.p;
+    }
+
+    float targetProbability = 0.0f;
+    for (size_t i = 0; i < cur_p.size; i++) {
+        if (cur_p.data[i].id == draftToken) {
+            targetProbability = cur_p.data[i].p;
+            break;
+        }
+    }
+
+    llama_token result = cur_p.data[cur_p.selected].id;
+    const float draftProbability = draftProbabilities[draftToken];
+
+    if (draftProbability > 0 && uniform(rng) * draftProbability <= targetProbability) {
+        result = draftToken;
+    } else {
+        float residualSum = 0.0f;
+        for (size_t i = 0; i < cur_p.size; i++) {
+            residualSum += std::max(0.0f, cur_p.data[i].p - draftProbabilities[cur_p.data[i].id]);
+        }
+
+        if (residualSum > 0) {
+            float remaining = uniform(rng) * residualSum;
+            for (size_t i = 0; i < cur_p.size; i++) {
+                const float residual = std::max(0.0f, cur_p.data[i].p - draftProbabilities[cur_p.data[i].id]);
+                if (residual <= 0) {
+                    continue;
+                }
+
+                result = cur_p.data[i].id;
+                remaining -= residual;
+
+                if (remaining <= 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto& candidate : draftDistribution) {
+        draftProbabilities[candidate.id] = 0.0f;
+    }
+
+    return result;
+}
+
+static void decodeSpeculativeBatch(AddonContext* ctx, const llama_batch& batch) {
+    int r = ctx->decode(batch);
+
+    if (r != 0) {
+        throw std::runtime_error(r == 1
+            ? "could not find a KV slot for the batch (try reducing the size of the batch or increase the context)"
+            : "Eval has failed"
+        );
+    }
+}
+
+class AddonContextSpeculativeDecodeWorker : public AddonAsyncWorker {
+    public:
+        AddonContext* ctx;
+        AddonContext* draftCtx;
+        AddonSampler* sampler;
+        AddonSampler* draftSampler;
+
+        llama_seq_id sequenceId;
+        llama_pos firstTokenIndex;
+        std::vector<llama_token> tokens;
+        llama_seq_id draftSequenceId;
+        llama_pos draftFirstTokenIndex;
+        std::vector<llama_token> draftTokens;
+        int32_t maxDraftTokens = 16;
+        float minDraftConfidence = 0.0f;
+        AddonSpeculativeAcceptance acceptance = AddonSpeculativeAcceptance::exact;
+
+        std::vector<llama_token> resultTokens;
+        int32_t draftedTokensCount = 0;
+        int32_t acceptedDraftTokensCount = 0;
+        int32_t draftEvaluatedTokensCount = 0;
+
+        AddonContextSpeculativeDecodeWorker(const Napi::CallbackInfo& info, AddonContext* ctx, AddonContext* draftCtx)
+            : AddonAsyncWorker(info.Env(), "AddonContextSpeculativeDecodeWorker", AddonExecutorLane::compute),
+              ctx(ctx),
+              draftCtx(draftCtx),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            ctx->Ref();
+            draftCtx->Ref();
+
+            sampler = Napi::ObjectWrap<AddonSampler>::Unwrap(info[1].As<Napi::Object>());
+            draftSampler = Napi::ObjectWrap<AddonSampler>::Unwrap(info[2].As<Napi::Object>());
+            sampler->Ref();
+            draftSampler->Ref();
+
+            Napi::Object options = info[3].As<Napi::Object>();
+            sequenceId = options.Get("sequenceId").As<Napi::Number>().Int32Value();
+            firstTokenIndex = options.Get("firstTokenIndex").As<Napi::Number>().Int32Value();
+            draftSequenceId = options.Get("draftSequenceId").As<Napi::Number>().Int32Value();
+            draftFirstTokenIndex = options.Get("draftFirstTokenIndex").As<Napi::Number>().Int32Value();
+
+            Napi::Uint32Array tokensArray = options.Get("tokens").As<Napi::Uint32Array>();
+            tokens.resize(tokensArray.ElementLength());
+            for (size_t i = 0; i < tokens.size(); i++) {
+                tokens[i] = static_cast<llama_token>(tokensArray[i]);
+            }
+
+            Napi::Uint32Array draftTokensArray = options.Get("draftTokens").As<Napi::Uint32Array>();
+            draftTokens.resize(draftTokensArray.ElementLength());
+            for (size_t i = 0; i < draftTokens.size(); i++) {
+                draftTokens[i] = static_cast<llama_token>(draftTokensArray[i]);
+            }
+
+            if (options.Has("maxDraftTokens")) {
+                maxDraftTokens = std::max(0, options.Get("maxDraftTokens").As<Napi::Number>().Int32Value());
+            }
+
+            if (options.Has("minDraftConfidence")) {
+                minDraftConfidence = options.Get("minDraftConfidence").As<Napi::Number>().FloatValue();
+            }
+
+            if (options.Has("acceptance")) {
+                const auto acceptanceName = options.Get("acceptance").As<Napi::String>().Utf8Value();
+
+                if (acceptanceName == "rejectionSampling") {
+                    acceptance = AddonSpeculativeAcceptance::rejectionSampling;
+                }
+            }
+        }
+        ~AddonContextSpeculativeDecodeWorker() {
+            ctx->Unref();
+            draftCtx->Unref();
+            sampler->Unref();
+            draftSampler->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                ScopedDecodeWindow decodeWindow;
+                SpeculativeDecode();
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"SpeculativeDecode\"");
+            }
+        }
+
+        void SpeculativeDecode() {
+            if (llama_get_logits(ctx->ctx) == nullptr) {
+                SetError("This model does not support token generation");
+                return;
+            }
+
+            if (tokens.empty() || draftTokens.empty()) {
+                SetError("Speculative decoding requires at least one token to evaluate on both the target and the draft sequences");
+                return;
+            }
+
+            if (tokens.size() + maxDraftTokens > llama_n_batch(ctx->ctx) || draftTokens.size() > llama_n_batch(draftCtx->ctx)) {
+                SetError("The tokens to evaluate for speculative decoding do not fit in the batch size");
+                return;
+            }
+
+            llama_batch batch = llama_batch_init(std::max(tokens.size() + maxDraftTokens, draftTokens.size()), 0, 1);
+            auto draftSamplerSnapshot = draftSampler->takeStateSnapshot();
+
+            try {
+                DraftAndVerify(batch);
+            } catch (...) {
+                llama_batch_free(batch);
+                draftSampler->restoreStateSnapshot(draftSamplerSnapshot);
+
+                // restore the state of both sequences to what it was before this step, so it matches the state on the JS side
+                llama_memory_seq_rm(llama_get_memory(ctx->ctx), sequenceId, firstTokenIndex, -1);
+                llama_memory_seq_rm(llama_get_memory(draftCtx->ctx), draftSequenceId, draftFirstTokenIndex, -1);
+                throw;
+            }
+
+            llama_batch_free(batch);
+
+            // rejected drafts must not affect the repeat penalty and grammar state of the draft sampler,
+            // so the drafted tokens are undone and only the verified ones are accepted again
+            draftSampler->restoreStateSnapshot(draftSamplerSnapshot);
+            for (int32_t i = 0; i < acceptedDraftTokensCount; i++) {
+                draftSampler->acceptToken(resultTokens[i], false);
+            }
+        }
+
+        void DraftAndVerify(llama_batch& batch) {
+            const auto vocab = ctx->model->vocab;
+            const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+            const bool useRejectionSampling = acceptance == AddonSpeculativeAcceptance::rejectionSampling &&
+                sampler->greedySampler == nullptr;
+
+            std::vector<llama_token> drafts;
+            std::vector<std::vector<llama_token_data>> draftDistributions;
+            int32_t draftDecodedTokensCount = 0;
+            drafts.reserve(maxDraftTokens);
+
+            common_batch_clear(batch);
+            for (size_t i = 0; i < draftTokens.size(); i++) {
+                common_batch_add(batch, draftTokens[i], draftFirstTokenIndex + i, { draftSequenceId }, i == draftTokens.size() - 1);
+            }
+
+            decodeSpeculativeBatch(draftCtx, batch);
+            llama_pos draftPosition = draftFirstTokenIndex + draftTokens.size();
+
+            // draft tokens autoregressively on the draft context
+            while ((int32_t)drafts.size() < maxDraftTokens) {
+                auto cur_p = draftSampler->applyChain(draftCtx->getLogits(-1));
+
+                if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                    break;
+                }
+
+                computeCandidateProbabilities(cur_p);
+                const llama_token token = cur_p.data[cur_p.selected].id;
+
+                if (token >= n_vocab || (minDraftConfidence > 0 && cur_p.data[cur_p.selected].p < minDraftConfidence)) {
+                    break;
+                }
+
+                drafts.push_back(token);
+                draftSampler->acceptToken(token, false); // undone after verification, so unverified draft tokens are never learned
+
+                if (useRejectionSampling) {
+                    auto& draftDistribution = draftDistributions.emplace_back();
+
+                    if (draftSampler->greedySampler != nullptr) {
+                        draftDistribution.push_back(llama_token_data{token, cur_p.data[cur_p.selected].logit, 1.0f});
+                    } else {
+                        for (size_t i = 0; i < cur_p.size; i++) {
+                            if (cur_p.data[i].p > 0 && cur_p.data[i].id < n_vocab) {
+                                draftDistribution.push_back(cur_p.data[i]);
+                            }
+                        }
+                    }
+                }
+
+                if (llama_vocab_is_eog(vocab, token) || (int32_t)drafts.size() == maxDraftTokens) {
+                    break;
+                }
+
+                common_batch_clear(batch);
+                common_batch_add(batch, token, draftPosition, { draftSequenceId }, true);
+                decodeSpeculativeBatch(draftCtx, batch);
+
+                draftPosition++;
+                draftDecodedTokensCount++;
+            }
+
+            draftedTokensCount = drafts.size();
+
+            // verify all the drafted tokens in a single batch on the target context
+            common_batch_clear(batch);
+            for (size_t i = 0; i < tokens.size(); i++) {
+                common_batch_add(batch, tokens[i], firstTokenIndex + i, { sequenceId }, i == tokens.size() - 1);
+            }
+            for (size_t i = 0; i < drafts.size(); i++) {
+                common_batch_add(batch, drafts[i], firstTokenIndex + tokens.size() + i, { sequenceId }, true);
+            }
+
+            decodeSpeculativeBatch(ctx, batch);
+            llama_synchronize(ctx->ctx);
+
+            std::vector<float> draftProbabilities;
+            if (useRejectionSampling) {
+                draftProbabilities.resize(n_vocab, 0.0f);
+            }
+
+            const int32_t firstLogitsIndex = tokens.size() - 1;
+            for (size_t i = 0; i <= drafts.size(); i++) {
+                auto cur_p = sampler->applyChain(ctx->getLogits(firstLogitsIndex + i));
+
+                if (!(cur_p.selected >= 0 && cur_p.selected < (int32_t)cur_p.size)) {
+                    // the last accepted token has to be evaluated again to sample the token after it
+                    if (acceptedDraftTokensCount > 0) {
+                        acceptedDraftTokensCount--;
+                    }
+
+                    break;
+                }
+
+                llama_token token = cur_p.data[cur_p.selected].id;
+                if (i < drafts.size() && useRejectionSampling) {
+                    computeCandidateProbabilities(cur_p);
+                    token = rejectionSampleDraftToken(
+                        cur_p, drafts[i], draftDistributions[i], draftProbabilities, sampler->rejectionSamplingRng
+                    );
+                }
+
+                sampler->acceptToken(token);
+                resultTokens.push_back(token);
+
+                // the last result token is never kept in the context state, so the next step can evaluate it
+                if (i == drafts.size() || token != drafts[i] || llama_vocab_is_eog(vocab, token)) {
+                    break;
+                }
+
+                acceptedDraftTokensCount++;
+            }
+
+            // roll back the cells of the rejected draft tokens on both contexts
+            llama_memory_seq_rm(llama_get_memory(ctx->ctx), sequenceId, firstTokenIndex + tokens.size() + acceptedDraftTokensCount, -1);
+
+            draftEvaluatedTokensCount = draftTokens.size() + std::min(acceptedDraftTokensCount, draftDecodedTokensCount);
+            llama_memory_seq_rm(llama_get_memory(draftCtx->ctx), draftSequenceId, draftFirstTokenIndex + draftEvaluatedTokensCount, -1);
+        }
+        void OnOK() {
+            Napi::Uint32Array resultTokensArray = Napi::Uint32Array::New(Env(), resultTokens.size());
+            for (size_t i = 0; i < resultTokens.size(); i++) {
+                resultTokensArray[i] = static_cast<uint32_t>(resultTokens[i]);
+            }
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("tokens", resultTokensArray);
+            result.Set("draftTokens", Napi::Number::New(Env(), draftedTokensCount));
+            result.Set("acceptedDraftTokens", Napi::Number::New(Env(), acceptedDraftTokensCount));
+            result.Set("draftEvaluatedTokens", Napi::Number::New(Env(), draftEvaluatedTokensCount));
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+Napi::Value AddonContext::SpeculativeDecode(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContext* draftContext = Napi::ObjectWrap<AddonContext>::Unwrap(info[0].As<Napi::Object>());
+    if (draftContext->disposed) {
+        Napi::Error::New(info.Env(), "Draft context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonContextSpeculativeDecodeWorker* worker = new AddonContextSpeculativeDecodeWorker(info, this, draftContext);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
 Napi::Value AddonContext::SetLora(const Napi::CallbackInfo& info) {
     AddonModelLora* lora = Napi::ObjectWrap<AddonModelLora>::Unwrap(info[0].As<Napi::Object>());
     float scale = info[1].As<Napi::Number>().FloatValue();
 
-    llama_set_adapter_lora(ctx, lora->lora_adapter, scale);
+    auto existingLora = std::find_if(contextLoras.begin(), contextLoras.end(), [lora](const auto& item) {
+        return item.first == lora;
+    });
+    if (existingLora != contextLoras.end()) {
+        existingLora->second = scale;
+    } else {
+        contextLoras.emplace_back(lora, scale);
+    }
+
+    lorasApplied = false; // applied on the next decode
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonContext::SetSequenceLoras(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Context is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    int32_t sequenceId = info[0].As<Napi::Number>().Int32Value();
+    Napi::Array loras = info[1].As<Napi::Array>();
+    Napi::Float32Array scales = info[2].As<Napi::Float32Array>();
+
+    AddonLoraSet newLoras;
+    for (uint32_t i = 0; i < loras.Length(); i++) {
+        AddonModelLora* lora = Napi::ObjectWrap<AddonModelLora>::Unwrap(loras.Get(i).As<Napi::Object>());
+        lora->Ref();
+        newLoras.emplace_back(lora, i < scales.ElementLength() ? scales[i] : 1.0f);
+    }
+
+    clearSequenceLoras(sequenceId);
+
+    if (!newLoras.empty()) {
+        sequenceLoras.emplace(sequenceId, std::move(newLoras));
+
+        if (appliedLorasSequenceId == sequenceId) {
+            lorasApplied = false;
+        }
+    }
 
     return info.Env().Undefined();
 }
@@ -965,19 +2443,30 @@ void AddonContext::init(Napi::Object exports) {
                 InstanceMethod("disposeSequence", &AddonContext::DisposeSequence),
                 InstanceMethod("removeTokenCellsFromSequence", &AddonContext::RemoveTokenCellsFromSequence),
                 InstanceMethod("shiftSequenceTokenCells", &AddonContext::ShiftSequenceTokenCells),
+                InstanceMethod("eraseSequenceTokenRanges", &AddonContext::EraseSequenceTokenRanges),
                 InstanceMethod("getSequenceKvCacheMinPosition", &AddonContext::GetSequenceKvCacheMinPosition),
                 InstanceMethod("getSequenceKvCacheMaxPosition", &AddonContext::GetSequenceKvCacheMaxPosition),
+                InstanceMethod("getKvCacheUsage", &AddonContext::GetKvCacheUsage),
+                InstanceMethod("defragmentKvCache", &AddonContext::DefragmentKvCache),
                 InstanceMethod("decodeBatch", &AddonContext::DecodeBatch),
+                InstanceMethod("abortDecodeBatch", &AddonContext::AbortDecodeBatch),
+                InstanceMethod("getDecodeStats", &AddonContext::GetDecodeStats),
                 InstanceMethod("sampleToken", &AddonContext::SampleToken),
                 InstanceMethod("getEmbedding", &AddonContext::GetEmbedding),
+                InstanceMethod("computeEmbeddings", &AddonContext::ComputeEmbeddings),
+                InstanceMethod("computeRankings", &AddonContext::ComputeRankings),
                 InstanceMethod("getStateSize", &AddonContext::GetStateSize),
                 InstanceMethod("getThreads", &AddonContext::GetThreads),
                 InstanceMethod("setThreads", &AddonContext::SetThreads),
+                InstanceMethod("getBatchThreads", &AddonContext::GetBatchThreads),
+                InstanceMethod("tuneThreads", &AddonContext::TuneThreads),
                 InstanceMethod("printTimings", &AddonContext::PrintTimings),
                 InstanceMethod("ensureDraftContextIsCompatibleForSpeculative", &AddonContext::EnsureDraftContextIsCompatibleForSpeculative),
+                InstanceMethod("speculativeDecode", &AddonContext::SpeculativeDecode),
                 InstanceMethod("saveSequenceStateToFile", &AddonContext::SaveSequenceStateToFile),
                 InstanceMethod("loadSequenceStateFromFile", &AddonContext::LoadSequenceStateFromFile),
                 InstanceMethod("setLora", &AddonContext::SetLora),
+                InstanceMethod("setSequenceLoras", &AddonContext::SetSequenceLoras),
                 InstanceMethod("dispose", &AddonContext::Dispose),
             }
         )
@@ -1,8 +1,30 @@
 #pragma once
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
 #include "AddonSampler.h"
+#include "AddonThreadPool.h"
+#include "utils/pageFaults.h"
+
+using AddonLoraSet = std::vector<std::pair<AddonModelLora*, float>>;
+
+struct AddonContextDecodeStats {
+    uint64_t batches = 0;
+    uint64_t time = 0; // in microseconds
+    uint64_t majorPageFaults = 0; // only of batches that didn't overlap with a decode of another context
+    uint64_t minorPageFaults = 0; // only of batches that didn't overlap with a decode of another context
+    uint64_t pagedBatches = 0; // batches that had at least `pagingMajorPageFaultsThreshold` major page faults
+    uint64_t overlappedBatches = 0; // batches that were decoded while a decode of another context ran
+    uint64_t lastTime = 0; // in microseconds
+    uint64_t lastMajorPageFaults = 0;
+    uint64_t lastMinorPageFaults = 0;
+    bool lastOverlapped = false;
+};
 
 class AddonContext : public Napi::ObjectWrap<AddonContext> {
     public:
@@ -13,19 +35,82 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
         uint64_t batchMemorySize = 0;
         bool has_batch = false;
         int32_t batch_n_tokens = 0;
+        int32_t batch_capacity = 0; // the number of tokens allocated in `batch`, which only grows until the batch is disposed
         int n_cur = 0;
 
         uint64_t loadedContextMemorySize = 0;
+        uint64_t kvCacheMemorySize = 0; // included in `loadedContextMemorySize`
+        uint64_t computeBuffersMemorySize = 0; // the host compute buffers, reserved when the context is created
         bool contextLoaded = false;
 
+        AddonThreadPool* threadPool = nullptr;
+
+        // the context buffers (like the KV cache) are allocated while the loading thread runs on these CPU cores,
+        // so the memory is placed on their NUMA nodes
+        std::vector<uint32_t> affinityCpus;
+
+        // adapters applied to all the sequences, and adapters applied only to specific sequences (on top of the context adapters).
+        // batches that mix sequences with different adapters are decoded in groups of rows that share the same adapters
+        AddonLoraSet contextLoras;
+        std::unordered_map<llama_seq_id, AddonLoraSet> sequenceLoras;
+        llama_seq_id appliedLorasSequenceId = -1; // -1 = only the context adapters
+        bool lorasApplied = true;
+        llama_batch loraGroupBatch;
+        int32_t loraGroupBatch_n_tokens = 0;
+
+        // when the last decoded batch was split into groups, the logits of each group are copied here,
+        // since decoding a group overrides the logits of the previous one
+        bool hasGroupedLogits = false;
+        int32_t groupedLogitsBatch_n_tokens = 0;
+        std::vector<float> groupedLogits;
+        std::vector<int32_t> groupedLogitsRows;
+
+        // set from JS to abort the batch decode that's currently running (or is queued to run),
+        // checked by the abort callback of the context between the graph computations of the batch
+        std::atomic<bool> abortBatchDecode{false};
+        std::atomic<bool> batchDecodeRunning{false};
+        std::atomic<int64_t> batchDecodeDeadline{0}; // a steady clock time in microseconds, or `0` for no deadline
+
+        // the wall time and page faults of the decoded batches, so the model weights being paged in from the disk can be detected.
+        // the page faults are of the whole process, so they're only attributed to the context for batches
+        // that were decoded while no other context was decoding
+        std::mutex decodeStatsMutex;
+        AddonContextDecodeStats decodeStats;
+        std::atomic<bool> pageFaultsAvailable{true};
+
         bool disposed = false;
+        bool referencesReleased = false;
 
         AddonContext(const Napi::CallbackInfo& info);
         ~AddonContext();
 
         void dispose();
+
+        // frees the native resources of the context, and can run on a worker thread
+        void disposeNativeResources();
+
+        // releases the references to other objects (like the model, the adapters and the thread pool), and must run on the JS thread
+        void releaseReferences();
         void disposeBatch();
 
+        AddonThreadPoolComputeLock lockThreadPool();
+        int32_t resolveThreads(int32_t threads);
+        void applyLoras(llama_seq_id sequenceId);
+        void clearSequenceLoras(llama_seq_id sequenceId);
+        int32_t decode(const llama_batch& batch);
+        void rollbackLoraGroups(
+            const llama_batch& batch,
+            const std::vector<llama_seq_id>& rowGroups,
+            const std::vector<llama_seq_id>& groups,
+            size_t groupsCount
+        );
+        float* getLogits(int32_t batchIndex);
+        bool isBatchDecodeAborted();
+        void recordBatchDecode(
+            uint64_t time, const PageFaultCounts& pageFaultsBefore, const PageFaultCounts& pageFaultsAfter, bool overlapped
+        );
+        static bool abortDecodeCallback(void* data);
+
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value Dispose(const Napi::CallbackInfo& info);
 
@@ -36,23 +121,34 @@ class AddonContext : public Napi::ObjectWrap<AddonContext> {
         Napi::Value DisposeSequence(const Napi::CallbackInfo& info);
         Napi::Value RemoveTokenCellsFromSequence(const Napi::CallbackInfo& info);
         Napi::Value ShiftSequenceTokenCells(const Napi::CallbackInfo& info);
+        Napi::Value EraseSequenceTokenRanges(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMinPosition(const Napi::CallbackInfo& info);
         Napi::Value GetSequenceKvCacheMaxPosition(const Napi::CallbackInfo& info);
+        Napi::Value GetKvCacheUsage(const Napi::CallbackInfo& info);
+        Napi::Value DefragmentKvCache(const Napi::CallbackInfo& info);
         Napi::Value DecodeBatch(const Napi::CallbackInfo& info);
+        Napi::Value AbortDecodeBatch(const Napi::CallbackInfo& info);
+        Napi::Value GetDecodeStats(const Napi::CallbackInfo& info);
         Napi::Value SampleToken(const Napi::CallbackInfo& info);
 
         Napi::Value GetEmbedding(const Napi::CallbackInfo& info);
+        Napi::Value ComputeEmbeddings(const Napi::CallbackInfo& info);
+        Napi::Value ComputeRankings(const Napi::CallbackInfo& info);
         Napi::Value GetStateSize(const Napi::CallbackInfo& info);
         Napi::Value GetThreads(const Napi::CallbackInfo& info);
         Napi::Value SetThreads(const Napi::CallbackInfo& info);
+        Napi::Value GetBatchThreads(const Napi::CallbackInfo& info);
+        Napi::Value TuneThreads(const Napi::CallbackInfo& info);
 
         Napi::Value SaveSequenceStateToFile(const Napi::CallbackInfo& info);
         Napi::Value LoadSequenceStateFromFile(const Napi::CallbackInfo& info);
 
         Napi::Value PrintTimings(const Napi::CallbackInfo& info);
         Napi::Value EnsureDraftContextIsCompatibleForSpeculative(const Napi::CallbackInfo& info);
+        Napi::Value SpeculativeDecode(const Napi::CallbackInfo& info);
 
         Napi::Value SetLora(const Napi::CallbackInfo& info);
+        Napi::Value SetSequenceLoras(const Napi::CallbackInfo& info);
 
         static void init(Napi::Object exports);
 };
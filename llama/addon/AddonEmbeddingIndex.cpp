@@ -0,0 +1,947 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "common/common.h"
+#include "llama.h"
+
+#include "addonGlobals.h"
+#include "globals/addonExecutor.h"
+#include "utils/vectorMath.h"
+#include "AddonEmbeddingIndex.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char embeddingIndexFileMagic[4] = {'N', 'L', 'E', 'I'};
+static const uint32_t embeddingIndexFileVersion = 1;
+
+// fewer vectors than this per thread makes the cost of starting a thread higher than the work it saves
+static const size_t minVectorsPerSearchThread = 4096;
+
+// the vectors are scanned in blocks that stay in the cache while all the queries are scored against them
+static const size_t searchBlockSize = 128;
+
+struct AddonEmbeddingIndexFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t type;
+    uint32_t metric;
+    uint32_t vectorSize;
+    uint32_t reserved;
+    uint64_t count;
+};
+static_assert(sizeof(AddonEmbeddingIndexFileHeader) == 32, "unexpected embedding index file header size");
+
+static size_t getEmbeddingIndexTypeByteSize(AddonEmbeddingIndexType type) {
+    switch (type) {
+        case AddonEmbeddingIndexType::f16:
+            return sizeof(ggml_fp16_t);
+        case AddonEmbeddingIndexType::int8:
+            return sizeof(int8_t);
+        case AddonEmbeddingIndexType::f32:
+        default:
+            return sizeof(float);
+    }
+}
+
+// the scales of int8 vectors are stored after the vectors, aligned to 4 bytes so they can be read in place from a mapped file
+static size_t getEmbeddingIndexFileScalesOffset(size_t vectorsByteSize) {
+    return (sizeof(AddonEmbeddingIndexFileHeader) + vectorsByteSize + 3) & ~size_t(3);
+}
+
+// `false` when the sizes described by a file header don't fit in `size_t`
+static bool checkedMultiplySize(size_t a, size_t b, size_t& result) {
+    if (a != 0 && b > SIZE_MAX / a) {
+        return false;
+    }
+
+    result = a * b;
+    return true;
+}
+
+struct AddonEmbeddingIndexSearchCandidate {
+    float score;
+    uint32_t index;
+
+    // ordered so that a heap built with this comparator keeps the lowest score at its front
+    bool operator<(const AddonEmbeddingIndexSearchCandidate& other) const {
+        return score > other.score || (score == other.score && index < other.index);
+    }
+};
+
+static void pushSearchCandidate(std::vector<AddonEmbeddingIndexSearchCandidate>& heap, size_t k, float score, uint32_t index) {
+    if (heap.size() < k) {
+        heap.push_back({score, index});
+        std::push_heap(heap.begin(), heap.end());
+    } else if (score > heap.front().score) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = {score, index};
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+AddonEmbeddingIndex::AddonEmbeddingIndex(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonEmbeddingIndex>(info) {
+    vectorSize = info[0].As<Napi::Number>().Uint32Value();
+
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+
+        if (options.Has("type")) {
+            const auto typeName = options.Get("type").As<Napi::String>().Utf8Value();
+
+            if (typeName == "f16") {
+                type = AddonEmbeddingIndexType::f16;
+            } else if (typeName == "int8") {
+                type = AddonEmbeddingIndexType::int8;
+            }
+        }
+
+        if (options.Has("metric")) {
+            const auto metricName = options.Get("metric").As<Napi::String>().Utf8Value();
+
+            if (metricName == "dot") {
+                metric = AddonEmbeddingIndexMetric::dot;
+            }
+        }
+    }
+
+    publishStorageInfo();
+}
+AddonEmbeddingIndex::~AddonEmbeddingIndex() {
+    dispose();
+}
+
+size_t AddonEmbeddingIndex::getVectorByteSize() const {
+    return vectorSize * getEmbeddingIndexTypeByteSize(type);
+}
+
+void AddonEmbeddingIndex::moveToOwnedStorage() {
+    if (mappedAddress == nullptr) {
+        return;
+    }
+
+    ownedVectors.assign(vectors, vectors + count * getVectorByteSize());
+
+    if (scales != nullptr) {
+        ownedScales.assign(scales, scales + count);
+    } else {
+        ownedScales.clear();
+    }
+
+    unmapFile();
+    vectors = ownedVectors.data();
+    scales = type == AddonEmbeddingIndexType::int8 ? ownedScales.data() : nullptr;
+}
+
+void AddonEmbeddingIndex::publishStorageInfo() {
+    publishedCount = count;
+    publishedVectorSize = vectorSize;
+    publishedType = type;
+    publishedMetric = metric;
+    publishedIsMemoryMapped = mappedAddress != nullptr;
+}
+
+void AddonEmbeddingIndex::unmapFile() {
+    if (mappedAddress == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedAddress);
+    CloseHandle((HANDLE)mappedMappingHandle);
+    CloseHandle((HANDLE)mappedFileHandle);
+    mappedMappingHandle = nullptr;
+    mappedFileHandle = nullptr;
+#else
+    munmap(mappedAddress, mappedSize);
+#endif
+
+    mappedAddress = nullptr;
+    mappedSize = 0;
+}
+
+// must be called while holding the exclusive storage lock
+void AddonEmbeddingIndex::freeStorage() {
+    unmapFile();
+
+    ownedVectors.clear();
+    ownedVectors.shrink_to_fit();
+    ownedScales.clear();
+    ownedScales.shrink_to_fit();
+    vectors = nullptr;
+    scales = nullptr;
+    count = 0;
+    publishStorageInfo();
+}
+
+void AddonEmbeddingIndex::dispose() {
+    std::unique_lock<std::shared_mutex> lock(storageMutex);
+
+    disposed = true;
+    freeStorage();
+}
+
+class AddonEmbeddingIndexDisposeWorker : public AddonAsyncWorker {
+    public:
+        AddonEmbeddingIndex* index;
+
+        AddonEmbeddingIndexDisposeWorker(const Napi::Env& env, AddonEmbeddingIndex* index)
+            : AddonAsyncWorker(env, "AddonEmbeddingIndexDisposeWorker", AddonExecutorLane::io),
+              index(index) {
+            index->Ref();
+        }
+        ~AddonEmbeddingIndexDisposeWorker() {
+            index->Unref();
+        }
+
+    protected:
+        void Execute() {
+            // waits for the running searches to finish, so this runs on a worker thread instead of blocking the JS thread
+            std::unique_lock<std::shared_mutex> lock(index->storageMutex);
+            index->freeStorage();
+        }
+};
+
+class AddonEmbeddingIndexAddWorker : public AddonAsyncWorker {
+    public:
+        AddonEmbeddingIndex* index;
+        std::vector<float> inputVectors;
+        size_t firstIndex = 0;
+
+        AddonEmbeddingIndexAddWorker(const Napi::Env& env, AddonEmbeddingIndex* index, std::vector<float> inputVectors)
+            : AddonAsyncWorker(env, "AddonEmbeddingIndexAddWorker", AddonExecutorLane::compute),
+              index(index),
+              inputVectors(std::move(inputVectors)),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            index->Ref();
+        }
+        ~AddonEmbeddingIndexAddWorker() {
+            index->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            // the exclusive lock waits for running searches, so this runs on a worker thread instead of blocking the JS thread
+            std::unique_lock<std::shared_mutex> lock(index->storageMutex);
+
+            if (index->disposed) {
+                SetError("Embedding index is disposed");
+                return;
+            }
+
+            const size_t vectorSize = index->vectorSize;
+            if (vectorSize == 0 || inputVectors.size() % vectorSize != 0) {
+                // the index may have been loaded from a file with a different vector size since this was queued
+                SetError("Vectors length must be a multiple of the vector size");
+                return;
+            }
+
+            const size_t inputCount = inputVectors.size() / vectorSize;
+            if (inputCount > UINT32_MAX - index->count) {
+                // the search results hold vector indexes as `uint32_t`
+                SetError("The embedding index cannot hold more than " + std::to_string(UINT32_MAX) + " vectors");
+                return;
+            }
+
+            const size_t vectorByteSize = index->getVectorByteSize();
+            std::vector<float> normalizedVector(vectorSize);
+
+            index->moveToOwnedStorage();
+
+            firstIndex = index->count;
+            index->ownedVectors.resize((firstIndex + inputCount) * vectorByteSize);
+            if (index->type == AddonEmbeddingIndexType::int8) {
+                index->ownedScales.resize(firstIndex + inputCount);
+            }
+
+            for (size_t i = 0; i < inputCount; i++) {
+                const float* inputVector = inputVectors.data() + i * vectorSize;
+                uint8_t* vector = index->ownedVectors.data() + (firstIndex + i) * vectorByteSize;
+
+                if (index->metric == AddonEmbeddingIndexMetric::cosine) {
+                    // normalizing the stored vectors once turns every cosine similarity calculation into a dot product
+                    common_embd_normalize(inputVector, normalizedVector.data(), vectorSize, 2);
+                    inputVector = normalizedVector.data();
+                }
+
+                if (index->type == AddonEmbeddingIndexType::f32) {
+                    std::memcpy(vector, inputVector, vectorByteSize);
+                } else if (index->type == AddonEmbeddingIndexType::f16) {
+                    ggml_fp32_to_fp16_row(inputVector, (ggml_fp16_t*)vector, vectorSize);
+                } else if (index->type == AddonEmbeddingIndexType::int8) {
+                    index->ownedScales[firstIndex + i] = quantizeVectorToInt8(inputVector, vectorSize, (int8_t*)vector);
+                }
+            }
+
+            index->count += inputCount;
+            index->vectors = index->ownedVectors.data();
+            index->scales = index->type == AddonEmbeddingIndexType::int8 ? index->ownedScales.data() : nullptr;
+            index->publishStorageInfo();
+        }
+        void OnOK() {
+            deferred.Resolve(Napi::Number::New(Env(), firstIndex));
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonEmbeddingIndex::Add(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Embedding index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Float32Array inputVectors = info[0].As<Napi::Float32Array>();
+    const size_t inputLength = inputVectors.ElementLength();
+    const uint32_t currentVectorSize = publishedVectorSize;
+
+    if (currentVectorSize == 0 || inputLength % currentVectorSize != 0) {
+        Napi::Error::New(info.Env(), "Vectors length must be a multiple of the vector size").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    } else if (inputLength / currentVectorSize > UINT32_MAX - publishedCount.load()) {
+        Napi::Error::New(info.Env(), "The embedding index cannot hold more than " + std::to_string(UINT32_MAX) + " vectors")
+            .ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    auto* worker = new AddonEmbeddingIndexAddWorker(
+        info.Env(),
+        this,
+        std::vector<float>(inputVectors.Data(), inputVectors.Data() + inputLength)
+    );
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonEmbeddingIndexSearchWorker : public AddonAsyncWorker {
+    public:
+        AddonEmbeddingIndex* index;
+        std::vector<float> queries;
+        size_t k = 10;
+        size_t threads = 0;
+        size_t resultK = 0;
+        std::vector<uint32_t> resultIndexes;
+        std::vector<float> resultScores;
+
+        AddonEmbeddingIndexSearchWorker(const Napi::CallbackInfo& info, AddonEmbeddingIndex* index)
+            : AddonAsyncWorker(info.Env(), "AddonEmbeddingIndexSearchWorker", AddonExecutorLane::compute),
+              index(index),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            index->Ref();
+
+            Napi::Float32Array queriesArray = info[0].As<Napi::Float32Array>();
+            queries.assign(queriesArray.Data(), queriesArray.Data() + queriesArray.ElementLength());
+
+            k = info[1].As<Napi::Number>().Uint32Value();
+
+            if (info.Length() > 2 && info[2].IsObject()) {
+                Napi::Object options = info[2].As<Napi::Object>();
+
+                if (options.Has("threads")) {
+                    threads = options.Get("threads").As<Napi::Number>().Uint32Value();
+                }
+            }
+        }
+        ~AddonEmbeddingIndexSearchWorker() {
+            index->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                search();
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"search\"");
+            }
+        }
+
+        float score(size_t queryIndex, size_t vectorIndex) const {
+            const float* query = queries.data() + queryIndex * index->vectorSize;
+            const uint8_t* vector = index->vectors + vectorIndex * index->getVectorByteSize();
+
+            switch (index->type) {
+                case AddonEmbeddingIndexType::f16:
+                    return dotProductF16(query, (const uint16_t*)vector, index->vectorSize);
+                case AddonEmbeddingIndexType::int8:
+                    return dotProductInt8(query, (const int8_t*)vector, index->vectorSize) * index->scales[vectorIndex];
+                case AddonEmbeddingIndexType::f32:
+                default:
+                    return dotProductF32(query, (const float*)vector, index->vectorSize);
+            }
+        }
+
+        void searchRange(size_t start, size_t end, std::vector<std::vector<AddonEmbeddingIndexSearchCandidate>>& heaps) const {
+            const size_t queriesCount = heaps.size();
+
+            for (size_t blockStart = start; blockStart < end; blockStart += searchBlockSize) {
+                const size_t blockEnd = std::min(end, blockStart + searchBlockSize);
+
+                for (size_t queryIndex = 0; queryIndex < queriesCount; queryIndex++) {
+                    auto& heap = heaps[queryIndex];
+
+                    for (size_t vectorIndex = blockStart; vectorIndex < blockEnd; vectorIndex++) {
+                        pushSearchCandidate(heap, resultK, score(queryIndex, vectorIndex), (uint32_t)vectorIndex);
+                    }
+                }
+            }
+        }
+
+        void search() {
+            std::shared_lock<std::shared_mutex> lock(index->storageMutex);
+
+            if (index->disposed) {
+                SetError("Embedding index is disposed");
+                return;
+            }
+
+            const size_t vectorSize = index->vectorSize;
+            if (vectorSize == 0 || queries.size() % vectorSize != 0) {
+                SetError("Queries length must be a multiple of the vector size");
+                return;
+            }
+
+            const size_t queriesCount = queries.size() / vectorSize;
+            const size_t count = index->count;
+            resultK = std::min(k, count);
+
+            resultIndexes.resize(queriesCount * resultK);
+            resultScores.resize(queriesCount * resultK);
+
+            if (resultK == 0 || queriesCount == 0) {
+                return;
+            }
+
+            if (index->metric == AddonEmbeddingIndexMetric::cosine) {
+                for (size_t i = 0; i < queriesCount; i++) {
+                    float* query = queries.data() + i * vectorSize;
+                    common_embd_normalize(query, query, vectorSize, 2);
+                }
+            }
+
+            size_t threadsCount = threads > 0 ? threads : (size_t)cpu_get_num_math();
+            threadsCount = std::max<size_t>(1, std::min(threadsCount, count / minVectorsPerSearchThread));
+
+            std::vector<std::vector<std::vector<AddonEmbeddingIndexSearchCandidate>>> threadHeaps(
+                threadsCount,
+                std::vector<std::vector<AddonEmbeddingIndexSearchCandidate>>(queriesCount)
+            );
+
+            const size_t vectorsPerThread = (count + threadsCount - 1) / threadsCount;
+            std::vector<std::thread> workerThreads;
+            workerThreads.reserve(threadsCount - 1);
+
+            for (size_t t = 1; t < threadsCount; t++) {
+                const size_t start = t * vectorsPerThread;
+                const size_t end = std::min(count, start + vectorsPerThread);
+                workerThreads.emplace_back([this, start, end, &heaps = threadHeaps[t]]() {
+                    searchRange(start, end, heaps);
+                });
+            }
+
+            searchRange(0, std::min(count, vectorsPerThread), threadHeaps[0]);
+
+            for (auto& workerThread : workerThreads) {
+                workerThread.join();
+            }
+
+            std::vector<AddonEmbeddingIndexSearchCandidate> candidates;
+            for (size_t queryIndex = 0; queryIndex < queriesCount; queryIndex++) {
+                candidates.clear();
+                for (auto& heaps : threadHeaps) {
+                    candidates.insert(candidates.end(), heaps[queryIndex].begin(), heaps[queryIndex].end());
+                }
+
+                // the comparator orders candidates from the highest score to the lowest
+                std::partial_sort(candidates.begin(), candidates.begin() + resultK, candidates.end());
+
+                for (size_t i = 0; i < resultK; i++) {
+                    resultIndexes[queryIndex * resultK + i] = candidates[i].index;
+                    resultScores[queryIndex * resultK + i] = candidates[i].score;
+                }
+            }
+        }
+        void OnOK() {
+            Napi::Uint32Array indexesArray = Napi::Uint32Array::New(Env(), resultIndexes.size());
+            std::copy(resultIndexes.begin(), resultIndexes.end(), indexesArray.Data());
+
+            Napi::Float32Array scoresArray = Napi::Float32Array::New(Env(), resultScores.size());
+            std::copy(resultScores.begin(), resultScores.end(), scoresArray.Data());
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("k", Napi::Number::New(Env(), resultK));
+            result.Set("indexes", indexesArray);
+            result.Set("scores", scoresArray);
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonEmbeddingIndex::Search(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Embedding index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonEmbeddingIndexSearchWorker* worker = new AddonEmbeddingIndexSearchWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonEmbeddingIndexSaveWorker : public AddonAsyncWorker {
+    public:
+        AddonEmbeddingIndex* index;
+        std::string filePath;
+
+        AddonEmbeddingIndexSaveWorker(const Napi::CallbackInfo& info, AddonEmbeddingIndex* index)
+            : AddonAsyncWorker(info.Env(), "AddonEmbeddingIndexSaveWorker", AddonExecutorLane::io),
+              index(index),
+              filePath(info[0].As<Napi::String>().Utf8Value()),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            index->Ref();
+        }
+        ~AddonEmbeddingIndexSaveWorker() {
+            index->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                save();
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"save\"");
+            }
+        }
+
+        void save() {
+            std::shared_lock<std::shared_mutex> lock(index->storageMutex);
+
+            if (index->disposed) {
+                SetError("Embedding index is disposed");
+                return;
+            }
+
+            std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                SetError("Failed to open the embedding index file for writing");
+                return;
+            }
+
+            AddonEmbeddingIndexFileHeader header = {};
+            std::memcpy(header.magic, embeddingIndexFileMagic, sizeof(header.magic));
+            header.version = embeddingIndexFileVersion;
+            header.type = (uint32_t)index->type;
+            header.metric = (uint32_t)index->metric;
+            header.vectorSize = index->vectorSize;
+            header.count = index->count;
+
+            const size_t vectorsByteSize = index->count * index->getVectorByteSize();
+            file.write((const char*)&header, sizeof(header));
+            file.write((const char*)index->vectors, vectorsByteSize);
+
+            if (index->type == AddonEmbeddingIndexType::int8) {
+                const size_t paddingSize = getEmbeddingIndexFileScalesOffset(vectorsByteSize) - sizeof(header) - vectorsByteSize;
+                const char padding[4] = {0, 0, 0, 0};
+                file.write(padding, paddingSize);
+                file.write((const char*)index->scales, index->count * sizeof(float));
+            }
+
+            if (!file) {
+                SetError("Failed to write the embedding index file");
+            }
+        }
+        void OnOK() {
+            deferred.Resolve(Env().Undefined());
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonEmbeddingIndex::Save(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Embedding index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonEmbeddingIndexSaveWorker* worker = new AddonEmbeddingIndexSaveWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+class AddonEmbeddingIndexLoadWorker : public AddonAsyncWorker {
+    public:
+        AddonEmbeddingIndex* index;
+        std::string filePath;
+        bool useMmap = false;
+
+        AddonEmbeddingIndexLoadWorker(const Napi::CallbackInfo& info, AddonEmbeddingIndex* index)
+            : AddonAsyncWorker(info.Env(), "AddonEmbeddingIndexLoadWorker", AddonExecutorLane::io),
+              index(index),
+              filePath(info[0].As<Napi::String>().Utf8Value()),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            index->Ref();
+
+            if (info.Length() > 1 && info[1].IsObject()) {
+                Napi::Object options = info[1].As<Napi::Object>();
+
+                if (options.Has("useMmap")) {
+                    useMmap = options.Get("useMmap").As<Napi::Boolean>().Value();
+                }
+            }
+        }
+        ~AddonEmbeddingIndexLoadWorker() {
+            index->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            try {
+                load();
+            } catch (const std::exception& e) {
+                SetError(e.what());
+            } catch(...) {
+                SetError("Unknown error when calling \"load\"");
+            }
+        }
+
+        // `vectorsByteSize` is set to the size of the vectors described by the header
+        bool validateHeader(const AddonEmbeddingIndexFileHeader& header, size_t fileSize, size_t& vectorsByteSize) {
+            if (std::memcmp(header.magic, embeddingIndexFileMagic, sizeof(header.magic)) != 0) {
+                SetError("The file is not an embedding index file");
+                return false;
+            } else if (header.version != embeddingIndexFileVersion) {
+                SetError("Unsupported embedding index file version");
+                return false;
+            } else if (header.type > (uint32_t)AddonEmbeddingIndexType::int8 || header.metric > (uint32_t)AddonEmbeddingIndexMetric::dot) {
+                SetError("Unsupported embedding index type or metric");
+                return false;
+            }
+
+            // the search results hold vector indexes as `uint32_t`.
+            // the sizes are checked against the file size only after making sure they don't overflow,
+            // since a wrapped size would pass the check and make the search read past the end of the file
+            const size_t typeByteSize = getEmbeddingIndexTypeByteSize((AddonEmbeddingIndexType)header.type);
+            size_t vectorByteSize = 0;
+            size_t scalesByteSize = 0;
+            const bool sizesValid = header.count <= UINT32_MAX &&
+                checkedMultiplySize(header.vectorSize, typeByteSize, vectorByteSize) &&
+                checkedMultiplySize((size_t)header.count, vectorByteSize, vectorsByteSize) &&
+                checkedMultiplySize((size_t)header.count, sizeof(float), scalesByteSize) &&
+                scalesByteSize <= SIZE_MAX - sizeof(header) - 3 &&
+                vectorsByteSize <= SIZE_MAX - sizeof(header) - 3 - scalesByteSize;
+
+            if (!sizesValid) {
+                SetError("The embedding index file header is invalid");
+                return false;
+            }
+
+            const size_t expectedFileSize = header.type == (uint32_t)AddonEmbeddingIndexType::int8
+                ? getEmbeddingIndexFileScalesOffset(vectorsByteSize) + scalesByteSize
+                : sizeof(header) + vectorsByteSize;
+
+            if (fileSize < expectedFileSize) {
+                SetError("The embedding index file is truncated");
+                return false;
+            }
+
+            return true;
+        }
+
+        void applyHeader(const AddonEmbeddingIndexFileHeader& header) {
+            index->vectorSize = header.vectorSize;
+            index->type = (AddonEmbeddingIndexType)header.type;
+            index->metric = (AddonEmbeddingIndexMetric)header.metric;
+            index->count = header.count;
+        }
+
+        void load() {
+            if (useMmap) {
+                loadMapped();
+            } else {
+                loadToMemory();
+            }
+        }
+
+        void loadToMemory() {
+            std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+            if (!file) {
+                SetError("Failed to open the embedding index file");
+                return;
+            }
+
+            const size_t fileSize = (size_t)file.tellg();
+            file.seekg(0);
+
+            AddonEmbeddingIndexFileHeader header = {};
+            if (fileSize < sizeof(header) || !file.read((char*)&header, sizeof(header))) {
+                SetError("The file is not an embedding index file");
+                return;
+            }
+
+            size_t vectorsByteSize = 0;
+            if (!validateHeader(header, fileSize, vectorsByteSize)) {
+                return;
+            }
+
+            const bool isInt8 = header.type == (uint32_t)AddonEmbeddingIndexType::int8;
+
+            std::vector<uint8_t> loadedVectors(vectorsByteSize);
+            std::vector<float> loadedScales(isInt8 ? header.count : 0);
+
+            file.read((char*)loadedVectors.data(), vectorsByteSize);
+            if (isInt8) {
+                file.seekg(getEmbeddingIndexFileScalesOffset(vectorsByteSize));
+                file.read((char*)loadedScales.data(), header.count * sizeof(float));
+            }
+
+            if (!file) {
+                SetError("Failed to read the embedding index file");
+                return;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(index->storageMutex);
+            if (index->disposed) {
+                SetError("Embedding index is disposed");
+                return;
+            }
+
+            index->unmapFile();
+            applyHeader(header);
+            index->ownedVectors = std::move(loadedVectors);
+            index->ownedScales = std::move(loadedScales);
+            index->vectors = index->ownedVectors.data();
+            index->scales = isInt8 ? index->ownedScales.data() : nullptr;
+            index->publishStorageInfo();
+        }
+
+        void loadMapped() {
+            void* address = nullptr;
+            size_t fileSize = 0;
+
+#ifdef _WIN32
+            HANDLE fileHandle = CreateFileA(
+                filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+            );
+            if (fileHandle == INVALID_HANDLE_VALUE) {
+                SetError("Failed to open the embedding index file");
+                return;
+            }
+
+            LARGE_INTEGER fileSizeInfo;
+            if (!GetFileSizeEx(fileHandle, &fileSizeInfo)) {
+                CloseHandle(fileHandle);
+                SetError("Failed to get the embedding index file size");
+                return;
+            }
+            fileSize = (size_t)fileSizeInfo.QuadPart;
+
+            HANDLE mappingHandle = fileSize == 0 ? nullptr : CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mappingHandle != nullptr) {
+                address = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+            }
+
+            if (address == nullptr) {
+                if (mappingHandle != nullptr) {
+                    CloseHandle(mappingHandle);
+                }
+                CloseHandle(fileHandle);
+                SetError("Failed to memory map the embedding index file");
+                return;
+            }
+#else
+            const int fd = open(filePath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                SetError("Failed to open the embedding index file");
+                return;
+            }
+
+            struct stat fileStat;
+            if (fstat(fd, &fileStat) != 0) {
+                close(fd);
+                SetError("Failed to get the embedding index file size");
+                return;
+            }
+            fileSize = (size_t)fileStat.st_size;
+
+            address = fileSize == 0 ? MAP_FAILED : mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if (address == MAP_FAILED) {
+                SetError("Failed to memory map the embedding index file");
+                return;
+            }
+#endif
+
+            const auto unmap = [&]() {
+#ifdef _WIN32
+                UnmapViewOfFile(address);
+                CloseHandle(mappingHandle);
+                CloseHandle(fileHandle);
+#else
+                munmap(address, fileSize);
+#endif
+            };
+
+            AddonEmbeddingIndexFileHeader header = {};
+            if (fileSize < sizeof(header)) {
+                unmap();
+                SetError("The file is not an embedding index file");
+                return;
+            }
+
+            std::memcpy(&header, address, sizeof(header));
+            size_t vectorsByteSize = 0;
+            if (!validateHeader(header, fileSize, vectorsByteSize)) {
+                unmap();
+                return;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(index->storageMutex);
+            if (index->disposed) {
+                unmap();
+                SetError("Embedding index is disposed");
+                return;
+            }
+
+            index->unmapFile();
+            index->ownedVectors.clear();
+            index->ownedVectors.shrink_to_fit();
+            index->ownedScales.clear();
+            index->ownedScales.shrink_to_fit();
+
+            applyHeader(header);
+            index->mappedAddress = address;
+            index->mappedSize = fileSize;
+#ifdef _WIN32
+            index->mappedFileHandle = fileHandle;
+            index->mappedMappingHandle = mappingHandle;
+#endif
+
+            const uint8_t* fileData = (const uint8_t*)address;
+            index->vectors = fileData + sizeof(header);
+            index->scales = index->type == AddonEmbeddingIndexType::int8
+                ? (const float*)(fileData + getEmbeddingIndexFileScalesOffset(vectorsByteSize))
+                : nullptr;
+            index->publishStorageInfo();
+        }
+        void OnOK() {
+            deferred.Resolve(Env().Undefined());
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonEmbeddingIndex::Load(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Embedding index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    AddonEmbeddingIndexLoadWorker* worker = new AddonEmbeddingIndexLoadWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+
+Napi::Value AddonEmbeddingIndex::GetSize(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), (double)publishedCount.load());
+}
+
+Napi::Value AddonEmbeddingIndex::GetVectorSize(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), publishedVectorSize.load());
+}
+
+Napi::Value AddonEmbeddingIndex::GetType(const Napi::CallbackInfo& info) {
+    switch (publishedType.load()) {
+        case AddonEmbeddingIndexType::f16:
+            return Napi::String::New(info.Env(), "f16");
+        case AddonEmbeddingIndexType::int8:
+            return Napi::String::New(info.Env(), "int8");
+        case AddonEmbeddingIndexType::f32:
+        default:
+            return Napi::String::New(info.Env(), "f32");
+    }
+}
+
+Napi::Value AddonEmbeddingIndex::GetMetric(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), publishedMetric.load() == AddonEmbeddingIndexMetric::dot ? "dot" : "cosine");
+}
+
+Napi::Value AddonEmbeddingIndex::GetIsMemoryMapped(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), publishedIsMemoryMapped.load());
+}
+
+Napi::Value AddonEmbeddingIndex::Dispose(const Napi::CallbackInfo& info) {
+    if (disposed.exchange(true)) {
+        return info.Env().Undefined();
+    }
+
+    // workers that acquire the storage lock from now on fail without touching the storage
+    AddonEmbeddingIndexDisposeWorker* worker = new AddonEmbeddingIndexDisposeWorker(info.Env(), this);
+    worker->Queue();
+
+    return info.Env().Undefined();
+}
+
+void AddonEmbeddingIndex::init(Napi::Object exports) {
+    exports.Set(
+        "AddonEmbeddingIndex",
+        DefineClass(
+            exports.Env(),
+            "AddonEmbeddingIndex",
+            {
+                InstanceMethod("add", &AddonEmbeddingIndex::Add),
+                InstanceMethod("search", &AddonEmbeddingIndex::Search),
+                InstanceMethod("save", &AddonEmbeddingIndex::Save),
+                InstanceMethod("load", &AddonEmbeddingIndex::Load),
+                InstanceMethod("getSize", &AddonEmbeddingIndex::GetSize),
+                InstanceMethod("getVectorSize", &AddonEmbeddingIndex::GetVectorSize),
+                InstanceMethod("getType", &AddonEmbeddingIndex::GetType),
+                InstanceMethod("getMetric", &AddonEmbeddingIndex::GetMetric),
+                InstanceMethod("getIsMemoryMapped", &AddonEmbeddingIndex::GetIsMemoryMapped),
+                InstanceMethod("dispose", &AddonEmbeddingIndex::Dispose),
+            }
+        )
+    );
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "napi.h"
+#include "addonGlobals.h"
+
+enum class AddonEmbeddingIndexType : uint32_t {
+    f32 = 0,
+    f16 = 1,
+    int8 = 2
+};
+
+enum class AddonEmbeddingIndexMetric : uint32_t {
+    cosine = 0,
+    dot = 1
+};
+
+class AddonEmbeddingIndex : public Napi::ObjectWrap<AddonEmbeddingIndex> {
+    public:
+        uint32_t vectorSize = 0;
+        AddonEmbeddingIndexType type = AddonEmbeddingIndexType::f32;
+        AddonEmbeddingIndexMetric metric = AddonEmbeddingIndexMetric::cosine;
+        size_t count = 0;
+
+        // the vectors are stored contiguously, either in `ownedVectors` or in a memory mapped file.
+        // `vectors` and `scales` always point to the active storage
+        std::vector<uint8_t> ownedVectors;
+        std::vector<float> ownedScales;
+        const uint8_t* vectors = nullptr;
+        const float* scales = nullptr;
+
+        void* mappedAddress = nullptr;
+        size_t mappedSize = 0;
+#ifdef _WIN32
+        void* mappedFileHandle = nullptr;
+        void* mappedMappingHandle = nullptr;
+#endif
+
+        // searches run on worker threads and hold a shared lock, while any change to the storage holds an exclusive lock.
+        // `disposed` is set on the JS thread right away, and the storage is freed on a worker thread once the running searches finish
+        std::shared_mutex storageMutex;
+        std::atomic<bool> disposed{false};
+
+        // copies of the storage fields for the getters, so the JS thread never waits for the storage lock.
+        // updated by `publishStorageInfo` while holding the exclusive lock
+        std::atomic<uint64_t> publishedCount{0};
+        std::atomic<uint32_t> publishedVectorSize{0};
+        std::atomic<AddonEmbeddingIndexType> publishedType{AddonEmbeddingIndexType::f32};
+        std::atomic<AddonEmbeddingIndexMetric> publishedMetric{AddonEmbeddingIndexMetric::cosine};
+        std::atomic<bool> publishedIsMemoryMapped{false};
+
+        AddonEmbeddingIndex(const Napi::CallbackInfo& info);
+        ~AddonEmbeddingIndex();
+
+        size_t getVectorByteSize() const;
+        void moveToOwnedStorage();
+        void publishStorageInfo();
+        void unmapFile();
+        void freeStorage();
+        void dispose();
+
+        Napi::Value Add(const Napi::CallbackInfo& info);
+        Napi::Value Search(const Napi::CallbackInfo& info);
+        Napi::Value Save(const Napi::CallbackInfo& info);
+        Napi::Value Load(const Napi::CallbackInfo& info);
+        Napi::Value GetSize(const Napi::CallbackInfo& info);
+        Napi::Value GetVectorSize(const Napi::CallbackInfo& info);
+        Napi::Value GetType(const Napi::CallbackInfo& info);
+        Napi::Value GetMetric(const Napi::CallbackInfo& info);
+        Napi::Value GetIsMemoryMapped(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
@@ -1,17 +1,26 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 #include <sstream>
 #include <cmath>
+#include <cstring>
 #include <nlohmann/json.hpp>
 #include "addonGlobals.h"
 #include "globals/addonLog.h"
 #include "globals/addonProgress.h"
+#include "globals/addonExecutor.h"
 #include "common/common.h"
 #include "llama.h"
+#include "llama-vocab.h"
 #include "json-schema-to-grammar.h"
 #include "sampling.h"
 #include "AddonModel.h"
 #include "AddonModelData.h"
 #include "AddonModelLora.h"
+#include "utils/cpuAffinity.h"
+#include "utils/FileMapping.h"
+#include "utils/pageFaults.h"
 
 using json = nlohmann::ordered_json;
 
@@ -76,12 +85,82 @@ static bool llamaModelParamsProgressCallback(float progress, void * user_data) {
     return !(addonModel->abortModelLoad);
 }
 
-class AddonModelLoadModelWorker : public Napi::AsyncWorker {
+static void fnv1aHash(uint64_t& hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+// a hash of everything that affects how text is tokenized and detokenized,
+// so two models with the same fingerprint can be used with each other's tokens
+static uint64_t computeVocabularyFingerprint(const llama_vocab* vocab) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    const int32_t vocabType = llama_vocab_type(vocab);
+    const int32_t n_tokens = llama_vocab_n_tokens(vocab);
+    const uint8_t flags[] = {(uint8_t)llama_vocab_get_add_bos(vocab), (uint8_t)llama_vocab_get_add_eos(vocab)};
+    const llama_token specialTokens[] = {
+        llama_vocab_bos(vocab),
+        llama_vocab_eos(vocab),
+        llama_vocab_eot(vocab),
+        llama_vocab_sep(vocab),
+        llama_vocab_nl(vocab),
+        llama_vocab_pad(vocab),
+        llama_vocab_fim_pre(vocab),
+        llama_vocab_fim_suf(vocab),
+        llama_vocab_fim_mid(vocab)
+    };
+
+    // the pre-tokenizer splits the text before the merges are applied, so models with the same tokens can still tokenize differently
+    const int32_t preTokenizerType = vocab->get_pre_type();
+    const uint8_t textProcessingFlags[] = {
+        (uint8_t)vocab->get_add_space_prefix(),
+        (uint8_t)vocab->get_ignore_merges(),
+        (uint8_t)vocab->get_clean_spaces(),
+        (uint8_t)vocab->get_remove_extra_whitespaces(),
+        (uint8_t)vocab->get_escape_whitespaces(),
+        (uint8_t)vocab->get_treat_whitespace_as_suffix()
+    };
+
+    fnv1aHash(hash, &vocabType, sizeof(vocabType));
+    fnv1aHash(hash, &n_tokens, sizeof(n_tokens));
+    fnv1aHash(hash, flags, sizeof(flags));
+    fnv1aHash(hash, specialTokens, sizeof(specialTokens));
+    fnv1aHash(hash, &preTokenizerType, sizeof(preTokenizerType));
+    fnv1aHash(hash, textProcessingFlags, sizeof(textProcessingFlags));
+
+    for (llama_token token = 0; token < n_tokens; token++) {
+        const char* text = llama_vocab_get_text(vocab, token);
+        const size_t textLength = text == nullptr ? 0 : std::strlen(text);
+        const int32_t attributes = llama_vocab_get_attr(vocab, token);
+
+        // hashing the length keeps the boundaries between token texts unambiguous
+        fnv1aHash(hash, &textLength, sizeof(textLength));
+        fnv1aHash(hash, text, textLength);
+        fnv1aHash(hash, &attributes, sizeof(attributes));
+    }
+
+    // the merges are ordered by their rank, and BPE tokenization applies them by that order
+    const std::vector<std::string> merges = vocab->get_bpe_merges();
+    const size_t mergesCount = merges.size();
+    fnv1aHash(hash, &mergesCount, sizeof(mergesCount));
+    for (const auto& merge : merges) {
+        const size_t mergeLength = merge.size();
+        fnv1aHash(hash, &mergeLength, sizeof(mergeLength));
+        fnv1aHash(hash, merge.data(), mergeLength);
+    }
+
+    return hash;
+}
+
+class AddonModelLoadModelWorker : public AddonAsyncWorker {
     public:
         AddonModel* model;
 
         AddonModelLoadModelWorker(const Napi::Env& env, AddonModel* model)
-            : Napi::AsyncWorker(env, "AddonModelLoadModelWorker"),
+            : AddonAsyncWorker(env, "AddonModelLoadModelWorker", AddonExecutorLane::load),
               model(model),
               deferred(Napi::Promise::Deferred::New(env)) {
             model->Ref();
@@ -99,10 +178,18 @@ class AddonModelLoadModelWorker : public Napi::AsyncWorker {
 
         void Execute() {
             try {
-                model->model = llama_model_load_from_file(model->modelPath.c_str(), model->model_params);
+                {
+                    // weights that are loaded into memory are placed on the NUMA nodes of these CPU cores
+                    ScopedThreadAffinity threadAffinity(model->affinityCpus);
+                    model->model = llama_model_load_from_file(model->modelPath.c_str(), model->model_params);
+                }
                 model->vocab = llama_model_get_vocab(model->model);
 
                 model->modelLoaded = model->model != nullptr && model->model != NULL;
+
+                if (model->modelLoaded) {
+                    model->vocabFingerprint = computeVocabularyFingerprint(model->vocab);
+                }
             } catch (const std::exception& e) {
                 SetError(e.what());
             } catch(...) {
@@ -126,12 +213,12 @@ class AddonModelLoadModelWorker : public Napi::AsyncWorker {
         }
 };
 
-class AddonModelUnloadModelWorker : public Napi::AsyncWorker {
+class AddonModelUnloadModelWorker : public AddonAsyncWorker {
     public:
         AddonModel* model;
 
         AddonModelUnloadModelWorker(const Napi::Env& env, AddonModel* model)
-            : Napi::AsyncWorker(env, "AddonModelUnloadModelWorker"),
+            : AddonAsyncWorker(env, "AddonModelUnloadModelWorker", AddonExecutorLane::load),
               model(model),
               deferred(Napi::Promise::Deferred::New(env)) {
             model->Ref();
@@ -170,7 +257,7 @@ class AddonModelUnloadModelWorker : public Napi::AsyncWorker {
         }
 };
 
-class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
+class AddonModelLoadLoraWorker : public AddonAsyncWorker {
     public:
         AddonModelLora* modelLora;
 
@@ -178,7 +265,7 @@ class AddonModelLoadLoraWorker : public Napi::AsyncWorker {
             const Napi::Env& env,
             AddonModelLora* modelLora
         )
-            : Napi::AsyncWorker(env, "AddonModelLoadLoraWorker"),
+            : AddonAsyncWorker(env, "AddonModelLoadLoraWorker", AddonExecutorLane::load),
               modelLora(modelLora),
               deferred(Napi::Promise::Deferred::New(env)) {
             modelLora->model->Ref();
@@ -267,6 +354,11 @@ AddonModel::AddonModel(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonM
             model_params.check_tensors = options.Get("checkTensors").As<Napi::Boolean>().Value();
         }
 
+        if (options.Has("cpus")) {
+            Napi::Uint32Array cpus = options.Get("cpus").As<Napi::Uint32Array>();
+            affinityCpus.assign(cpus.Data(), cpus.Data() + cpus.ElementLength());
+        }
+
         if (options.Has("onLoadProgress")) {
             auto onLoadProgressJSCallback = options.Get("onLoadProgress").As<Napi::Function>();
             if (onLoadProgressJSCallback.IsFunction()) {
@@ -365,6 +457,12 @@ void AddonModel::dispose() {
     }
 
     disposed = true;
+    abortPrefetches();
+
+    // the n-gram cache is freed once no other model or `AddonNgramCache` of the same vocabulary holds it
+    ngramCache.store(nullptr, std::memory_order_release);
+    ngramCacheOwner.reset();
+
     if (modelLoaded) {
         modelLoaded = false;
         llama_model_free(model);
@@ -385,6 +483,32 @@ void AddonModel::dispose() {
     }
 }
 
+int64_t AddonModel::getFileResidentSize(const std::vector<std::string>& filePaths, uint64_t& fileSize, bool checkResidency) {
+    fileSize = 0;
+    int64_t residentSize = checkResidency ? 0 : -1;
+
+    // the files are mapped only while they're probed, so the mappings never outlive a model file that was replaced on the disk
+    try {
+        for (const auto& filePath : filePaths) {
+            FileMapping fileMapping;
+            fileMapping.open(filePath);
+            fileSize += fileMapping.size;
+
+            if (residentSize >= 0) {
+                const int64_t fileResidentSize = fileMapping.getResidentSize(0, fileMapping.size);
+                residentSize = fileResidentSize < 0
+                    ? -1
+                    : residentSize + fileResidentSize;
+            }
+        }
+    } catch (const std::exception&) {
+        fileSize = 0;
+        return -1;
+    }
+
+    return residentSize;
+}
+
 Napi::Value AddonModel::Init(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
@@ -405,11 +529,20 @@ Napi::Value AddonModel::AbortActiveModelLoad(const Napi::CallbackInfo& info) {
     abortModelLoad = true;
     return info.Env().Undefined();
 }
+// the prefetches read their own mappings of the model files, so they're only stopped early to not keep reading files of a disposed model
+void AddonModel::abortPrefetches() {
+    for (auto& [prefetchId, abortFlag] : prefetchAbortFlags) {
+        *abortFlag = true;
+    }
+}
+
 Napi::Value AddonModel::Dispose(const Napi::CallbackInfo& info) {
     if (disposed) {
         return info.Env().Undefined();
     }
 
+    abortPrefetches();
+
     if (modelLoaded) {
         modelLoaded = false;
 
@@ -730,6 +863,7 @@ Napi::Value AddonModel::CompletionSync(const Napi::CallbackInfo& info) {
     std::string _result = "";
     for (int n_pos = 0; n_pos + batch.n_tokens < n_prompt + n_predict; ) {
         // evaluate the current batch with the transformer model
+        ScopedDecodeWindow decodeWindow;
         if (llama_decode(ctx, batch)) {
             Napi::Error::New(info.Env(), "Failed to Decode token").ThrowAsJavaScriptException();
             return info.Env().Undefined();
@@ -998,6 +1132,17 @@ Napi::Value AddonModel::GetVocabularyType(const Napi::CallbackInfo& info) {
 
     return Napi::Number::From(info.Env(), int32_t(vocabularyType));
 }
+Napi::Value AddonModel::GetVocabularyFingerprint(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Model is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    char fingerprint[17];
+    snprintf(fingerprint, sizeof(fingerprint), "%016llx", (unsigned long long)vocabFingerprint);
+
+    return Napi::String::New(info.Env(), fingerprint);
+}
 Napi::Value AddonModel::ShouldPrependBosToken(const Napi::CallbackInfo& info) {
     const bool addBos = llama_vocab_get_add_bos(vocab);
 
@@ -1013,6 +1158,298 @@ Napi::Value AddonModel::GetModelSize(const Napi::CallbackInfo& info) {
     return Napi::Number::From(info.Env(), llama_model_size(model));
 }
 
+static std::vector<std::string> getFilePathsArgument(const Napi::Value& value) {
+    Napi::Array filePathsArray = value.As<Napi::Array>();
+    std::vector<std::string> filePaths;
+    filePaths.reserve(filePathsArray.Length());
+
+    for (uint32_t i = 0; i < filePathsArray.Length(); i++) {
+        filePaths.push_back(filePathsArray.Get(i).As<Napi::String>().Utf8Value());
+    }
+
+    return filePaths;
+}
+
+class AddonModelGetFileResidencyWorker : public AddonAsyncWorker {
+    public:
+        AddonModel* model;
+        std::vector<std::string> filePaths;
+        int64_t residentSize = 0;
+        uint64_t totalSize = 0;
+
+        AddonModelGetFileResidencyWorker(const Napi::Env& env, AddonModel* model, std::vector<std::string> filePaths)
+            : AddonAsyncWorker(env, "AddonModelGetFileResidencyWorker", AddonExecutorLane::io),
+              model(model),
+              filePaths(std::move(filePaths)),
+              deferred(Napi::Promise::Deferred::New(env)) {
+            model->Ref();
+        }
+        ~AddonModelGetFileResidencyWorker() {
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        void Execute() {
+            for (const auto& filePath : filePaths) {
+                FileMapping fileMapping;
+                fileMapping.open(filePath);
+
+                const int64_t fileResidentSize = fileMapping.getResidentSize(0, fileMapping.size);
+                if (fileResidentSize < 0) {
+                    residentSize = -1;
+                    return;
+                }
+
+                residentSize += fileResidentSize;
+                totalSize += fileMapping.size;
+            }
+        }
+        void OnOK() {
+            if (residentSize < 0) {
+                deferred.Resolve(Env().Null());
+                return;
+            }
+
+            Napi::Object result = Napi::Object::New(Env());
+            result.Set("residentSize", Napi::Number::New(Env(), (double)residentSize));
+            result.Set("totalSize", Napi::Number::New(Env(), (double)totalSize));
+
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            deferred.Reject(err.Value());
+        }
+};
+
+class AddonModelPrefetchFileWorker : public AddonAsyncWorker {
+    public:
+        AddonModel* model;
+        uint32_t prefetchId;
+        std::vector<std::string> filePaths;
+        uint32_t threads = 4;
+        double bytesPerSecond = 0; // `0` means unlimited
+        std::shared_ptr<std::atomic<bool>> abortFlag = std::make_shared<std::atomic<bool>>(false);
+        bool aborted = false;
+
+        bool hasProgressCallback = false;
+        AddonThreadSafeProgressEventCallbackFunction progressCallback;
+
+        AddonModelPrefetchFileWorker(const Napi::CallbackInfo& info, AddonModel* model)
+            : AddonAsyncWorker(info.Env(), "AddonModelPrefetchFileWorker", AddonExecutorLane::prefetch),
+              model(model),
+              prefetchId(info[0].As<Napi::Number>().Uint32Value()),
+              filePaths(getFilePathsArgument(info[1])),
+              deferred(Napi::Promise::Deferred::New(info.Env())) {
+            model->Ref();
+            model->prefetchAbortFlags[prefetchId] = abortFlag;
+
+            if (info.Length() > 2 && info[2].IsObject()) {
+                Napi::Object options = info[2].As<Napi::Object>();
+
+                if (options.Has("threads")) {
+                    threads = std::max(1u, options.Get("threads").As<Napi::Number>().Uint32Value());
+                }
+
+                if (options.Has("bytesPerSecond")) {
+                    bytesPerSecond = std::max(0.0, options.Get("bytesPerSecond").As<Napi::Number>().DoubleValue());
+                }
+
+                if (options.Has("onProgress") && options.Get("onProgress").IsFunction()) {
+                    AddonThreadSafeProgressCallbackFunctionContext* context = new Napi::Reference<Napi::Value>(Napi::Persistent(info.This()));
+                    progressCallback = AddonThreadSafeProgressEventCallbackFunction::New(
+                        info.Env(),
+                        options.Get("onProgress").As<Napi::Function>(),
+                        "onPrefetchProgressCallback",
+                        0,
+                        1,
+                        context,
+                        [](Napi::Env, void*, AddonThreadSafeProgressCallbackFunctionContext* ctx) {
+                            delete ctx;
+                        },
+                        (void*)nullptr
+                    );
+                    hasProgressCallback = true;
+                }
+            }
+        }
+        ~AddonModelPrefetchFileWorker() {
+            auto it = model->prefetchAbortFlags.find(prefetchId);
+            if (it != model->prefetchAbortFlags.end() && it->second == abortFlag) {
+                model->prefetchAbortFlags.erase(it);
+            }
+
+            model->Unref();
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+
+        // the file is read in chunks, so the threads share the work evenly and the I/O rate can be limited
+        static constexpr uint64_t chunkSize = 4 * 1024 * 1024;
+
+        bool isAborted() {
+            return abortFlag->load() || IsExecutorStopping();
+        }
+
+        void reportProgress(float progress) {
+            if (!hasProgressCallback) {
+                return;
+            }
+
+            addon_progress_event* data = new addon_progress_event {
+                progress
+            };
+
+            if (progressCallback.NonBlockingCall(data) != napi_ok) {
+                delete data;
+            }
+        }
+
+        void Execute() {
+            std::vector<std::unique_ptr<FileMapping>> fileMappings;
+            std::vector<uint64_t> fileFirstChunks;
+            uint64_t totalChunks = 0;
+            uint64_t totalSize = 0;
+
+            for (const auto& filePath : filePaths) {
+                auto fileMapping = std::make_unique<FileMapping>();
+                fileMapping->open(filePath);
+
+                fileFirstChunks.push_back(totalChunks);
+                totalChunks += (fileMapping->size + chunkSize - 1) / chunkSize;
+                totalSize += fileMapping->size;
+                fileMappings.push_back(std::move(fileMapping));
+            }
+
+            if (totalSize == 0) {
+                reportProgress(1);
+                return;
+            }
+
+            std::atomic<uint64_t> nextChunk{0};
+            std::atomic<uint64_t> scheduledBytes{0};
+            std::atomic<uint64_t> doneBytes{0};
+            std::atomic<uint32_t> reportedPercentage{0};
+            std::atomic<bool> stopped{false};
+            const auto startTime = std::chrono::steady_clock::now();
+
+            auto prefetchChunks = [&]() {
+                while (!stopped.load()) {
+                    const uint64_t chunk = nextChunk.fetch_add(1);
+                    if (chunk >= totalChunks) {
+                        break;
+                    }
+
+                    const size_t fileIndex = std::upper_bound(fileFirstChunks.begin(), fileFirstChunks.end(), chunk) - fileFirstChunks.begin() - 1;
+                    FileMapping& fileMapping = *fileMappings[fileIndex];
+                    const uint64_t offset = (chunk - fileFirstChunks[fileIndex]) * chunkSize;
+                    const uint64_t length = std::min(chunkSize, fileMapping.size - offset);
+
+                    // only the parts that aren't cached yet count towards the I/O rate
+                    const int64_t residentSize = fileMapping.getResidentSize(offset, length);
+                    if (residentSize < 0 || (uint64_t)residentSize < length) {
+                        if (bytesPerSecond > 0) {
+                            const uint64_t missingSize = length - (uint64_t)std::max<int64_t>(0, residentSize);
+                            const double scheduledSeconds = (double)(scheduledBytes.fetch_add(missingSize) + missingSize) / bytesPerSecond;
+                            const auto dueTime = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(scheduledSeconds)
+                            );
+
+                            while (std::chrono::steady_clock::now() < dueTime) {
+                                if (isAborted()) {
+                                    stopped = true;
+                                    return;
+                                }
+
+                                std::this_thread::sleep_for(
+                                    std::min<std::chrono::steady_clock::duration>(dueTime - std::chrono::steady_clock::now(), std::chrono::milliseconds(100))
+                                );
+                            }
+                        }
+
+                        fileMapping.adviseWillNeed(offset, length);
+                        fileMapping.touch(offset, length);
+                    }
+
+                    if (isAborted()) {
+                        stopped = true;
+                        return;
+                    }
+
+                    const uint64_t done = doneBytes.fetch_add(length) + length;
+                    const uint32_t percentage = (uint32_t)((done * 100) / totalSize);
+                    uint32_t lastPercentage = reportedPercentage.load();
+                    while (percentage > lastPercentage) {
+                        if (reportedPercentage.compare_exchange_weak(lastPercentage, percentage)) {
+                            reportProgress((float)done / (float)totalSize);
+                            break;
+                        }
+                    }
+                }
+            };
+
+            // the prefetch faults in pages of the model files, so the decodes that run meanwhile can't attribute the page faults to themselves
+            ScopedDecodeWindow decodeWindow;
+
+            std::vector<std::thread> prefetchThreads;
+            const uint32_t threadsCount = (uint32_t)std::min<uint64_t>(threads, totalChunks);
+            for (uint32_t i = 1; i < threadsCount; i++) {
+                prefetchThreads.emplace_back(prefetchChunks);
+            }
+
+            prefetchChunks();
+
+            for (auto& thread : prefetchThreads) {
+                thread.join();
+            }
+
+            aborted = stopped.load();
+        }
+        void OnOK() {
+            if (hasProgressCallback) {
+                progressCallback.Release();
+            }
+
+            deferred.Resolve(Napi::Boolean::New(Env(), !aborted));
+        }
+        void OnError(const Napi::Error& err) {
+            if (hasProgressCallback) {
+                progressCallback.Release();
+            }
+
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value AddonModel::GetFileResidency(const Napi::CallbackInfo& info) {
+    auto* worker = new AddonModelGetFileResidencyWorker(info.Env(), this, getFilePathsArgument(info[0]));
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonModel::PrefetchFile(const Napi::CallbackInfo& info) {
+    auto* worker = new AddonModelPrefetchFileWorker(info, this);
+    worker->Queue();
+    return worker->GetPromise();
+}
+Napi::Value AddonModel::AbortPrefetchFile(const Napi::CallbackInfo& info) {
+    auto it = prefetchAbortFlags.find(info[0].As<Napi::Number>().Uint32Value());
+    if (it != prefetchAbortFlags.end()) {
+        *it->second = true;
+    }
+
+    return info.Env().Undefined();
+}
+
 void AddonModel::init(Napi::Object exports) {
     exports.Set(
         "AddonModel",
@@ -1044,9 +1481,13 @@ void AddonModel::init(Napi::Object exports) {
                 InstanceMethod("getTokenAttributes", &AddonModel::GetTokenAttributes),
                 InstanceMethod("isEogToken", &AddonModel::IsEogToken),
                 InstanceMethod("getVocabularyType", &AddonModel::GetVocabularyType),
+                InstanceMethod("getVocabularyFingerprint", &AddonModel::GetVocabularyFingerprint),
                 InstanceMethod("shouldPrependBosToken", &AddonModel::ShouldPrependBosToken),
                 InstanceMethod("shouldAppendEosToken", &AddonModel::ShouldAppendEosToken),
                 InstanceMethod("getModelSize", &AddonModel::GetModelSize),
+                InstanceMethod("getFileResidency", &AddonModel::GetFileResidency),
+                InstanceMethod("prefetchFile", &AddonModel::PrefetchFile),
+                InstanceMethod("abortPrefetchFile", &AddonModel::AbortPrefetchFile),
                 InstanceMethod("dispose", &AddonModel::Dispose),
             }
         )
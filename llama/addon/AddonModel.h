@@ -1,4 +1,9 @@
 #pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "llama.h"
 #include "napi.h"
 #include "addonGlobals.h"
@@ -10,12 +15,17 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         std::vector<llama_model_kv_override> kv_overrides;
         llama_model* model;
         const llama_vocab* vocab;
+        uint64_t vocabFingerprint = 0; // computed once when the model is loaded
         uint64_t loadedModelSize = 0;
         Napi::Reference<Napi::Object> addonExportsRef;
         bool hasAddonExportsRef = false;
         AddonModelData* data;
+        std::atomic<TokenNgramCache*> ngramCache{nullptr}; // set by `AddonNgramCache`, the samplers of the model learn into it
+        std::shared_ptr<TokenNgramCache> ngramCacheOwner; // keeps the n-gram cache of the model's vocabulary alive until the model is disposed
+        uint32_t ngramCacheUsers = 0; // the number of undisposed `AddonNgramCache` instances of this model, only used on the JS thread
 
         std::string modelPath;
+        std::vector<uint32_t> affinityCpus; // the model is loaded while the loading thread runs on these CPU cores
         bool modelLoaded = false;
         bool abortModelLoad = false;
         bool model_load_stopped = false;
@@ -25,11 +35,19 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         bool onLoadProgressEventCallbackSet = false;
         bool hasLoadAbortSignal = false;
 
+        // the abort flags of the running prefetches of the model files, by their IDs
+        std::unordered_map<uint32_t, std::shared_ptr<std::atomic<bool>>> prefetchAbortFlags;
+
         bool disposed = false;
 
         AddonModel(const Napi::CallbackInfo& info);
         ~AddonModel();
         void dispose();
+        void abortPrefetches();
+
+        // the number of bytes of the given model files that are in the page cache, or `-1` when it cannot be checked or isn't requested.
+        // checking the residency goes over every page of the files, so it's only done when `checkResidency` is `true`
+        int64_t getFileResidentSize(const std::vector<std::string>& filePaths, uint64_t& fileSize, bool checkResidency);
 
         Napi::Value Init(const Napi::CallbackInfo& info);
         Napi::Value LoadLora(const Napi::CallbackInfo& info);
@@ -58,9 +76,14 @@ class AddonModel : public Napi::ObjectWrap<AddonModel> {
         Napi::Value GetTokenAttributes(const Napi::CallbackInfo& info);
         Napi::Value IsEogToken(const Napi::CallbackInfo& info);
         Napi::Value GetVocabularyType(const Napi::CallbackInfo& info);
+        Napi::Value GetVocabularyFingerprint(const Napi::CallbackInfo& info);
         Napi::Value ShouldPrependBosToken(const Napi::CallbackInfo& info);
         Napi::Value ShouldAppendEosToken(const Napi::CallbackInfo& info);
         Napi::Value GetModelSize(const Napi::CallbackInfo& info);
 
+        Napi::Value GetFileResidency(const Napi::CallbackInfo& info);
+        Napi::Value PrefetchFile(const Napi::CallbackInfo& info);
+        Napi::Value AbortPrefetchFile(const Napi::CallbackInfo& info);
+
         static void init(Napi::Object exports);
 };
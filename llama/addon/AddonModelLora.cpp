@@ -1,14 +1,15 @@
 #include "addonGlobals.h"
+#include "globals/addonExecutor.h"
 #include "AddonModel.h"
 #include "AddonModelData.h"
 #include "AddonModelLora.h"
 
-class AddonModelLoraUnloadLoraWorker : public Napi::AsyncWorker {
+class AddonModelLoraUnloadLoraWorker : public AddonAsyncWorker {
     public:
         AddonModelLora* addonLora;
 
         AddonModelLoraUnloadLoraWorker(const Napi::Env& env, AddonModelLora* addonLora)
-            : Napi::AsyncWorker(env, "AddonModelLoraUnloadLoraWorker"),
+            : AddonAsyncWorker(env, "AddonModelLoraUnloadLoraWorker", AddonExecutorLane::load),
               addonLora(addonLora),
               deferred(Napi::Promise::Deferred::New(env)) {
             addonLora->Ref();
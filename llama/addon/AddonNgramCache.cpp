@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <vector>
+#include "llama.h"
+
+#include "addonGlobals.h"
+#include "AddonNgramCache.h"
+
+AddonNgramCache::AddonNgramCache(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonNgramCache>(info) {
+    model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
+    model->Ref();
+
+    size_t maxMemorySize = 32 * 1024 * 1024;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+
+        if (options.Has("maxMemorySize")) {
+            maxMemorySize = options.Get("maxMemorySize").As<Napi::Number>().Int64Value();
+        }
+    }
+
+    cache = acquireTokenNgramCache(model->vocabFingerprint, maxMemorySize);
+
+    // the samplers of the model start learning the tokens they accept into the cache.
+    // the model holds the cache too, since its samplers may still be learning into it after this cache is disposed
+    model->ngramCacheOwner = cache;
+    model->ngramCache.store(cache.get(), std::memory_order_release);
+    model->ngramCacheUsers++;
+}
+AddonNgramCache::~AddonNgramCache() {
+    dispose();
+}
+
+void AddonNgramCache::dispose() {
+    if (disposed) {
+        return;
+    }
+
+    disposed = true;
+
+    // the samplers of the model stop learning once no cache of the model is in use.
+    // the model keeps holding the cache until it's disposed, so the learned n-grams are available to the next cache created for it
+    model->ngramCacheUsers--;
+    if (model->ngramCacheUsers == 0) {
+        TokenNgramCache* expectedCache = cache.get();
+        model->ngramCache.compare_exchange_strong(expectedCache, nullptr, std::memory_order_acq_rel);
+    }
+
+    cache.reset();
+    model->Unref();
+}
+
+Napi::Value AddonNgramCache::Draft(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "N-gram cache is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    const auto maxTokens = info[1].As<Napi::Number>().Uint32Value();
+    const auto minCount = info[2].As<Napi::Number>().Uint32Value();
+
+    // only the last tokens are used as the n-gram context
+    const size_t contextLength = std::min(tokens.ElementLength(), TokenNgramCache::maxOrder);
+    std::vector<llama_token> context(contextLength);
+    for (size_t i = 0; i < contextLength; i++) {
+        context[i] = static_cast<llama_token>(tokens[tokens.ElementLength() - contextLength + i]);
+    }
+
+    std::vector<llama_token> draft;
+    cache->draft(context.data(), context.size(), maxTokens, std::max(1u, minCount), draft);
+
+    Napi::Uint32Array result = Napi::Uint32Array::New(info.Env(), draft.size());
+    for (size_t i = 0; i < draft.size(); i++) {
+        result[i] = static_cast<uint32_t>(draft[i]);
+    }
+
+    return result;
+}
+
+Napi::Value AddonNgramCache::RecordAcceptedTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "N-gram cache is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    cache->recordAcceptedTokens(info[0].As<Napi::Number>().Uint32Value());
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonNgramCache::GetStats(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "N-gram cache is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const auto stats = cache->getStats();
+
+    Napi::Object result = Napi::Object::New(info.Env());
+    result.Set("lookups", Napi::Number::New(info.Env(), static_cast<double>(stats.lookups)));
+    result.Set("hits", Napi::Number::New(info.Env(), static_cast<double>(stats.hits)));
+    result.Set("draftedTokens", Napi::Number::New(info.Env(), static_cast<double>(stats.draftedTokens)));
+    result.Set("acceptedTokens", Napi::Number::New(info.Env(), static_cast<double>(stats.acceptedTokens)));
+    result.Set("learnedTokens", Napi::Number::New(info.Env(), static_cast<double>(stats.learnedTokens)));
+    result.Set("memorySize", Napi::Number::New(info.Env(), static_cast<double>(stats.memorySize)));
+
+    return result;
+}
+
+Napi::Value AddonNgramCache::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+void AddonNgramCache::init(Napi::Object exports) {
+    exports.Set(
+        "AddonNgramCache",
+        DefineClass(
+            exports.Env(),
+            "AddonNgramCache",
+            {
+                InstanceMethod("draft", &AddonNgramCache::Draft),
+                InstanceMethod("recordAcceptedTokens", &AddonNgramCache::RecordAcceptedTokens),
+                InstanceMethod("getStats", &AddonNgramCache::GetStats),
+                InstanceMethod("dispose", &AddonNgramCache::Dispose),
+            }
+        )
+    );
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <memory>
+#include "llama.h"
+#include "napi.h"
+#include "addonGlobals.h"
+#include "AddonModel.h"
+#include "utils/TokenNgramCache.h"
+
+class AddonNgramCache : public Napi::ObjectWrap<AddonNgramCache> {
+    public:
+        AddonModel* model;
+        std::shared_ptr<TokenNgramCache> cache; // shared by all models with the same vocabulary
+        bool disposed = false;
+
+        AddonNgramCache(const Napi::CallbackInfo& info);
+        ~AddonNgramCache();
+
+        void dispose();
+
+        Napi::Value Draft(const Napi::CallbackInfo& info);
+        Napi::Value RecordAcceptedTokens(const Napi::CallbackInfo& info);
+        Napi::Value GetStats(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
@@ -6,6 +6,7 @@
 
 #include "AddonGrammarEvaluationState.h"
 #include "AddonSampler.h"
+#include "utils/TokenNgramCache.h"
 
 AddonSampler::AddonSampler(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonSampler>(info) {
     model = Napi::ObjectWrap<AddonModel>::Unwrap(info[0].As<Napi::Object>());
@@ -137,7 +138,27 @@ void AddonSampler::rebuildChainIfNeeded() {
     }
 }
 
-void AddonSampler::acceptToken(llama_token token) {
+llama_token_data_array AddonSampler::applyChain(const float * logits) {
+    rebuildChainIfNeeded();
+
+    const int n_vocab = llama_vocab_n_tokens(model->vocab);
+    for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+        tokenCandidates[token_id] = llama_token_data{token_id, logits[token_id], 0.0f};
+    }
+
+    llama_token_data_array cur_p = {
+        /* .data       = */ tokenCandidates.data(),
+        /* .size       = */ tokenCandidates.size(),
+        /* .selected   = */ -1,
+        /* .sorted     = */ false,
+    };
+
+    llama_sampler_apply(chain, &cur_p);
+
+    return cur_p;
+}
+
+void AddonSampler::acceptToken(llama_token token, bool learnNgram) {
     if (repeatPenaltySampler != nullptr) {
         llama_sampler_accept(repeatPenaltySampler, token);
         repeatPenalty_lastTokens.push_back(token);
@@ -146,12 +167,81 @@ void AddonSampler::acceptToken(llama_token token) {
     if (grammarEvaluationState != nullptr && grammarEvaluationState->sampler != nullptr && !llama_vocab_is_eog(model->vocab, token)) {
         llama_sampler_accept(grammarEvaluationState->sampler, token);
     }
+
+    if (learnNgram) {
+        learnNgramToken(token);
+    }
+}
+
+void AddonSampler::learnNgramToken(llama_token token) {
+    TokenNgramCache* ngramCache = model->ngramCache.load(std::memory_order_acquire);
+    if (ngramCache != nullptr) {
+        ngramCache->learn(ngramCacheHistory.data(), ngramCacheHistory.size(), token);
+
+        if (ngramCacheHistory.size() == TokenNgramCache::maxOrder) {
+            ngramCacheHistory.erase(ngramCacheHistory.begin());
+        }
+        ngramCacheHistory.push_back(token);
+    }
+}
+
+AddonSamplerStateSnapshot AddonSampler::takeStateSnapshot() {
+    AddonSamplerStateSnapshot snapshot;
+
+    if (repeatPenaltySampler != nullptr) {
+        snapshot.repeatPenaltySampler = llama_sampler_clone(repeatPenaltySampler);
+        snapshot.repeatPenalty_lastTokens = repeatPenalty_lastTokens;
+    }
+
+    if (grammarEvaluationState != nullptr && grammarEvaluationState->sampler != nullptr) {
+        snapshot.grammarSampler = llama_sampler_clone(grammarEvaluationState->sampler);
+    }
+
+    return snapshot;
+}
+
+void AddonSampler::restoreStateSnapshot(AddonSamplerStateSnapshot& snapshot) {
+    // the chain references the samplers that are about to be replaced
+    freeChain();
+
+    if (snapshot.repeatPenaltySampler != nullptr) {
+        if (repeatPenaltySampler != nullptr) {
+            llama_sampler_free(repeatPenaltySampler);
+            repeatPenaltySampler = snapshot.repeatPenaltySampler;
+            repeatPenalty_lastTokens = snapshot.repeatPenalty_lastTokens;
+        } else {
+            llama_sampler_free(snapshot.repeatPenaltySampler);
+        }
+
+        snapshot.repeatPenaltySampler = nullptr;
+    }
+
+    if (snapshot.grammarSampler != nullptr) {
+        if (grammarEvaluationState != nullptr && grammarEvaluationState->sampler != nullptr) {
+            llama_sampler_free(grammarEvaluationState->sampler);
+            grammarEvaluationState->sampler = snapshot.grammarSampler;
+        } else {
+            llama_sampler_free(snapshot.grammarSampler);
+        }
+
+        snapshot.grammarSampler = nullptr;
+    }
 }
 
 Napi::Value AddonSampler::Dispose(const Napi::CallbackInfo& info) {
     dispose();
     return info.Env().Undefined();
 }
+Napi::Value AddonSampler::LearnNgramToken(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Sampler is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    learnNgramToken(static_cast<llama_token>(info[0].As<Napi::Number>().Uint32Value()));
+
+    return info.Env().Undefined();
+}
 Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
     if (disposed) {
         Napi::Error::New(info.Env(), "Sampler is disposed").ThrowAsJavaScriptException();
@@ -276,10 +366,12 @@ Napi::Value AddonSampler::ApplyConfig(const Napi::CallbackInfo& info) {
             }
 
             seedSampler = llama_sampler_init_dist(seedSampler_seed);
+            rejectionSamplingRng.seed(seedSampler_seed);
         }
     } else if (seedSampler == nullptr) {
         freeChain();
         seedSampler = llama_sampler_init_dist(time(NULL));
+        rejectionSamplingRng.seed(time(NULL));
     }
 
     if (config.Has("repeatPenaltyTokens")) {
@@ -503,6 +595,7 @@ void AddonSampler::init(Napi::Object exports) {
             {
                 InstanceMethod("dispose", &AddonSampler::Dispose),
                 InstanceMethod("applyConfig", &AddonSampler::ApplyConfig),
+                InstanceMethod("learnNgramToken", &AddonSampler::LearnNgramToken),
                 StaticMethod("acceptGrammarEvaluationStateToken", &AddonSampler::AcceptGrammarEvaluationStateToken),
                 StaticMethod("canBeNextTokenForGrammarEvaluationState", &AddonSampler::CanBeNextTokenForGrammarEvaluationState),
             }
@@ -1,10 +1,18 @@
 #pragma once
+#include <random>
 #include "llama.h"
 #include "napi.h"
 #include "RingBuffer.h"
 #include "addonGlobals.h"
 #include "AddonModel.h"
 
+// a copy of the stateful parts of a sampler, used to undo tokens that were accepted speculatively
+struct AddonSamplerStateSnapshot {
+    llama_sampler * repeatPenaltySampler = nullptr;
+    RingBuffer<llama_token> repeatPenalty_lastTokens = RingBuffer<llama_token>(0);
+    llama_sampler * grammarSampler = nullptr;
+};
+
 class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
     public:
         AddonModel* model;
@@ -28,6 +36,7 @@ class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
         
         llama_sampler * seedSampler = nullptr;
         uint32_t seedSampler_seed = 0;
+        std::mt19937 rejectionSamplingRng; // seeded together with `seedSampler`
 
         llama_sampler * repeatPenaltySampler = nullptr;
         RingBuffer<llama_token> repeatPenalty_lastTokens = RingBuffer<llama_token>(64);
@@ -43,6 +52,9 @@ class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
 
         std::vector<llama_token_data> tokenCandidates;
 
+        // the last accepted tokens, used as the context of the accepted token when learning n-grams into the model's n-gram cache
+        std::vector<llama_token> ngramCacheHistory;
+
         bool disposed = false;
 
         AddonSampler(const Napi::CallbackInfo& info);
@@ -51,10 +63,15 @@ class AddonSampler : public Napi::ObjectWrap<AddonSampler> {
         void dispose();
         void freeChain();
         void rebuildChainIfNeeded();
-        void acceptToken(llama_token token);
+        llama_token_data_array applyChain(const float * logits);
+        void acceptToken(llama_token token, bool learnNgram = true);
+        void learnNgramToken(llama_token token);
+        AddonSamplerStateSnapshot takeStateSnapshot();
+        void restoreStateSnapshot(AddonSamplerStateSnapshot& snapshot);
 
         Napi::Value Dispose(const Napi::CallbackInfo& info);
         Napi::Value ApplyConfig(const Napi::CallbackInfo& info);
+        Napi::Value LearnNgramToken(const Napi::CallbackInfo& info);
 
         static Napi::Value AcceptGrammarEvaluationStateToken(const Napi::CallbackInfo& info);
         static Napi::Value CanBeNextTokenForGrammarEvaluationState(const Napi::CallbackInfo& info);
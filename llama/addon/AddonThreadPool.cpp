@@ -0,0 +1,212 @@
+#include <algorithm>
+#include "common/common.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include "addonGlobals.h"
+#include "AddonThreadPool.h"
+
+// the CPU backend may be loaded dynamically, so its threadpool functions are resolved through the backend registry
+template <typename T>
+static T* getCpuBackendFunction(const char* name) {
+    ggml_backend_dev_t cpuDevice = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    if (cpuDevice == nullptr) {
+        return nullptr;
+    }
+
+    ggml_backend_reg_t cpuBackendReg = ggml_backend_dev_backend_reg(cpuDevice);
+    if (cpuBackendReg == nullptr) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<T*>(ggml_backend_reg_get_proc_address(cpuBackendReg, name));
+}
+
+static bool parseSchedulingPriority(const std::string& priority, ggml_sched_priority& result) {
+    if (priority == "normal") {
+        result = GGML_SCHED_PRIO_NORMAL;
+    } else if (priority == "medium") {
+        result = GGML_SCHED_PRIO_MEDIUM;
+    } else if (priority == "high") {
+        result = GGML_SCHED_PRIO_HIGH;
+    } else if (priority == "realtime") {
+        result = GGML_SCHED_PRIO_REALTIME;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+AddonThreadPool::AddonThreadPool(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonThreadPool>(info) {
+    int32_t threads = info[0].As<Napi::Number>().Int32Value();
+    if (threads <= 0) {
+        threads = std::max(cpu_get_num_math(), 1);
+    }
+
+    ggml_threadpool_params_init(&params, std::min(threads, GGML_MAX_N_THREADS));
+
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+
+        if (options.Has("cpus")) {
+            Napi::Uint32Array cpus = options.Get("cpus").As<Napi::Uint32Array>();
+
+            for (size_t i = 0; i < cpus.ElementLength(); i++) {
+                if (cpus[i] < GGML_MAX_N_THREADS) {
+                    params.cpumask[cpus[i]] = true;
+                }
+            }
+        }
+
+        if (options.Has("strictCpuPlacement")) {
+            params.strict_cpu = options.Get("strictCpuPlacement").As<Napi::Boolean>().Value();
+        }
+
+        if (options.Has("priority")) {
+            const auto priority = options.Get("priority").As<Napi::String>().Utf8Value();
+
+            if (!parseSchedulingPriority(priority, params.prio)) {
+                Napi::Error::New(info.Env(), "Invalid thread pool priority: " + priority).ThrowAsJavaScriptException();
+                return;
+            }
+        }
+
+        if (options.Has("poll")) {
+            params.poll = std::min<uint32_t>(100, options.Get("poll").As<Napi::Number>().Uint32Value());
+        }
+    }
+
+    auto threadpoolNew = getCpuBackendFunction<decltype(ggml_threadpool_new)>("ggml_threadpool_new");
+    if (threadpoolNew == nullptr) {
+        Napi::Error::New(info.Env(), "The CPU backend is not available").ThrowAsJavaScriptException();
+        return;
+    }
+
+    threadpool = threadpoolNew(&params);
+    if (threadpool == nullptr) {
+        Napi::Error::New(info.Env(), "Failed to create a thread pool").ThrowAsJavaScriptException();
+        return;
+    }
+}
+AddonThreadPool::~AddonThreadPool() {
+    disposed = true;
+    freeThreadPoolIfUnused();
+}
+
+void AddonThreadPool::attachContext() {
+    attachedContexts++;
+}
+
+void AddonThreadPool::detachContext() {
+    if (attachedContexts > 0) {
+        attachedContexts--;
+    }
+
+    freeThreadPoolIfUnused();
+}
+
+void AddonThreadPool::freeThreadPoolIfUnused() {
+    if (!disposed || attachedContexts > 0 || threadpool == nullptr) {
+        return;
+    }
+
+    auto threadpoolFree = getCpuBackendFunction<decltype(ggml_threadpool_free)>("ggml_threadpool_free");
+    if (threadpoolFree != nullptr) {
+        threadpoolFree(threadpool);
+    }
+
+    threadpool = nullptr;
+}
+
+Napi::Value AddonThreadPool::GetThreads(const Napi::CallbackInfo& info) {
+    return Napi::Number::From(info.Env(), params.n_threads);
+}
+
+void AddonThreadPool::applyRequestedPauseState() {
+    if (threadpool == nullptr) {
+        return;
+    }
+
+    if (pauseRequested.load()) {
+        auto threadpoolPause = getCpuBackendFunction<decltype(ggml_threadpool_pause)>("ggml_threadpool_pause");
+        if (threadpoolPause != nullptr) {
+            threadpoolPause(threadpool);
+        }
+    } else if (resumeRequested.exchange(false)) {
+        auto threadpoolResume = getCpuBackendFunction<decltype(ggml_threadpool_resume)>("ggml_threadpool_resume");
+        if (threadpoolResume != nullptr) {
+            threadpoolResume(threadpool);
+        }
+    }
+}
+
+void AddonThreadPool::applyRequestedPauseStateIfIdle() {
+    // when a context is computing on the threadpool, it applies the requested state once it's done
+    std::unique_lock<std::mutex> lock(computeMutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        applyRequestedPauseState();
+    }
+}
+
+Napi::Value AddonThreadPool::Pause(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Thread pool is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    pauseRequested = true;
+    resumeRequested = false;
+    applyRequestedPauseStateIfIdle();
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonThreadPool::Resume(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Thread pool is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    pauseRequested = false;
+    resumeRequested = true;
+    applyRequestedPauseStateIfIdle();
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonThreadPool::Dispose(const Napi::CallbackInfo& info) {
+    // the threadpool is freed only after all the contexts that use it are disposed
+    disposed = true;
+    freeThreadPoolIfUnused();
+
+    return info.Env().Undefined();
+}
+
+void AddonThreadPool::init(Napi::Object exports) {
+    exports.Set(
+        "AddonThreadPool",
+        DefineClass(
+            exports.Env(),
+            "AddonThreadPool",
+            {
+                InstanceMethod("getThreads", &AddonThreadPool::GetThreads),
+                InstanceMethod("pause", &AddonThreadPool::Pause),
+                InstanceMethod("resume", &AddonThreadPool::Resume),
+                InstanceMethod("dispose", &AddonThreadPool::Dispose),
+            }
+        )
+    );
+}
+
+AddonThreadPoolComputeLock::AddonThreadPoolComputeLock(AddonThreadPool* threadPool) : threadPool(threadPool) {
+    if (threadPool != nullptr) {
+        threadPool->computeMutex.lock();
+    }
+}
+AddonThreadPoolComputeLock::~AddonThreadPoolComputeLock() {
+    if (threadPool != nullptr) {
+        threadPool->applyRequestedPauseState();
+        threadPool->computeMutex.unlock();
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include "ggml.h"
+#include "napi.h"
+#include "addonGlobals.h"
+
+// A ggml compute threadpool that can be attached to multiple contexts.
+// The contexts take turns using the threadpool, so concurrent decodes share the same workers instead of oversubscribing the CPU
+class AddonThreadPool : public Napi::ObjectWrap<AddonThreadPool> {
+    public:
+        ggml_threadpool_params params;
+        ggml_threadpool* threadpool = nullptr;
+
+        // held while a graph of an attached context is computed on the threadpool
+        std::mutex computeMutex;
+
+        // pausing and resuming is requested from the JS thread without waiting for a running compute to finish,
+        // and is applied by whoever holds `computeMutex` next, right before releasing it.
+        // a compute resumes a paused threadpool, so a requested pause is applied again after each compute
+        std::atomic<bool> pauseRequested{false};
+        std::atomic<bool> resumeRequested{false};
+
+        // only accessed on the JS thread, so contexts attach and detach in `Init` and in the completion of their unload
+        uint32_t attachedContexts = 0;
+        bool disposed = false;
+
+        AddonThreadPool(const Napi::CallbackInfo& info);
+        ~AddonThreadPool();
+
+        void attachContext();
+        void detachContext();
+        void freeThreadPoolIfUnused();
+        void applyRequestedPauseState();
+        void applyRequestedPauseStateIfIdle();
+
+        Napi::Value GetThreads(const Napi::CallbackInfo& info);
+        Napi::Value Pause(const Napi::CallbackInfo& info);
+        Napi::Value Resume(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
+
+// locks the compute mutex of a threadpool (when there is one) and applies the requested pause state when it's released
+class AddonThreadPoolComputeLock {
+    public:
+        explicit AddonThreadPoolComputeLock(AddonThreadPool* threadPool);
+        ~AddonThreadPoolComputeLock();
+
+        AddonThreadPoolComputeLock(const AddonThreadPoolComputeLock&) = delete;
+        AddonThreadPoolComputeLock& operator=(const AddonThreadPoolComputeLock&) = delete;
+
+    private:
+        AddonThreadPool* threadPool;
+};
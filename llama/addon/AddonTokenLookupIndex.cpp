@@ -0,0 +1,149 @@
+#include <algorithm>
+#include "llama.h"
+
+#include "addonGlobals.h"
+#include "AddonTokenLookupIndex.h"
+
+AddonTokenLookupIndex::AddonTokenLookupIndex(const Napi::CallbackInfo& info) : Napi::ObjectWrap<AddonTokenLookupIndex>(info) {}
+AddonTokenLookupIndex::~AddonTokenLookupIndex() {
+    dispose();
+}
+
+void AddonTokenLookupIndex::dispose() {
+    if (disposed) {
+        return;
+    }
+
+    disposed = true;
+    automaton.clear();
+    stateTokens.clear();
+    stateTokens.shrink_to_fit();
+}
+
+void AddonTokenLookupIndex::rematchStateTokens() {
+    automaton.clearMatch();
+
+    for (const auto token : stateTokens) {
+        automaton.matchToken(token);
+    }
+}
+
+Napi::Value AddonTokenLookupIndex::SetInputTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Token lookup index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    const size_t tokensCount = tokens.ElementLength();
+    const auto& indexedTokens = automaton.getTokens();
+
+    // when the new input tokens continue the indexed ones, only the new tokens are added to the index
+    bool continuesIndexedTokens = tokensCount >= indexedTokens.size();
+    for (size_t i = 0; continuesIndexedTokens && i < indexedTokens.size(); i++) {
+        continuesIndexedTokens = indexedTokens[i] == static_cast<llama_token>(tokens[i]);
+    }
+
+    if (continuesIndexedTokens && tokensCount == indexedTokens.size()) {
+        return info.Env().Undefined();
+    }
+
+    size_t firstNewTokenIndex = indexedTokens.size();
+    if (!continuesIndexedTokens) {
+        automaton.clear();
+        firstNewTokenIndex = 0;
+    }
+
+    automaton.reserve(tokensCount);
+    for (size_t i = firstNewTokenIndex; i < tokensCount; i++) {
+        automaton.addToken(static_cast<llama_token>(tokens[i]));
+    }
+
+    rematchStateTokens();
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonTokenLookupIndex::SetStateTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Token lookup index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    stateTokens.resize(tokens.ElementLength());
+    for (size_t i = 0; i < stateTokens.size(); i++) {
+        stateTokens[i] = static_cast<llama_token>(tokens[i]);
+    }
+
+    rematchStateTokens();
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonTokenLookupIndex::PushStateTokens(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Token lookup index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    Napi::Uint32Array tokens = info[0].As<Napi::Uint32Array>();
+    for (size_t i = 0; i < tokens.ElementLength(); i++) {
+        const auto token = static_cast<llama_token>(tokens[i]);
+
+        stateTokens.push_back(token);
+        automaton.matchToken(token);
+    }
+
+    return info.Env().Undefined();
+}
+
+Napi::Value AddonTokenLookupIndex::Predict(const Napi::CallbackInfo& info) {
+    if (disposed) {
+        Napi::Error::New(info.Env(), "Token lookup index is disposed").ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+    }
+
+    const auto patternMinLength = info[0].As<Napi::Number>().Uint32Value();
+    const auto patternMaxLength = info[1].As<Napi::Number>().Uint32Value();
+    const auto predictionMinLength = info[2].As<Napi::Number>().Uint32Value();
+    const auto predictionMaxLength = info[3].As<Napi::Number>().Uint32Value();
+
+    std::vector<llama_token> prediction;
+    automaton.findContinuation(
+        std::max(1u, patternMinLength),
+        patternMaxLength,
+        std::max(1u, predictionMinLength),
+        predictionMaxLength,
+        prediction
+    );
+
+    Napi::Uint32Array result = Napi::Uint32Array::New(info.Env(), prediction.size());
+    for (size_t i = 0; i < prediction.size(); i++) {
+        result[i] = static_cast<uint32_t>(prediction[i]);
+    }
+
+    return result;
+}
+
+Napi::Value AddonTokenLookupIndex::Dispose(const Napi::CallbackInfo& info) {
+    dispose();
+    return info.Env().Undefined();
+}
+
+void AddonTokenLookupIndex::init(Napi::Object exports) {
+    exports.Set(
+        "AddonTokenLookupIndex",
+        DefineClass(
+            exports.Env(),
+            "AddonTokenLookupIndex",
+            {
+                InstanceMethod("setInputTokens", &AddonTokenLookupIndex::SetInputTokens),
+                InstanceMethod("setStateTokens", &AddonTokenLookupIndex::SetStateTokens),
+                InstanceMethod("pushStateTokens", &AddonTokenLookupIndex::PushStateTokens),
+                InstanceMethod("predict", &AddonTokenLookupIndex::Predict),
+                InstanceMethod("dispose", &AddonTokenLookupIndex::Dispose),
+            }
+        )
+    );
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include "llama.h"
+#include "napi.h"
+#include "addonGlobals.h"
+#include "utils/TokenSuffixAutomaton.h"
+
+class AddonTokenLookupIndex : public Napi::ObjectWrap<AddonTokenLookupIndex> {
+    public:
+        // indexes the input tokens, and matches the state tokens against them
+        TokenSuffixAutomaton automaton;
+        std::vector<llama_token> stateTokens;
+        bool disposed = false;
+
+        AddonTokenLookupIndex(const Napi::CallbackInfo& info);
+        ~AddonTokenLookupIndex();
+
+        void dispose();
+        void rematchStateTokens();
+
+        Napi::Value SetInputTokens(const Napi::CallbackInfo& info);
+        Napi::Value SetStateTokens(const Napi::CallbackInfo& info);
+        Napi::Value PushStateTokens(const Napi::CallbackInfo& info);
+        Napi::Value Predict(const Napi::CallbackInfo& info);
+        Napi::Value Dispose(const Napi::CallbackInfo& info);
+
+        static void init(Napi::Object exports);
+};
@@ -5,11 +5,20 @@
 #include "AddonGrammarEvaluationState.h"
 #include "AddonSampler.h"
 #include "AddonContext.h"
+#include "AddonEmbeddingIndex.h"
+#include "AddonTokenLookupIndex.h"
+#include "AddonNgramCache.h"
+#include "AddonThreadPool.h"
 #include "globals/addonLog.h"
 #include "globals/addonProgress.h"
+#include "globals/addonExecutor.h"
 #include "globals/getGpuInfo.h"
+#include "globals/getNumaNodes.h"
 #include "globals/getSwapInfo.h"
 #include "globals/getMemoryInfo.h"
+#include "globals/getMemoryUsage.h"
+#include "globals/getPagingStats.h"
+#include "globals/readGgufFileHeader.h"
 
 #include <atomic>
 
@@ -100,10 +109,10 @@ Napi::Value addonGetConsts(const Napi::CallbackInfo& info) {
     return consts;
 }
 
-class AddonBackendLoadWorker : public Napi::AsyncWorker {
+class AddonBackendLoadWorker : public AddonAsyncWorker {
     public:
         AddonBackendLoadWorker(const Napi::Env& env)
-            : Napi::AsyncWorker(env, "AddonBackendLoadWorker"),
+            : AddonAsyncWorker(env, "AddonBackendLoadWorker", AddonExecutorLane::load),
               deferred(Napi::Promise::Deferred::New(env)) {
         }
         ~AddonBackendLoadWorker() {
@@ -146,10 +155,10 @@ class AddonBackendLoadWorker : public Napi::AsyncWorker {
 };
 
 
-class AddonBackendUnloadWorker : public Napi::AsyncWorker {
+class AddonBackendUnloadWorker : public AddonAsyncWorker {
     public:
         AddonBackendUnloadWorker(const Napi::Env& env)
-            : Napi::AsyncWorker(env, "AddonBackendUnloadWorker"),
+            : AddonAsyncWorker(env, "AddonBackendUnloadWorker", AddonExecutorLane::load),
               deferred(Napi::Promise::Deferred::New(env)) {
         }
         ~AddonBackendUnloadWorker() {
@@ -292,8 +301,13 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
         Napi::PropertyDescriptor::Function("ensureGpuDeviceIsSupported", ensureGpuDeviceIsSupported),
         Napi::PropertyDescriptor::Function("getSwapInfo", getSwapInfo),
         Napi::PropertyDescriptor::Function("getMemoryInfo", getMemoryInfo),
+        Napi::PropertyDescriptor::Function("getMemoryUsage", getMemoryUsage),
         Napi::PropertyDescriptor::Function("loadBackends", addonLoadBackends),
         Napi::PropertyDescriptor::Function("setNuma", addonSetNuma),
+        Napi::PropertyDescriptor::Function("getNumaNodes", getNumaNodes),
+        Napi::PropertyDescriptor::Function("getExecutorMetrics", getExecutorMetrics),
+        Napi::PropertyDescriptor::Function("getPagingStats", getPagingStats),
+        Napi::PropertyDescriptor::Function("readGgufFileHeader", readGgufFileHeader),
         Napi::PropertyDescriptor::Function("init", addonInit),
         Napi::PropertyDescriptor::Function("dispose", addonDispose),
     });
@@ -303,6 +317,10 @@ Napi::Object registerCallback(Napi::Env env, Napi::Object exports) {
     AddonGrammarEvaluationState::init(exports);
     AddonContext::init(exports);
     AddonSampler::init(exports);
+    AddonEmbeddingIndex::init(exports);
+    AddonTokenLookupIndex::init(exports);
+    AddonNgramCache::init(exports);
+    AddonThreadPool::init(exports);
 
     llama_log_set(addonLlamaCppLogCallback, nullptr);
 
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "addonExecutor.h"
+
+struct AddonExecutorLaneState {
+    const char* name;
+    size_t maxThreads;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::deque<AddonAsyncWorker*> queue;
+    std::vector<std::thread> threads;
+    size_t idleThreads = 0;
+    size_t running = 0;
+    bool shuttingDown = false;
+
+    // workers whose completion couldn't be queued to the JS thread, deleted on shutdown
+    std::vector<AddonAsyncWorker*> orphanedWorkers;
+
+    uint64_t completed = 0;
+    double totalWaitTime = 0; // in milliseconds
+    double maxWaitTime = 0; // in milliseconds
+    double lastWaitTime = 0; // in milliseconds
+
+    AddonExecutorLaneState(const char* name, size_t maxThreads) : name(name), maxThreads(maxThreads) {}
+};
+
+class AddonExecutor {
+    public:
+        // threads are created on demand up to the limit of each lane and then stay alive until the env is torn down
+        AddonExecutorLaneState lanes[4] = {
+            {"compute", 32},
+            {"io", 4},
+            {"load", 4},
+            {"prefetch", 4}
+        };
+
+        // set before the lane threads are joined, so long-running workers (like a rate-limited prefetch) stop early
+        std::atomic<bool> stopping{false};
+
+        static AddonExecutor* get(Napi::Env env) {
+            std::lock_guard<std::mutex> lock(executorsMutex);
+
+            auto it = executors.find(env);
+            if (it != executors.end()) {
+                return it->second;
+            }
+
+            AddonExecutor* executor = new AddonExecutor(env);
+            executors[env] = executor;
+            return executor;
+        }
+
+        void enqueue(AddonAsyncWorker* worker) {
+            // keeps the event loop alive only while there are pending workers
+            if (pendingWorkers++ == 0) {
+                completionCallback.Ref(env);
+            }
+
+            AddonExecutorLaneState& lane = lanes[static_cast<size_t>(worker->lane)];
+            std::lock_guard<std::mutex> lock(lane.mutex);
+
+            worker->queueTime = std::chrono::steady_clock::now();
+            lane.queue.push_back(worker);
+
+            if (lane.queue.size() > lane.idleThreads && lane.threads.size() < lane.maxThreads) {
+                lane.threads.emplace_back(&AddonExecutor::runLane, this, &lane);
+            }
+
+            lane.workAvailable.notify_one();
+        }
+
+        // called on a lane thread after the worker has run
+        void complete(AddonAsyncWorker* worker) {
+            napi_status status = completionCallback.BlockingCall(worker, [](Napi::Env env, Napi::Function, AddonAsyncWorker* worker) {
+                // `env` is null when the env is torn down with completions still queued,
+                // in which case the executor may already be freed.
+                // the worker is leaked then, since its members can't release their references to JS objects without a live env
+                if (env == nullptr) {
+                    return;
+                }
+
+                std::unique_ptr<AddonAsyncWorker> ownedWorker(worker);
+
+                if (!worker->executor->shutDown) {
+                    worker->complete();
+                    worker->executor->onWorkerCompleted();
+                }
+            });
+
+            if (status != napi_ok) {
+                AddonExecutorLaneState& lane = lanes[static_cast<size_t>(worker->lane)];
+                std::lock_guard<std::mutex> lock(lane.mutex);
+                lane.orphanedWorkers.push_back(worker);
+            }
+        }
+
+    private:
+        static std::mutex executorsMutex;
+        static std::unordered_map<napi_env, AddonExecutor*> executors;
+
+        napi_env env;
+        Napi::ThreadSafeFunction completionCallback;
+        size_t pendingWorkers = 0;
+        bool shutDown = false;
+
+        AddonExecutor(Napi::Env env) : env(env) {
+            // a single completion callback is shared by all the workers of the env.
+            // the executor is freed by its finalizer, after the completions that are still queued on it are dropped
+            completionCallback = Napi::ThreadSafeFunction::New(
+                env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}), "AddonExecutor", 0, 1,
+                [](Napi::Env, AddonExecutor* executor) {
+                    delete executor;
+                },
+                this
+            );
+            completionCallback.Unref(env);
+
+            // added after the thread-safe function is created, so it runs before the thread-safe function is torn down
+            napi_add_env_cleanup_hook(env, AddonExecutor::onEnvCleanup, this);
+        }
+
+        void onWorkerCompleted() {
+            if (--pendingWorkers == 0) {
+                completionCallback.Unref(env);
+            }
+        }
+
+        static void onEnvCleanup(void* data) {
+            static_cast<AddonExecutor*>(data)->shutdown();
+        }
+
+        // runs on the JS thread when the env is torn down.
+        // queued workers are dropped without running, and running workers are signalled to stop
+        // and waited for before the lane threads are joined
+        void shutdown() {
+            stopping = true;
+
+            {
+                std::lock_guard<std::mutex> lock(executorsMutex);
+                executors.erase(env);
+            }
+
+            shutDown = true;
+            std::vector<AddonAsyncWorker*> droppedWorkers;
+
+            for (AddonExecutorLaneState& lane : lanes) {
+                std::lock_guard<std::mutex> lock(lane.mutex);
+                lane.shuttingDown = true;
+                droppedWorkers.insert(droppedWorkers.end(), lane.queue.begin(), lane.queue.end());
+                lane.queue.clear();
+                lane.workAvailable.notify_all();
+            }
+
+            for (AddonExecutorLaneState& lane : lanes) {
+                for (std::thread& thread : lane.threads) {
+                    thread.join();
+                }
+
+                droppedWorkers.insert(droppedWorkers.end(), lane.orphanedWorkers.begin(), lane.orphanedWorkers.end());
+                lane.orphanedWorkers.clear();
+            }
+
+            for (AddonAsyncWorker* worker : droppedWorkers) {
+                delete worker;
+            }
+
+            completionCallback.Release();
+        }
+
+        void runLane(AddonExecutorLaneState* lane) {
+            std::unique_lock<std::mutex> lock(lane->mutex);
+
+            while (true) {
+                lane->idleThreads++;
+                lane->workAvailable.wait(lock, [lane] { return !lane->queue.empty() || lane->shuttingDown; });
+                lane->idleThreads--;
+
+                if (lane->shuttingDown) {
+                    break;
+                }
+
+                AddonAsyncWorker* worker = lane->queue.front();
+                lane->queue.pop_front();
+
+                const double waitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - worker->queueTime).count();
+                lane->totalWaitTime += waitTime;
+                lane->lastWaitTime = waitTime;
+                lane->maxWaitTime = std::max(lane->maxWaitTime, waitTime);
+                lane->running++;
+
+                lock.unlock();
+                worker->run();
+                lock.lock();
+
+                lane->running--;
+                lane->completed++;
+            }
+        }
+};
+
+std::mutex AddonExecutor::executorsMutex;
+std::unordered_map<napi_env, AddonExecutor*> AddonExecutor::executors;
+
+AddonAsyncWorker::AddonAsyncWorker(const Napi::Env& env, const char* resourceName, AddonExecutorLane lane)
+    : env(env),
+      resourceName(resourceName),
+      lane(lane) {
+}
+
+Napi::Env AddonAsyncWorker::Env() const {
+    return env;
+}
+
+void AddonAsyncWorker::SetError(const std::string& error) {
+    this->error = error;
+    hasError = true;
+}
+
+bool AddonAsyncWorker::IsExecutorStopping() const {
+    return executor != nullptr && executor->stopping.load();
+}
+
+void AddonAsyncWorker::Queue() {
+    executor = AddonExecutor::get(env);
+    executor->enqueue(this);
+}
+
+void AddonAsyncWorker::run() {
+    try {
+        Execute();
+    } catch (const std::exception& e) {
+        SetError(e.what());
+    } catch(...) {
+        SetError("Unknown error when running \"" + resourceName + "\"");
+    }
+
+    // the worker may be deleted as soon as the completion is queued
+    executor->complete(this);
+}
+
+void AddonAsyncWorker::complete() {
+    Napi::HandleScope scope(env);
+
+    if (hasError) {
+        OnError(Napi::Error::New(env, error));
+    } else {
+        OnOK();
+    }
+}
+
+Napi::Value getExecutorMetrics(const Napi::CallbackInfo& info) {
+    Napi::Object result = Napi::Object::New(info.Env());
+    AddonExecutor* executor = AddonExecutor::get(info.Env());
+
+    for (AddonExecutorLaneState& lane : executor->lanes) {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        Napi::Object laneMetrics = Napi::Object::New(info.Env());
+
+        laneMetrics.Set("queued", Napi::Number::New(info.Env(), lane.queue.size()));
+        laneMetrics.Set("running", Napi::Number::New(info.Env(), lane.running));
+        laneMetrics.Set("threads", Napi::Number::New(info.Env(), lane.threads.size()));
+        laneMetrics.Set("completed", Napi::Number::New(info.Env(), lane.completed));
+        laneMetrics.Set("totalWaitTime", Napi::Number::New(info.Env(), lane.totalWaitTime));
+        laneMetrics.Set("maxWaitTime", Napi::Number::New(info.Env(), lane.maxWaitTime));
+        laneMetrics.Set("lastWaitTime", Napi::Number::New(info.Env(), lane.lastWaitTime));
+
+        result.Set(lane.name, laneMetrics);
+    }
+
+    return result;
+}
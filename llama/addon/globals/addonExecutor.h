@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include "napi.h"
+
+// the addon runs its work on its own threads instead of on the libuv threadpool, which is shared with `fs`, `dns` and `zlib`.
+// each lane has its own threads, so a burst of state file I/O or a long model load never delays evaluations.
+// every env has its own executor, which drops its queued work and joins its threads when the env is torn down
+enum class AddonExecutorLane {
+    compute = 0, // decoding, sampling and embeddings
+    io = 1, // saving and loading state files
+    load = 2, // loading and unloading models, contexts, adapters and backends
+    prefetch = 3 // reading model files into the page cache, which can be rate-limited to run for a long time
+};
+
+class AddonExecutor;
+
+// a drop-in replacement for `Napi::AsyncWorker` that runs `Execute` on a lane of the addon executor
+class AddonAsyncWorker {
+    public:
+        AddonAsyncWorker(const Napi::Env& env, const char* resourceName, AddonExecutorLane lane = AddonExecutorLane::compute);
+        virtual ~AddonAsyncWorker() = default;
+
+        void Queue();
+        Napi::Env Env() const;
+
+    protected:
+        virtual void Execute() = 0;
+        virtual void OnOK() {}
+        virtual void OnError(const Napi::Error& err) {}
+
+        void SetError(const std::string& error);
+
+        // whether the env is being torn down, so long-running work should stop early
+        bool IsExecutorStopping() const;
+
+    private:
+        Napi::Env env;
+        std::string resourceName;
+        AddonExecutorLane lane;
+        AddonExecutor* executor = nullptr;
+        std::chrono::steady_clock::time_point queueTime;
+        std::string error;
+        bool hasError = false;
+
+        void run();
+        void complete();
+
+        friend class AddonExecutor;
+};
+
+Napi::Value getExecutorMetrics(const Napi::CallbackInfo& info);
@@ -32,7 +32,7 @@ Napi::Value getMemoryInfo(const Napi::CallbackInfo& info) {
     std::string line;
     bool foundMemoryUsage = false;
     while (std::getline(procStatus, line)) {
-        if (line.rfind("VmSize:", 0) == 0) { // Resident Set Size (current memory usage)
+        if (line.rfind("VmSize:", 0) == 0) { // virtual memory size, which includes the full size of memory-mapped model files
             std::istringstream iss(line);
             std::string key, unit;
             size_t value;
@@ -0,0 +1,163 @@
+#include <string>
+#include <vector>
+#include "getMemoryUsage.h"
+#include "../AddonModel.h"
+#include "../AddonContext.h"
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#elif __linux__
+#include <fstream>
+#include <sstream>
+#elif _WIN32
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+static const size_t processMemoryUsageItems = 6;
+static const size_t modelMemoryUsageItems = 2;
+static const size_t contextMemoryUsageItems = 3;
+
+#ifdef __linux__
+struct ProcMemoryField {
+    const char* key;
+    uint64_t value = 0;
+    bool found = false;
+};
+
+// reads `<key> <value> kB` lines of a `/proc` file
+static void readProcMemoryFields(const char* filePath, ProcMemoryField* fields, size_t fieldsCount) {
+    std::ifstream file(filePath);
+    std::string line;
+    while (std::getline(file, line)) {
+        for (size_t i = 0; i < fieldsCount; i++) {
+            ProcMemoryField& field = fields[i];
+            if (field.found || line.rfind(field.key, 0) != 0) {
+                continue;
+            }
+
+            std::istringstream iss(line);
+            std::string key;
+            uint64_t value;
+            if (iss >> key >> value) {
+                field.value = value * 1024; // convert from kB to bytes
+                field.found = true;
+            }
+            break;
+        }
+    }
+}
+#endif
+
+// fills `[rss, pss, anonymous, fileBacked, swap, virtual]` in bytes, leaving `-1` for values that aren't available on this platform
+static void readProcessMemoryUsage(double* usage) {
+    for (size_t i = 0; i < processMemoryUsageItems; i++) {
+        usage[i] = -1;
+    }
+
+#ifdef __APPLE__
+    struct mach_task_basic_info taskInfo;
+    mach_msg_type_number_t infoCount = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&taskInfo, &infoCount) == KERN_SUCCESS) {
+        usage[0] = (double)taskInfo.resident_size;
+        usage[5] = (double)taskInfo.virtual_size;
+    }
+#elif __linux__
+    // `smaps_rollup` (Linux 4.14+) is the only cheap source of PSS.
+    // `status` provides the rest, and is used instead when `smaps_rollup` is not available
+    ProcMemoryField smapsRollupFields[] = {{"Rss:"}, {"Pss:"}, {"Anonymous:"}, {"Swap:"}};
+    ProcMemoryField statusFields[] = {{"VmRSS:"}, {"VmSize:"}, {"RssAnon:"}, {"VmSwap:"}};
+    readProcMemoryFields("/proc/self/smaps_rollup", smapsRollupFields, 4);
+    readProcMemoryFields("/proc/self/status", statusFields, 4);
+
+    const ProcMemoryField& rss = smapsRollupFields[0].found ? smapsRollupFields[0] : statusFields[0];
+    const ProcMemoryField& pss = smapsRollupFields[1];
+    const ProcMemoryField& anonymous = smapsRollupFields[2].found ? smapsRollupFields[2] : statusFields[2];
+    const ProcMemoryField& swap = smapsRollupFields[3].found ? smapsRollupFields[3] : statusFields[3];
+    const ProcMemoryField& virtualSize = statusFields[1];
+
+    if (rss.found) {
+        usage[0] = (double)rss.value;
+    }
+    if (pss.found) {
+        usage[1] = (double)pss.value;
+    }
+    if (anonymous.found) {
+        usage[2] = (double)anonymous.value;
+    }
+    if (rss.found && anonymous.found && rss.value >= anonymous.value) {
+        usage[3] = (double)(rss.value - anonymous.value);
+    }
+    if (swap.found) {
+        usage[4] = (double)swap.value;
+    }
+    if (virtualSize.found) {
+        usage[5] = (double)virtualSize.value;
+    }
+#elif _WIN32
+    PROCESS_MEMORY_COUNTERS_EX memCounters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memCounters, sizeof(memCounters))) {
+        usage[0] = (double)memCounters.WorkingSetSize;
+        usage[2] = (double)memCounters.PrivateUsage;
+    }
+#endif
+}
+
+// returns a single `Float64Array` of:
+// - `[rss, pss, anonymous, fileBacked, swap, virtual]` of the process
+// - `[fileResidentSize, fileSize]` for each of the given models
+// - `[kvCacheSize, computeBuffersSize, batchSize]` for each of the given contexts
+// all in bytes, with `-1` for values that are not available
+Napi::Value getMemoryUsage(const Napi::CallbackInfo& info) {
+    Napi::Array models = info.Length() > 0 && info[0].IsArray()
+        ? info[0].As<Napi::Array>()
+        : Napi::Array::New(info.Env(), 0);
+    Napi::Array modelsFilePaths = info.Length() > 1 && info[1].IsArray()
+        ? info[1].As<Napi::Array>()
+        : Napi::Array::New(info.Env(), 0);
+    Napi::Array contexts = info.Length() > 2 && info[2].IsArray()
+        ? info[2].As<Napi::Array>()
+        : Napi::Array::New(info.Env(), 0);
+    const bool checkFileResidency = info.Length() > 3 && info[3].IsBoolean() && info[3].As<Napi::Boolean>().Value();
+
+    Napi::Float64Array result = Napi::Float64Array::New(
+        info.Env(),
+        processMemoryUsageItems + models.Length() * modelMemoryUsageItems + contexts.Length() * contextMemoryUsageItems
+    );
+    double* usage = result.Data();
+
+    readProcessMemoryUsage(usage);
+    usage += processMemoryUsageItems;
+
+    for (uint32_t i = 0; i < models.Length(); i++) {
+        AddonModel* model = Napi::ObjectWrap<AddonModel>::Unwrap(models.Get(i).As<Napi::Object>());
+        std::vector<std::string> filePaths;
+
+        if (i < modelsFilePaths.Length()) {
+            Napi::Array filePathsArray = modelsFilePaths.Get(i).As<Napi::Array>();
+            for (uint32_t j = 0; j < filePathsArray.Length(); j++) {
+                filePaths.push_back(filePathsArray.Get(j).As<Napi::String>().Utf8Value());
+            }
+        }
+
+        uint64_t fileSize = 0;
+        usage[0] = model->disposed
+            ? -1
+            : (double)model->getFileResidentSize(filePaths, fileSize, checkFileResidency);
+        usage[1] = model->disposed
+            ? -1
+            : (double)fileSize;
+        usage += modelMemoryUsageItems;
+    }
+
+    for (uint32_t i = 0; i < contexts.Length(); i++) {
+        AddonContext* context = Napi::ObjectWrap<AddonContext>::Unwrap(contexts.Get(i).As<Napi::Object>());
+
+        usage[0] = (double)context->kvCacheMemorySize;
+        usage[1] = (double)context->computeBuffersMemorySize;
+        usage[2] = (double)context->batchMemorySize;
+        usage += contextMemoryUsageItems;
+    }
+
+    return result;
+}
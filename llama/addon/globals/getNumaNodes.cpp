@@ -0,0 +1,23 @@
+#include "getNumaNodes.h"
+#include "../utils/cpuAffinity.h"
+
+Napi::Value getNumaNodes(const Napi::CallbackInfo& info) {
+    const auto nodes = getNumaNodes();
+
+    Napi::Array result = Napi::Array::New(info.Env(), nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const auto cpus = getNumaNodeCpus(nodes[i]);
+
+        Napi::Array cpusArray = Napi::Array::New(info.Env(), cpus.size());
+        for (size_t j = 0; j < cpus.size(); j++) {
+            cpusArray.Set(j, Napi::Number::New(info.Env(), cpus[j]));
+        }
+
+        Napi::Object node = Napi::Object::New(info.Env());
+        node.Set("node", Napi::Number::New(info.Env(), nodes[i]));
+        node.Set("cpus", cpusArray);
+        result.Set(i, node);
+    }
+
+    return result;
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "napi.h"
+
+Napi::Value getNumaNodes(const Napi::CallbackInfo& info);
@@ -0,0 +1,16 @@
+#include "getPagingStats.h"
+#include "../utils/pageFaults.h"
+
+Napi::Value getPagingStats(const Napi::CallbackInfo& info) {
+    PageFaultCounts pageFaults;
+    const bool pageFaultsAvailable = getProcessPageFaults(pageFaults);
+
+    uint64_t swappedInPages = 0;
+    const bool swappedInPagesAvailable = getSystemSwappedInPages(swappedInPages);
+
+    Napi::Object obj = Napi::Object::New(info.Env());
+    obj.Set("majorPageFaults", Napi::Number::New(info.Env(), pageFaultsAvailable ? (double)pageFaults.major : -1));
+    obj.Set("minorPageFaults", Napi::Number::New(info.Env(), pageFaultsAvailable ? (double)pageFaults.minor : -1));
+    obj.Set("swappedInPages", Napi::Number::New(info.Env(), swappedInPagesAvailable ? (double)swappedInPages : -1));
+    return obj;
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "napi.h"
+
+Napi::Value getPagingStats(const Napi::CallbackInfo& info);
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "readGgufFileHeader.h"
+#include "addonExecutor.h"
+#include "../utils/FileMapping.h"
+
+// source: `enum gguf_type` in `gguf.h` in the `llama.cpp` source code
+enum GgufValueType : uint32_t {
+    GgufValueTypeUint8 = 0,
+    GgufValueTypeInt8 = 1,
+    GgufValueTypeUint16 = 2,
+    GgufValueTypeInt16 = 3,
+    GgufValueTypeUint32 = 4,
+    GgufValueTypeInt32 = 5,
+    GgufValueTypeFloat32 = 6,
+    GgufValueTypeBool = 7,
+    GgufValueTypeString = 8,
+    GgufValueTypeArray = 9,
+    GgufValueTypeUint64 = 10,
+    GgufValueTypeInt64 = 11,
+    GgufValueTypeFloat64 = 12
+};
+
+static const uint32_t ggufDefaultAlignment = 32;
+static const uint32_t ggufMaxTensorDimensions = 4;
+
+// the smallest tensor info: an empty name (its length), the dimensions count, the ggml type and the offset
+static const uint64_t ggufMinTensorInfoSize = 8 + 4 + 4 + 8;
+
+// every tensor takes this many items in the tensor table: ggml type, offset, dimensions count, and up to 4 dimensions
+static const size_t tensorTableItemsPerTensor = 3 + ggufMaxTensorDimensions;
+
+class GgufHeaderReader {
+    public:
+        const uint8_t* data;
+        uint64_t size;
+        uint64_t offset = 0;
+
+        GgufHeaderReader(const uint8_t* data, uint64_t size) : data(data), size(size) {}
+
+        template <typename T>
+        T read() {
+            ensureAvailable(sizeof(T));
+
+            T value;
+            std::memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+
+            return value;
+        }
+
+        std::string readString() {
+            const uint64_t length = read<uint64_t>();
+            ensureAvailable(length);
+
+            std::string value((const char*)(data + offset), length);
+            offset += length;
+
+            return value;
+        }
+
+        void skip(uint64_t length) {
+            ensureAvailable(length);
+            offset += length;
+        }
+
+        void skipValue(uint32_t type, uint32_t arrayDepth = 0) {
+            switch (type) {
+                case GgufValueTypeUint8:
+                case GgufValueTypeInt8:
+                case GgufValueTypeBool:
+                    return skip(1);
+                case GgufValueTypeUint16:
+                case GgufValueTypeInt16:
+                    return skip(2);
+                case GgufValueTypeUint32:
+                case GgufValueTypeInt32:
+                case GgufValueTypeFloat32:
+                    return skip(4);
+                case GgufValueTypeUint64:
+                case GgufValueTypeInt64:
+                case GgufValueTypeFloat64:
+                    return skip(8);
+                case GgufValueTypeString:
+                    return skip(read<uint64_t>());
+                case GgufValueTypeArray: {
+                    // GGUF files nest arrays at most one level in practice, so deeper nesting is rejected before it can exhaust the stack
+                    if (arrayDepth >= maxArrayDepth) {
+                        throw std::runtime_error(
+                            "Unsupported GGUF value: arrays are nested more than " + std::to_string(maxArrayDepth) + " levels deep"
+                        );
+                    }
+
+                    const uint32_t itemType = read<uint32_t>();
+                    const uint64_t length = read<uint64_t>();
+                    const uint64_t itemSize = getFixedValueSize(itemType);
+
+                    if (itemSize > 0) {
+                        if (length > (size - offset) / itemSize) {
+                            throwUnexpectedEnd();
+                        }
+
+                        return skip(length * itemSize);
+                    }
+
+                    for (uint64_t i = 0; i < length; i++) {
+                        skipValue(itemType, arrayDepth + 1);
+                    }
+
+                    return;
+                }
+            }
+
+            throw std::runtime_error("Unsupported GGUF value type \"" + std::to_string(type) + "\"");
+        }
+
+    private:
+        static constexpr uint32_t maxArrayDepth = 4;
+
+        void ensureAvailable(uint64_t length) {
+            if (length > size - offset) {
+                throwUnexpectedEnd();
+            }
+        }
+
+        [[noreturn]] static void throwUnexpectedEnd() {
+            throw std::runtime_error("Unexpected end of the GGUF file header");
+        }
+
+        static uint64_t getFixedValueSize(uint32_t type) {
+            switch (type) {
+                case GgufValueTypeUint8:
+                case GgufValueTypeInt8:
+                case GgufValueTypeBool:
+                    return 1;
+                case GgufValueTypeUint16:
+                case GgufValueTypeInt16:
+                    return 2;
+                case GgufValueTypeUint32:
+                case GgufValueTypeInt32:
+                case GgufValueTypeFloat32:
+                    return 4;
+                case GgufValueTypeUint64:
+                case GgufValueTypeInt64:
+                case GgufValueTypeFloat64:
+                    return 8;
+            }
+
+            return 0;
+        }
+};
+
+class AddonReadGgufFileHeaderWorker : public AddonAsyncWorker {
+    public:
+        std::string filePath;
+        bool readTensorInfo;
+
+        std::string magic;
+        uint32_t version = 0;
+        uint64_t tensorCount = 0;
+        uint64_t metadataSize = 0;
+        uint64_t tensorInfoSize = 0;
+        uint64_t tensorDataOffset = 0;
+
+        std::vector<std::string> metadataKeys;
+        std::vector<double> metadataEntries; // value type and value offset of each key
+        std::vector<std::string> tensorNames;
+        std::vector<double> tensorTable;
+
+        AddonReadGgufFileHeaderWorker(const Napi::Env& env, std::string filePath, bool readTensorInfo)
+            : AddonAsyncWorker(env, "AddonReadGgufFileHeaderWorker", AddonExecutorLane::io),
+              filePath(std::move(filePath)),
+              readTensorInfo(readTensorInfo),
+              deferred(Napi::Promise::Deferred::New(env)) {
+        }
+
+        Napi::Promise GetPromise() {
+            return deferred.Promise();
+        }
+
+    protected:
+        Napi::Promise::Deferred deferred;
+        // the file is memory-mapped, so the header is parsed without copying it through read buffers
+        std::unique_ptr<FileMapping> fileMapping;
+
+        void Execute() {
+            fileMapping = std::make_unique<FileMapping>();
+            fileMapping->open(filePath);
+
+            // the header is read sequentially from the start of the file
+            fileMapping->adviseSequential(0, fileMapping->size);
+            GgufHeaderReader reader(fileMapping->data, fileMapping->size);
+
+            magic.assign((const char*)fileMapping->data, std::min<uint64_t>(4, fileMapping->size));
+            if (magic != "GGUF") {
+                return;
+            }
+
+            reader.skip(magic.size());
+            version = reader.read<uint32_t>();
+            if (version == 1) {
+                return;
+            }
+
+            tensorCount = reader.read<uint64_t>();
+            const uint64_t metadataKeysCount = reader.read<uint64_t>();
+            uint32_t alignment = ggufDefaultAlignment;
+
+            for (uint64_t i = 0; i < metadataKeysCount; i++) {
+                std::string key = reader.readString();
+                const uint32_t valueType = reader.read<uint32_t>();
+                const uint64_t valueOffset = reader.offset;
+
+                if (valueType == GgufValueTypeUint32 && key == "general.alignment") {
+                    alignment = reader.read<uint32_t>();
+                    reader.offset = valueOffset;
+                }
+
+                reader.skipValue(valueType);
+
+                metadataKeys.push_back(std::move(key));
+                metadataEntries.push_back(valueType);
+                metadataEntries.push_back((double)valueOffset);
+            }
+
+            metadataSize = reader.offset;
+
+            if (!readTensorInfo) {
+                return;
+            }
+
+            // the tensor count is read from the file, so the reserved size is capped by the number of tensors that can fit
+            // in the rest of the file, to not allocate a huge buffer for a corrupted header
+            const uint64_t reservedTensors = std::min<uint64_t>(tensorCount, (fileMapping->size - reader.offset) / ggufMinTensorInfoSize);
+            tensorNames.reserve(reservedTensors);
+            tensorTable.reserve(reservedTensors * tensorTableItemsPerTensor);
+
+            for (uint64_t i = 0; i < tensorCount; i++) {
+                tensorNames.push_back(reader.readString());
+
+                const uint32_t dimensionsCount = reader.read<uint32_t>();
+                if (dimensionsCount > ggufMaxTensorDimensions) {
+                    throw std::runtime_error("Tensor \"" + tensorNames.back() + "\" has too many dimensions");
+                }
+
+                double dimensions[ggufMaxTensorDimensions] = {0};
+                for (uint32_t d = 0; d < dimensionsCount; d++) {
+                    dimensions[d] = (double)reader.read<uint64_t>();
+                }
+
+                const uint32_t ggmlType = reader.read<uint32_t>();
+                const uint64_t tensorOffset = reader.read<uint64_t>();
+
+                tensorTable.push_back(ggmlType);
+                tensorTable.push_back((double)tensorOffset);
+                tensorTable.push_back(dimensionsCount);
+                tensorTable.insert(tensorTable.end(), dimensions, dimensions + ggufMaxTensorDimensions);
+            }
+
+            tensorInfoSize = reader.offset - metadataSize;
+            tensorDataOffset = alignment == 0
+                ? reader.offset
+                : reader.offset + (alignment - (reader.offset % alignment)) % alignment;
+        }
+        void OnOK() {
+            Napi::Env env = Env();
+            Napi::Object result = Napi::Object::New(env);
+
+            result.Set("magic", Napi::String::New(env, magic));
+            result.Set("version", Napi::Number::New(env, version));
+
+            if (magic == "GGUF" && version != 1) {
+                result.Set("tensorCount", Napi::Number::New(env, (double)tensorCount));
+                result.Set("metadataSize", Napi::Number::New(env, (double)metadataSize));
+
+                // the metadata values are decoded lazily in JS from a single copy of the metadata part of the header
+                Napi::ArrayBuffer header = Napi::ArrayBuffer::New(env, metadataSize);
+                std::memcpy(header.Data(), fileMapping->data, metadataSize);
+                result.Set("header", header);
+
+                Napi::Array keys = Napi::Array::New(env, metadataKeys.size());
+                for (size_t i = 0; i < metadataKeys.size(); i++) {
+                    keys.Set(i, Napi::String::New(env, metadataKeys[i]));
+                }
+                result.Set("metadataKeys", keys);
+
+                Napi::Float64Array entries = Napi::Float64Array::New(env, metadataEntries.size());
+                std::memcpy(entries.Data(), metadataEntries.data(), metadataEntries.size() * sizeof(double));
+                result.Set("metadataEntries", entries);
+
+                if (readTensorInfo) {
+                    Napi::Array names = Napi::Array::New(env, tensorNames.size());
+                    for (size_t i = 0; i < tensorNames.size(); i++) {
+                        names.Set(i, Napi::String::New(env, tensorNames[i]));
+                    }
+                    result.Set("tensorNames", names);
+
+                    Napi::Float64Array table = Napi::Float64Array::New(env, tensorTable.size());
+                    std::memcpy(table.Data(), tensorTable.data(), tensorTable.size() * sizeof(double));
+                    result.Set("tensorTable", table);
+
+                    result.Set("tensorInfoSize", Napi::Number::New(env, (double)tensorInfoSize));
+                    result.Set("tensorDataOffset", Napi::Number::New(env, (double)tensorDataOffset));
+                }
+            }
+
+            fileMapping.reset();
+            deferred.Resolve(result);
+        }
+        void OnError(const Napi::Error& err) {
+            fileMapping.reset();
+            deferred.Reject(err.Value());
+        }
+};
+
+Napi::Value readGgufFileHeader(const Napi::CallbackInfo& info) {
+    const std::string filePath = info[0].As<Napi::String>().Utf8Value();
+    const bool readTensorInfo = info.Length() > 1 && info[1].IsBoolean()
+        ? info[1].As<Napi::Boolean>().Value()
+        : true;
+
+    auto* worker = new AddonReadGgufFileHeaderWorker(info.Env(), filePath, readTensorInfo);
+    worker->Queue();
+    return worker->GetPromise();
+}
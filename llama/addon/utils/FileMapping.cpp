@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "FileMapping.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the residency of large ranges is checked in windows of this many pages, to keep the residency vector small
+static const uint64_t residencyCheckPages = 64 * 1024;
+
+void FileMapping::open(const std::string& filePath) {
+#ifdef _WIN32
+    const int wideFilePathLength = MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, nullptr, 0);
+    std::wstring wideFilePath(wideFilePathLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, wideFilePath.data(), wideFilePathLength);
+
+    HANDLE fileHandle = CreateFileW(
+        wideFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr
+    );
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open the file \"" + filePath + "\"");
+    }
+
+    file = fileHandle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        throw std::runtime_error("Failed to get the size of the file \"" + filePath + "\"");
+    }
+
+    size = (uint64_t)fileSize.QuadPart;
+    if (size == 0) {
+        return;
+    }
+
+    mapping = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        throw std::runtime_error("Failed to map the file \"" + filePath + "\"");
+    }
+
+    data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        throw std::runtime_error("Failed to map the file \"" + filePath + "\"");
+    }
+#else
+    fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open the file \"" + filePath + "\"");
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        throw std::runtime_error("Failed to get the size of the file \"" + filePath + "\"");
+    }
+
+    size = (uint64_t)fileStat.st_size;
+
+#ifdef __linux__
+    residencyKnown = fileStat.st_uid == geteuid() || geteuid() == 0 || faccessat(AT_FDCWD, filePath.c_str(), W_OK, AT_EACCESS) == 0;
+#endif
+
+    if (size == 0) {
+        return;
+    }
+
+    void* mappedData = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mappedData == MAP_FAILED) {
+        throw std::runtime_error("Failed to map the file \"" + filePath + "\"");
+    }
+
+    data = (const uint8_t*)mappedData;
+#endif
+}
+
+FileMapping::~FileMapping() {
+#ifdef _WIN32
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+
+    if (file != nullptr) {
+        CloseHandle(file);
+    }
+#else
+    if (data != nullptr) {
+        munmap((void*)data, size);
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+}
+
+// expands the given range to page boundaries and clamps it to the file size
+static bool resolvePageAlignedRange(uint64_t fileSize, uint64_t& offset, uint64_t& length) {
+    if (offset >= fileSize || length == 0) {
+        return false;
+    }
+
+    const uint64_t pageSize = FileMapping::getPageSize();
+    const uint64_t end = std::min(fileSize, offset + length);
+
+    offset -= offset % pageSize;
+    length = end - offset;
+
+    return true;
+}
+
+void FileMapping::adviseSequential(uint64_t offset, uint64_t length) {
+    if (data == nullptr || !resolvePageAlignedRange(size, offset, length)) {
+        return;
+    }
+
+#ifndef _WIN32
+    posix_madvise((void*)(data + offset), length, POSIX_MADV_SEQUENTIAL);
+#endif
+}
+
+void FileMapping::adviseWillNeed(uint64_t offset, uint64_t length) {
+    if (data == nullptr || !resolvePageAlignedRange(size, offset, length)) {
+        return;
+    }
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (PVOID)(data + offset);
+    range.NumberOfBytes = (SIZE_T)length;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    posix_madvise((void*)(data + offset), length, POSIX_MADV_WILLNEED);
+#endif
+}
+
+int64_t FileMapping::getResidentSize(uint64_t offset, uint64_t length) const {
+    if (data == nullptr || !resolvePageAlignedRange(size, offset, length)) {
+        return 0;
+    }
+
+    if (!residencyKnown) {
+        return -1;
+    }
+
+#ifdef _WIN32
+    // Windows has no API to check whether the pages of a file are in the standby list without adding them to the working set
+    return -1;
+#else
+    const uint64_t pageSize = getPageSize();
+    const uint64_t end = offset + length;
+
+#ifdef __APPLE__
+    std::vector<char> residency;
+#else
+    std::vector<unsigned char> residency;
+#endif
+
+    int64_t residentSize = 0;
+    for (uint64_t windowStart = offset; windowStart < end; windowStart += residencyCheckPages * pageSize) {
+        const uint64_t windowLength = std::min(end - windowStart, residencyCheckPages * pageSize);
+        const uint64_t windowPages = (windowLength + pageSize - 1) / pageSize;
+        residency.resize(windowPages);
+
+        if (mincore((void*)(data + windowStart), windowLength, residency.data()) != 0) {
+            return -1;
+        }
+
+        for (uint64_t i = 0; i < windowPages; i++) {
+            if (residency[i] & 1) {
+                residentSize += std::min(pageSize, end - (windowStart + i * pageSize));
+            }
+        }
+    }
+
+    return residentSize;
+#endif
+}
+
+void FileMapping::touch(uint64_t offset, uint64_t length) const {
+    if (data == nullptr || !resolvePageAlignedRange(size, offset, length)) {
+        return;
+    }
+
+    const uint64_t pageSize = getPageSize();
+    const uint64_t end = offset + length;
+
+    volatile uint8_t sink = 0;
+    for (uint64_t position = offset; position < end; position += pageSize) {
+        sink ^= data[position];
+    }
+    (void)sink;
+}
+
+uint64_t FileMapping::getPageSize() {
+#ifdef _WIN32
+    static const uint64_t pageSize = []() {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        return (uint64_t)systemInfo.dwPageSize;
+    }();
+#else
+    static const uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+
+    return pageSize;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// A read-only memory mapping of a whole file.
+// The mapping shares the page cache with other mappings of the same file (like the one `llama.cpp` loads a model with),
+// so it can be used to check and control which parts of the file are cached in memory
+class FileMapping {
+    public:
+        const uint8_t* data = nullptr;
+        uint64_t size = 0;
+
+        FileMapping() = default;
+        ~FileMapping();
+
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        // throws on failure. the mapping is released by the destructor also when this throws
+        void open(const std::string& filePath);
+
+        // hint that the given range is about to be read sequentially
+        void adviseSequential(uint64_t offset, uint64_t length);
+
+        // start reading the given range into the page cache in the background
+        void adviseWillNeed(uint64_t offset, uint64_t length);
+
+        // the number of bytes of the given range that are cached in memory, or `-1` when it cannot be checked on this platform
+        // or for this file
+        int64_t getResidentSize(uint64_t offset, uint64_t length) const;
+
+        // reads a byte of every page in the given range, so the range is read into the page cache
+        void touch(uint64_t offset, uint64_t length) const;
+
+        static uint64_t getPageSize();
+
+    private:
+        // on Linux, `mincore` reports all the pages of a file as resident when the process neither owns the file nor can write to it,
+        // so the residency of such files is unknown
+        bool residencyKnown = true;
+
+#ifdef _WIN32
+        void* file = nullptr;
+        void* mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+};
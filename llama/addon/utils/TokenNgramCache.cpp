@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include "TokenNgramCache.h"
+
+static uint64_t hashNgram(const llama_token* tokens, size_t length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<uint32_t>(tokens[i]);
+
+        // splitmix64 finalizer
+        hash += 0x9e3779b97f4a7c15ULL;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+    }
+
+    // 0 marks an empty entry
+    return hash == 0 ? 1 : hash;
+}
+
+static size_t getEntryCount(size_t maxMemorySize, size_t entrySize) {
+    return std::max<size_t>(1, maxMemorySize / entrySize);
+}
+
+TokenNgramCache::TokenNgramCache(size_t maxMemorySize) {
+    entries.resize(getEntryCount(maxMemorySize, sizeof(Entry)));
+}
+
+void TokenNgramCache::resize(size_t maxMemorySize) {
+    const size_t entryCount = getEntryCount(maxMemorySize, sizeof(Entry));
+
+    std::lock_guard<std::mutex> lock(entriesMutex);
+
+    if (entries.size() == entryCount) {
+        return;
+    }
+
+    std::vector<Entry> resizedEntries(entryCount);
+    for (const auto& entry : entries) {
+        if (entry.count == 0) {
+            continue;
+        }
+
+        Entry& resizedEntry = resizedEntries[entry.key % entryCount];
+        if (entry.count > resizedEntry.count) {
+            resizedEntry = entry;
+        }
+    }
+
+    entries = std::move(resizedEntries);
+}
+
+void TokenNgramCache::learn(const llama_token* context, size_t contextLength, llama_token token) {
+    const size_t maxLength = std::min(maxOrder, contextLength);
+    if (maxLength < minOrder) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(entriesMutex);
+
+    for (size_t length = minOrder; length <= maxLength; length++) {
+        const uint64_t key = hashNgram(context + contextLength - length, length);
+        Entry& entry = entries[key % entries.size()];
+
+        if (entry.key == key) {
+            if (entry.token == token) {
+                entry.count = std::min<uint32_t>(entry.count + 1, UINT32_MAX - 1);
+            } else if (entry.count > 1) {
+                entry.count--;
+            } else {
+                entry.token = token;
+                entry.count = 1;
+            }
+        } else if (entry.count > 1) {
+            // age the existing n-gram, so it's replaced when it stops being seen
+            entry.count--;
+        } else {
+            entry.key = key;
+            entry.token = token;
+            entry.count = 1;
+        }
+    }
+
+    learnedTokens++;
+}
+
+size_t TokenNgramCache::draft(
+    const llama_token* context,
+    size_t contextLength,
+    size_t maxTokens,
+    uint32_t minCount,
+    std::vector<llama_token>& result
+) {
+    std::vector<llama_token> draftContext(context + contextLength - std::min(maxOrder, contextLength), context + contextLength);
+    size_t drafted = 0;
+
+    lookups++;
+
+    {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+
+        while (drafted < maxTokens) {
+            bool found = false;
+
+            // prefer the longest matching n-gram
+            for (size_t length = std::min(maxOrder, draftContext.size()); length >= minOrder; length--) {
+                const uint64_t key = hashNgram(draftContext.data() + draftContext.size() - length, length);
+                const Entry& entry = entries[key % entries.size()];
+
+                if (entry.key == key && entry.count >= minCount) {
+                    result.push_back(entry.token);
+                    draftContext.push_back(entry.token);
+                    drafted++;
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found) {
+                break;
+            }
+
+            if (draftContext.size() > maxOrder) {
+                draftContext.erase(draftContext.begin());
+            }
+        }
+    }
+
+    if (drafted > 0) {
+        hits++;
+        draftedTokens += drafted;
+    }
+
+    return drafted;
+}
+
+void TokenNgramCache::recordAcceptedTokens(size_t tokens) {
+    acceptedTokens += tokens;
+}
+
+TokenNgramCache::Stats TokenNgramCache::getStats() const {
+    std::lock_guard<std::mutex> lock(entriesMutex);
+
+    return Stats{
+        lookups.load(),
+        hits.load(),
+        draftedTokens.load(),
+        acceptedTokens.load(),
+        learnedTokens.load(),
+        entries.size() * sizeof(Entry)
+    };
+}
+
+std::shared_ptr<TokenNgramCache> acquireTokenNgramCache(uint64_t vocabFingerprint, size_t maxMemorySize) {
+    static std::mutex cachesMutex;
+    static std::unordered_map<uint64_t, std::weak_ptr<TokenNgramCache>> caches;
+
+    std::lock_guard<std::mutex> lock(cachesMutex);
+
+    // drop the entries of caches that were already freed
+    for (auto it = caches.begin(); it != caches.end();) {
+        if (it->second.expired()) {
+            it = caches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::shared_ptr<TokenNgramCache> cache = caches[vocabFingerprint].lock();
+    if (cache == nullptr) {
+        cache = std::make_shared<TokenNgramCache>(maxMemorySize);
+        caches[vocabFingerprint] = cache;
+    } else {
+        cache->resize(maxMemorySize);
+    }
+
+    return cache;
+}
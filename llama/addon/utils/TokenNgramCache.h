@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "llama.h"
+
+// A fixed size table that maps the hash of the last few tokens (an n-gram) to the token that most often followed it.
+// Collisions and competing continuations are resolved by a vote counter, so the memory usage never grows
+// and frequently seen continuations outlive rare ones
+class TokenNgramCache {
+    public:
+        static constexpr size_t minOrder = 2;
+        static constexpr size_t maxOrder = 4;
+
+        struct Stats {
+            uint64_t lookups;
+            uint64_t hits;
+            uint64_t draftedTokens;
+            uint64_t acceptedTokens;
+            uint64_t learnedTokens;
+            uint64_t memorySize;
+        };
+
+        TokenNgramCache(size_t maxMemorySize);
+
+        // Rehashes the learned n-grams into a table of the given memory size.
+        // When n-grams collide in the new table, the one with more votes is kept
+        void resize(size_t maxMemorySize);
+
+        // `context` holds the tokens that preceded `token`, oldest first
+        void learn(const llama_token* context, size_t contextLength, llama_token token);
+
+        // Appends up to `maxTokens` tokens that are likely to follow `context` to `result`,
+        // using continuations that won at least `minCount` more votes than they lost
+        size_t draft(const llama_token* context, size_t contextLength, size_t maxTokens, uint32_t minCount, std::vector<llama_token>& result);
+
+        void recordAcceptedTokens(size_t acceptedTokens);
+        Stats getStats() const;
+
+    private:
+        struct Entry {
+            uint64_t key = 0;
+            llama_token token = 0;
+            uint32_t count = 0;
+        };
+
+        std::vector<Entry> entries;
+        mutable std::mutex entriesMutex;
+
+        std::atomic<uint64_t> lookups{0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> draftedTokens{0};
+        std::atomic<uint64_t> acceptedTokens{0};
+        std::atomic<uint64_t> learnedTokens{0};
+};
+
+// Returns the cache of the given vocabulary, creating it if no one holds it anymore, and resizing it to the given memory size.
+// Models with the same vocabulary fingerprint share the same cache, and it's freed once all of its holders release it
+std::shared_ptr<TokenNgramCache> acquireTokenNgramCache(uint64_t vocabFingerprint, size_t maxMemorySize);
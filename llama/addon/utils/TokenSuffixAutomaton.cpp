@@ -0,0 +1,168 @@
+#include <algorithm>
+#include "TokenSuffixAutomaton.h"
+
+int32_t TokenSuffixAutomaton::getTransition(const State& state, llama_token token) {
+    const auto it = std::lower_bound(
+        state.transitions.begin(),
+        state.transitions.end(),
+        token,
+        [](const std::pair<llama_token, int32_t>& transition, llama_token token) {
+            return transition.first < token;
+        }
+    );
+
+    if (it == state.transitions.end() || it->first != token) {
+        return -1;
+    }
+
+    return it->second;
+}
+
+void TokenSuffixAutomaton::setTransition(State& state, llama_token token, int32_t target) {
+    const auto it = std::lower_bound(
+        state.transitions.begin(),
+        state.transitions.end(),
+        token,
+        [](const std::pair<llama_token, int32_t>& transition, llama_token token) {
+            return transition.first < token;
+        }
+    );
+
+    if (it != state.transitions.end() && it->first == token) {
+        it->second = target;
+    } else {
+        state.transitions.insert(it, {token, target});
+    }
+}
+
+void TokenSuffixAutomaton::clear() {
+    tokens.clear();
+    states.assign(1, State());
+    lastState = 0;
+    clearMatch();
+}
+
+void TokenSuffixAutomaton::reserve(size_t tokensCount) {
+    tokens.reserve(tokensCount);
+    states.reserve(tokensCount * 2 + 1);
+}
+
+void TokenSuffixAutomaton::addToken(llama_token token) {
+    tokens.push_back(token);
+
+    const int32_t current = states.size();
+    states.emplace_back();
+    states[current].length = states[lastState].length + 1;
+    states[current].firstEndIndex = tokens.size() - 1;
+
+    int32_t p = lastState;
+    while (p != -1 && getTransition(states[p], token) == -1) {
+        setTransition(states[p], token, current);
+        p = states[p].link;
+    }
+
+    if (p == -1) {
+        states[current].link = 0;
+    } else {
+        const int32_t q = getTransition(states[p], token);
+
+        if (states[p].length + 1 == states[q].length) {
+            states[current].link = q;
+        } else {
+            const int32_t clone = states.size();
+            State cloneState = states[q];
+            cloneState.length = states[p].length + 1;
+            states.push_back(std::move(cloneState));
+
+            while (p != -1 && getTransition(states[p], token) == q) {
+                setTransition(states[p], token, clone);
+                p = states[p].link;
+            }
+
+            states[q].link = clone;
+            states[current].link = clone;
+        }
+    }
+
+    lastState = current;
+
+    // the states of the matched tokens may have been split, so the match has to be found again
+    clearMatch();
+}
+
+void TokenSuffixAutomaton::clearMatch() {
+    matchState = 0;
+    matchLength = 0;
+}
+
+void TokenSuffixAutomaton::matchToken(llama_token token) {
+    while (matchState != -1 && getTransition(states[matchState], token) == -1) {
+        matchState = states[matchState].link;
+
+        if (matchState != -1) {
+            matchLength = states[matchState].length;
+        }
+    }
+
+    if (matchState == -1) {
+        matchState = 0;
+        matchLength = 0;
+        return;
+    }
+
+    matchState = getTransition(states[matchState], token);
+    matchLength++;
+}
+
+size_t TokenSuffixAutomaton::getMatchLength() const {
+    return matchLength;
+}
+
+bool TokenSuffixAutomaton::findContinuation(
+    size_t patternMinLength,
+    size_t patternMaxLength,
+    size_t continuationMinLength,
+    size_t continuationMaxLength,
+    std::vector<llama_token>& result
+) const {
+    int32_t state = matchState;
+    size_t length = matchLength;
+
+    if (patternMaxLength > 0 && length > patternMaxLength) {
+        length = patternMaxLength;
+
+        while (states[state].link > 0 && (size_t)states[states[state].link].length >= length) {
+            state = states[state].link;
+        }
+    }
+
+    // all the suffixes in a state end at the same indexes, so shorter suffixes are only checked when they belong to another state
+    while (state > 0 && length >= patternMinLength && length > 0) {
+        const size_t continuationStart = states[state].firstEndIndex + 1;
+        const size_t available = tokens.size() - continuationStart;
+
+        if (available >= continuationMinLength && available > 0) {
+            const size_t continuationLength = std::min(available, continuationMaxLength);
+            result.insert(result.end(), tokens.begin() + continuationStart, tokens.begin() + continuationStart + continuationLength);
+            return true;
+        }
+
+        state = states[state].link;
+        length = states[state].length;
+    }
+
+    return false;
+}
+
+const std::vector<llama_token>& TokenSuffixAutomaton::getTokens() const {
+    return tokens;
+}
+
+size_t TokenSuffixAutomaton::getMemorySize() const {
+    size_t size = tokens.capacity() * sizeof(llama_token) + states.capacity() * sizeof(State);
+    for (const auto& state : states) {
+        size += state.transitions.capacity() * sizeof(std::pair<llama_token, int32_t>);
+    }
+
+    return size;
+}
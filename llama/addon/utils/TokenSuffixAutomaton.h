@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "llama.h"
+
+// A suffix automaton of a token sequence that can be extended one token at a time.
+// It finds the longest suffix of another (matched) token sequence that appears in the indexed tokens
+// in O(1) amortized time for every matched token, and reads the tokens that followed it
+class TokenSuffixAutomaton {
+    public:
+        void clear();
+        void reserve(size_t tokensCount);
+        void addToken(llama_token token);
+
+        // matching state
+        void clearMatch();
+        void matchToken(llama_token token);
+        size_t getMatchLength() const;
+
+        // Finds the longest suffix of the matched tokens, between `patternMinLength` and `patternMaxLength` tokens long (`0` for no max),
+        // that is followed by at least `continuationMinLength` indexed tokens, and appends up to `continuationMaxLength` of these tokens to `result`.
+        // When the suffix appears multiple times, the earliest appearance is used, since it has the longest continuation
+        bool findContinuation(
+            size_t patternMinLength,
+            size_t patternMaxLength,
+            size_t continuationMinLength,
+            size_t continuationMaxLength,
+            std::vector<llama_token>& result
+        ) const;
+
+        const std::vector<llama_token>& getTokens() const;
+        size_t getMemorySize() const;
+
+    private:
+        struct State {
+            int32_t length = 0;
+            int32_t link = -1;
+            int32_t firstEndIndex = -1;
+
+            // sorted by token
+            std::vector<std::pair<llama_token, int32_t>> transitions;
+        };
+
+        std::vector<llama_token> tokens;
+        std::vector<State> states = {State()};
+        int32_t lastState = 0;
+
+        int32_t matchState = 0;
+        int32_t matchLength = 0;
+
+        static int32_t getTransition(const State& state, llama_token token);
+        static void setTransition(State& state, llama_token token, int32_t target);
+};
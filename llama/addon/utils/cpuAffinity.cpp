@@ -0,0 +1,92 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "cpuAffinity.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+// parses the list format of the Linux sysfs, for example "0-3,8,10-11"
+static std::vector<uint32_t> parseSysfsList(const std::string& list) {
+    std::vector<uint32_t> result;
+    std::stringstream listStream(list);
+    std::string range;
+
+    while (std::getline(listStream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+
+        try {
+            const auto dashIndex = range.find('-');
+            if (dashIndex == std::string::npos) {
+                result.push_back(static_cast<uint32_t>(std::stoul(range)));
+                continue;
+            }
+
+            const auto start = static_cast<uint32_t>(std::stoul(range.substr(0, dashIndex)));
+            const auto end = static_cast<uint32_t>(std::stoul(range.substr(dashIndex + 1)));
+            for (uint32_t i = start; i <= end; i++) {
+                result.push_back(i);
+            }
+        } catch (...) {
+            return {};
+        }
+    }
+
+    return result;
+}
+
+static std::string readFirstLine(const std::string& filePath) {
+    std::ifstream file(filePath);
+    std::string line;
+
+    if (file.is_open()) {
+        std::getline(file, line);
+    }
+
+    return line;
+}
+
+std::vector<uint32_t> getNumaNodes() {
+#ifdef __linux__
+    return parseSysfsList(readFirstLine("/sys/devices/system/node/online"));
+#else
+    return {};
+#endif
+}
+
+std::vector<uint32_t> getNumaNodeCpus(uint32_t node) {
+#ifdef __linux__
+    return parseSysfsList(readFirstLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+#else
+    return {};
+#endif
+}
+
+ScopedThreadAffinity::ScopedThreadAffinity(const std::vector<uint32_t>& cpus) {
+#ifdef __linux__
+    if (cpus.empty() || pthread_getaffinity_np(pthread_self(), sizeof(previousCpus), &previousCpus) != 0) {
+        return;
+    }
+
+    cpu_set_t newCpus;
+    CPU_ZERO(&newCpus);
+    for (const auto cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &newCpus);
+        }
+    }
+
+    applied = pthread_setaffinity_np(pthread_self(), sizeof(newCpus), &newCpus) == 0;
+#endif
+}
+
+ScopedThreadAffinity::~ScopedThreadAffinity() {
+#ifdef __linux__
+    if (applied) {
+        pthread_setaffinity_np(pthread_self(), sizeof(previousCpus), &previousCpus);
+    }
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// the ids of the NUMA nodes of the machine, empty when NUMA information isn't available
+std::vector<uint32_t> getNumaNodes();
+
+// the CPU cores of the given NUMA node, empty when NUMA information isn't available
+std::vector<uint32_t> getNumaNodeCpus(uint32_t node);
+
+// Restricts the current thread to the given CPU cores until destroyed.
+// Memory that is first touched by the thread while restricted is allocated on the NUMA nodes of these cores
+// (under the default first-touch policy of the OS), so buffers allocated in this scope are local to the cores.
+// Does nothing on platforms that don't support setting the thread affinity
+class ScopedThreadAffinity {
+    public:
+        ScopedThreadAffinity(const std::vector<uint32_t>& cpus);
+        ~ScopedThreadAffinity();
+
+        ScopedThreadAffinity(const ScopedThreadAffinity&) = delete;
+        ScopedThreadAffinity& operator=(const ScopedThreadAffinity&) = delete;
+
+    private:
+        bool applied = false;
+#ifdef __linux__
+        cpu_set_t previousCpus;
+#endif
+};
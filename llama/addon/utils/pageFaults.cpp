@@ -0,0 +1,84 @@
+#include "pageFaults.h"
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <fstream>
+#include <string>
+#endif
+
+static std::mutex decodeWindowsMutex;
+static uint32_t runningDecodes = 0;
+static uint64_t startedDecodes = 0;
+
+bool getProcessPageFaults(PageFaultCounts& counts) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS memCounters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &memCounters, sizeof(memCounters))) {
+        return false;
+    }
+
+    counts.major = 0;
+    counts.minor = memCounters.PageFaultCount;
+    return true;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return false;
+    }
+
+    counts.major = (uint64_t)usage.ru_majflt;
+    counts.minor = (uint64_t)usage.ru_minflt;
+    return true;
+#endif
+}
+
+bool getSystemSwappedInPages(uint64_t& pages) {
+#ifdef __linux__
+    std::ifstream vmstat("/proc/vmstat");
+    if (!vmstat.is_open()) {
+        return false;
+    }
+
+    std::string key;
+    uint64_t value;
+    while (vmstat >> key >> value) {
+        if (key == "pswpin") {
+            pages = value;
+            return true;
+        }
+    }
+
+    return false;
+#else
+    return false;
+#endif
+}
+
+DecodeWindow beginDecodeWindow() {
+    std::lock_guard<std::mutex> lock(decodeWindowsMutex);
+
+    DecodeWindow window;
+    window.overlapped = runningDecodes > 0;
+    runningDecodes++;
+    startedDecodes++;
+    window.startedDecodes = startedDecodes;
+
+    return window;
+}
+
+bool endDecodeWindow(const DecodeWindow& window) {
+    std::lock_guard<std::mutex> lock(decodeWindowsMutex);
+
+    if (runningDecodes > 0) {
+        runningDecodes--;
+    }
+
+    return window.overlapped || startedDecodes != window.startedDecodes;
+}
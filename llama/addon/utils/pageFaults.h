@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+struct PageFaultCounts {
+    uint64_t major = 0; // faults that had to read a page from the disk (like a part of a model file that isn't in the page cache)
+    uint64_t minor = 0; // faults that were resolved without reading from the disk
+};
+
+// the page faults of the whole process so far, since the threads of `llama.cpp` handle faults on behalf of a single decode.
+// returns `false` when page fault counters aren't available on this platform.
+// on Windows, all the faults are counted as minor, since major faults aren't reported separately
+bool getProcessPageFaults(PageFaultCounts& counts);
+
+// the number of pages the whole system swapped in from the disk so far (`pswpin` in `/proc/vmstat`).
+// returns `false` when it isn't available on this platform (only Linux reports it)
+bool getSystemSwappedInPages(uint64_t& pages);
+
+// since page fault counters are process-wide, the faults during a decode can only be attributed to its context
+// when no other work that faults in model pages ran at the same time.
+// every `llama_decode` call, and every prefetch of model files, runs inside a decode window
+struct DecodeWindow {
+    uint64_t startedDecodes = 0;
+    bool overlapped = false;
+};
+
+DecodeWindow beginDecodeWindow();
+
+// returns whether another decode window was open during the window
+bool endDecodeWindow(const DecodeWindow& window);
+
+// keeps a decode window open until it's ended or goes out of scope
+class ScopedDecodeWindow {
+    public:
+        ScopedDecodeWindow() : window(beginDecodeWindow()) {}
+        ~ScopedDecodeWindow() {
+            end();
+        }
+
+        ScopedDecodeWindow(const ScopedDecodeWindow&) = delete;
+        ScopedDecodeWindow& operator=(const ScopedDecodeWindow&) = delete;
+
+        // returns whether another decode window was open during the window
+        bool end() {
+            if (!ended) {
+                ended = true;
+                overlapped = endDecodeWindow(window);
+            }
+
+            return overlapped;
+        }
+
+    private:
+        DecodeWindow window;
+        bool ended = false;
+        bool overlapped = false;
+};
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ggml.h"
+#include "vectorMath.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+
+// the addon is compiled for the baseline instruction set, so the AVX2 kernels are selected at runtime
+#if defined(__GNUC__) || defined(__clang__)
+#define ADDON_VECTOR_MATH_AVX2 1
+#define ADDON_VECTOR_MATH_AVX2_TARGET __attribute__((target("avx2,fma,f16c")))
+
+#define ADDON_VECTOR_MATH_AVX512 1
+#define ADDON_VECTOR_MATH_AVX512_TARGET __attribute__((target("avx512f,avx2,fma,f16c")))
+
+static bool cpuSupportsAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    return supported;
+}
+
+static bool cpuSupportsAvx512() {
+    static const bool supported = cpuSupportsAvx2() && __builtin_cpu_supports("avx512f");
+    return supported;
+}
+#elif defined(__AVX2__)
+#define ADDON_VECTOR_MATH_AVX2 1
+#define ADDON_VECTOR_MATH_AVX2_TARGET
+
+static bool cpuSupportsAvx2() {
+    return true;
+}
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define ADDON_VECTOR_MATH_NEON 1
+#endif
+
+static inline uint8_t reverseByteBits(uint8_t value) {
+    value = (uint8_t)(((value & 0xF0) >> 4) | ((value & 0x0F) << 4));
+    value = (uint8_t)(((value & 0xCC) >> 2) | ((value & 0x33) << 2));
+    value = (uint8_t)(((value & 0xAA) >> 1) | ((value & 0x55) << 1));
+    return value;
+}
+
+static float maxAbsScalar(const float* input, size_t size) {
+    float maxAbs = 0;
+    for (size_t i = 0; i < size; i++) {
+        maxAbs = std::max(maxAbs, std::fabs(input[i]));
+    }
+
+    return maxAbs;
+}
+
+static void quantizeToInt8Scalar(const float* input, size_t size, float inverseScale, int8_t* output) {
+    for (size_t i = 0; i < size; i++) {
+        const float value = std::nearbyint(input[i] * inverseScale);
+        output[i] = (int8_t)std::max(-127.0f, std::min(127.0f, value));
+    }
+}
+
+static void binarizeScalar(const float* input, size_t size, uint8_t* output) {
+    for (size_t i = 0; i < size; i += 8) {
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 8 && i + j < size; j++) {
+            if (input[i + j] > 0) {
+                byte |= (uint8_t)(0x80 >> j);
+            }
+        }
+
+        output[i / 8] = byte;
+    }
+}
+
+static float dotProductF32Scalar(const float* query, const float* vector, size_t size) {
+    float sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += query[i] * vector[i];
+    }
+
+    return sum;
+}
+
+static float dotProductF16Scalar(const float* query, const uint16_t* vector, size_t size) {
+    float sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += query[i] * ggml_fp16_to_fp32((ggml_fp16_t)vector[i]);
+    }
+
+    return sum;
+}
+
+static float dotProductInt8Scalar(const float* query, const int8_t* vector, size_t size) {
+    float sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += query[i] * (float)vector[i];
+    }
+
+    return sum;
+}
+
+#ifdef ADDON_VECTOR_MATH_AVX2
+ADDON_VECTOR_MATH_AVX2_TARGET static inline float horizontalSumAvx2(__m256 value) {
+    __m128 result = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+    result = _mm_add_ps(result, _mm_movehl_ps(result, result));
+    result = _mm_add_ss(result, _mm_movehdup_ps(result));
+    return _mm_cvtss_f32(result);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static float dotProductF32Avx2(const float* query, const float* vector, size_t size) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(query + i), _mm256_loadu_ps(vector + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(query + i + 8), _mm256_loadu_ps(vector + i + 8), sum1);
+    }
+
+    for (; i + 8 <= size; i += 8) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(query + i), _mm256_loadu_ps(vector + i), sum0);
+    }
+
+    return horizontalSumAvx2(_mm256_add_ps(sum0, sum1)) + dotProductF32Scalar(query + i, vector + i, size - i);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static float dotProductF16Avx2(const float* query, const uint16_t* vector, size_t size) {
+    __m256 sum = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const __m256 values = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(vector + i)));
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(query + i), values, sum);
+    }
+
+    return horizontalSumAvx2(sum) + dotProductF16Scalar(query + i, vector + i, size - i);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static float dotProductInt8Avx2(const float* query, const int8_t* vector, size_t size) {
+    __m256 sum = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const __m256i widened = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(vector + i)));
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(query + i), _mm256_cvtepi32_ps(widened), sum);
+    }
+
+    return horizontalSumAvx2(sum) + dotProductInt8Scalar(query + i, vector + i, size - i);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static inline float horizontalMaxAvx2(__m256 value) {
+    __m128 result = _mm_max_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+    result = _mm_max_ps(result, _mm_movehl_ps(result, result));
+    result = _mm_max_ss(result, _mm_movehdup_ps(result));
+    return _mm_cvtss_f32(result);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static float maxAbsAvx2(const float* input, size_t size) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 maxAbs = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        maxAbs = _mm256_max_ps(maxAbs, _mm256_andnot_ps(signMask, _mm256_loadu_ps(input + i)));
+    }
+
+    return std::max(horizontalMaxAvx2(maxAbs), maxAbsScalar(input + i, size - i));
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static void quantizeToInt8Avx2(const float* input, size_t size, float inverseScale, int8_t* output) {
+    const __m256 multiplier = _mm256_set1_ps(inverseScale);
+    const __m256i permutation = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v0 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(input + i), multiplier));
+        __m256i v1 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(input + i + 8), multiplier));
+        __m256i v2 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(input + i + 16), multiplier));
+        __m256i v3 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(input + i + 24), multiplier));
+
+        // the packing instructions work per 128-bit lane, so the result has to be permuted back into order
+        __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v0, v1), _mm256_packs_epi32(v2, v3));
+        packed = _mm256_permutevar8x32_epi32(packed, permutation);
+
+        _mm256_storeu_si256((__m256i*)(output + i), packed);
+    }
+
+    quantizeToInt8Scalar(input + i, size - i, inverseScale, output + i);
+}
+
+ADDON_VECTOR_MATH_AVX2_TARGET static void binarizeAvx2(const float* input, size_t size, uint8_t* output) {
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(input + i), zero, _CMP_GT_OQ));
+        output[i / 8] = reverseByteBits((uint8_t)mask);
+    }
+
+    binarizeScalar(input + i, size - i, output + i / 8);
+}
+#endif
+
+#ifdef ADDON_VECTOR_MATH_AVX512
+ADDON_VECTOR_MATH_AVX512_TARGET static float dotProductF32Avx512(const float* query, const float* vector, size_t size) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(query + i), _mm512_loadu_ps(vector + i), sum0);
+        sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(query + i + 16), _mm512_loadu_ps(vector + i + 16), sum1);
+    }
+
+    for (; i + 16 <= size; i += 16) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(query + i), _mm512_loadu_ps(vector + i), sum0);
+    }
+
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1)) + dotProductF32Scalar(query + i, vector + i, size - i);
+}
+
+ADDON_VECTOR_MATH_AVX512_TARGET static float dotProductF16Avx512(const float* query, const uint16_t* vector, size_t size) {
+    __m512 sum = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m512 values = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(vector + i)));
+        sum = _mm512_fmadd_ps(_mm512_loadu_ps(query + i), values, sum);
+    }
+
+    return _mm512_reduce_add_ps(sum) + dotProductF16Scalar(query + i, vector + i, size - i);
+}
+
+ADDON_VECTOR_MATH_AVX512_TARGET static float dotProductInt8Avx512(const float* query, const int8_t* vector, size_t size) {
+    __m512 sum = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m512i widened = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)(vector + i)));
+        sum = _mm512_fmadd_ps(_mm512_loadu_ps(query + i), _mm512_cvtepi32_ps(widened), sum);
+    }
+
+    return _mm512_reduce_add_ps(sum) + dotProductInt8Scalar(query + i, vector + i, size - i);
+}
+#endif
+
+#ifdef ADDON_VECTOR_MATH_NEON
+static float dotProductF32Neon(const float* query, const float* vector, size_t size) {
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        sum0 = vfmaq_f32(sum0, vld1q_f32(query + i), vld1q_f32(vector + i));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(query + i + 4), vld1q_f32(vector + i + 4));
+    }
+
+    return vaddvq_f32(vaddq_f32(sum0, sum1)) + dotProductF32Scalar(query + i, vector + i, size - i);
+}
+
+static float dotProductF16Neon(const float* query, const uint16_t* vector, size_t size) {
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const float16x8_t values = vreinterpretq_f16_u16(vld1q_u16(vector + i));
+        sum0 = vfmaq_f32(sum0, vld1q_f32(query + i), vcvt_f32_f16(vget_low_f16(values)));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(query + i + 4), vcvt_high_f32_f16(values));
+    }
+
+    return vaddvq_f32(vaddq_f32(sum0, sum1)) + dotProductF16Scalar(query + i, vector + i, size - i);
+}
+
+static float dotProductInt8Neon(const float* query, const int8_t* vector, size_t size) {
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const int16x8_t widened = vmovl_s8(vld1_s8(vector + i));
+        sum0 = vfmaq_f32(sum0, vld1q_f32(query + i), vcvtq_f32_s32(vmovl_s16(vget_low_s16(widened))));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(query + i + 4), vcvtq_f32_s32(vmovl_high_s16(widened)));
+    }
+
+    return vaddvq_f32(vaddq_f32(sum0, sum1)) + dotProductInt8Scalar(query + i, vector + i, size - i);
+}
+
+static float maxAbsNeon(const float* input, size_t size) {
+    float32x4_t maxAbs = vdupq_n_f32(0);
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        maxAbs = vmaxq_f32(maxAbs, vabsq_f32(vld1q_f32(input + i)));
+    }
+
+    return std::max(vmaxvq_f32(maxAbs), maxAbsScalar(input + i, size - i));
+}
+
+static void quantizeToInt8Neon(const float* input, size_t size, float inverseScale, int8_t* output) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const int32x4_t v0 = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i), inverseScale));
+        const int32x4_t v1 = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i + 4), inverseScale));
+
+        const int16x8_t packed = vcombine_s16(vqmovn_s32(v0), vqmovn_s32(v1));
+        vst1_s8(output + i, vqmovn_s16(packed));
+    }
+
+    quantizeToInt8Scalar(input + i, size - i, inverseScale, output + i);
+}
+#endif
+
+float quantizeVectorToInt8(const float* input, size_t size, int8_t* output) {
+    float maxAbs = 0;
+
+#if defined(ADDON_VECTOR_MATH_AVX2)
+    const bool useAvx2 = cpuSupportsAvx2();
+    maxAbs = useAvx2 ? maxAbsAvx2(input, size) : maxAbsScalar(input, size);
+#elif defined(ADDON_VECTOR_MATH_NEON)
+    maxAbs = maxAbsNeon(input, size);
+#else
+    maxAbs = maxAbsScalar(input, size);
+#endif
+
+    if (maxAbs == 0) {
+        std::fill(output, output + size, 0);
+        return 0;
+    }
+
+    const float inverseScale = 127.0f / maxAbs;
+
+#if defined(ADDON_VECTOR_MATH_AVX2)
+    if (useAvx2) {
+        quantizeToInt8Avx2(input, size, inverseScale, output);
+    } else {
+        quantizeToInt8Scalar(input, size, inverseScale, output);
+    }
+#elif defined(ADDON_VECTOR_MATH_NEON)
+    quantizeToInt8Neon(input, size, inverseScale, output);
+#else
+    quantizeToInt8Scalar(input, size, inverseScale, output);
+#endif
+
+    return maxAbs / 127.0f;
+}
+
+void binarizeVector(const float* input, size_t size, uint8_t* output) {
+#if defined(ADDON_VECTOR_MATH_AVX2)
+    if (cpuSupportsAvx2()) {
+        binarizeAvx2(input, size, output);
+        return;
+    }
+#endif
+
+    binarizeScalar(input, size, output);
+}
+
+template <typename T>
+using DotProductFunction = float (*)(const float* query, const T* vector, size_t size);
+
+// the kernel of each type is selected once, on its first use
+float dotProductF32(const float* query, const float* vector, size_t size) {
+    static const DotProductFunction<float> dotProduct = []() -> DotProductFunction<float> {
+#if defined(ADDON_VECTOR_MATH_AVX512)
+        if (cpuSupportsAvx512()) {
+            return dotProductF32Avx512;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_AVX2)
+        if (cpuSupportsAvx2()) {
+            return dotProductF32Avx2;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_NEON)
+        return dotProductF32Neon;
+#else
+        return dotProductF32Scalar;
+#endif
+    }();
+
+    return dotProduct(query, vector, size);
+}
+
+float dotProductF16(const float* query, const uint16_t* vector, size_t size) {
+    static const DotProductFunction<uint16_t> dotProduct = []() -> DotProductFunction<uint16_t> {
+#if defined(ADDON_VECTOR_MATH_AVX512)
+        if (cpuSupportsAvx512()) {
+            return dotProductF16Avx512;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_AVX2)
+        if (cpuSupportsAvx2()) {
+            return dotProductF16Avx2;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_NEON)
+        return dotProductF16Neon;
+#else
+        return dotProductF16Scalar;
+#endif
+    }();
+
+    return dotProduct(query, vector, size);
+}
+
+float dotProductInt8(const float* query, const int8_t* vector, size_t size) {
+    static const DotProductFunction<int8_t> dotProduct = []() -> DotProductFunction<int8_t> {
+#if defined(ADDON_VECTOR_MATH_AVX512)
+        if (cpuSupportsAvx512()) {
+            return dotProductInt8Avx512;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_AVX2)
+        if (cpuSupportsAvx2()) {
+            return dotProductInt8Avx2;
+        }
+#endif
+#if defined(ADDON_VECTOR_MATH_NEON)
+        return dotProductInt8Neon;
+#else
+        return dotProductInt8Scalar;
+#endif
+    }();
+
+    return dotProduct(query, vector, size);
+}
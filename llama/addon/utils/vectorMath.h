@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Quantizes `input` to int8 using a single symmetric scale for the whole vector.
+// `output[i] * scale` approximates `input[i]`. Returns the scale (0 for an all-zero vector)
+float quantizeVectorToInt8(const float* input, size_t size, int8_t* output);
+
+// Packs the sign of each element into bits (1 for positive values, 0 otherwise), most significant bit first,
+// the same bit order as numpy's `packbits`. `output` must have room for `(size + 7) / 8` bytes
+void binarizeVector(const float* input, size_t size, uint8_t* output);
+
+// Dot products of a float query with a stored vector, using the widest SIMD instruction set the CPU supports.
+// `dotProductF16` expects IEEE half-precision values (`ggml_fp16_t`)
+float dotProductF32(const float* query, const float* vector, size_t size);
+float dotProductF16(const float* query, const uint16_t* vector, size_t size);
+float dotProductInt8(const float* query, const int8_t* vector, size_t size);
@@ -1,5 +1,5 @@
 import {Token} from "../types.js";
-import {LlamaNuma} from "./types.js";
+import {LlamaExecutorMetrics, LlamaNuma, LlamaNumaNode} from "./types.js";
 
 
 export type BindingModule = {
@@ -11,6 +11,7 @@ export type BindingModule = {
             useMmap?: boolean,
             useMlock?: boolean,
             checkTensors?: boolean,
+            cpus?: Uint32Array,
             onLoadProgress?(loadPercentage: number): void,
             hasLoadAbortSignal?: boolean,
             overridesList?: Array<[key: string, value: number | bigint | boolean | string, type: 0 | 1 | undefined]>
@@ -23,14 +24,20 @@ export type BindingModule = {
         new (model: AddonModel, params: {
             contextSize?: number,
             batchSize?: number,
+            ubatchSize?: number,
             sequences?: number,
             flashAttention?: boolean,
             logitsAll?: boolean,
             embeddings?: boolean,
             ranking?: boolean,
             threads?: number,
+            batchThreads?: number,
+            threadPool?: AddonThreadPool,
+            cpus?: Uint32Array,
             performanceTracking?: boolean,
-            swaFullCache?: boolean
+            swaFullCache?: boolean,
+            kvCacheKeyType?: number, // `GgmlType`
+            kvCacheValueType?: number // `GgmlType`
         }): AddonContext
     },
     AddonGrammar: {
@@ -48,6 +55,28 @@ export type BindingModule = {
         acceptGrammarEvaluationStateToken(grammarEvaluationState: AddonGrammarEvaluationState, token: Token): void,
         canBeNextTokenForGrammarEvaluationState(grammarEvaluationState: AddonGrammarEvaluationState, token: Token): boolean
     },
+    AddonEmbeddingIndex: {
+        new (vectorSize: number, params?: {
+            type?: "f32" | "f16" | "int8",
+            metric?: "cosine" | "dot"
+        }): AddonEmbeddingIndex
+    },
+    AddonTokenLookupIndex: {
+        new (): AddonTokenLookupIndex
+    },
+    AddonThreadPool: {
+        new (threads: number, options?: {
+            cpus?: Uint32Array,
+            strictCpuPlacement?: boolean,
+            priority?: "normal" | "medium" | "high" | "realtime",
+            poll?: number
+        }): AddonThreadPool
+    },
+    AddonNgramCache: {
+        new (model: AddonModel, options?: {
+            maxMemorySize?: number
+        }): AddonNgramCache
+    },
     markLoaded(): boolean,
     systemInfo(): string,
     getSupportsGpuOffloading(): boolean,
@@ -86,8 +115,19 @@ export type BindingModule = {
     getMemoryInfo(): {
         total: number
     },
+    getMemoryUsage(
+        models?: AddonModel[], modelsFilePaths?: string[][], contexts?: AddonContext[], checkFileResidency?: boolean
+    ): Float64Array,
     init(): Promise<void>,
     setNuma(numa?: LlamaNuma): void,
+    getNumaNodes(): LlamaNumaNode[],
+    getExecutorMetrics(): LlamaExecutorMetrics,
+    getPagingStats(): {
+        majorPageFaults: number,
+        minorPageFaults: number,
+        swappedInPages: number
+    },
+    readGgufFileHeader(filePath: string, readTensorInfo: boolean): Promise<AddonGgufFileHeader>,
     loadBackends(forceLoadLibrariesSearchPath?: string): void,
     dispose(): Promise<void>
 };
@@ -157,9 +197,17 @@ export type AddonModel = {
     getTokenAttributes(token: Token): number,
     isEogToken(token: Token): boolean,
     getVocabularyType(): number,
+    getVocabularyFingerprint(): string,
     shouldPrependBosToken(): boolean,
     shouldAppendEosToken(): boolean,
-    getModelSize(): number
+    getModelSize(): number,
+    getFileResidency(filePaths: string[]): Promise<{residentSize: number, totalSize: number} | null>,
+    prefetchFile(prefetchId: number, filePaths: string[], options?: {
+        threads?: number,
+        bytesPerSecond?: number,
+        onProgress?(progress: number): void
+    }): Promise<boolean>,
+    abortPrefetchFile(prefetchId: number): void
 };
 
 export type AddonContext = {
@@ -173,13 +221,23 @@ export type AddonContext = {
         tokens: Uint32Array,
         logitIndexes: Uint32Array,
     ): Uint32Array, // returns an array with batchLogitIndex for each item in the logitIndexes array
-    decodeBatch(): Promise<void>,
-    sampleToken(batchLogitIndex: BatchLogitIndex, sampler: AddonSampler): Promise<Token | -1>,
+    decodeBatch(options?: {
+        timeout?: number // in milliseconds
+    }): Promise<boolean>, // returns `false` when the decoding was aborted
+    abortDecodeBatch(): void,
+    sampleToken(
+        batchLogitIndex: BatchLogitIndex,
+        sampler: AddonSampler,
+        probabilities?: undefined,
+        confidence?: undefined,
+        learnNgram?: boolean // defaults to `true`
+    ): Promise<Token | -1>,
     sampleToken(
         batchLogitIndex: BatchLogitIndex,
         sampler: AddonSampler,
         probabilities: boolean,
-        confidence?: boolean
+        confidence?: boolean,
+        learnNgram?: boolean // defaults to `true`
     ): Promise<[token: Token | -1, probabilities: (Token | number)[] | undefined, confidence: number | undefined]>,
     disposeSequence(sequenceId: number): void,
 
@@ -189,17 +247,86 @@ export type AddonContext = {
     // startPos in inclusive, endPos is exclusive
     shiftSequenceTokenCells(sequenceId: number, startPos: number, endPos: number, shiftDelta: number): void,
 
+    // removes the given sorted [start, end) ranges and shifts the cells after each range back, up to endPos (exclusive).
+    // returns `false` without changing the sequence when the ranges are invalid or the context memory can't remove ranges
+    eraseSequenceTokenRanges(sequenceId: number, ranges: Uint32Array, endPos: number): boolean,
+
     getSequenceKvCacheMinPosition(sequenceId: number): number,
     getSequenceKvCacheMaxPosition(sequenceId: number): number,
+
+    // `sequences` has 3 items for each sequence: cells count, min position, max position
+    getKvCacheUsage(): {
+        sequences: Int32Array,
+        usedCells: number,
+        freeCells: number,
+        budgetSkew: number
+    },
+
+    // rewrites the KV cache cells of every sequence to compact them. does nothing when the KV cache has a budget per sequence.
+    // resolves with the IDs of sequences whose cells couldn't be restored and were cleared
+    defragmentKvCache(): Promise<Int32Array>,
+
+    // batches, total time, major faults, minor faults, paged batches, last time, last major faults, last minor faults,
+    // whether page faults are available and whether the last batch was paged (`1` or `0`). times are in microseconds
+    getDecodeStats(): Float64Array,
     getEmbedding(inputTokensLength: number, maxVectorSize?: number): Float64Array,
+
+    // evaluates each input on its own sequence (clearing all the context sequences it uses),
+    // and returns a matrix of `inputs.length` rows of the resolved vector size
+    computeEmbeddings(inputs: Uint32Array[], options?: {
+        maxVectorSize?: number,
+        normalize?: boolean,
+        outputType?: "float32"
+    }): Promise<Float32Array>,
+
+    // int8 vectors are always L2-normalized before quantization, and `vectors[i] * scales[row]` approximates the original value
+    computeEmbeddings(inputs: Uint32Array[], options: {
+        maxVectorSize?: number,
+        outputType: "int8"
+    }): Promise<{vectors: Int8Array, scales: Float32Array}>,
+
+    // each vector is packed into `Math.ceil(vectorSize / 8)` bytes, most significant bit first
+    computeEmbeddings(inputs: Uint32Array[], options: {
+        maxVectorSize?: number,
+        outputType: "binary"
+    }): Promise<Uint8Array>,
+
+    // for ranking contexts, evaluates each input the same way as `computeEmbeddings` and returns the rank score of each input
+    // as a probability between 0 and 1
+    computeRankings(inputs: Uint32Array[]): Promise<Float32Array>,
     getStateSize(): number,
     getThreads(): number,
-    setThreads(threads: number): void,
+    setThreads(threads: number, batchThreads?: number): void,
+    getBatchThreads(): number,
+
+    // evaluates a short batch and a few single-token steps with each thread count candidate,
+    // and returns the evaluation time per token of each candidate, in milliseconds
+    tuneThreads(candidates: Uint32Array, token: Token, batchTokens: number, generationSteps: number): Promise<{
+        batchTimes: Float64Array,
+        generationTimes: Float64Array
+    }>,
     printTimings(): void,
     ensureDraftContextIsCompatibleForSpeculative(draftContext: AddonContext): void,
+    speculativeDecode(draftContext: AddonContext, sampler: AddonSampler, draftSampler: AddonSampler, options: {
+        sequenceId: number,
+        firstTokenIndex: number,
+        tokens: Uint32Array,
+        draftSequenceId: number,
+        draftFirstTokenIndex: number,
+        draftTokens: Uint32Array,
+        maxDraftTokens: number,
+        minDraftConfidence?: number,
+        acceptance?: "exact" | "rejectionSampling"
+    }): Promise<{
+        tokens: Uint32Array,
+        draftTokens: number,
+        acceptedDraftTokens: number,
+        draftEvaluatedTokens: number
+    }>,
     saveSequenceStateToFile(filePath: string, sequenceId: number, tokens: Uint32Array): Promise<number>,
     loadSequenceStateFromFile(filePath: string, sequenceId: number, maxContextSize: number): Promise<Uint32Array>,
-    setLora(lora: AddonModelLora, scale: number): void
+    setLora(lora: AddonModelLora, scale: number): void,
+    setSequenceLoras(sequenceId: number, loras: AddonModelLora[], scales: Float32Array): void
 };
 
 export type BatchLogitIndex = number & {
@@ -230,7 +357,60 @@ export type AddonSampler = {
         grammarEvaluationState?: AddonGrammarEvaluationState,
         tokenBiasKeys?: Uint32Array,
         tokenBiasValues?: Float32Array
-    }): void
+    }): void,
+    learnNgramToken(token: Token): void
+};
+
+export type AddonEmbeddingIndex = {
+    /** @returns the index of the first added vector */
+    add(vectors: Float32Array): Promise<number>,
+    search(queries: Float32Array, k: number, options?: {
+        threads?: number
+    }): Promise<{
+        /** the number of results per query */
+        k: number,
+        indexes: Uint32Array,
+        scores: Float32Array
+    }>,
+    save(filePath: string): Promise<void>,
+    load(filePath: string, options?: {
+        useMmap?: boolean
+    }): Promise<void>,
+    getSize(): number,
+    getVectorSize(): number,
+    getType(): "f32" | "f16" | "int8",
+    getMetric(): "cosine" | "dot",
+    getIsMemoryMapped(): boolean,
+    dispose(): void
+};
+
+export type AddonTokenLookupIndex = {
+    setInputTokens(tokens: Uint32Array): void,
+    setStateTokens(tokens: Uint32Array): void,
+    pushStateTokens(tokens: Uint32Array): void,
+    predict(patternMinLength: number, patternMaxLength: number, predictionMinLength: number, predictionMaxLength: number): Uint32Array,
+    dispose(): void
+};
+
+export type AddonThreadPool = {
+    getThreads(): number,
+    pause(): void,
+    resume(): void,
+    dispose(): void
+};
+
+export type AddonNgramCache = {
+    draft(contextTokens: Uint32Array, maxTokens: number, minCount: number): Uint32Array,
+    recordAcceptedTokens(tokens: number): void,
+    getStats(): {
+        lookups: number,
+        hits: number,
+        draftedTokens: number,
+        acceptedTokens: number,
+        learnedTokens: number,
+        memorySize: number
+    },
+    dispose(): void
 };
 
 export type AddonModelLora = {
@@ -240,6 +420,29 @@ export type AddonModelLora = {
     dispose(): Promise<void>
 };
 
+// `magic` and `version` are always set, and the rest only when the file is a supported GGUF file
+export type AddonGgufFileHeader = {
+    magic: string,
+    version: number,
+    tensorCount?: number,
+    metadataSize?: number,
+
+    // the bytes of the file up to the end of the metadata
+    header?: ArrayBuffer,
+    metadataKeys?: string[],
+
+    // 2 items for each metadata key: value type, value offset
+    metadataEntries?: Float64Array,
+
+    // only when reading the tensor info
+    tensorNames?: string[],
+
+    // 7 items for each tensor: ggml type, offset, dimensions count, and 4 dimensions
+    tensorTable?: Float64Array,
+    tensorInfoSize?: number,
+    tensorDataOffset?: number
+};
+
 export type ModelTypeDescription = `${AddonModelArchName} ${AddonModelTypeName} ${AddonModelFileTypeName}`;
 export type AddonModelArchName = "unknown" | "llama" | "falcon" | "gpt2" | "gptj" | "gptneox" | "mpt" | "baichuan" | "starcoder" | "persimmon" |
     "refact" | "bloom" | "stablelm";
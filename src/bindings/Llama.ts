@@ -4,16 +4,20 @@ import chalk from "chalk";
 import {DisposedError, EventRelay, withLock} from "lifecycle-utils";
 import {getConsoleLogPrefix} from "../utils/getConsoleLogPrefix.js";
 import {LlamaModel, LlamaModelOptions} from "../evaluator/LlamaModel/LlamaModel.js";
+import {resolveSplitGgufParts} from "../gguf/utils/resolveSplitGgufParts.js";
+import type {LlamaContext} from "../evaluator/LlamaContext/LlamaContext.js";
 import {DisposeGuard} from "../utils/DisposeGuard.js";
 import {GbnfJsonDefList, GbnfJsonSchema} from "../utils/gbnfJson/types.js";
 import {LlamaJsonSchemaGrammar} from "../evaluator/LlamaJsonSchemaGrammar.js";
 import {LlamaGrammar, LlamaGrammarOptions} from "../evaluator/LlamaGrammar.js";
+import {LlamaThreadPool, LlamaThreadPoolOptions} from "../evaluator/LlamaThreadPool.js";
 import {ThreadsSplitter} from "../utils/ThreadsSplitter.js";
 import {getLlamaClasses, LlamaClasses} from "../utils/getLlamaClasses.js";
 import {BindingModule} from "./AddonTypes.js";
 import {
     BuildGpu, BuildMetadataFile, LlamaGpuType, LlamaLocks, LlamaLogLevel,
-    LlamaLogLevelGreaterThan, LlamaLogLevelGreaterThanOrEqual, LlamaNuma
+    LlamaLogLevelGreaterThan, LlamaLogLevelGreaterThanOrEqual, LlamaNuma, LlamaCpuAffinity, LlamaNumaNode,
+    LlamaExecutorMetrics, LlamaMemoryUsage, LlamaPagingStats
 } from "./types.js";
 import {MemoryOrchestrator, MemoryReservation} from "./utils/MemoryOrchestrator.js";
 
@@ -67,6 +71,10 @@ export class Llama {
     /** @internal */ private _previousLogLevel: LlamaLogLevel | null = null;
     /** @internal */ private _nextLogNeedNewLine: boolean = false;
     /** @internal */ private _disposed: boolean = false;
+    /** @internal */ private _lastPagingSample: {
+        time: number,
+        stats: ReturnType<BindingModule["getPagingStats"]>
+    } | null = null;
 
     private _classes?: LlamaClasses;
     public readonly onDispose = new EventRelay<void>();
@@ -236,6 +244,137 @@ export class Llama {
         return this._numa;
     }
 
+    /**
+     * Get the NUMA nodes of the machine and their CPU cores.
+     *
+     * Only supported on Linux. Returns an empty array on other platforms.
+     */
+    public getNumaNodes(): LlamaNumaNode[] {
+        this._ensureNotDisposed();
+
+        return this._bindings.getNumaNodes();
+    }
+
+    /**
+     * Get the queue depth and wait time metrics of the threads that run the native work of `node-llama-cpp`.
+     *
+     * The native work runs on dedicated threads instead of on the libuv thread pool,
+     * with a separate lane for evaluations, for state file I/O, for loading models and for prefetching model files,
+     * so a long model load or a burst of file I/O doesn't delay evaluations.
+     */
+    public getExecutorMetrics(): LlamaExecutorMetrics {
+        this._ensureNotDisposed();
+
+        return this._bindings.getExecutorMetrics();
+    }
+
+    /**
+     * Get a breakdown of the memory usage of the process, and of the given models and contexts.
+     *
+     * Without `fileResidency`, this is cheap enough to call before every request,
+     * so it can be used to decide whether there's enough memory to accept it.
+     * Use `rss` or `pss` for that rather than `virtual`,
+     * which counts the full size of memory-mapped model files even when they're not in RAM.
+     */
+    public getMemoryUsage({
+        models = [],
+        contexts = [],
+        fileResidency = false
+    }: {
+        models?: readonly LlamaModel[],
+        contexts?: readonly LlamaContext[],
+
+        /**
+         * Check how much of the file of each of the given models is in the page cache (`fileResidentSize`).
+         *
+         * This goes over every page of the model files synchronously, which can take a while for large models,
+         * so prefer the async `model.getFileResidency()` when it's checked often.
+         *
+         * Defaults to `false`.
+         */
+        fileResidency?: boolean
+    } = {}): LlamaMemoryUsage {
+        this._ensureNotDisposed();
+
+        const usage = this._bindings.getMemoryUsage(
+            models.map((model) => model._model),
+            models.map((model) => resolveSplitGgufParts(model.modelPath)),
+            contexts.map((context) => context._ctx),
+            fileResidency
+        );
+
+        const processItems = 6;
+        const modelItems = 2;
+        const contextItems = 3;
+        const getSize = (index: number) => (
+            usage[index]! < 0
+                ? null
+                : usage[index]!
+        );
+
+        return {
+            rss: getSize(0),
+            pss: getSize(1),
+            anonymous: getSize(2),
+            fileBacked: getSize(3),
+            swap: getSize(4),
+            virtual: getSize(5),
+            models: models.map((_, i) => {
+                const offset = processItems + i * modelItems;
+
+                return {
+                    fileResidentSize: getSize(offset),
+                    fileSize: getSize(offset + 1)
+                };
+            }),
+            contexts: contexts.map((_, i) => {
+                const offset = processItems + models.length * modelItems + i * contextItems;
+
+                return {
+                    kvCacheSize: usage[offset]!,
+                    computeBuffersSize: usage[offset + 1]!,
+                    batchSize: usage[offset + 2]!
+                };
+            })
+        };
+    }
+
+    /**
+     * Get the page faults of the process and the pages the system swapped in from the disk,
+     * with their rates since the previous call.
+     *
+     * Unlike `context.getDecodeStats()`, which only attributes page faults to a context when no other context decoded at the same time,
+     * this covers the whole process, so it can be polled to detect paging when multiple contexts are decoding concurrently.
+     */
+    public getPagingStats(): LlamaPagingStats {
+        this._ensureNotDisposed();
+
+        const time = performance.now();
+        const stats = this._bindings.getPagingStats();
+        const lastSample = this._lastPagingSample;
+        this._lastPagingSample = {time, stats};
+
+        const getCount = (value: number) => (
+            value < 0
+                ? null
+                : value
+        );
+        const getRate = (value: number, lastValue: number | undefined) => {
+            if (lastSample == null || lastValue == null || value < 0 || lastValue < 0 || time <= lastSample.time)
+                return null;
+
+            return Math.max(0, value - lastValue) / ((time - lastSample.time) / 1000);
+        };
+
+        return {
+            majorPageFaults: getCount(stats.majorPageFaults),
+            minorPageFaults: getCount(stats.minorPageFaults),
+            swappedInPages: getCount(stats.swappedInPages),
+            majorPageFaultRate: getRate(stats.majorPageFaults, lastSample?.stats.majorPageFaults),
+            swapInRate: getRate(stats.swappedInPages, lastSample?.stats.swappedInPages)
+        };
+    }
+
     public get logLevel() {
         return this._logLevel;
     }
@@ -393,6 +532,33 @@ export class Llama {
         return new LlamaGrammar(this, options);
     }
 
+    /**
+     * Create a pool of compute threads that can be shared by multiple contexts,
+     * so contexts that run in parallel take turns using the same threads instead of oversubscribing the CPU cores.
+     *
+     * Pass the thread pool to the `threadPool` option when creating contexts.
+     */
+    public createThreadPool(options: LlamaThreadPoolOptions = {}) {
+        this._ensureNotDisposed();
+
+        return LlamaThreadPool._create({_llama: this}, options);
+    }
+
+    /** @internal */
+    public _resolveCpuAffinity(cpuAffinity?: LlamaCpuAffinity): number[] | undefined {
+        if (cpuAffinity == null)
+            return undefined;
+
+        if ("cpus" in cpuAffinity)
+            return cpuAffinity.cpus.slice();
+
+        const numaNode = this._bindings.getNumaNodes().find((node) => node.node === cpuAffinity.numaNode);
+        if (numaNode == null)
+            throw new Error(`NUMA node ${cpuAffinity.numaNode} was not found`);
+
+        return numaNode.cpus;
+    }
+
     /** @internal */
     public async _init() {
         await this._bindings.init();
@@ -25,6 +25,164 @@ export type BuildOptions = {
 export const llamaNumaOptions = ["distribute", "isolate", "numactl", "mirror", false] as const satisfies LlamaNuma[];
 export type LlamaNuma = false | "distribute" | "isolate" | "numactl" | "mirror";
 
+/**
+ * The CPU cores to run on - either a list of CPU core indexes, or all the CPU cores of a NUMA node.
+ *
+ * NUMA nodes are only detected on Linux.
+ */
+export type LlamaCpuAffinity = {
+    cpus: readonly number[]
+} | {
+    numaNode: number
+};
+
+export type LlamaNumaNode = {
+    node: number,
+
+    /** The CPU core indexes of the NUMA node */
+    cpus: number[]
+};
+
+export type LlamaExecutorLaneMetrics = {
+    /** The number of tasks waiting for a free thread of the lane */
+    queued: number,
+
+    /** The number of tasks currently running on the lane */
+    running: number,
+
+    /** The number of threads the lane created so far */
+    threads: number,
+
+    /** The number of tasks that finished running on the lane */
+    completed: number,
+
+    /** The total time tasks waited in the queue of the lane before running, in milliseconds */
+    totalWaitTime: number,
+
+    /** The longest time a task waited in the queue of the lane before running, in milliseconds */
+    maxWaitTime: number,
+
+    /** The time the last task that started running waited in the queue of the lane, in milliseconds */
+    lastWaitTime: number
+};
+
+export type LlamaExecutorMetrics = {
+    /** Decoding, sampling and computing embeddings */
+    compute: LlamaExecutorLaneMetrics,
+
+    /** Saving and loading state files */
+    io: LlamaExecutorLaneMetrics,
+
+    /** Loading and unloading models, contexts and LoRA adapters */
+    load: LlamaExecutorLaneMetrics,
+
+    /** Prefetching model files into the page cache */
+    prefetch: LlamaExecutorLaneMetrics
+};
+
+/**
+ * All sizes are in bytes, and are `null` when they're not available on the current platform
+ */
+export type LlamaMemoryUsage = {
+    /** Resident set size - the memory of the process that is currently in RAM, including the mapped parts of model files */
+    rss: number | null,
+
+    /**
+     * Proportional set size - like `rss`, but memory shared with other processes (like a model file mapped by multiple processes)
+     * is divided between them.
+     *
+     * Only available on Linux.
+     */
+    pss: number | null,
+
+    /** The part of `rss` that isn't backed by files (like model weights loaded without mmap, and the KV cache on the CPU) */
+    anonymous: number | null,
+
+    /**
+     * The part of `rss` that is backed by files (like model files loaded using mmap).
+     *
+     * Only available on Linux.
+     */
+    fileBacked: number | null,
+
+    /** The memory of the process that was moved to swap */
+    swap: number | null,
+
+    /**
+     * The virtual memory size of the process.
+     * This includes the full size of memory-mapped model files, even when they're not read into RAM
+     */
+    virtual: number | null,
+
+    /** The memory usage of each of the given models, in the same order */
+    models: Array<{
+        /**
+         * The size of the parts of the model files that are in the page cache.
+         *
+         * When the model is loaded using mmap, this is the part of the model weights that doesn't have to be read from the disk.
+         *
+         * Only checked when `fileResidency` is enabled.
+         * On Linux, it's `null` when the process neither owns the model file nor can write to it.
+         */
+        fileResidentSize: number | null,
+
+        /** The total size of the model files */
+        fileSize: number | null
+    }>,
+
+    /** The memory usage of each of the given contexts, in the same order */
+    contexts: Array<{
+        /** The size of the KV cache of the context that is in RAM. A KV cache that is offloaded to the GPU isn't included */
+        kvCacheSize: number,
+
+        /** The size of the compute buffers of the context that are in RAM. Compute buffers on the GPU aren't included */
+        computeBuffersSize: number,
+
+        /** The size of the buffers used to pass batches to the context */
+        batchSize: number
+    }>
+};
+
+/**
+ * The counters are `null` when they're not available on the current platform
+ */
+export type LlamaPagingStats = {
+    /**
+     * The number of page faults of the process that had to read from the disk so far.
+     *
+     * When models are loaded using mmap, these are usually parts of the model weights that are not in RAM.
+     *
+     * Always `0` on Windows, where these are not reported separately from `minorPageFaults`.
+     */
+    majorPageFaults: number | null,
+
+    /** The number of page faults of the process that were resolved without reading from the disk so far */
+    minorPageFaults: number | null,
+
+    /**
+     * The number of pages the whole system swapped in from the disk so far.
+     *
+     * Only available on Linux.
+     */
+    swappedInPages: number | null,
+
+    /**
+     * The number of major page faults of the process per second since the previous call of `getPagingStats()`.
+     *
+     * `null` on the first call.
+     */
+    majorPageFaultRate: number | null,
+
+    /**
+     * The number of pages the whole system swapped in per second since the previous call of `getPagingStats()`.
+     *
+     * A sustained non-zero rate means that the system is short on RAM.
+     *
+     * `null` on the first call.
+     */
+    swapInRate: number | null
+};
+
 export type BuildOptionsJSON = Omit<BuildOptions, "customCmakeOptions"> & {
     customCmakeOptions: Record<string, string>
 };
@@ -5,6 +5,7 @@ import {InspectGgufCommand} from "./commands/InspectGgufCommand.js";
 import {InspectGpuCommand} from "./commands/InspectGpuCommand.js";
 import {InspectMeasureCommand} from "./commands/InspectMeasureCommand.js";
 import {InspectEstimateCommand} from "./commands/InspectEstimateCommand.js";
+import {InspectBenchmarkCommand} from "./commands/InspectBenchmarkCommand.js";
 
 type InspectCommand = {
     // no options for now
@@ -21,7 +22,8 @@ export const InspectCommand: CommandModule<object, InspectCommand> = {
             .command(InspectGpuCommand)
             .command(InspectGgufCommand)
             .command(InspectMeasureCommand)
-            .command(InspectEstimateCommand);
+            .command(InspectEstimateCommand)
+            .command(InspectBenchmarkCommand);
     },
     async handler() {
         // this function must exist, even though we do nothing here
@@ -0,0 +1,630 @@
+import os from "os";
+import process from "process";
+import {CommandModule} from "yargs";
+import chalk from "chalk";
+import {resolveCommandGgufPath} from "../../../utils/resolveCommandGgufPath.js";
+import {getLlama} from "../../../../bindings/getLlama.js";
+import {BuildGpu, LlamaLogLevel, nodeLlamaCppGpuOptions, parseNodeLlamaCppGpuOption} from "../../../../bindings/types.js";
+import {ConsoleTable, ConsoleTableColumn} from "../../../utils/ConsoleTable.js";
+import {resolveHeaderFlag} from "../../../utils/resolveHeaderFlag.js";
+import {getPrettyBuildGpuName} from "../../../../bindings/consts.js";
+import {getReadablePath} from "../../../utils/getReadablePath.js";
+import {withCliCommandDescriptionDocsUrl} from "../../../utils/withCliCommandDescriptionDocsUrl.js";
+import {documentationPageUrls} from "../../../../config.js";
+import {Llama} from "../../../../bindings/Llama.js";
+import {LlamaModel} from "../../../../evaluator/LlamaModel/LlamaModel.js";
+import {Token} from "../../../../types.js";
+import {LlamaContextKvCacheType, LlamaContextOptions} from "../../../../evaluator/LlamaContext/types.js";
+import {llamaContextKvCacheTypes} from "../../../../evaluator/LlamaContext/utils/resolveKvCacheGgmlType.js";
+import {toBytes} from "../../../utils/toBytes.js";
+import {readGgufFileInfo} from "../../../../gguf/readGgufFileInfo.js";
+
+const benchmarkTypes = ["numa", "ubatch", "kvCache", "ggufParser"] as const;
+type BenchmarkType = typeof benchmarkTypes[number];
+
+type InspectBenchmarkCommand = {
+    modelPath?: string,
+    header?: string[],
+    gpu?: BuildGpu | "auto",
+    type: BenchmarkType,
+    contextSize: number,
+    batchSize?: number,
+    batchSizes: number[],
+    ubatchSizes: number[],
+    kvCacheTypes: LlamaContextKvCacheType[],
+    threads?: number,
+    promptTokens: number,
+    generateTokens: number,
+    repeats: number
+};
+
+export const InspectBenchmarkCommand: CommandModule<object, InspectBenchmarkCommand> = {
+    command: "benchmark [modelPath]",
+    describe: withCliCommandDescriptionDocsUrl(
+        "Benchmark the evaluation speed of a GGUF model file under different runtime configurations",
+        documentationPageUrls.CLI.Inspect.Benchmark
+    ),
+    builder(yargs) {
+        return yargs
+            .option("modelPath", {
+                alias: ["m", "model", "path", "url", "uri"],
+                type: "string",
+                description: "Model file to benchmark. Can be a path to a local file or a URI of a model file to download. Leave empty to choose from a list of recommended models"
+            })
+            .option("header", {
+                alias: ["H"],
+                type: "string",
+                array: true,
+                description: "Headers to use when downloading a model from a URL, in the format `key: value`. You can pass this option multiple times to add multiple headers."
+            })
+            .option("gpu", {
+                type: "string",
+
+                // yargs types don't support passing `false` as a choice, although it is supported by yargs
+                choices: nodeLlamaCppGpuOptions as any as Exclude<typeof nodeLlamaCppGpuOptions[number], false>[],
+                coerce: (value) => {
+                    if (value == null || value == "")
+                        return undefined;
+
+                    return parseNodeLlamaCppGpuOption(value);
+                },
+                defaultDescription: "Uses the latest local build, and fallbacks to \"auto\"",
+                description: "Compute layer implementation type to use for llama.cpp. If omitted, uses the latest local build, and fallbacks to \"auto\""
+            })
+            .option("type", {
+                alias: "t",
+                type: "string",
+                choices: benchmarkTypes,
+                default: "numa" as const,
+                description: "The benchmark to run. " +
+                    "`numa` compares the evaluation speed of a context running on the NUMA node the model was loaded on with contexts running on other NUMA nodes. " +
+                    "`ubatch` compares the evaluation speed and memory usage of combinations of batch sizes and physical batch sizes. " +
+                    "`kvCache` compares the capacity and evaluation speed of KV cache types. " +
+                    "`ggufParser` compares the time it takes to read the GGUF file header using the TypeScript parser and the native parser"
+            })
+            .option("contextSize", {
+                alias: "c",
+                type: "number",
+                default: 4096,
+                description: "Context size to use for the benchmarked contexts"
+            })
+            .option("batchSize", {
+                alias: "b",
+                type: "number",
+                description: "Batch size to use for the benchmarked contexts"
+            })
+            .option("batchSizes", {
+                alias: "bs",
+                type: "number",
+                array: true,
+                default: [512, 1024, 2048],
+                description: "Batch sizes to compare in the `ubatch` benchmark"
+            })
+            .option("ubatchSizes", {
+                alias: "ubs",
+                type: "number",
+                array: true,
+                default: [128, 256, 512, 1024, 2048],
+                description: "Physical batch sizes to compare in the `ubatch` benchmark. Only sizes up to the batch size are used with each batch size"
+            })
+            .option("kvCacheTypes", {
+                alias: "kvt",
+                type: "string",
+                array: true,
+                choices: llamaContextKvCacheTypes,
+                default: ["f16", "q8_0", "q4_0"] satisfies LlamaContextKvCacheType[],
+                description: "KV cache types to compare in the `kvCache` benchmark. Each type is used for both the keys and the values"
+            })
+            .option("threads", {
+                type: "number",
+                defaultDescription: "The number of CPU cores of the benchmarked CPU set",
+                description: "Number of threads to use for the evaluation"
+            })
+            .option("promptTokens", {
+                alias: "pt",
+                type: "number",
+                default: 512,
+                description: "Number of prompt tokens to evaluate in each measurement"
+            })
+            .option("generateTokens", {
+                alias: "gt",
+                type: "number",
+                default: 128,
+                description: "Number of tokens to generate in each measurement"
+            })
+            .option("repeats", {
+                alias: "r",
+                type: "number",
+                default: 3,
+                description: "Number of times to repeat each measurement. The best result is shown"
+            });
+    },
+    async handler({
+        modelPath: ggufPath, header: headerArg, gpu, type, contextSize, batchSize, batchSizes, ubatchSizes, kvCacheTypes, threads,
+        promptTokens, generateTokens, repeats
+    }: InspectBenchmarkCommand) {
+        const headers = resolveHeaderFlag(headerArg);
+
+        // ensure a llama build is available
+        const llama = gpu == null
+            ? await getLlama("lastBuild", {
+                logLevel: LlamaLogLevel.error
+            })
+            : await getLlama({
+                gpu,
+                logLevel: LlamaLogLevel.error
+            });
+
+        const resolvedGgufPath = await resolveCommandGgufPath(ggufPath, llama, headers);
+
+        console.info(`${chalk.yellow("File:")} ${getReadablePath(resolvedGgufPath)}`);
+        console.info(`${chalk.yellow("GPU:")} ${getPrettyBuildGpuName(llama.gpu)}${gpu == null ? chalk.gray(" (last build)") : ""}`);
+        console.info();
+
+        const measureOptions: MeasureOptions = {
+            contextSize,
+            batchSize,
+            threads,
+            promptTokens: Math.max(1, Math.floor(promptTokens)),
+            generateTokens: Math.max(1, Math.floor(generateTokens)),
+            repeats: Math.max(1, Math.floor(repeats))
+        };
+
+        if (type === "numa")
+            await benchmarkNuma(llama, resolvedGgufPath, measureOptions);
+        else if (type === "ubatch")
+            await benchmarkUbatch(llama, resolvedGgufPath, measureOptions, {batchSizes, ubatchSizes});
+        else if (type === "kvCache")
+            await benchmarkKvCache(llama, resolvedGgufPath, measureOptions, {kvCacheTypes});
+        else if (type === "ggufParser")
+            await benchmarkGgufParser(llama, resolvedGgufPath, measureOptions);
+
+        await llama.dispose();
+        process.exit(0);
+    }
+};
+
+type MeasureOptions = {
+    contextSize: number,
+
+    /** The context size is never smaller than this, even when the prompt and the generated tokens fit in a smaller context */
+    minContextSize?: number,
+    batchSize?: number,
+    threads?: number,
+    promptTokens: number,
+    generateTokens: number,
+    repeats: number
+};
+
+type MeasureContextOptions = Pick<
+    LlamaContextOptions, "cpuAffinity" | "batchSize" | "ubatchSize" | "flashAttention" | "kvCacheKeyType" | "kvCacheValueType"
+>;
+
+type MeasureResult = {
+    promptTokensPerSecond: number,
+    generationTokensPerSecond: number,
+
+    /** The peak growth of the process resident memory while the context was created and evaluated */
+    ramUsage: number,
+
+    /** The peak growth of the used VRAM, sampled after creating the context and after each evaluation */
+    vramUsage: number
+};
+
+async function benchmarkNuma(llama: Llama, modelPath: string, measureOptions: MeasureOptions) {
+    const numaNodes = llama.getNumaNodes();
+
+    if (numaNodes.length === 0) {
+        console.info(chalk.yellow("NUMA topology information is not available on this machine"));
+        return;
+    }
+
+    const modelNode = numaNodes[0]!;
+    console.info(`${chalk.yellow("NUMA nodes:")} ${numaNodes.map((node) => `${node.node} (${node.cpus.length} CPUs)`).join(", ")}`);
+    console.info(`${chalk.yellow("Model loaded on NUMA node:")} ${modelNode.node}`);
+
+    if (numaNodes.length === 1)
+        console.info(chalk.gray("Only one NUMA node was found, so there are no cross-node contexts to compare with"));
+
+    console.info();
+
+    const model = await llama.loadModel({
+        modelPath,
+        gpuLayers: 0,
+
+        // memory-mapped weights that are already in the page cache stay on the node they were first read on
+        useMmap: false,
+        cpuAffinity: {numaNode: modelNode.node}
+    });
+
+    const table = new ConsoleTable([{
+        key: "contextNode",
+        title: "Context node",
+        width: 14
+    }, {
+        key: "placement",
+        title: "Placement",
+        width: 11
+    }, {
+        key: "promptSpeed",
+        title: "Prompt t/s",
+        width: 12
+    }, {
+        key: "generationSpeed",
+        title: "Generation t/s",
+        width: 16
+    }] as const satisfies readonly ConsoleTableColumn[]);
+
+    table.logHeader();
+
+    let localResult: MeasureResult | undefined = undefined;
+    for (const node of numaNodes) {
+        const isLocal = node.node === modelNode.node;
+        const result = await measureEvaluationSpeed(model, {cpuAffinity: {numaNode: node.node}}, measureOptions);
+
+        if (isLocal)
+            localResult = result;
+
+        table.logLine({
+            contextNode: String(node.node),
+            placement: isLocal
+                ? chalk.green("local")
+                : chalk.yellow("cross-node"),
+            promptSpeed: formatSpeed(result.promptTokensPerSecond, localResult?.promptTokensPerSecond, isLocal),
+            generationSpeed: formatSpeed(result.generationTokensPerSecond, localResult?.generationTokensPerSecond, isLocal)
+        });
+    }
+
+    await model.dispose();
+}
+
+async function benchmarkUbatch(llama: Llama, modelPath: string, measureOptions: MeasureOptions, {batchSizes, ubatchSizes}: {
+    batchSizes: number[],
+    ubatchSizes: number[]
+}) {
+    const model = await llama.loadModel({modelPath});
+
+    // every row uses the same context and prompt, which must fit the largest batch size,
+    // otherwise the batch size is clamped to the context size and larger batches aren't filled
+    const largestBatchSize = Math.max(...batchSizes);
+    const ubatchMeasureOptions: MeasureOptions = {
+        ...measureOptions,
+        minContextSize: largestBatchSize,
+        promptTokens: Math.max(measureOptions.promptTokens, largestBatchSize)
+    };
+
+    if (ubatchMeasureOptions.promptTokens !== measureOptions.promptTokens) {
+        console.info(chalk.gray(`The prompt is extended to ${ubatchMeasureOptions.promptTokens} tokens to fill the largest batch size`));
+        console.info();
+    }
+
+    const table = new ConsoleTable([{
+        key: "batchSize",
+        title: "Batch size",
+        width: 12
+    }, {
+        key: "ubatchSize",
+        title: "Ubatch size",
+        width: 13
+    }, {
+        key: "promptSpeed",
+        title: "Prompt t/s",
+        width: 12
+    }, {
+        key: "generationSpeed",
+        title: "Generation t/s",
+        width: 16
+    }, {
+        key: "ram",
+        title: "RAM",
+        width: 12
+    }, {
+        key: "vram",
+        title: "VRAM",
+        width: 12
+    }] as const satisfies readonly ConsoleTableColumn[]);
+
+    table.logHeader();
+
+    for (const batchSize of [...new Set(batchSizes)].sort((a, b) => a - b)) {
+        const resolvedUbatchSizes = [...new Set(ubatchSizes.filter((ubatchSize) => ubatchSize <= batchSize))]
+            .sort((a, b) => a - b);
+
+        let baseline: MeasureResult | undefined = undefined;
+        for (const ubatchSize of resolvedUbatchSizes) {
+            const result = await measureEvaluationSpeed(model, {batchSize, ubatchSize}, ubatchMeasureOptions);
+            const isBaseline = baseline == null;
+
+            if (baseline == null)
+                baseline = result;
+
+            table.logLine({
+                batchSize: String(batchSize),
+                ubatchSize: String(ubatchSize),
+                promptSpeed: formatSpeed(result.promptTokensPerSecond, baseline.promptTokensPerSecond, isBaseline),
+                generationSpeed: formatSpeed(result.generationTokensPerSecond, baseline.generationTokensPerSecond, isBaseline),
+                ram: toBytes(result.ramUsage),
+                vram: toBytes(result.vramUsage)
+            });
+        }
+    }
+
+    await model.dispose();
+}
+
+async function benchmarkKvCache(llama: Llama, modelPath: string, measureOptions: MeasureOptions, {kvCacheTypes}: {
+    kvCacheTypes: LlamaContextKvCacheType[]
+}) {
+    const model = await llama.loadModel({modelPath});
+    const flashAttention = model.flashAttentionSupported;
+
+    if (!flashAttention)
+        console.info(chalk.yellow("Flash attention is not supported by this model, so the KV cache values are kept as f16"));
+
+    const availableMemory = model.gpuLayers > 0
+        ? (await llama.getVramState()).free
+        : os.freemem();
+
+    console.info(`${chalk.yellow("Available " + (model.gpuLayers > 0 ? "VRAM" : "RAM") + ":")} ${toBytes(availableMemory)}`);
+    console.info();
+
+    const table = new ConsoleTable([{
+        key: "keyType",
+        title: "K type",
+        width: 8
+    }, {
+        key: "valueType",
+        title: "V type",
+        width: 8
+    }, {
+        key: "sequenceMemory",
+        title: "Memory/seq",
+        width: 12
+    }, {
+        key: "maxSequences",
+        title: "Max sequences",
+        width: 15
+    }, {
+        key: "promptSpeed",
+        title: "Prompt t/s",
+        width: 12
+    }, {
+        key: "generationSpeed",
+        title: "Generation t/s",
+        width: 16
+    }] as const satisfies readonly ConsoleTableColumn[]);
+
+    table.logHeader();
+
+    let baseline: MeasureResult | undefined = undefined;
+    for (const kvCacheType of [...new Set(kvCacheTypes)]) {
+        const kvCacheKeyType = kvCacheType;
+        const kvCacheValueType = flashAttention
+            ? kvCacheType
+            : "f16";
+
+        const estimateMemory = (sequences: number) => {
+            const requirements = model.fileInsights.estimateContextResourceRequirements({
+                contextSize: measureOptions.contextSize,
+                sequences,
+                modelGpuLayers: model.gpuLayers,
+                batchSize: measureOptions.batchSize,
+                flashAttention,
+                kvCacheKeyType,
+                kvCacheValueType
+            });
+
+            return model.gpuLayers > 0
+                ? requirements.gpuVram
+                : requirements.cpuRam;
+        };
+
+        // the memory that isn't the KV cache (like the compute buffers) is shared by all the sequences of a context
+        const sequenceMemory = estimateMemory(2) - estimateMemory(1);
+        const sharedMemory = Math.max(0, estimateMemory(1) - sequenceMemory);
+        const maxSequences = sequenceMemory <= 0
+            ? 0
+            : Math.max(0, Math.floor((availableMemory - sharedMemory) / sequenceMemory));
+
+        const result = await measureEvaluationSpeed(model, {flashAttention, kvCacheKeyType, kvCacheValueType}, measureOptions);
+        const isBaseline = baseline == null;
+
+        if (baseline == null)
+            baseline = result;
+
+        table.logLine({
+            keyType: kvCacheKeyType,
+            valueType: kvCacheValueType,
+            sequenceMemory: toBytes(sequenceMemory),
+            maxSequences: String(maxSequences),
+            promptSpeed: formatSpeed(result.promptTokensPerSecond, baseline.promptTokensPerSecond, isBaseline),
+            generationSpeed: formatSpeed(result.generationTokensPerSecond, baseline.generationTokensPerSecond, isBaseline)
+        });
+    }
+
+    console.info();
+    console.info(chalk.gray(`Max sequences is estimated for sequences with a context size of ${measureOptions.contextSize}`));
+
+    await model.dispose();
+}
+
+async function benchmarkGgufParser(llama: Llama, modelPath: string, {repeats}: MeasureOptions) {
+    const table = new ConsoleTable([{
+        key: "parser",
+        title: "Parser",
+        width: 12
+    }, {
+        key: "headerTime",
+        title: "Header",
+        width: 20
+    }, {
+        key: "tokensTime",
+        title: "Tokens access",
+        width: 15
+    }, {
+        key: "tensors",
+        title: "Tensors",
+        width: 9
+    }] as const satisfies readonly ConsoleTableColumn[]);
+
+    table.logHeader();
+
+    let baselineHeaderTime: number | undefined = undefined;
+    for (const parser of ["typescript", "native"] as const) {
+        let bestHeaderTime = Infinity;
+        let bestTokensTime = Infinity;
+        let tensors = 0;
+
+        for (let i = 0; i < repeats; i++) {
+            const headerStartTime = performance.now();
+            const fileInfo = await readGgufFileInfo(modelPath, {
+                sourceType: "filesystem",
+                logWarnings: false,
+                llama: parser === "native"
+                    ? llama
+                    : undefined
+            });
+            bestHeaderTime = Math.min(bestHeaderTime, performance.now() - headerStartTime);
+
+            // the native parser only decodes array values when they're accessed
+            const tokensStartTime = performance.now();
+            void fileInfo.metadata.tokenizer?.ggml?.tokens?.length;
+            bestTokensTime = Math.min(bestTokensTime, performance.now() - tokensStartTime);
+
+            tensors = fileInfo.tensorInfo?.length ?? 0;
+        }
+
+        const isBaseline = baselineHeaderTime == null;
+        if (baselineHeaderTime == null)
+            baselineHeaderTime = bestHeaderTime;
+
+        table.logLine({
+            parser,
+            headerTime: formatDuration(bestHeaderTime, baselineHeaderTime, isBaseline),
+            tokensTime: `${bestTokensTime.toFixed(1)}ms`,
+            tensors: String(tensors)
+        });
+    }
+
+    console.info();
+    console.info(chalk.gray("The best time of each parser is shown. Lower is better"));
+}
+
+async function measureEvaluationSpeed(model: LlamaModel, contextOptions: MeasureContextOptions, {
+    contextSize, minContextSize = 0, batchSize, threads, promptTokens, generateTokens, repeats
+}: MeasureOptions): Promise<MeasureResult> {
+    const ramUsageBefore = process.memoryUsage.rss();
+    const vramUsageBefore = (await model._llama.getVramState()).used;
+
+    // the compute buffers grow while evaluating, so the peak is sampled across the entire measurement
+    const peakRamSampler = createPeakRssSampler();
+    let peakVramUsage = vramUsageBefore;
+
+    let bestPromptTime = Infinity;
+    let bestGenerationTime = Infinity;
+
+    try {
+        const context = await model.createContext({
+            contextSize: Math.max(minContextSize, Math.min(contextSize, promptTokens + generateTokens + 1)),
+            batchSize,
+            threads,
+            ...contextOptions
+        });
+
+        try {
+            peakVramUsage = Math.max(peakVramUsage, (await model._llama.getVramState()).used);
+
+            const sequence = context.getSequence();
+            const prompt = getBenchmarkPromptTokens(model, promptTokens);
+
+            for (let i = 0; i < repeats; i++) {
+                await sequence.clearHistory();
+
+                const promptStartTime = performance.now();
+                await sequence.evaluateWithoutGeneratingNewTokens(prompt);
+                bestPromptTime = Math.min(bestPromptTime, performance.now() - promptStartTime);
+
+                let generatedTokens = 0;
+                const generationStartTime = performance.now();
+                for await (const token of sequence.evaluate([prompt[0]!], {temperature: 0})) {
+                    void token;
+                    generatedTokens++;
+
+                    if (generatedTokens >= generateTokens)
+                        break;
+                }
+                bestGenerationTime = Math.min(bestGenerationTime, (performance.now() - generationStartTime) / generatedTokens * generateTokens);
+
+                peakVramUsage = Math.max(peakVramUsage, (await model._llama.getVramState()).used);
+            }
+        } finally {
+            await context.dispose();
+        }
+    } finally {
+        peakRamSampler.stop();
+    }
+
+    return {
+        promptTokensPerSecond: promptTokens / (bestPromptTime / 1000),
+        generationTokensPerSecond: generateTokens / (bestGenerationTime / 1000),
+        ramUsage: Math.max(0, peakRamSampler.peak - ramUsageBefore),
+        vramUsage: Math.max(0, peakVramUsage - vramUsageBefore)
+    };
+}
+
+function createPeakRssSampler(interval: number = 10) {
+    let peak = process.memoryUsage.rss();
+    const sample = () => {
+        peak = Math.max(peak, process.memoryUsage.rss());
+    };
+    const intervalId = setInterval(sample, interval);
+
+    return {
+        get peak() {
+            return peak;
+        },
+        stop() {
+            clearInterval(intervalId);
+            sample();
+        }
+    };
+}
+
+function getBenchmarkPromptTokens(model: LlamaModel, length: number): Token[] {
+    const textTokens = model.tokenize("The quick brown fox jumps over the lazy dog. ");
+    const res: Token[] = [];
+
+    while (res.length < length)
+        res.push(...textTokens.slice(0, length - res.length));
+
+    return res;
+}
+
+function formatDuration(duration: number, baseline: number | undefined, isBaseline: boolean) {
+    const durationText = `${duration.toFixed(1)}ms`;
+
+    if (isBaseline || baseline == null || duration === 0)
+        return durationText;
+
+    return durationText + " " + (
+        duration <= baseline
+            ? chalk.green(`(${(baseline / duration).toFixed(1)}x faster)`)
+            : chalk.red(`(${(duration / baseline).toFixed(1)}x slower)`)
+    );
+}
+
+function formatSpeed(speed: number, baseline: number | undefined, isBaseline: boolean) {
+    const speedText = speed.toFixed(1);
+
+    if (isBaseline || baseline == null || baseline === 0)
+        return speedText;
+
+    const diffPercentage = ((speed / baseline) - 1) * 100;
+    const diffText = `${diffPercentage >= 0 ? "+" : ""}${diffPercentage.toFixed(1)}%`;
+
+    return speedText + " " + (
+        diffPercentage >= 0
+            ? chalk.green(`(${diffText})`)
+            : chalk.red(`(${diffText})`)
+    );
+}
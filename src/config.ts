@@ -109,7 +109,8 @@ export const documentationPageUrls = {
             GPU: documentationCliUrl + "/inspect/gpu",
             GGUF: documentationCliUrl + "/inspect/gguf",
             Measure: documentationCliUrl + "/inspect/measure",
-            Estimate: documentationCliUrl + "/inspect/estimate"
+            Estimate: documentationCliUrl + "/inspect/estimate",
+            Benchmark: documentationCliUrl + "/inspect/benchmark"
         },
         Source: {
             index: documentationCliUrl + "/source",
@@ -10,6 +10,7 @@ import {TokenMeter} from "../TokenMeter.js";
 import {TokenBias} from "../TokenBias.js";
 import {LlamaModel} from "../LlamaModel/LlamaModel.js";
 import {UnsupportedError} from "../../utils/UnsupportedError.js";
+import {EvaluationDeadlineError} from "../../utils/EvaluationDeadlineError.js";
 import {ThreadsSplitterConsumer} from "../../utils/ThreadsSplitter.js";
 import {pushAll} from "../../utils/pushAll.js";
 import {safeEventCallback} from "../../utils/safeEventCallback.js";
@@ -17,12 +18,16 @@ import {GgufArchitectureType} from "../../gguf/types/GgufMetadataTypes.js";
 import {
     BatchingOptions, BatchItem, ContextShiftOptions, ContextTokensDeleteRange, ControlledEvaluateIndexOutput, ControlledEvaluateInputItem,
     EvaluationPriority, LlamaContextOptions, LlamaContextSequenceRepeatPenalty, PrioritizedBatchItem, SequenceEvaluateMetadataOptions,
-    SequenceEvaluateOptions, SequenceEvaluateOutput
+    SequenceEvaluateOptions, SequenceEvaluateOutput, LlamaContextKvCacheType,
+    LlamaContextKvCacheUsage, LlamaContextDecodeStats
 } from "./types.js";
 import {resolveBatchItemsPrioritizationStrategy} from "./utils/resolveBatchItemsPrioritizationStrategy.js";
 import {LlamaSampler} from "./LlamaSampler.js";
-import {TokenPredictor} from "./TokenPredictor.js";
+import {TokenPredictor, TokenPredictorNativeSpeculation} from "./TokenPredictor.js";
 import {padSafeContextSize} from "./utils/padSafeContextSize.js";
+import {tuneContextThreads} from "./utils/tuneContextThreads.js";
+import {isQuantizedKvCacheType, resolveKvCacheGgmlType} from "./utils/resolveKvCacheGgmlType.js";
+import {getContextShiftDeleteRanges} from "./utils/getContextShiftDeleteRanges.js";
 import type {Llama} from "../../bindings/Llama.js";
 
 const defaultLoraScale = 1;
@@ -47,12 +52,18 @@ export class LlamaContext {
     /** @internal */ private readonly _model: LlamaModel;
     /** @internal */ private readonly _contextSize: number;
     /** @internal */ private readonly _batchSize: number;
+    /** @internal */ private readonly _ubatchSize: number;
+    /** @internal */ private readonly _kvCacheKeyType: LlamaContextKvCacheType;
+    /** @internal */ private readonly _kvCacheValueType: LlamaContextKvCacheType;
     /** @internal */ private readonly _flashAttention: boolean;
-    /** @internal */ private readonly _idealThreads: number;
+    /** @internal */ private _idealThreads: number;
+    /** @internal */ private _idealBatchThreads: number;
     /** @internal */ private readonly _minThreads: number;
+    /** @internal */ private readonly _threadsAutoTune?: {maxThreads: number, cpus?: readonly number[]};
     /** @internal */ private readonly _performanceTracking: boolean;
     /** @internal */ private readonly _totalSequences: number;
     /** @internal */ private readonly _unusedSequenceIds: number[] = [];
+    /** @internal */ private readonly _sequenceRefs = new Map<number, WeakRef<LlamaContextSequence>>();
     /** @internal */ private readonly _batchingOptions: Required<BatchingOptions>;
     /** @internal */ private readonly _swaFullCache: boolean = false;
     /** @internal */ private readonly _queuedDecodeSequenceIds = new Set<number>();
@@ -60,8 +71,10 @@ export class LlamaContext {
     /** @internal */ private readonly _disposeAggregator = new AsyncDisposeAggregator();
     /** @internal */ private readonly _modelPreventDisposalHandle: DisposalPreventionHandle;
     /** @internal */ private readonly _loraAdapters = new Set<AddonModelLora>();
+    /** @internal */ private readonly _loraAdaptersPendingRelease: AddonModelLora[] = [];
     /** @internal */ private readonly _gcRegistry: FinalizationRegistry<Set<AddonModelLora>>;
     /** @internal */ private _nextGeneratedSequenceId = 0;
+    /** @internal */ private _backendContextDisposed = false;
     /** @internal */ private _dispatchDecodeScheduled = false;
     /** @internal */ private _batchDispatchPending = false;
     /** @internal */ private _threadSplitterConsumer?: ThreadsSplitterConsumer;
@@ -80,13 +93,19 @@ export class LlamaContext {
         sequences,
         contextSize,
         batchSize,
+        ubatchSize,
         flashAttention = _model.defaultContextFlashAttention,
         threads,
+        threadPool,
+        cpuAffinity,
         batching: {
             dispatchSchedule: batchingDispatchSchedule = "nextCycle",
-            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy = "maximumParallelism"
+            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy = "maximumParallelism",
+            stepTokenBudget: batchingStepTokenBudget
         } = {},
         swaFullCache = _model.defaultContextSwaFullCache,
+        kvCacheKeyType = "f16",
+        kvCacheValueType = "f16",
         performanceTracking = false,
         _embeddings,
         _ranking
@@ -109,42 +128,95 @@ export class LlamaContext {
             ? Math.floor(padSafeContextSize(Math.max(2, contextSize) * this._totalSequences, "up") / this._totalSequences)
             : padSafeContextSize(Math.max(2, contextSize), "up");
         this._batchSize = Math.max(batchSize, this._totalSequences);
+        this._ubatchSize = (ubatchSize == null || _embeddings)
+            ? this._batchSize
+            : Math.max(1, Math.min(this._batchSize, Math.floor(ubatchSize)));
         this._flashAttention = flashAttention;
-        this._idealThreads = typeof threads === "number"
-            ? this._llama._threadsSplitter.normalizeThreadsValue(threads)
+        const threadsOptions = threads === "auto"
+            ? undefined
+            : threads;
+        this._idealThreads = typeof threadsOptions === "number"
+            ? this._llama._threadsSplitter.normalizeThreadsValue(threadsOptions)
             : this._llama._threadsSplitter.normalizeThreadsValue(
-                threads?.ideal ?? (
+                threadsOptions?.ideal ?? (
                     this._llama.maxThreads === 0
                         ? this._llama.cpuMathCores
                         : this._llama.maxThreads
                 )
             );
+        this._idealBatchThreads = (typeof threadsOptions === "object" && threadsOptions.batch != null)
+            ? this._llama._threadsSplitter.normalizeThreadsValue(threadsOptions.batch)
+            : this._idealThreads;
         this._minThreads = Math.max(
             1,
-            typeof threads === "number"
+            typeof threadsOptions === "number"
                 ? 1
-                : this._llama._threadsSplitter.normalizeThreadsValue(threads?.min ?? 1)
+                : this._llama._threadsSplitter.normalizeThreadsValue(threadsOptions?.min ?? 1)
         );
         this._performanceTracking = !!performanceTracking;
         this._swaFullCache = !!swaFullCache;
-        this._ctx = new this._llama._bindings.AddonContext(this._model._model, removeNullFields({
-            contextSize: padSafeContextSize(this._contextSize * this._totalSequences, "up"), // each sequence needs its own <contextSize> of cells
-            batchSize: this._batchSize + (
-                (!this._swaFullCache && this.model.fileInsights.swaSize != null && this.model.fileInsights.swaSize > 0)
-                    ? 1 // +1 to handle edge cases with SWA KV cache
-                    : 0
-            ),
-            sequences: this._totalSequences,
-            flashAttention: this._flashAttention,
-            threads: this._idealThreads,
-            embeddings: _embeddings,
-            ranking: _ranking,
-            performanceTracking: this._performanceTracking,
-            swaFullCache: this._swaFullCache
-        }));
+        this._kvCacheKeyType = kvCacheKeyType;
+        this._kvCacheValueType = kvCacheValueType;
+        const affinityCpus = this._llama._resolveCpuAffinity(cpuAffinity);
+        const ownedThreadPool = (threadPool == null && affinityCpus != null && affinityCpus.length > 0)
+            ? this._llama.createThreadPool({
+                threads: Math.min(
+                    getMaxThreads(this._idealThreads, this._idealBatchThreads) || affinityCpus.length,
+                    affinityCpus.length
+                ),
+                cpus: affinityCpus
+            })
+            : undefined;
+        try {
+            this._ctx = new this._llama._bindings.AddonContext(this._model._model, removeNullFields({
+                // each sequence needs its own <contextSize> of cells
+                contextSize: padSafeContextSize(this._contextSize * this._totalSequences, "up"),
+                batchSize: this._batchSize + (
+                    (!this._swaFullCache && this.model.fileInsights.swaSize != null && this.model.fileInsights.swaSize > 0)
+                        ? 1 // +1 to handle edge cases with SWA KV cache
+                        : 0
+                ),
+                ubatchSize: this._ubatchSize === this._batchSize
+                    ? undefined
+                    : this._ubatchSize,
+                sequences: this._totalSequences,
+                flashAttention: this._flashAttention,
+                threads: this._idealThreads,
+                batchThreads: this._idealBatchThreads,
+                threadPool: (threadPool ?? ownedThreadPool)?._pool,
+                cpus: affinityCpus == null
+                    ? undefined
+                    : Uint32Array.from(affinityCpus),
+                embeddings: _embeddings,
+                ranking: _ranking,
+                performanceTracking: this._performanceTracking,
+                swaFullCache: this._swaFullCache,
+                kvCacheKeyType: this._kvCacheKeyType === "f16"
+                    ? undefined
+                    : resolveKvCacheGgmlType(this._kvCacheKeyType),
+                kvCacheValueType: this._kvCacheValueType === "f16"
+                    ? undefined
+                    : resolveKvCacheGgmlType(this._kvCacheValueType)
+            }));
+        } catch (err) {
+            // the context can't use the thread pool that was created for it
+            ownedThreadPool?.dispose();
+            throw err;
+        }
+        this._threadsAutoTune = threads === "auto"
+            ? {
+                maxThreads: Math.max(1, Math.min(
+                    getMaxThreads(this._idealThreads, this._idealBatchThreads) || this._llama.cpuMathCores,
+                    (threadPool ?? ownedThreadPool)?.threads ?? Infinity,
+                    affinityCpus?.length || Infinity
+                )),
+                cpus: affinityCpus
+            }
+            : undefined;
         this._batchingOptions = {
             dispatchSchedule: batchingDispatchSchedule,
-            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy
+            itemPrioritizationStrategy: batchingItemsPrioritizationStrategy,
+            stepTokenBudget: Math.max(1, Math.min(this._batchSize, Math.floor(batchingStepTokenBudget ?? this._batchSize)))
         };
         this._gcRegistry = new FinalizationRegistry(this._model._removeLoraUsage);
         this._gcRegistry.register(this, this._loraAdapters);
@@ -163,19 +235,22 @@ export class LlamaContext {
                 disposeContextIfReferenced.bind(null, new WeakRef(this))
             )
         );
-        this._disposeAggregator.add((): Promise<void> | void => {
-            if (this._loraAdapters.size > 0) {
-                const loraAdapters = new Set(this._loraAdapters);
-                this._loraAdapters.clear();
-                return this._model._removeLoraUsage(loraAdapters);
-            }
-        });
-
         this._disposeAggregator.add(async () => {
             await this._backendContextDisposeGuard.acquireDisposeLock();
             await this._ctx.dispose();
+            this._backendContextDisposed = true;
+
+            // the adapters can only be freed after the native context can no longer apply them
+            const loraAdapters = [...this._loraAdapters, ...this._loraAdaptersPendingRelease];
+            this._loraAdapters.clear();
+            this._loraAdaptersPendingRelease.length = 0;
+            if (loraAdapters.length > 0)
+                await this._model._removeLoraUsage(loraAdapters);
+
             this._modelPreventDisposalHandle.dispose();
         });
+        if (ownedThreadPool != null)
+            this._disposeAggregator.add(ownedThreadPool);
     }
 
     public async dispose() {
@@ -208,10 +283,25 @@ export class LlamaContext {
         return this._batchSize;
     }
 
+    /** The maximum number of tokens evaluated in a single computation */
+    public get ubatchSize(): number {
+        return this._ubatchSize;
+    }
+
     public get flashAttention(): boolean {
         return this._flashAttention;
     }
 
+    /** The type of the keys in the KV cache */
+    public get kvCacheKeyType(): LlamaContextKvCacheType {
+        return this._kvCacheKeyType;
+    }
+
+    /** The type of the values in the KV cache */
+    public get kvCacheValueType(): LlamaContextKvCacheType {
+        return this._kvCacheValueType;
+    }
+
     /**
      * The actual size of the state in the memory in bytes.
      * This value is provided by `llama.cpp` and doesn't include all the memory overhead of the context.
@@ -222,6 +312,80 @@ export class LlamaContext {
         return this._ctx.getStateSize();
     }
 
+    /**
+     * Get the KV cache usage of every sequence of the context, and the total used and free cells.
+     * @see [KV Cache Usage](https://node-llama-cpp.withcat.ai/guide/tips-and-tricks#kv-cache-usage)
+     */
+    public getKvCacheUsage(): LlamaContextKvCacheUsage {
+        this._ensureNotDisposed();
+
+        return this._ctx.getKvCacheUsage();
+    }
+
+    /**
+     * Get the wall time and page fault counters of the batches decoded by the context.
+     *
+     * Use `pagingDetected` to tell when the decoding latency is caused by the model weights being read from the disk.
+     */
+    public getDecodeStats(): LlamaContextDecodeStats {
+        this._ensureNotDisposed();
+
+        const stats = this._ctx.getDecodeStats();
+
+        return {
+            batches: stats[0]!,
+            time: stats[1]! / 1000,
+            majorPageFaults: stats[2]!,
+            minorPageFaults: stats[3]!,
+            pagedBatches: stats[4]!,
+            overlappedBatches: stats[10]!,
+            lastBatchTime: stats[5]! / 1000,
+            lastBatchMajorPageFaults: stats[6]!,
+            lastBatchMinorPageFaults: stats[7]!,
+            lastBatchOverlapped: stats[11] === 1,
+            pageFaultsAvailable: stats[8] === 1,
+            pagingDetected: stats[9] === 1
+        };
+    }
+
+    /**
+     * Compact the KV cache cells of all the sequences of the context.
+     *
+     * Only contexts with a single sequence are compacted.
+     * In contexts with multiple sequences, each sequence has its own cells, so there's nothing to compact and this does nothing.
+     *
+     * Waits for the ongoing evaluations of all the sequences to finish,
+     * so it's best to call it while the context is idle.
+     *
+     * In the rare case that the KV cache cells of a sequence cannot be restored, the sequence is cleared,
+     * and its tokens will be evaluated again on its next evaluation.
+     * @see [KV Cache Usage](https://node-llama-cpp.withcat.ai/guide/tips-and-tricks#kv-cache-usage)
+     */
+    public async defragmentKvCache() {
+        this._ensureNotDisposed();
+
+        const sequences = [...this._sequenceRefs.values()]
+            .map((sequenceRef) => sequenceRef.deref())
+            .filter((sequence): sequence is LlamaContextSequence => sequence != null && !sequence.disposed);
+        const evaluatorLocks: Lock[] = [];
+
+        try {
+            for (const sequence of sequences)
+                evaluatorLocks.push(await acquireLock([sequence._lock, "evaluate"]));
+
+            await withLock([this as LlamaContext, "context"], async () => {
+                this._ensureNotDisposed();
+
+                const clearedSequenceIds = await this._ctx.defragmentKvCache();
+                for (const sequenceId of clearedSequenceIds)
+                    this._sequenceRefs.get(sequenceId)?.deref()?._onKvCacheCleared();
+            });
+        } finally {
+            for (const lock of evaluatorLocks)
+                lock.dispose();
+        }
+    }
+
     /** The number of threads currently used to evaluate tokens */
     public get currentThreads() {
         this._ensureNotDisposed();
@@ -238,6 +402,22 @@ export class LlamaContext {
         return this._idealThreads;
     }
 
+    /** The number of threads currently used to evaluate batches of multiple tokens (like a prompt) */
+    public get currentBatchThreads() {
+        this._ensureNotDisposed();
+
+        return this._ctx.getBatchThreads();
+    }
+
+    /**
+     * The number of threads that are preferred to be used to evaluate batches of multiple tokens (like a prompt).
+     *
+     * The actual number of threads used may be lower when other evaluations are running in parallel.
+     */
+    public get idealBatchThreads() {
+        return this._idealBatchThreads;
+    }
+
     public getAllocatedContextSize(): number {
         this._ensureNotDisposed();
 
@@ -298,7 +478,7 @@ export class LlamaContext {
         if (nextSequenceId == null)
             throw new Error("No sequences left");
 
-        return LlamaContextSequence._create({
+        const sequence = LlamaContextSequence._create({
             sequenceId: nextSequenceId,
             context: this,
             tokenMeter: _tokenMeter,
@@ -308,6 +488,9 @@ export class LlamaContext {
             },
             tokenPredictor
         });
+        this._sequenceRefs.set(nextSequenceId, new WeakRef(sequence));
+
+        return sequence;
     }
 
     public dispatchPendingBatch() {
@@ -338,6 +521,32 @@ export class LlamaContext {
                 return null;
             };
 
+            const rejectCancelledQueuedDecodes = () => {
+                for (let i = 0; i < this._queuedDecodes.length; i++) {
+                    const queuedDecode = this._queuedDecodes[i]!;
+                    const cancellationError = queuedDecode.timedOut
+                        ? new EvaluationDeadlineError()
+                        : getDecodeCancellationError(queuedDecode.cancellation);
+
+                    if (cancellationError == null)
+                        continue;
+
+                    this._queuedDecodes.splice(i, 1);
+                    this._queuedDecodeSequenceIds.delete(queuedDecode.sequenceId);
+                    queuedDecodeToMappedLogits.delete(queuedDecode);
+                    i--;
+
+                    // earlier chunks of this decode may have already been decoded in previous batches
+                    if (queuedDecode.firstTokenSequenceIndex > queuedDecode.startTokenSequenceIndex)
+                        this._ctx.removeTokenCellsFromSequence(
+                            queuedDecode.sequenceId, queuedDecode.startTokenSequenceIndex, queuedDecode.firstTokenSequenceIndex
+                        );
+
+                    const [, reject] = queuedDecode.response;
+                    reject(cancellationError);
+                }
+            };
+
             const getOrderedQueuedDecodes = (
                 prioritizationStrategy: ReturnType<typeof resolveBatchItemsPrioritizationStrategy>
             ): null | CurrentBatchItem[] => {
@@ -358,7 +567,7 @@ export class LlamaContext {
                 try {
                     prioritizedItems = prioritizationStrategy({
                         items: batchItemsList,
-                        size: this._batchSize
+                        size: this._batchingOptions.stepTokenBudget
                     });
                 } catch (err) {
                     this._dispatchErrorForQueuedDecodesAndDequeue(new Set(this._queuedDecodes), err);
@@ -424,6 +633,16 @@ export class LlamaContext {
                 const queuedDecodesToDelete = new Set<InternalQueuedDecode>();
                 const currentQueuedDecodeItems = new Set<InternalQueuedDecode>();
 
+                // used to restore the queued decodes when the batch decoding is aborted
+                const queuedDecodeSnapshots: Array<{
+                    queuedDecode: InternalQueuedDecode,
+                    tokens: readonly Token[],
+                    logits: (true | undefined)[],
+                    firstTokenSequenceIndex: number,
+                    inputTokens: number,
+                    outputTokens: number
+                }> = [];
+
                 if (currentBatchSize !== 0)
                     this._ctx.initBatch(currentBatchSize);
 
@@ -435,8 +654,6 @@ export class LlamaContext {
                         .filter((index) => index != undefined);
 
                     const numberOfOutputTokens = tokenIndexesWithLogitsToProcess.length;
-                    TokenMeter.useTokens(queuedDecode.tokenMeter, Math.max(0, tokensToProcess.length - numberOfOutputTokens), "input");
-                    TokenMeter.useTokens(queuedDecode.tokenMeter, numberOfOutputTokens, "output");
 
                     try {
                         batchLogitIndexes = this._ctx.addToBatch(
@@ -450,6 +667,14 @@ export class LlamaContext {
                         continue;
                     }
                     currentQueuedDecodeItems.add(queuedDecode);
+                    queuedDecodeSnapshots.push({
+                        queuedDecode,
+                        tokens: queuedDecode.tokens,
+                        logits: queuedDecode.logits,
+                        firstTokenSequenceIndex: queuedDecode.firstTokenSequenceIndex,
+                        inputTokens: Math.max(0, tokensToProcess.length - numberOfOutputTokens),
+                        outputTokens: numberOfOutputTokens
+                    });
 
                     if (queuedDecode.tokens.length === processAmount) {
                         queuedDecodesToDelete.add(queuedDecode);
@@ -490,17 +715,81 @@ export class LlamaContext {
                         ? await allocationResult ?? []
                         : allocationResult ?? [];
 
+                    let deadline: number | undefined = undefined;
+                    const signals = new Set<AbortSignal>();
+                    for (const queuedDecode of currentQueuedDecodeItems) {
+                        const cancellation = queuedDecode.cancellation;
+
+                        if (cancellation?.signal != null)
+                            signals.add(cancellation.signal);
+
+                        if (cancellation?.deadline != null)
+                            deadline = Math.min(deadline ?? Infinity, cancellation.deadline);
+                    }
+
+                    let abortedBySignal = false;
+                    const onAbort = () => {
+                        abortedBySignal = true;
+                        this._ctx.abortDecodeBatch();
+                    };
+
+                    let decoded: boolean;
                     try {
                         if (threadsToUse != null)
-                            this._ctx.setThreads(threadsToUse);
+                            this._ctx.setThreads(
+                                capThreads(threadsToUse, this._idealThreads),
+                                capThreads(threadsToUse, this._idealBatchThreads)
+                            );
+
+                        for (const signal of signals)
+                            signal.addEventListener("abort", onAbort);
+
+                        if ([...signals].some((signal) => signal.aborted)) {
+                            abortedBySignal = true;
+                            decoded = false;
+                        } else
+                            decoded = await this._ctx.decodeBatch(
+                                deadline == null
+                                    ? undefined
+                                    : {timeout: Math.max(0, deadline - Date.now())}
+                            );
 
-                        await this._ctx.decodeBatch();
                         consumerHandle?.dispose();
                     } catch (err) {
                         consumerHandle?.dispose();
                         this._dispatchErrorForQueuedDecodesAndDequeue(currentQueuedDecodeItems, err);
                         return;
+                    } finally {
+                        for (const signal of signals)
+                            signal.removeEventListener("abort", onAbort);
                     }
+
+                    if (!decoded) {
+                        // the cells of the aborted batch are already removed from the KV cache,
+                        // so the queued decodes are restored to be decoded again in the next batch,
+                        // and the cancelled ones are rejected at the beginning of the next loop
+                        for (const snapshot of queuedDecodeSnapshots) {
+                            const {queuedDecode} = snapshot;
+                            queuedDecode.tokens = snapshot.tokens;
+                            queuedDecode.logits = snapshot.logits;
+                            queuedDecode.firstTokenSequenceIndex = snapshot.firstTokenSequenceIndex;
+
+                            if (!abortedBySignal && deadline != null && queuedDecode.cancellation?.deadline === deadline)
+                                queuedDecode.timedOut = true;
+
+                            if (queuedDecodesToDelete.has(queuedDecode)) {
+                                this._queuedDecodes.push(queuedDecode);
+                                this._queuedDecodeSequenceIds.add(queuedDecode.sequenceId);
+                            }
+                        }
+
+                        return;
+                    }
+                }
+
+                for (const {queuedDecode, inputTokens, outputTokens} of queuedDecodeSnapshots) {
+                    TokenMeter.useTokens(queuedDecode.tokenMeter, inputTokens, "input");
+                    TokenMeter.useTokens(queuedDecode.tokenMeter, outputTokens, "output");
                 }
 
                 function finishAfterDecodeAction(
@@ -574,13 +863,17 @@ export class LlamaContext {
             this._reserveThreads();
             try {
                 while (shouldHaveAnotherLoop) {
+                    rejectCancelledQueuedDecodes();
+                    if (this._queuedDecodes.length === 0)
+                        break;
+
                     const orderedQueuedDecodes = getOrderedQueuedDecodes(prioritizationStrategy);
                     if (orderedQueuedDecodes == null) return; // all queued items are rejected and dequeued when we get here
 
                     const {
                         currentBatchItems,
                         currentBatchSize
-                    } = fitQueuedDecodesToABatch(orderedQueuedDecodes, this._batchSize);
+                    } = fitQueuedDecodesToABatch(orderedQueuedDecodes, this._batchingOptions.stepTokenBudget);
 
                     let preventDisposalHandle: DisposalPreventionHandle;
                     try {
@@ -630,19 +923,25 @@ export class LlamaContext {
 
     /** @internal */
     public async _decodeTokens<T>({
-        sequenceId, firstTokenSequenceIndex, tokens, logits, evaluationPriority = defaultEvaluationPriority, tokenMeter
+        sequenceId, firstTokenSequenceIndex, tokens, logits, evaluationPriority = defaultEvaluationPriority, tokenMeter, cancellation
     }: {
         sequenceId: number, firstTokenSequenceIndex: number, tokens: Token[], logits: (true | undefined)[],
-        evaluationPriority?: EvaluationPriority, tokenMeter: TokenMeter
+        evaluationPriority?: EvaluationPriority, tokenMeter: TokenMeter, cancellation?: DecodeCancellation
     }, logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => T | Promise<T>)): Promise<[index: number, value: T][]> {
+        const cancellationError = getDecodeCancellationError(cancellation);
+        if (cancellationError != null)
+            throw cancellationError;
+
         return await new Promise((accept, reject) => {
             this._queuedDecodes.push({
                 sequenceId,
                 tokens,
                 logits,
                 firstTokenSequenceIndex,
+                startTokenSequenceIndex: firstTokenSequenceIndex,
                 evaluationPriority,
                 tokenMeter,
+                cancellation,
                 response: [accept, reject],
                 logitDataMapper
             });
@@ -652,21 +951,45 @@ export class LlamaContext {
         });
     }
 
-    /** @internal */
-    public _reclaimUnusedSequenceId(sequenceId: number) {
-        if (this._disposed)
+    /**
+     * The usages of the given LoRA adapters of the sequence are released only after the native sequence is disposed,
+     * so a batch that is still being decoded can't use an adapter that was already freed
+     * @internal
+     */
+    public _reclaimUnusedSequenceId(sequenceId: number, loraAdapters: AddonModelLora[] = []) {
+        if (this._disposed) {
+            this._releaseSequenceLoraAdapters(loraAdapters);
             return;
+        }
+
+        this._sequenceRefs.delete(sequenceId);
 
         void withLock([this as LlamaContext, "context"], async () => {
-            if (this._disposed)
+            if (this._disposed) {
+                this._releaseSequenceLoraAdapters(loraAdapters);
                 return;
+            }
 
             this._ctx.disposeSequence(sequenceId);
             this._unusedSequenceIds.push(sequenceId);
             this._onReclaimUnusedSequenceId.dispatchEvent();
+
+            if (loraAdapters.length > 0)
+                void this._model._removeLoraUsage(loraAdapters);
         });
     }
 
+    /** @internal */
+    private _releaseSequenceLoraAdapters(loraAdapters: AddonModelLora[]) {
+        if (loraAdapters.length === 0)
+            return;
+
+        if (this._backendContextDisposed)
+            void this._model._removeLoraUsage(loraAdapters);
+        else
+            this._loraAdaptersPendingRelease.push(...loraAdapters);
+    }
+
     /** @internal */
     private _popSequenceId(): number | null {
         if (this._unusedSequenceIds.length > 0)
@@ -749,10 +1072,28 @@ export class LlamaContext {
         const lora = await this._model._getOrLoadLora(filePath);
         this._ctx.setLora(lora, scale ?? defaultLoraScale);
 
-        if (!this._loraAdapters.has(lora)) {
+        if (!this._loraAdapters.has(lora))
             this._loraAdapters.add(lora);
-            lora.usages++;
-        }
+        else
+            lora.usages--; // the context already holds a usage of this adapter
+    }
+
+    /** @internal */
+    private async _tuneThreads() {
+        if (this._threadsAutoTune == null)
+            return;
+
+        const {threads, batchThreads} = await tuneContextThreads({
+            ctx: this._ctx,
+            model: this._model,
+            maxThreads: this._threadsAutoTune.maxThreads,
+            batchSize: this._batchSize,
+            cpus: this._threadsAutoTune.cpus
+        });
+
+        this._idealThreads = this._llama._threadsSplitter.normalizeThreadsValue(threads);
+        this._idealBatchThreads = this._llama._threadsSplitter.normalizeThreadsValue(batchThreads);
+        this._ctx.setThreads(this._idealThreads, this._idealBatchThreads);
     }
 
     /** @internal */
@@ -763,7 +1104,10 @@ export class LlamaContext {
         if (this._threadSplitterConsumer != null)
             return;
 
-        this._threadSplitterConsumer = this._llama._threadsSplitter.createConsumer(this._idealThreads, this._minThreads);
+        this._threadSplitterConsumer = this._llama._threadsSplitter.createConsumer(
+            getMaxThreads(this._idealThreads, this._idealBatchThreads),
+            this._minThreads
+        );
     }
 
     /** @internal */
@@ -796,6 +1140,10 @@ export class LlamaContext {
             ? Boolean(options.flashAttention ?? _model.defaultContextFlashAttention)
             : false;
         const swaFullCache = options.swaFullCache ?? _model.defaultContextSwaFullCache;
+        const {kvCacheKeyType, kvCacheValueType} = options;
+
+        if (isQuantizedKvCacheType(kvCacheValueType) && !flashAttention)
+            throw new Error("A quantized KV cache value type requires flash attention to be enabled");
         const loraOptions = typeof options.lora === "string"
             ? {adapters: [{filePath: options.lora}]} satisfies LlamaContextOptions["lora"]
             : options.lora satisfies LlamaContextOptions["lora"];
@@ -813,6 +1161,8 @@ export class LlamaContext {
             modelTrainContextSize: _model.trainContextSize,
             flashAttention,
             swaFullCache,
+            kvCacheKeyType,
+            kvCacheValueType,
             getVramState: () => _model._llama._vramOrchestrator.getMemoryState(),
             llamaGpu: _model._llama.gpu,
             ignoreMemorySafetyChecks: options.ignoreMemorySafetyChecks,
@@ -835,8 +1185,13 @@ export class LlamaContext {
                 isEmbeddingContext: options._embeddings,
                 modelGpuLayers: _model.gpuLayers,
                 batchSize,
+                ubatchSize: options._embeddings
+                    ? undefined
+                    : options.ubatchSize,
                 flashAttention,
-                swaFullCache
+                swaFullCache,
+                kvCacheKeyType,
+                kvCacheValueType
             });
 
             const context = new LlamaContext({_model}, {...options, contextSize, batchSize, sequences, flashAttention, swaFullCache});
@@ -864,6 +1219,13 @@ export class LlamaContext {
                 contextCreationVramReservation?.dispose?.();
                 contextCreationRamReservation?.dispose?.();
 
+                try {
+                    await context._tuneThreads();
+                } catch (err) {
+                    await context.dispose();
+                    throw err;
+                }
+
                 if (loraOptions != null && loraOptions.adapters.length > 0) {
                     let loadedAdapters = 0;
 
@@ -942,7 +1304,7 @@ export class LlamaContextSequence {
     /** @internal */ private readonly _tokenPredictor?: TokenPredictor;
     /** @internal */ private readonly _tokenMeter: TokenMeter;
     /** @internal */ private readonly _disposeAggregator = new DisposeAggregator();
-    /** @internal */ private readonly _lock = {};
+    /** @internal */ public readonly _lock = {};
     /** @internal */ private _resetTokenPredictor: boolean = false;
     /** @internal */ private _tokenPredictorOwner: {} = {};
     /** @internal */ public _contextTokens: Token[] = [];
@@ -955,6 +1317,7 @@ export class LlamaContextSequence {
     /** @internal */ private _unusedTokenPredictions: number = 0;
     /** @internal */ private _validatedTokenPredictions: number = 0;
     /** @internal */ private _refutedTokenPredictions: number = 0;
+    /** @internal */ private _loraAdapters: AddonModelLora[] = [];
     /** @internal */ private _disposed = false;
 
     public readonly onDispose = new EventRelay<void>();
@@ -986,7 +1349,9 @@ export class LlamaContextSequence {
             )
         );
         this._disposeAggregator.add(() => {
-            this._context._reclaimUnusedSequenceId(this._sequenceId);
+            const loraAdapters = this._loraAdapters;
+            this._loraAdapters = [];
+            this._context._reclaimUnusedSequenceId(this._sequenceId, loraAdapters);
         });
 
         if (this._tokenPredictor != null)
@@ -1050,6 +1415,70 @@ export class LlamaContextSequence {
         return this._tokenPredictor;
     }
 
+    /**
+     * Apply LoRA adapters only to this sequence, on top of the LoRA adapters of the context.
+     *
+     * Sequences with different LoRA adapters can be evaluated in the same batch -
+     * the batch is evaluated in groups of tokens that share the same LoRA adapters,
+     * so a single context can serve many LoRA adapters at once.
+     *
+     * The current sequence state was evaluated with the previous LoRA adapters and is not re-evaluated,
+     * so you may want to clear the history of the sequence after changing its LoRA adapters.
+     *
+     * Pass `undefined` to remove the LoRA adapters of this sequence.
+     *
+     * If a string is provided, it will be treated as a path to a single LoRA adapter file.
+     */
+    public async setLora(lora?: string | {
+        adapters: Array<{
+            filePath: string,
+
+            /**
+             * Defaults to `1`
+             */
+            scale?: number
+        }>
+    }) {
+        this._ensureNotDisposed();
+
+        const adapters = lora == null
+            ? []
+            : typeof lora === "string"
+                ? [{filePath: lora}]
+                : lora.adapters;
+        const loadResults = await Promise.allSettled(adapters.map((adapter) => this.model._getOrLoadLora(adapter.filePath)));
+        const loras = loadResults
+            .filter((result): result is PromiseFulfilledResult<AddonModelLora> => result.status === "fulfilled")
+            .map((result) => result.value);
+
+        const failedLoad = loadResults.find((result) => result.status === "rejected");
+        if (failedLoad != null) {
+            await this.model._removeLoraUsage(loras);
+            throw failedLoad.reason;
+        }
+
+        const previousLoraAdapters = await withLock([this._context, "context"], async () => {
+            if (this._disposed)
+                return loras;
+
+            this._context._ctx.setSequenceLoras(
+                this._sequenceId,
+                loras,
+                Float32Array.from(adapters.map((adapter) => adapter.scale ?? defaultLoraScale))
+            );
+
+            const previousLoraAdapters = this._loraAdapters;
+            this._loraAdapters = loras;
+
+            return previousLoraAdapters;
+        });
+
+        if (previousLoraAdapters.length > 0)
+            await this.model._removeLoraUsage(previousLoraAdapters);
+
+        this._ensureNotDisposed();
+    }
+
     /**
      * Get the index of the first token in the KV cache.
      *
@@ -1283,31 +1712,26 @@ export class LlamaContextSequence {
             }
 
             let removedTokens = 0;
-            let lastDeleteRangeEndPos: number | null = null;
             for (const range of resolvedRanges) {
                 this._contextTokens.splice(range.start - removedTokens, range.end - range.start);
-                if (deletionSuccessful)
-                    deletionSuccessful &&= this._context._ctx.removeTokenCellsFromSequence(this._sequenceId, range.start, range.end);
-
-                if (deletionSuccessful && lastDeleteRangeEndPos != null && removedTokens > 0 && lastDeleteRangeEndPos !== range.start) {
-                    this._context._ctx.shiftSequenceTokenCells(this._sequenceId, lastDeleteRangeEndPos, range.start, -removedTokens);
-                    const shiftedTokens = range.start - lastDeleteRangeEndPos;
-                    this._tokenMeter.useTokens(shiftedTokens, "input");
-                }
-
                 removedTokens += range.end - range.start;
-                lastDeleteRangeEndPos = range.end;
             }
 
             if (tokenPredictionsToRemove > 0)
                 this._loadedTokenPredictions.splice(0, tokenPredictionsToRemove);
 
-            if (deletionSuccessful && lastDeleteRangeEndPos != null && removedTokens > 0 &&
-                lastDeleteRangeEndPos !== this._nextTokenIndex
-            ) {
-                this._context._ctx.shiftSequenceTokenCells(this._sequenceId, lastDeleteRangeEndPos, this._nextTokenIndex, -removedTokens);
-                const shiftedTokens = this._nextTokenIndex - lastDeleteRangeEndPos;
-                this._tokenMeter.useTokens(shiftedTokens, "input");
+            if (deletionSuccessful && removedTokens > 0) {
+                // all the ranges are removed and the rest of the cells are shifted back in a single native call
+                deletionSuccessful = this._context._ctx.eraseSequenceTokenRanges(
+                    this._sequenceId,
+                    Uint32Array.from(resolvedRanges.flatMap(({start, end}) => [start, end])),
+                    this._nextTokenIndex
+                );
+
+                if (deletionSuccessful) {
+                    const shiftedTokens = this._nextTokenIndex - resolvedRanges[0]!.start - removedTokens;
+                    this._tokenMeter.useTokens(shiftedTokens, "input");
+                }
             }
 
             this._nextTokenIndex -= removedTokens;
@@ -1377,9 +1801,14 @@ export class LlamaContextSequence {
                 strategy: contextShiftStrategy = this._contextShift.strategy
             } = {},
             yieldEogToken = false,
+            signal,
+            deadline,
 
             _noSampling = false
         } = options;
+        const cancellation: DecodeCancellation | undefined = (signal != null || deadline != null)
+            ? {signal, deadline}
+            : undefined;
 
         if (this._tokenPredictor != null && !_noSampling && tokens.length > 0)
             return this._speculativeEvaluate(tokens, metadata, {
@@ -1397,6 +1826,7 @@ export class LlamaContextSequence {
                     strategy: contextShiftStrategy
                 },
                 yieldEogToken,
+                cancellation,
                 tokenPredictor: this._tokenPredictor
             });
 
@@ -1415,6 +1845,7 @@ export class LlamaContextSequence {
                 strategy: contextShiftStrategy
             },
             yieldEogToken,
+            cancellation,
 
             _noSampling
         });
@@ -1438,6 +1869,20 @@ export class LlamaContextSequence {
         /** Override the sequence context shift options for this evaluation */
         contextShift?: ContextShiftOptions,
 
+        /**
+         * An abort signal to abort the evaluation.
+         *
+         * When aborted while a batch with tokens of this evaluation is being decoded, the decoding of the batch is interrupted.
+         */
+        signal?: AbortSignal,
+
+        /**
+         * A timestamp (as returned from `Date.now()`) to abort the evaluation at.
+         *
+         * When the deadline passes, the evaluation throws an `EvaluationDeadlineError`.
+         */
+        deadline?: number,
+
         /** @internal */
         _skipLock?: boolean
     } = {}): Promise<void> {
@@ -1447,6 +1892,8 @@ export class LlamaContextSequence {
                 size: contextShiftSize = this._contextShift.size,
                 strategy: contextShiftStrategy = this._contextShift.strategy
             } = {},
+            signal,
+            deadline,
             _skipLock = false
         } = options;
 
@@ -1457,6 +1904,9 @@ export class LlamaContextSequence {
                 size: contextShiftSize,
                 strategy: contextShiftStrategy
             },
+            cancellation: (signal != null || deadline != null)
+                ? {signal, deadline}
+                : undefined,
             _skipLock
         });
         const predictorAlignmentPromise = this.tokenPredictor == null
@@ -1731,6 +2181,7 @@ export class LlamaContextSequence {
         generateNewTokens = true,
         contextShiftOptions,
         yieldEogToken = false,
+        cancellation,
 
         _noSampling = false,
         _skipLock = false
@@ -1739,7 +2190,7 @@ export class LlamaContextSequence {
         grammarEvaluationState?: LlamaGrammarEvaluationState | (() => LlamaGrammarEvaluationState | undefined),
         repeatPenalty?: LlamaContextSequenceRepeatPenalty, tokenBias?: TokenBias | (() => TokenBias),
         evaluationPriority?: EvaluationPriority, generateNewTokens?: boolean, contextShiftOptions: Required<ContextShiftOptions>,
-        yieldEogToken?: boolean,
+        yieldEogToken?: boolean, cancellation?: DecodeCancellation,
         _noSampling?: boolean,
         _skipLock?: boolean
     }): AsyncGenerator<SequenceEvaluateOutput<Metadata>, void, void | Token | Token[]> {
@@ -1808,7 +2259,8 @@ export class LlamaContextSequence {
                                 else
                                     return this._context._ctx.sampleToken(batchLogitIndex, sampler._sampler);
                             });
-                        }
+                        },
+                        cancellation
                     );
 
                     const lastDecodeResult = decodeResult[evalTokens.length - 1];
@@ -1868,13 +2320,14 @@ export class LlamaContextSequence {
         evaluationPriority = defaultEvaluationPriority,
         contextShiftOptions,
         yieldEogToken = false,
+        cancellation,
         tokenPredictor
     }: {
         temperature?: number, minP?: number, topK?: number, topP?: number, seed?: number,
         grammarEvaluationState?: LlamaGrammarEvaluationState | (() => LlamaGrammarEvaluationState | undefined),
         repeatPenalty?: LlamaContextSequenceRepeatPenalty, tokenBias?: TokenBias | (() => TokenBias),
         evaluationPriority?: EvaluationPriority, contextShiftOptions: Required<ContextShiftOptions>,
-        yieldEogToken?: boolean, tokenPredictor: TokenPredictor
+        yieldEogToken?: boolean, cancellation?: DecodeCancellation, tokenPredictor: TokenPredictor
     }): AsyncGenerator<SequenceEvaluateOutput<Metadata>, void, void | Token | Token[]> {
         this._ensureNotDisposed();
 
@@ -1890,12 +2343,20 @@ export class LlamaContextSequence {
         const sampleProbabilities = metadata.probabilities === true;
         const sampleConfidence = metadata.confidence === true;
 
+        // native speculation doesn't return token probabilities
+        const nativeSpeculation = (sampleProbabilities || sampleConfidence)
+            ? undefined
+            : tokenPredictor._getNativeSpeculation();
+
         let logitsArray: (true | undefined)[] = [];
         let logitsStartIndex = evalTokens.length - 1;
         const validatedTokens: [input: Token, output: Token][] = [];
         logitsArray[logitsStartIndex] = true;
 
         const sampler = new LlamaSampler(this.model);
+        const draftSampler = nativeSpeculation == null
+            ? undefined
+            : new LlamaSampler(nativeSpeculation.draftSequence.model);
         try {
             while (true) {
                 this._ensureNotDisposed();
@@ -1913,6 +2374,10 @@ export class LlamaContextSequence {
                         nextToken = token;
                         yieldRes.token = nextToken;
 
+                        // the tokens sampled for predictions are only learned by the n-gram cache once they're accepted
+                        if (!sampler.disposed)
+                            sampler.learnNgramToken(nextToken);
+
                         if (probabilities != null)
                             yieldRes.probabilities = reviveTokenProbabilities(probabilities);
 
@@ -1965,8 +2430,24 @@ export class LlamaContextSequence {
                         this._tokenPredictorOwner = tokenPredictorOwner;
                     }
 
+                    if (nextToken == null && nativeSpeculation != null && draftSampler != null &&
+                        this._tokenPredictorOwner === tokenPredictorOwner
+                    ) {
+                        nextToken = await this._speculativeDecodeNatively(evalTokens, {
+                            nativeSpeculation,
+                            sampler,
+                            draftSampler,
+                            samplerOptions: {temperature, minP, topK, topP, seed, grammarEvaluationState, repeatPenalty, tokenBias},
+                            evaluationPriority,
+                            contextShiftOptions
+                        });
+
+                        if (nextToken != null)
+                            yieldRes.token = nextToken;
+                    }
+
                     if (nextToken == null) {
-                        if (this._tokenPredictorOwner === tokenPredictorOwner &&
+                        if (this._tokenPredictorOwner === tokenPredictorOwner && nativeSpeculation == null &&
 
                             // prevent incurring context shifts due to token prediction validations
                             this._nextTokenIndex + evalTokens.length < this._context.contextSize
@@ -2027,18 +2508,29 @@ export class LlamaContextSequence {
                                     if (sampler.disposed)
                                         return null;
 
+                                    // tokens sampled after a prediction may be refuted, so they're learned only when they're used
+                                    const learnNgram = tokenIndex === logitsStartIndex;
+
                                     sampler.applyConfig(samplerConfig);
                                     if (sampleProbabilities || sampleConfidence)
                                         return this._context._ctx.sampleToken(
                                             batchLogitIndex,
                                             sampler._sampler,
                                             sampleProbabilities,
-                                            sampleConfidence
+                                            sampleConfidence,
+                                            learnNgram
                                         );
                                     else
-                                        return this._context._ctx.sampleToken(batchLogitIndex, sampler._sampler);
+                                        return this._context._ctx.sampleToken(
+                                            batchLogitIndex,
+                                            sampler._sampler,
+                                            undefined,
+                                            undefined,
+                                            learnNgram
+                                        );
                                 });
-                            }
+                            },
+                            cancellation
                         );
 
                         for (let i = logitsStartIndex; i < evalTokens.length; i++) {
@@ -2108,7 +2600,7 @@ export class LlamaContextSequence {
                 else
                     evalTokens = [nextToken];
 
-                if (this._tokenPredictorOwner === tokenPredictorOwner)
+                if (this._tokenPredictorOwner === tokenPredictorOwner && nativeSpeculation == null)
                     tokenPredictor.pushTokens(evalTokens);
 
                 logitsArray = [];
@@ -2118,11 +2610,160 @@ export class LlamaContextSequence {
         } finally {
             void withLock([sampler, "sample"], sampler.asyncDispose);
 
+            if (draftSampler != null)
+                void withLock([draftSampler, "sample"], draftSampler.asyncDispose);
+
             if (this._tokenPredictorOwner === tokenPredictorOwner)
                 tokenPredictor.stop();
         }
     }
 
+    /**
+     * Draft tokens on the draft sequence and verify them on this sequence in a single native step.
+     *
+     * The accepted draft tokens are loaded as token predictions, so the next iterations yield them without evaluating them again.
+     *
+     * The caller of this function has to wrap it with a lock to ensure this function doesn't run concurrently.
+     * @returns The next token, or `undefined` when there's no room for drafting tokens on either of the sequences
+     * @internal
+     */
+    private async _speculativeDecodeNatively(tokens: Token[], {
+        nativeSpeculation,
+        sampler,
+        draftSampler,
+        samplerOptions,
+        evaluationPriority,
+        contextShiftOptions
+    }: {
+        nativeSpeculation: TokenPredictorNativeSpeculation,
+        sampler: LlamaSampler,
+        draftSampler: LlamaSampler,
+        samplerOptions: {
+            temperature?: number, minP?: number, topK?: number, topP?: number, seed?: number,
+            grammarEvaluationState?: LlamaGrammarEvaluationState | (() => LlamaGrammarEvaluationState | undefined),
+            repeatPenalty?: LlamaContextSequenceRepeatPenalty, tokenBias?: TokenBias | (() => TokenBias)
+        },
+        evaluationPriority: EvaluationPriority,
+        contextShiftOptions: Required<ContextShiftOptions>
+    }): Promise<Token | undefined> {
+        const {draftSequence, maxTokens, minConfidence, acceptance, evaluateOptions} = nativeSpeculation;
+
+        if (draftSequence.disposed || draftSequence.context === this._context || tokens.length === 0 || maxTokens <= 0)
+            return undefined;
+
+        // the tokens and at least one drafted token have to fit in both sequences without a context shift
+        const lastTokenIndex = this._nextTokenIndex + tokens.length - 1;
+        if (lastTokenIndex + 2 >= this._context.contextSize || lastTokenIndex + 2 >= draftSequence.context.contextSize)
+            return undefined;
+
+        if (tokens.length > 1)
+            await this._decodeTokens(tokens.slice(0, -1), [], evaluationPriority, this._tokenMeter, contextShiftOptions, () => null);
+
+        const lastToken = tokens.at(-1)!;
+        const maxDraftTokens = Math.min(
+            maxTokens,
+            this._context.contextSize - 2 - this._nextTokenIndex,
+            draftSequence.context.contextSize - 2 - this._nextTokenIndex,
+            this._context.batchSize - 1
+        );
+
+        // align the draft sequence with the state of this sequence
+        const {firstDifferentIndex} = draftSequence.compareContextTokens(this._contextTokens);
+        if (firstDifferentIndex < draftSequence.nextTokenIndex)
+            await draftSequence.eraseContextTokenRanges([{start: firstDifferentIndex, end: draftSequence.nextTokenIndex}]);
+
+        let draftTokens = this._contextTokens.slice(draftSequence.nextTokenIndex);
+        if (draftTokens.length >= draftSequence.context.batchSize) {
+            await draftSequence.evaluateWithoutGeneratingNewTokens(draftTokens, {
+                evaluationPriority,
+                contextShift: contextShiftOptions
+            });
+            draftTokens = [];
+        }
+        draftTokens.push(lastToken);
+
+        const resolvedGrammarEvaluationState = samplerOptions.grammarEvaluationState instanceof Function
+            ? samplerOptions.grammarEvaluationState()
+            : samplerOptions.grammarEvaluationState;
+
+        // the native step accepts all the generated tokens on the grammar, so it uses a clone of the grammar evaluation state
+        sampler.applyConfig(this._resolveSamplerConfig({
+            ...samplerOptions,
+            grammarEvaluationState: resolvedGrammarEvaluationState?.clone()
+        }));
+        draftSampler.applyConfig(draftSequence._resolveSamplerConfig({
+            temperature: evaluateOptions.temperature ?? samplerOptions.temperature,
+            minP: evaluateOptions.minP ?? samplerOptions.minP,
+            topK: evaluateOptions.topK ?? samplerOptions.topK,
+            topP: evaluateOptions.topP ?? samplerOptions.topP,
+            seed: evaluateOptions.seed ?? samplerOptions.seed,
+            repeatPenalty: evaluateOptions.repeatPenalty ?? samplerOptions.repeatPenalty,
+            tokenBias: evaluateOptions.tokenBias ?? samplerOptions.tokenBias
+        }));
+
+        const contextLock = await acquireLock([this._context, "context"]);
+        const draftContextLock = await acquireLock([draftSequence.context, "context"]);
+        let result: Awaited<ReturnType<AddonContext["speculativeDecode"]>>;
+        try {
+            this._ensureNotDisposed();
+
+            result = await this._context._ctx.speculativeDecode(draftSequence.context._ctx, sampler._sampler, draftSampler._sampler, {
+                sequenceId: this._sequenceId,
+                firstTokenIndex: this._nextTokenIndex,
+                tokens: Uint32Array.from([lastToken]),
+                draftSequenceId: draftSequence._sequenceId,
+                draftFirstTokenIndex: draftSequence._nextTokenIndex,
+                draftTokens: Uint32Array.from(draftTokens),
+                maxDraftTokens,
+                minDraftConfidence: minConfidence,
+                acceptance
+            });
+        } finally {
+            draftContextLock.dispose();
+            contextLock.dispose();
+        }
+
+        const resultTokens = Array.from(result.tokens) as Token[];
+        const acceptedDraftTokens = resultTokens.slice(0, result.acceptedDraftTokens);
+
+        this._contextTokens = this._contextTokens.concat([lastToken], acceptedDraftTokens);
+        this._nextTokenIndex += 1 + acceptedDraftTokens.length;
+        TokenMeter.useTokens(this._tokenMeter, 1 + result.draftTokens, "output");
+
+        draftSequence._contextTokens = draftSequence._contextTokens.concat(
+            draftTokens,
+            resultTokens.slice(0, result.draftEvaluatedTokens - draftTokens.length)
+        );
+        draftSequence._nextTokenIndex += result.draftEvaluatedTokens;
+        TokenMeter.useTokens(draftSequence._tokenMeter, draftTokens.length - 1, "input");
+        TokenMeter.useTokens(draftSequence._tokenMeter, result.draftTokens, "output");
+
+        this._validatedTokenPredictions += acceptedDraftTokens.length;
+        this._refutedTokenPredictions += result.draftTokens - acceptedDraftTokens.length;
+        this._unusedTokenPredictions += acceptedDraftTokens.length;
+        for (let i = 0; i < acceptedDraftTokens.length; i++)
+            this._loadedTokenPredictions.push([resultTokens[i]!, [resultTokens[i + 1]!, undefined, undefined]]);
+
+        const nextToken = resultTokens[0];
+        if (nextToken == null)
+            throw new Error("Failed to sample next token");
+
+        if (resolvedGrammarEvaluationState != null)
+            LlamaSampler._acceptTokenOnGrammarEvaluationState(this._context._llama, resolvedGrammarEvaluationState, nextToken);
+
+        return nextToken;
+    }
+
+    /** @internal */
+    public _onKvCacheCleared() {
+        this._tokenPredictorOwner = {};
+        void this._abortTokenPredictor(true);
+
+        this._loadedTokenPredictions.length = 0;
+        this._nextTokenIndex = 0;
+        this._contextTokens = [];
+    }
+
     /** @internal */
     private async _abortTokenPredictor(skipClearingPredictionsFromState: boolean = false, skipLock: boolean = false) {
         this._tokenPredictor?.stop();
@@ -2205,7 +2846,8 @@ export class LlamaContextSequence {
         evaluationPriority: EvaluationPriority,
         tokenMeter: TokenMeter,
         contextShiftOptions: Required<ContextShiftOptions>,
-        logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => T | Promise<T>)
+        logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => T | Promise<T>),
+        cancellation?: DecodeCancellation
     ): Promise<Array<undefined | T>> {
         this._ensureNotDisposed();
 
@@ -2240,7 +2882,8 @@ export class LlamaContextSequence {
                 firstTokenSequenceIndex: this._nextTokenIndex,
                 logits: tokensLogits,
                 evaluationPriority,
-                tokenMeter
+                tokenMeter,
+                cancellation
             }, normalizedLogitDataMapper);
 
             for (const [index, value] of generatedLogits)
@@ -2270,12 +2913,14 @@ export class LlamaContextSequence {
 
         this._ensureNotDisposed();
 
-        if (contextShiftOptions.strategy === "eraseBeginning") {
-            let eraseStartIndex = 0;
-            if (this.model.tokens.bos != null && this._contextTokens[0] === this.model.tokens.bos)
-                eraseStartIndex = 1;
+        if (!(contextShiftOptions.strategy instanceof Function)) {
+            const ranges = getContextShiftDeleteRanges(contextShiftOptions.strategy, {
+                contextTokens: this._contextTokens,
+                size,
+                bosToken: this.model.tokens.bos ?? undefined
+            });
 
-            await this._eraseContextTokenRanges([{start: eraseStartIndex, end: size + eraseStartIndex}], {skipLock: true});
+            await this._eraseContextTokenRanges(ranges, {skipLock: true});
         } else {
             const ranges = await contextShiftOptions.strategy({
                 sequence: this,
@@ -2332,14 +2977,22 @@ export class LlamaContextSequence {
 type InternalQueuedDecode = {
     sequenceId: number,
     firstTokenSequenceIndex: number,
+    startTokenSequenceIndex: number,
     tokens: readonly Token[],
     logits: (true | undefined)[],
     evaluationPriority: EvaluationPriority,
     tokenMeter: TokenMeter,
+    cancellation?: DecodeCancellation,
+    timedOut?: boolean,
     response: [accept: (res: any) => void, reject: (reason: unknown) => void],
     logitDataMapper: ((batchLogitIndex: BatchLogitIndex, tokenIndex: number) => any | Promise<any>)
 };
 
+type DecodeCancellation = {
+    signal?: AbortSignal,
+    deadline?: number
+};
+
 type CurrentBatchItem = {
     queuedDecode: InternalQueuedDecode,
     processAmount: number
@@ -2423,3 +3076,29 @@ const defaultFallbackContextSize = 4096;
 export function getDefaultModelContextSize({trainContextSize}: {trainContextSize?: number}) {
     return trainContextSize ?? defaultFallbackContextSize;
 }
+
+/** `0` means no limit on the number of threads */
+function getMaxThreads(threads: number, batchThreads: number) {
+    if (threads === 0 || batchThreads === 0)
+        return 0;
+
+    return Math.max(threads, batchThreads);
+}
+
+function capThreads(allocatedThreads: number, idealThreads: number) {
+    if (idealThreads === 0)
+        return allocatedThreads;
+    else if (allocatedThreads === 0)
+        return idealThreads;
+
+    return Math.min(allocatedThreads, idealThreads);
+}
+
+function getDecodeCancellationError(cancellation?: DecodeCancellation): unknown {
+    if (cancellation?.signal?.aborted)
+        return cancellation.signal.reason;
+    else if (cancellation?.deadline != null && Date.now() >= cancellation.deadline)
+        return new EvaluationDeadlineError();
+
+    return undefined;
+}
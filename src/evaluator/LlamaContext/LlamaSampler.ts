@@ -31,6 +31,10 @@ export class LlamaSampler {
         return this._sampler.applyConfig(config);
     }
 
+    public learnNgramToken(token: Token) {
+        return this._sampler.learnNgramToken(token);
+    }
+
     /** @internal */
     public static _canBeNextTokenForGrammarEvaluationState(
         llama: Llama,
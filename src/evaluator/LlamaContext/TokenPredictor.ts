@@ -2,6 +2,15 @@ import {Token} from "../../types.js";
 import {SequenceEvaluateOptions} from "./types.js";
 import {LlamaContextSequence} from "./LlamaContext.js";
 
+/** @internal */
+export type TokenPredictorNativeSpeculation = {
+    draftSequence: LlamaContextSequence,
+    maxTokens: number,
+    minConfidence: number,
+    acceptance: "exact" | "rejectionSampling",
+    evaluateOptions: Pick<SequenceEvaluateOptions, "temperature" | "minP" | "topK" | "topP" | "seed" | "repeatPenalty" | "tokenBias">
+};
+
 /**
  * @see [Using Token Predictors](https://node-llama-cpp.withcat.ai/guide/token-prediction#custom)
  */
@@ -58,6 +67,15 @@ export abstract class TokenPredictor {
 
     public dispose(): Promise<void> | void {}
 
+    /**
+     * When this returns a value, the target sequence drafts and verifies tokens natively using the returned draft sequence
+     * instead of calling `predictTokens` and `pushTokens`.
+     * @internal
+     */
+    public _getNativeSpeculation(): TokenPredictorNativeSpeculation | undefined {
+        return undefined;
+    }
+
     /** @hidden */
     public [Symbol.dispose]() {
         return this.dispose();
@@ -6,7 +6,7 @@ import {getConsoleLogPrefix} from "../../../utils/getConsoleLogPrefix.js";
 import {SequenceEvaluateOptions, SequenceEvaluateOutput} from "../types.js";
 import {LlamaSampler} from "../LlamaSampler.js";
 import {LlamaContextSequence} from "../LlamaContext.js";
-import {TokenPredictor} from "../TokenPredictor.js";
+import {TokenPredictor, TokenPredictorNativeSpeculation} from "../TokenPredictor.js";
 
 const defaultPredictionMinTokens = 0;
 const defaultPredictionMaxTokens = 16;
@@ -22,6 +22,8 @@ export class DraftSequenceTokenPredictor extends TokenPredictor {
     /** @internal */ private readonly _minTokens: number;
     /** @internal */ private readonly _maxTokens: number;
     /** @internal */ private readonly _minConfidence?: number;
+    /** @internal */ private readonly _native: boolean;
+    /** @internal */ private readonly _acceptance: "exact" | "rejectionSampling";
     /** @internal */ private _stateTokens: Token[] = [];
     /** @internal */ private _pendingEvalTokens: Token[] = [];
     /** @internal */ private _predictedTokens: Token[] = [];
@@ -71,7 +73,35 @@ export class DraftSequenceTokenPredictor extends TokenPredictor {
          *
          * Defaults to `0.6`.
          */
-        minConfidence?: number
+        minConfidence?: number,
+
+        /**
+         * Draft the tokens and verify them against the target sequence natively in a single step,
+         * instead of drafting them in the background and validating them as part of the evaluation of the target sequence.
+         *
+         * Each step drafts up to `maxTokens` tokens on the draft sequence, verifies all of them in a single batch on the target sequence,
+         * and removes the rejected tokens from both sequences, so the drafted tokens don't have to pass through JavaScript one by one.
+         *
+         * Evaluations that include the token probabilities or confidence in their metadata draft the tokens in the background instead.
+         *
+         * Defaults to `false`.
+         */
+        native?: boolean,
+
+        /**
+         * The rule to accept drafted tokens by when `native` is enabled.
+         * - **`"exact"`** - accept a drafted token only when the target sequence samples the same token.
+         * - **`"rejectionSampling"`** - accept a drafted token with a probability of `min(1, p / q)`,
+         * where `p` and `q` are the probabilities the target and draft models assign to it,
+         * and sample a replacement token from the residual distribution when it's rejected.
+         * This keeps the distribution of the generated tokens the same as the target model's,
+         * while accepting more drafted tokens when sampling with a temperature.
+         *
+         * When the target sequence doesn't sample with a temperature, `"exact"` is used.
+         *
+         * Defaults to `"exact"`.
+         */
+        acceptance?: "exact" | "rejectionSampling"
     } = {}) {
         super();
 
@@ -80,6 +110,8 @@ export class DraftSequenceTokenPredictor extends TokenPredictor {
         this._maxTokens = Math.floor(Math.max(this._minTokens, options?.maxTokens ?? defaultPredictionMaxTokens));
         this._overrideEvaluateOptions = options.evaluateOptions ?? {};
         this._minConfidence = Math.min(1, Math.max(0, options?.minConfidence ?? defaultPredictionMinConfidence));
+        this._native = options?.native ?? false;
+        this._acceptance = options?.acceptance ?? "exact";
 
         if (draftSequence.disposed)
             throw new Error("The draft sequence is disposed");
@@ -101,6 +133,14 @@ export class DraftSequenceTokenPredictor extends TokenPredictor {
         return this._minConfidence;
     }
 
+    public get native() {
+        return this._native;
+    }
+
+    public get acceptance() {
+        return this._acceptance;
+    }
+
     public async reset({targetSequence, stateTokens, evaluateOptions}: {
         targetSequence: LlamaContextSequence,
         stateTokens: Token[],
@@ -244,6 +284,20 @@ export class DraftSequenceTokenPredictor extends TokenPredictor {
         });
     }
 
+    /** @internal */
+    public override _getNativeSpeculation(): TokenPredictorNativeSpeculation | undefined {
+        if (!this._native || this._disposed)
+            return undefined;
+
+        return {
+            draftSequence: this._draftSequence,
+            maxTokens: this._maxTokens,
+            minConfidence: this._minConfidence ?? 0,
+            acceptance: this._acceptance,
+            evaluateOptions: this._overrideEvaluateOptions
+        };
+    }
+
     /** @internal */
     private _canIterate(): boolean {
         return !this._disposed && !this._stopped && (this._predictedTokens.length < this._maxTokens || this._resetPredictions);
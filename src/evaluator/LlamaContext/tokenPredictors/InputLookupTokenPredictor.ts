@@ -1,7 +1,8 @@
 import {DisposedError} from "lifecycle-utils";
 import {Token} from "../../../types.js";
-import {pushAll} from "../../../utils/pushAll.js";
+import {AddonTokenLookupIndex, BindingModule} from "../../../bindings/AddonTypes.js";
 import {TokenPredictor} from "../TokenPredictor.js";
+import type {LlamaContextSequence} from "../LlamaContext.js";
 
 const defaultPatternMinLength = 1;
 const defaultPatternMaxLength = 0;
@@ -16,6 +17,9 @@ const defaultPredictionMaxLength = 3;
  *
  * This works in all completion classes, including `LlamaChatSession`, `LlamaChat`, and `LlamaCompletion`.
  *
+ * The input tokens are indexed natively, and the generated tokens are matched against the index as they are pushed,
+ * so finding a prediction doesn't scan the input tokens.
+ *
  * Based on https://github.com/apoorvumang/prompt-lookup-decoding.
  * @see [Using Token Predictors: Input Lookup Token Predictor](https://node-llama-cpp.withcat.ai/guide/token-prediction#input-lookup)
  */
@@ -24,10 +28,9 @@ export class InputLookupTokenPredictor extends TokenPredictor {
     /** @internal */ private readonly _patternMaxLength: number;
     /** @internal */ private readonly _predictionMinLength: number;
     /** @internal */ private readonly _predictionMaxLength: number;
-    /** @internal */ private _lastPredictionMatchStartIndex: number | undefined = undefined;
-    /** @internal */ private _lastPredictionMatchLength: number | undefined = undefined;
-    /** @internal */ private _stateTokens: Token[] = [];
     /** @internal */ private _inputTokens: Token[] = [];
+    /** @internal */ private _index?: AddonTokenLookupIndex;
+    /** @internal */ private _indexBindings?: BindingModule;
     /** @internal */ private _disposed = false;
 
     public constructor(options: {
@@ -99,123 +102,50 @@ export class InputLookupTokenPredictor extends TokenPredictor {
         return this._predictionMaxLength;
     }
 
-    public reset({stateTokens}: {
+    public reset({targetSequence, stateTokens}: {
+        targetSequence: LlamaContextSequence,
         stateTokens: Token[]
     }) {
-        this._stateTokens = stateTokens.slice();
-        delete this._lastPredictionMatchStartIndex;
-        delete this._lastPredictionMatchLength;
+        if (this._disposed)
+            throw new DisposedError();
+
+        const bindings = targetSequence.model._llama._bindings;
+        if (this._index == null || this._indexBindings !== bindings) {
+            this._index?.dispose();
+            this._index = new bindings.AddonTokenLookupIndex();
+            this._indexBindings = bindings;
+            this._index.setInputTokens(Uint32Array.from(this._inputTokens));
+        }
+
+        this._index.setStateTokens(Uint32Array.from(stateTokens));
     }
 
     public override updateInputTokens(tokens: Token[]) {
         this._inputTokens = tokens.slice();
-        delete this._lastPredictionMatchStartIndex;
-        delete this._lastPredictionMatchLength;
+        this._index?.setInputTokens(Uint32Array.from(this._inputTokens));
     }
 
     public pushTokens(tokens: Token[]) {
-        pushAll(this._stateTokens, tokens);
-
-        if (this._lastPredictionMatchStartIndex != null && this._lastPredictionMatchLength != null) {
-            this._lastPredictionMatchLength += tokens.length;
-        }
+        this._index?.pushStateTokens(Uint32Array.from(tokens));
     }
 
     public predictTokens() {
         if (this._disposed)
             throw new DisposedError();
 
-        if (this._inputTokens.length === 0 || this._stateTokens.length === 0)
-            return [];
-
-        if (this._lastPredictionMatchStartIndex != null && this._lastPredictionMatchLength != null) {
-            for (
-                let p = this._lastPredictionMatchStartIndex + this._lastPredictionMatchLength - 1,
-                    s = this._stateTokens.length - 1;
-                p >= this._lastPredictionMatchStartIndex && s >= 0;
-                p--, s--
-            ) {
-                if (this._inputTokens[p] !== this._stateTokens[s]) {
-                    delete this._lastPredictionMatchStartIndex;
-                    delete this._lastPredictionMatchLength;
-                    break;
-                }
-            }
-
-            if (this._lastPredictionMatchStartIndex != null && this._lastPredictionMatchLength != null) {
-                const predictionEndIndex = this._lastPredictionMatchStartIndex + this._lastPredictionMatchLength;
-                if (predictionEndIndex < this._inputTokens.length) {
-                    return this._inputTokens.slice(predictionEndIndex, predictionEndIndex + this._predictionMaxLength);
-                }
-            }
-        }
-
-        const [matchStartIndex, matchLength] = this._findLongestPatternIndex(this._inputTokens, this._stateTokens);
-        if (matchStartIndex == null || matchLength == null)
+        if (this._index == null || this._inputTokens.length === 0)
             return [];
 
-        const predictionEndIndex = matchStartIndex + matchLength;
-        const res = this._inputTokens.slice(predictionEndIndex, predictionEndIndex + this._predictionMaxLength);
-
-        if (res.length >= this._predictionMinLength) {
-            this._lastPredictionMatchStartIndex = matchStartIndex;
-            this._lastPredictionMatchLength = matchLength;
-            return res;
-        }
-
-        return [];
+        return Array.from(
+            this._index.predict(this._patternMinLength, this._patternMaxLength, this._predictionMinLength, this._predictionMaxLength)
+        ) as Token[];
     }
 
     public override dispose() {
         this._disposed = true;
-        this._stateTokens = [];
         this._inputTokens = [];
-        delete this._lastPredictionMatchStartIndex;
-        delete this._lastPredictionMatchLength;
-    }
-
-    /** @internal */
-    private _findLongestPatternIndex(findIn: Token[], lookupPattern: Token[]): [index: number, length: number] | [] {
-        const checkIndexes: number[] = [];
-        let bestIndex = -1;
-        let bestIndexDiff = -1;
-
-        for (let i = findIn.length - this._predictionMinLength; i >= 0; i--) {
-            const token = findIn[i];
-
-            for (let j = checkIndexes.length - 1; j >= 0; j--) {
-                const startIndex = checkIndexes[j]!;
-                const indexDiff = startIndex - i;
-                if (lookupPattern[lookupPattern.length - 1 - indexDiff] !== token || (
-                    this._patternMaxLength > 0 && indexDiff >= this._patternMaxLength
-                )) {
-                    checkIndexes.splice(j, 1);
-
-                    if (indexDiff >= this._patternMinLength && indexDiff >= bestIndexDiff) {
-                        bestIndex = startIndex;
-                        bestIndexDiff = indexDiff;
-                    }
-                }
-            }
-
-            if (token === lookupPattern[lookupPattern.length - 1])
-                checkIndexes.unshift(i);
-        }
-
-        for (let j = checkIndexes.length - 1; j >= 0; j--) {
-            const startIndex = checkIndexes[j]!;
-            const indexDiff = startIndex + 1;
-            checkIndexes.splice(j, 1);
-
-            if (indexDiff >= this._patternMinLength && indexDiff >= bestIndexDiff) {
-                bestIndex = startIndex;
-                bestIndexDiff = indexDiff;
-            }
-        }
-
-        if (bestIndex >= 0)
-            return [bestIndex - (bestIndexDiff - 1), bestIndexDiff];
-
-        return [];
+        this._index?.dispose();
+        this._index = undefined;
+        this._indexBindings = undefined;
     }
 }
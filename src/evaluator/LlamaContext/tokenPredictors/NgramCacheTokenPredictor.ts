@@ -0,0 +1,161 @@
+import {DisposedError} from "lifecycle-utils";
+import {Token} from "../../../types.js";
+import {AddonNgramCache, AddonModel} from "../../../bindings/AddonTypes.js";
+import {TokenPredictor} from "../TokenPredictor.js";
+import type {LlamaContextSequence} from "../LlamaContext.js";
+
+const defaultMaxTokens = 8;
+const defaultMinCount = 2;
+const defaultMaxMemorySize = 32 * 1024 * 1024; // 32MB
+const contextTokensLength = 4;
+
+export type NgramCacheTokenPredictorStats = {
+    /** The number of times the cache was used to predict tokens */
+    lookups: number,
+
+    /** The number of lookups that predicted at least one token */
+    hits: number,
+
+    /** The number of tokens predicted from the cache */
+    draftedTokens: number,
+
+    /** The number of predicted tokens that were generated by the model */
+    acceptedTokens: number,
+
+    /** The number of generated tokens that were learned into the cache */
+    learnedTokens: number,
+
+    /** The memory size of the cache, in bytes */
+    memorySize: number
+};
+
+/**
+ * Predicts the next tokens based on the tokens that were previously generated by the model.
+ *
+ * All the tokens generated by the model (in all of its sequences) are learned into a native memory-bounded n-gram cache
+ * that is shared by all the models with the same vocabulary in the process,
+ * so recurring generations (like a structured output format or repeated phrases) are predicted without a draft model.
+ *
+ * This works in all completion classes, including `LlamaChatSession`, `LlamaChat`, and `LlamaCompletion`.
+ * @see [Using Token Predictors: N-gram Cache Token Predictor](https://node-llama-cpp.withcat.ai/guide/token-prediction#ngram-cache)
+ */
+export class NgramCacheTokenPredictor extends TokenPredictor {
+    /** @internal */ private readonly _maxTokens: number;
+    /** @internal */ private readonly _minCount: number;
+    /** @internal */ private readonly _maxMemorySize: number;
+    /** @internal */ private _cache?: AddonNgramCache;
+    /** @internal */ private _cacheModel?: AddonModel;
+    /** @internal */ private _contextTokens: Token[] = [];
+    /** @internal */ private _pendingPredictions: Token[] = [];
+    /** @internal */ private _disposed = false;
+
+    public constructor(options: {
+        /**
+         * Maximum number of tokens to predict.
+         *
+         * Defaults to `8`.
+         */
+        maxTokens?: number,
+
+        /**
+         * The minimum number of times a continuation has to be generated (more than other continuations)
+         * to be used as a prediction.
+         *
+         * Defaults to `2`.
+         */
+        minCount?: number,
+
+        /**
+         * The memory size of the cache, in bytes.
+         *
+         * The cache is shared with all the other predictors of models with the same vocabulary,
+         * so it's resized to the memory size of the latest predictor that started using it.
+         *
+         * Defaults to 32MB.
+         */
+        maxMemorySize?: number
+    } = {}) {
+        super();
+
+        this._maxTokens = Math.floor(Math.max(1, options.maxTokens ?? defaultMaxTokens));
+        this._minCount = Math.floor(Math.max(1, options.minCount ?? defaultMinCount));
+        this._maxMemorySize = Math.floor(Math.max(1, options.maxMemorySize ?? defaultMaxMemorySize));
+    }
+
+    public get maxTokens() {
+        return this._maxTokens;
+    }
+
+    public get minCount() {
+        return this._minCount;
+    }
+
+    public reset({targetSequence, stateTokens}: {
+        targetSequence: LlamaContextSequence,
+        stateTokens: Token[]
+    }) {
+        if (this._disposed)
+            throw new DisposedError();
+
+        const model = targetSequence.model._model;
+        if (this._cache == null || this._cacheModel !== model) {
+            this._cache?.dispose();
+            this._cache = new targetSequence.model._llama._bindings.AddonNgramCache(model, {
+                maxMemorySize: this._maxMemorySize
+            });
+            this._cacheModel = model;
+        }
+
+        this._contextTokens = stateTokens.slice(-contextTokensLength);
+        this._pendingPredictions = [];
+    }
+
+    public pushTokens(tokens: Token[]) {
+        let acceptedTokens = 0;
+        while (acceptedTokens < tokens.length && acceptedTokens < this._pendingPredictions.length &&
+            tokens[acceptedTokens] === this._pendingPredictions[acceptedTokens]
+        )
+            acceptedTokens++;
+
+        if (acceptedTokens > 0)
+            this._cache?.recordAcceptedTokens(acceptedTokens);
+
+        this._pendingPredictions = [];
+        this._contextTokens = this._contextTokens.concat(tokens).slice(-contextTokensLength);
+    }
+
+    public predictTokens() {
+        if (this._disposed)
+            throw new DisposedError();
+
+        if (this._cache == null)
+            return [];
+
+        this._pendingPredictions = Array.from(
+            this._cache.draft(Uint32Array.from(this._contextTokens), this._maxTokens, this._minCount)
+        ) as Token[];
+
+        return this._pendingPredictions.slice();
+    }
+
+    /**
+     * Get the hit-rate and acceptance counters of the cache.
+     *
+     * The counters are shared by all the predictors that use the same cache.
+     */
+    public getCacheStats(): NgramCacheTokenPredictorStats | undefined {
+        if (this._disposed)
+            throw new DisposedError();
+
+        return this._cache?.getStats();
+    }
+
+    public override dispose() {
+        this._disposed = true;
+        this._contextTokens = [];
+        this._pendingPredictions = [];
+        this._cache?.dispose();
+        this._cache = undefined;
+        this._cacheModel = undefined;
+    }
+}
@@ -2,6 +2,8 @@ import {PickOptions} from "../../utils/utilTypes.js";
 import type {LlamaGrammarEvaluationState} from "../LlamaGrammarEvaluationState.js";
 import type {TokenBias} from "../TokenBias.js";
 import type {Token} from "../../types.js";
+import type {LlamaThreadPool} from "../LlamaThreadPool.js";
+import type {LlamaCpuAffinity} from "../../bindings/types.js";
 import type {LlamaContextSequence} from "./LlamaContext.js";
 
 
@@ -47,6 +49,20 @@ export type LlamaContextOptions = {
      */
     batchSize?: number,
 
+    /**
+     * The maximum number of tokens `llama.cpp` evaluates in a single computation (the physical batch size).
+     *
+     * Batches larger than this size are evaluated in multiple steps of this size.
+     * The compute buffers of the context are allocated for this size,
+     * so a smaller value uses less memory at the cost of a slower evaluation of long prompts.
+     *
+     * Use the `inspect benchmark --type ubatch` command to compare combinations of `batchSize` and `ubatchSize` on your hardware.
+     *
+     * Defaults to `batchSize`, and is capped to it.
+     * Embedding and ranking contexts always use `batchSize`, since they have to evaluate each input in a single step.
+     */
+    ubatchSize?: number,
+
     /**
      * Flash attention is an optimization in the attention mechanism that makes inference faster, more efficient and uses less memory.
      *
@@ -74,8 +90,12 @@ export type LlamaContextOptions = {
      *
      * If `maxThreads` from the Llama instance is set to `0`, defaults to the `.cpuMathCores` value from the Llama instance,
      * otherwise defaults to `maxThreads` from the Llama instance (see the `maxThreads` option of `getLlama` method for more details).
+     *
+     * Set to `"auto"` to measure a few short evaluations with different numbers of threads when the context is created,
+     * and use the fastest number of threads for prompt evaluation and for generation.
+     * The result is cached per model and CPU cores, so creating more contexts of the same model doesn't measure again.
      */
-    threads?: number | {
+    threads?: number | "auto" | {
         /**
          * The ideal number of threads to use for evaluations.
          *
@@ -88,6 +108,16 @@ export type LlamaContextOptions = {
          */
         ideal?: number,
 
+        /**
+         * The ideal number of threads to use when evaluating batches of multiple tokens (like a prompt).
+         *
+         * Prompt evaluation is compute-bound and usually benefits from using all the CPU cores,
+         * while generating a single token at a time is bound by the memory bandwidth and can be faster with fewer threads.
+         *
+         * Defaults to the `ideal` value.
+         */
+        batch?: number,
+
         /**
          * Ensure evaluations always use at least this number of threads.
          *
@@ -97,6 +127,31 @@ export type LlamaContextOptions = {
         min?: number
     },
 
+    /**
+     * Evaluate on the threads of the given thread pool instead of on threads of this context.
+     *
+     * Contexts that use the same thread pool take turns evaluating on its threads,
+     * so running multiple contexts in parallel doesn't oversubscribe the CPU cores.
+     *
+     * The number of threads used for evaluations is capped by the number of threads of the thread pool.
+     *
+     * Create a thread pool using [`llama.createThreadPool`](../api/classes/Llama.md#createthreadpool).
+     */
+    threadPool?: LlamaThreadPool,
+
+    /**
+     * Run the context on the given CPU cores (or on the CPU cores of the given NUMA node).
+     *
+     * The context state (like the KV cache) is allocated in the memory of the NUMA node of these CPU cores,
+     * and when no `threadPool` is provided, the evaluation threads of the context run only on these CPU cores.
+     *
+     * On multi-socket machines, use together with a model loaded on the same NUMA node
+     * (see the `cpuAffinity` option of `.loadModel()`) so the context reads only local memory.
+     *
+     * Only supported on Linux.
+     */
+    cpuAffinity?: LlamaCpuAffinity,
+
     /**
      * Control the parallel sequences processing behavior.
      *
@@ -120,6 +175,29 @@ export type LlamaContextOptions = {
      */
     swaFullCache?: boolean,
 
+    /**
+     * The type of the keys in the KV cache.
+     *
+     * Quantized types (like `"q8_0"` and `"q4_0"`) make the KV cache use less memory,
+     * so larger contexts or more sequences can fit in the same memory, at the cost of a small loss in the response quality.
+     *
+     * Use the `inspect benchmark --type kvCache` command to compare the capacity and speed of KV cache types on your hardware.
+     *
+     * Defaults to `"f16"`.
+     */
+    kvCacheKeyType?: LlamaContextKvCacheType,
+
+    /**
+     * The type of the values in the KV cache.
+     *
+     * Quantized value types require `flashAttention` to be enabled.
+     *
+     * See `kvCacheKeyType` for more information.
+     *
+     * Defaults to `"f16"`.
+     */
+    kvCacheValueType?: LlamaContextKvCacheType,
+
     /**
      * Load the provided LoRA adapters onto the context.
      * LoRA adapters are used to modify the weights of a pretrained model to adapt to new tasks or domains
@@ -240,6 +318,104 @@ export type LlamaContextSequenceRepeatPenalty = {
     presencePenalty?: number
 };
 
+export type LlamaContextKvCacheType = "f32" | "f16" | "bf16" | "q8_0" | "q4_0" | "q4_1" | "iq4_nl" | "q5_0" | "q5_1";
+
+export type LlamaContextKvCacheUsage = {
+    /**
+     * 3 items for each sequence of the context, ordered by the sequence ID:
+     * the number of KV cache cells used by the sequence, and its min and max positions in the KV cache (`-1` when it's empty).
+     *
+     * For example, the number of cells used by the sequence with the ID `2` is at index `2 * 3`.
+     */
+    sequences: Int32Array,
+
+    /** The number of KV cache cells used by all the sequences */
+    usedCells: number,
+
+    /** The number of KV cache cells that are not used by any sequence */
+    freeCells: number,
+
+    /**
+     * How much the free cells are split between the budgets of the sequences, from `0` to `1`.
+     *
+     * Each sequence of a context with multiple sequences can only use up to `contextSize / totalSequences` cells,
+     * so `0` means that a single sequence can use all the free cells,
+     * and values closer to `1` mean that most of the free cells are reserved for other sequences.
+     *
+     * This is not fragmentation of the cells, so `.defragmentKvCache()` doesn't change it.
+     */
+    budgetSkew: number
+};
+
+export type LlamaContextDecodeStats = {
+    /** The number of batches decoded by the context */
+    batches: number,
+
+    /** The total wall time of decoding the batches, in milliseconds */
+    time: number,
+
+    /**
+     * The number of page faults that had to read from the disk while decoding the batches.
+     *
+     * When the model is loaded using mmap, these are usually parts of the model weights that are not in RAM,
+     * which makes the decoding much slower.
+     *
+     * The page faults are counted for the whole process, so only the faults of batches that were decoded
+     * while no other context was decoding are counted here (see `overlappedBatches`).
+     * Other work of the process that ran during the decoding (like reading files) can still add to them.
+     *
+     * Always `0` on Windows, where these are not reported separately from `minorPageFaults`.
+     */
+    majorPageFaults: number,
+
+    /**
+     * The number of page faults that were resolved without reading from the disk while decoding the batches.
+     *
+     * Like `majorPageFaults`, only counted for batches that were decoded while no other context was decoding.
+     */
+    minorPageFaults: number,
+
+    /** The number of batches that had enough major page faults to indicate that the model weights were read from the disk */
+    pagedBatches: number,
+
+    /**
+     * The number of batches that were decoded while another decode (of any context) or a model file prefetch was running.
+     *
+     * The page faults of these batches can't be attributed to this context, so they're not counted in `majorPageFaults`,
+     * `minorPageFaults` and `pagedBatches`.
+     * Use `llama.getPagingStats()` to detect paging of the whole process when multiple contexts are decoding concurrently.
+     */
+    overlappedBatches: number,
+
+    /** The wall time of decoding the last batch, in milliseconds */
+    lastBatchTime: number,
+
+    /** The number of major page faults of the process while decoding the last batch */
+    lastBatchMajorPageFaults: number,
+
+    /** The number of minor page faults of the process while decoding the last batch */
+    lastBatchMinorPageFaults: number,
+
+    /**
+     * Whether another decode or a model file prefetch was running while the last batch was decoded,
+     * so its page faults may not be of this context
+     */
+    lastBatchOverlapped: boolean,
+
+    /**
+     * Whether decoding the last batch had to read the model weights from the disk.
+     *
+     * Always `false` when the last batch overlapped with another decode or a prefetch (`lastBatchOverlapped`).
+     *
+     * When this is `true`, the decoding latency is bound by the disk,
+     * so consider shedding load or reading the model file into memory using [`model.prefetch()`](../api/classes/LlamaModel.md#prefetch).
+     */
+    pagingDetected: boolean,
+
+    /** Whether page fault counters are available on the current platform */
+    pageFaultsAvailable: boolean
+};
+
 export type BatchingOptions = {
     /**
      * The strategy used to dispatch items to be processed when there are items pending to be processed.
@@ -254,12 +430,25 @@ export type BatchingOptions = {
      * The strategy used to prioritize pending items to be processed.
      * - **`"maximumParallelism"`** - process as many different sequences in parallel as possible.
      * - **`"firstInFirstOut"`** - process items in the order they were added.
+     * - **`"chunkedPrefill"`** - include the next token of every ongoing generation in each batch,
+     * and fill the rest of the batch with chunks of pending prompts.
+     * Use together with `stepTokenBudget` to bound the time between generated tokens while long prompts are being evaluated.
      * - **Custom prioritization function** - a custom function that prioritizes the items to be processed.
      * See the {@link CustomBatchingPrioritizationStrategy} type for more information.
      *
      * Defaults to `"maximumParallelism"`.
      */
-    itemPrioritizationStrategy?: "maximumParallelism" | "firstInFirstOut" | CustomBatchingPrioritizationStrategy
+    itemPrioritizationStrategy?: "maximumParallelism" | "firstInFirstOut" | "chunkedPrefill" | CustomBatchingPrioritizationStrategy,
+
+    /**
+     * The maximum number of tokens to process in each batch.
+     *
+     * A lower value makes each batch finish faster, so ongoing generations get their next token sooner
+     * while long prompts are evaluated over more batches.
+     *
+     * Defaults to the context `batchSize`, and is capped to it.
+     */
+    stepTokenBudget?: number
 };
 
 /**
@@ -283,12 +472,65 @@ export type CustomBatchingPrioritizationStrategy = (options: {
 
 export type ContextShiftOptions = {
     size?: number | ((sequence: LlamaContextSequence) => number | Promise<number>),
-    strategy?: "eraseBeginning" | ((options: {
+
+    /**
+     * The strategy used to choose which tokens to erase from the sequence when it reaches the context size.
+     * - **`"eraseBeginning"`** - erase the oldest tokens of the sequence (after the BOS token, if any).
+     * - **`{type: "keepSinkTokens"}`** - keep the first tokens of the sequence and erase the oldest tokens after them.
+     * See {@link ContextShiftKeepSinkTokensStrategy} for more information.
+     * - **`{type: "eraseMarkedRegion"}`** - erase a region of the sequence that is wrapped with marker tokens.
+     * See {@link ContextShiftEraseMarkedRegionStrategy} for more information.
+     * - **Custom function** - a custom function that returns the token ranges to erase.
+     *
+     * The built-in strategies erase the tokens and shift the rest of the sequence in a single native call,
+     * so the evaluation continues right after without evaluating the sequence again.
+     *
+     * Defaults to `"eraseBeginning"`.
+     */
+    strategy?: "eraseBeginning" | ContextShiftKeepSinkTokensStrategy | ContextShiftEraseMarkedRegionStrategy | ((options: {
         sequence: LlamaContextSequence,
         size: number
     }) => ContextTokensDeleteRange[] | Promise<ContextTokensDeleteRange[]>)
 };
 
+/**
+ * Keep the first `sinkTokens` tokens of the sequence and erase the oldest tokens after them.
+ *
+ * Models tend to attend strongly to the first tokens of a sequence (attention sinks),
+ * so keeping them preserves the response quality better than erasing them.
+ */
+export type ContextShiftKeepSinkTokensStrategy = {
+    type: "keepSinkTokens",
+
+    /**
+     * The number of tokens at the beginning of the sequence to keep.
+     *
+     * Defaults to `4`.
+     */
+    sinkTokens?: number
+};
+
+/**
+ * Erase the first region of the sequence that starts with the `startMarker` tokens and ends with the `endMarker` tokens,
+ * including the markers (for example, a part of a conversation that was already summarized).
+ *
+ * When no such region is found, the oldest tokens after the first `sinkTokens` tokens are erased.
+ * When the region is smaller than the space that has to be freed, the oldest tokens after the first `sinkTokens` tokens
+ * are erased as well.
+ */
+export type ContextShiftEraseMarkedRegionStrategy = {
+    type: "eraseMarkedRegion",
+    startMarker: readonly Token[],
+    endMarker: readonly Token[],
+
+    /**
+     * The number of tokens at the beginning of the sequence to keep when erasing the oldest tokens.
+     *
+     * Defaults to keeping only the BOS token (if any).
+     */
+    sinkTokens?: number
+};
+
 export type ContextTokensDeleteRange = {
     start: number,
     end: number
@@ -342,6 +584,22 @@ export type SequenceEvaluateOptions = {
      */
     yieldEogToken?: boolean,
 
+    /**
+     * An abort signal to abort the evaluation.
+     *
+     * When the signal is aborted while a batch with tokens of this evaluation is being decoded,
+     * the decoding of the batch is interrupted, and the tokens of other sequences in that batch are decoded again in the next batch.
+     */
+    signal?: AbortSignal,
+
+    /**
+     * A timestamp (as returned from `Date.now()`) to abort the evaluation at.
+     *
+     * When the deadline passes while a batch with tokens of this evaluation is being decoded,
+     * the decoding of the batch is interrupted and the evaluation throws an `EvaluationDeadlineError`.
+     */
+    deadline?: number,
+
     /** @internal */
     _noSampling?: boolean
 };
@@ -0,0 +1,53 @@
+import {BatchItem, PrioritizedBatchItem} from "../../types.js";
+
+export function chunkedPrefillStrategy({items, size}: {items: readonly BatchItem[], size: number}) {
+    const res: PrioritizedBatchItem[] = [];
+    const prefillItems: BatchItem[] = [];
+
+    let leftFreeTokens = size;
+
+    // generation steps are always included first, so a long prompt never delays the next token of ongoing generations
+    for (const item of items) {
+        if (!isGenerationItem(item)) {
+            prefillItems.push(item);
+            continue;
+        }
+
+        if (leftFreeTokens === 0)
+            continue;
+
+        const processAmount = Math.min(item.tokens.length, leftFreeTokens);
+        res.push({item, processAmount});
+        leftFreeTokens -= processAmount;
+    }
+
+    prefillItems.sort((a, b) => b.evaluationPriority - a.evaluationPriority);
+
+    // the rest of the batch is filled with chunks of pending prompts, the rest of which are processed in the next batches
+    for (const item of prefillItems) {
+        if (leftFreeTokens === 0)
+            break;
+
+        const processAmount = Math.min(item.tokens.length, leftFreeTokens);
+        res.push({item, processAmount});
+        leftFreeTokens -= processAmount;
+    }
+
+    return res;
+}
+
+/**
+ * A single token, or tokens that all need logits (like validating predicted tokens),
+ * are a step of an ongoing generation rather than a prompt to ingest
+ */
+function isGenerationItem(item: BatchItem) {
+    if (item.tokens.length === 1)
+        return true;
+
+    for (let i = 0; i < item.tokens.length; i++) {
+        if (item.logits[i] !== true)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,102 @@
+import {Token} from "../../../types.js";
+import {ContextShiftOptions, ContextTokensDeleteRange} from "../types.js";
+
+type BuiltinContextShiftStrategy = Exclude<Required<ContextShiftOptions>["strategy"], Function>;
+
+const defaultSinkTokens = 4;
+
+/**
+ * Get the token ranges to erase from a sequence to free up at least `size` tokens using a built-in context shift strategy
+ */
+export function getContextShiftDeleteRanges(strategy: BuiltinContextShiftStrategy, {contextTokens, size, bosToken}: {
+    contextTokens: readonly Token[],
+    size: number,
+    bosToken?: Token
+}): ContextTokensDeleteRange[] {
+    const beginningIndex = (bosToken != null && contextTokens[0] === bosToken)
+        ? 1
+        : 0;
+
+    if (strategy === "eraseBeginning")
+        return [{start: beginningIndex, end: size + beginningIndex}];
+    else if (strategy.type === "keepSinkTokens")
+        return [getOldestSpanRange(contextTokens, size, strategy.sinkTokens ?? defaultSinkTokens)];
+    else if (strategy.type === "eraseMarkedRegion") {
+        const regionStart = findTokens(contextTokens, strategy.startMarker, 0);
+        const regionEnd = regionStart < 0
+            ? -1
+            : findTokens(contextTokens, strategy.endMarker, regionStart + strategy.startMarker.length);
+
+        if (regionStart >= 0 && regionEnd >= 0)
+            return topUpRegionRange(
+                contextTokens,
+                {start: regionStart, end: regionEnd + strategy.endMarker.length},
+                size,
+                strategy.sinkTokens ?? beginningIndex
+            );
+
+        return [getOldestSpanRange(contextTokens, size, strategy.sinkTokens ?? beginningIndex)];
+    }
+
+    void (strategy satisfies never);
+    throw new Error(`Unknown context shift strategy: ${JSON.stringify(strategy)}`);
+}
+
+function getOldestSpanRange(contextTokens: readonly Token[], size: number, sinkTokens: number): ContextTokensDeleteRange {
+    // keep fewer sink tokens when there aren't enough tokens after them to free up the requested size
+    const start = Math.max(0, Math.min(sinkTokens, contextTokens.length - size));
+
+    return {start, end: start + size};
+}
+
+// when the region is smaller than `size`, the oldest tokens after the sink tokens are erased as well to free up the rest
+function topUpRegionRange(
+    contextTokens: readonly Token[], region: ContextTokensDeleteRange, size: number, sinkTokens: number
+): ContextTokensDeleteRange[] {
+    let missingSize = size - (region.end - region.start);
+    if (missingSize <= 0)
+        return [region];
+
+    const ranges: ContextTokensDeleteRange[] = [];
+    const start = Math.max(0, Math.min(sinkTokens, contextTokens.length - size));
+
+    if (start < region.start) {
+        const end = Math.min(region.start, start + missingSize);
+        ranges.push({start, end});
+        missingSize -= end - start;
+    }
+
+    const lastRange = ranges.at(-1);
+    if (lastRange != null && lastRange.end === region.start)
+        lastRange.end = region.end;
+    else
+        ranges.push({...region});
+
+    if (missingSize > 0) {
+        const afterRegionStart = Math.max(start, region.end);
+        const regionRange = ranges.at(-1)!;
+
+        if (regionRange.end === afterRegionStart)
+            regionRange.end += missingSize;
+        else
+            ranges.push({start: afterRegionStart, end: afterRegionStart + missingSize});
+    }
+
+    return ranges;
+}
+
+function findTokens(tokens: readonly Token[], searchTokens: readonly Token[], fromIndex: number) {
+    if (searchTokens.length === 0)
+        return -1;
+
+    for (let i = fromIndex; i <= tokens.length - searchTokens.length; i++) {
+        let matches = true;
+        for (let j = 0; j < searchTokens.length && matches; j++)
+            matches = tokens[i + j] === searchTokens[j];
+
+        if (matches)
+            return i;
+    }
+
+    return -1;
+}
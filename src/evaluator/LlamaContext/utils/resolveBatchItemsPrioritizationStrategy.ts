@@ -1,6 +1,7 @@
 import {BatchingOptions} from "../types.js";
 import {maximumParallelismStrategy} from "./batchItemsPrioritizationStrategies/maximumParallelismStrategy.js";
 import {firstInFirstOutStrategy} from "./batchItemsPrioritizationStrategies/firstInFirstOutStrategy.js";
+import {chunkedPrefillStrategy} from "./batchItemsPrioritizationStrategies/chunkedPrefillStrategy.js";
 
 export function resolveBatchItemsPrioritizationStrategy(strategy: Required<BatchingOptions>["itemPrioritizationStrategy"]) {
     if (strategy instanceof Function)
@@ -9,6 +10,8 @@ export function resolveBatchItemsPrioritizationStrategy(strategy: Required<Batch
         return maximumParallelismStrategy;
     else if (strategy === "firstInFirstOut")
         return firstInFirstOutStrategy;
+    else if (strategy === "chunkedPrefill")
+        return chunkedPrefillStrategy;
 
     void (strategy satisfies never);
 
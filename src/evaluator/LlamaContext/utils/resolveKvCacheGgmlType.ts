@@ -0,0 +1,30 @@
+import {GgmlType} from "../../../gguf/types/GgufTensorInfoTypes.js";
+import {LlamaContextKvCacheType} from "../types.js";
+
+// the KV cache types supported by `llama.cpp`
+const kvCacheGgmlTypes = {
+    f32: GgmlType.F32,
+    f16: GgmlType.F16,
+    bf16: GgmlType.BF16,
+    q8_0: GgmlType.Q8_0,
+    q4_0: GgmlType.Q4_0,
+    q4_1: GgmlType.Q4_1,
+    iq4_nl: GgmlType.IQ4_NL,
+    q5_0: GgmlType.Q5_0,
+    q5_1: GgmlType.Q5_1
+} as const satisfies Record<LlamaContextKvCacheType, GgmlType>;
+
+export const llamaContextKvCacheTypes = Object.keys(kvCacheGgmlTypes) as LlamaContextKvCacheType[];
+
+export function resolveKvCacheGgmlType(type: LlamaContextKvCacheType = "f16"): GgmlType {
+    const ggmlType = kvCacheGgmlTypes[type];
+
+    if (ggmlType == null)
+        throw new Error(`Unsupported KV cache type: "${type}"`);
+
+    return ggmlType;
+}
+
+export function isQuantizedKvCacheType(type: LlamaContextKvCacheType = "f16") {
+    return type !== "f32" && type !== "f16" && type !== "bf16";
+}
@@ -0,0 +1,91 @@
+import os from "os";
+import {AddonContext} from "../../../bindings/AddonTypes.js";
+import type {LlamaModel} from "../../LlamaModel/LlamaModel.js";
+
+export type TunedContextThreads = {
+    threads: number,
+    batchThreads: number
+};
+
+const tuningBatchTokens = 64;
+const tuningGenerationSteps = 4;
+
+// when the evaluation times of thread counts are within this ratio of each other, the lower thread count is preferred,
+// since it leaves more CPU cores free for other work
+const fewerThreadsPreferenceRatio = 1.03;
+
+const tunedThreadsCache = new Map<string, Promise<TunedContextThreads>>();
+
+/**
+ * Find the fastest thread counts to evaluate batches and single tokens with on the given context.
+ *
+ * The result is cached per model file path and size, GPU layers, batch size and CPU signature,
+ * so other contexts of the same model on the same CPU cores reuse it without measuring again.
+ */
+export function tuneContextThreads({ctx, model, maxThreads, batchSize, cpus}: {
+    ctx: AddonContext,
+    model: LlamaModel,
+    maxThreads: number,
+    batchSize: number,
+    cpus?: readonly number[]
+}): Promise<TunedContextThreads> {
+    const batchTokens = Math.min(batchSize, tuningBatchTokens);
+    const cacheKey = JSON.stringify([
+        model.modelPath, model.size, model.gpuLayers, model._llama.gpu, maxThreads, batchTokens, getCpuSignature(cpus)
+    ]);
+
+    const cachedResult = tunedThreadsCache.get(cacheKey);
+    if (cachedResult != null)
+        return cachedResult;
+
+    const result = (async (): Promise<TunedContextThreads> => {
+        const candidates = getThreadCandidates(maxThreads);
+        const token = model.tokenize("Hello")[0] ?? model.tokens.bos ?? 0;
+        const {batchTimes, generationTimes} = await ctx.tuneThreads(
+            Uint32Array.from(candidates), token, batchTokens, tuningGenerationSteps
+        );
+
+        return {
+            threads: pickFastestCandidate(candidates, generationTimes),
+            batchThreads: pickFastestCandidate(candidates, batchTimes)
+        };
+    })();
+
+    tunedThreadsCache.set(cacheKey, result);
+    void result.catch(() => {
+        if (tunedThreadsCache.get(cacheKey) === result)
+            tunedThreadsCache.delete(cacheKey);
+    });
+
+    return result;
+}
+
+function getThreadCandidates(maxThreads: number) {
+    const candidates = new Set<number>();
+    for (const fraction of [1, 3 / 4, 1 / 2, 1 / 4])
+        candidates.add(Math.max(1, Math.round(maxThreads * fraction)));
+
+    return [...candidates].sort((a, b) => a - b);
+}
+
+function pickFastestCandidate(candidates: number[], times: Float64Array) {
+    let fastestIndex = 0;
+    for (let i = 1; i < times.length; i++) {
+        if (times[i]! * fewerThreadsPreferenceRatio < times[fastestIndex]!)
+            fastestIndex = i;
+    }
+
+    return candidates[fastestIndex] ?? candidates[candidates.length - 1]!;
+}
+
+function getCpuSignature(cpus?: readonly number[]) {
+    const machineCpus = os.cpus();
+
+    return [
+        machineCpus[0]?.model ?? "",
+        machineCpus.length,
+        cpus == null
+            ? "all"
+            : cpus.join(",")
+    ].join("|");
+}
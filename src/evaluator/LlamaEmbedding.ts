@@ -7,6 +7,55 @@ export type LlamaEmbeddingJSON = {
     vector: readonly number[]
 };
 
+export type LlamaEmbeddingsMatrix = {
+    /** The size of each embedding vector in the matrix */
+    vectorSize: number,
+
+    /**
+     * The embedding vectors of all the inputs, stored contiguously one after the other.
+     *
+     * The embedding of the input at index `i` is at `vectors.subarray(i * vectorSize, (i + 1) * vectorSize)`.
+     */
+    vectors: Float32Array
+};
+
+export type LlamaQuantizedEmbeddingsMatrix = {
+    type: "int8",
+
+    /** The number of dimensions of each embedding vector in the matrix */
+    vectorSize: number,
+
+    /**
+     * The L2-normalized embedding vectors of all the inputs quantized to int8, stored contiguously one after the other.
+     *
+     * The embedding of the input at index `i` is at `vectors.subarray(i * vectorSize, (i + 1) * vectorSize)`.
+     */
+    vectors: Int8Array,
+
+    /**
+     * The scale of each vector.
+     *
+     * `vectors[i * vectorSize + j] * scales[i]` approximates the value of dimension `j` of the embedding of the input at index `i`.
+     */
+    scales: Float32Array
+} | {
+    type: "binary",
+
+    /** The number of dimensions of each embedding vector in the matrix */
+    vectorSize: number,
+
+    /** The number of bytes each packed vector takes */
+    bytesPerVector: number,
+
+    /**
+     * The sign bits of the embedding vectors of all the inputs (1 for positive values), packed most significant bit first,
+     * and stored contiguously one after the other.
+     *
+     * The embedding of the input at index `i` is at `vectors.subarray(i * bytesPerVector, (i + 1) * bytesPerVector)`.
+     */
+    vectors: Uint8Array
+};
+
 export class LlamaEmbedding {
     public readonly vector: readonly number[];
 
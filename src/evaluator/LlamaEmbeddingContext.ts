@@ -3,8 +3,10 @@ import {Token} from "../types.js";
 import {LlamaText} from "../utils/LlamaText.js";
 import {tokenizeInput} from "../utils/tokenizeInput.js";
 import {resolveBeginningTokenToPrepend, resolveEndTokenToAppend} from "../utils/tokenizerUtils.js";
-import {LlamaEmbedding} from "./LlamaEmbedding.js";
+import {LlamaEmbedding, LlamaEmbeddingsMatrix, LlamaQuantizedEmbeddingsMatrix} from "./LlamaEmbedding.js";
 import type {LlamaModel} from "./LlamaModel/LlamaModel.js";
+import type {LlamaThreadPool} from "./LlamaThreadPool.js";
+import type {LlamaCpuAffinity} from "../bindings/types.js";
 import type {LlamaContext, LlamaContextSequence} from "./LlamaContext/LlamaContext.js";
 
 export type LlamaEmbeddingContextOptions = {
@@ -28,12 +30,36 @@ export type LlamaEmbeddingContextOptions = {
     /** prompt processing batch size */
     batchSize?: number,
 
+    /**
+     * The number of inputs `getEmbeddingsFor` can evaluate in parallel on the same batch.
+     *
+     * Each sequence reserves its own `contextSize` of the context memory.
+     *
+     * Defaults to `1`.
+     */
+    sequences?: number,
+
     /**
      * number of threads to use to evaluate tokens.
      * set to 0 to use the maximum threads supported by the current machine hardware
      */
     threads?: number,
 
+    /**
+     * Evaluate on the threads of the given thread pool, so this context shares the CPU cores with other contexts
+     * that use the same thread pool instead of competing over them.
+     *
+     * Create a thread pool using [`llama.createThreadPool`](../api/classes/Llama.md#createthreadpool).
+     */
+    threadPool?: LlamaThreadPool,
+
+    /**
+     * Run the context on the given CPU cores (or on the CPU cores of the given NUMA node).
+     *
+     * Only supported on Linux.
+     */
+    cpuAffinity?: LlamaCpuAffinity,
+
     /** An abort signal to abort the context creation */
     createSignal?: AbortSignal,
 
@@ -76,26 +102,13 @@ export class LlamaEmbeddingContext {
     }
 
     public async getEmbeddingFor(input: Token[] | string | LlamaText) {
-        const resolvedInput = tokenizeInput(input, this._llamaContext.model.tokenizer, undefined, true);
+        const resolvedInput = this._resolveInput(input);
 
-        if (resolvedInput.length > this._llamaContext.contextSize)
-            throw new Error(
-                "Input is longer than the context size. " +
-                "Try to increase the context size or use another model that supports longer contexts."
-            );
-        else if (resolvedInput.length === 0)
+        if (resolvedInput.length === 0)
             return new LlamaEmbedding({
                 vector: []
             });
 
-        const beginningToken = resolveBeginningTokenToPrepend(this.model.vocabularyType, this.model.tokens);
-        if (beginningToken != null && resolvedInput[0] !== beginningToken)
-            resolvedInput.unshift(beginningToken);
-
-        const endToken = resolveEndTokenToAppend(this.model.vocabularyType, this.model.tokens);
-        if (endToken != null && resolvedInput.at(-1) !== endToken)
-            resolvedInput.push(endToken);
-
         return await withLock([this as LlamaEmbeddingContext, "evaluate"], async () => {
             await this._sequence.eraseContextTokenRanges([{
                 start: 0,
@@ -117,6 +130,120 @@ export class LlamaEmbeddingContext {
         });
     }
 
+    /**
+     * Get the embeddings of multiple inputs at once.
+     *
+     * Each input is evaluated on its own sequence, so as many inputs as the `sequences` option of the embedding context allows
+     * are evaluated together on the same batch.
+     *
+     * The embeddings are returned as a single contiguous matrix, to avoid allocating a separate array for each embedding.
+     * The rows of empty inputs are filled with zeros.
+     */
+    public async getEmbeddingsFor(inputs: Array<Token[] | string | LlamaText>, {
+        normalize = false,
+        vectorSize
+    }: {
+        /**
+         * L2-normalize each embedding vector.
+         *
+         * When used together with `vectorSize`, the normalization is done after the vector is truncated.
+         *
+         * Defaults to `false`.
+         */
+        normalize?: boolean,
+
+        /**
+         * Truncate each embedding vector to this size.
+         *
+         * Useful for models trained with Matryoshka representation learning.
+         *
+         * Defaults to the embedding vector size of the model.
+         */
+        vectorSize?: number
+    } = {}): Promise<LlamaEmbeddingsMatrix> {
+        const resolvedVectorSize = this._resolveVectorSize(vectorSize);
+        const vectors = await this._computeEmbeddings(inputs, resolvedVectorSize, Float32Array, (tokens) => (
+            this._llamaContext._ctx.computeEmbeddings(tokens, {
+                maxVectorSize: resolvedVectorSize,
+                normalize
+            })
+        ));
+
+        return {
+            vectorSize: resolvedVectorSize,
+            vectors
+        };
+    }
+
+    /**
+     * Get the quantized embeddings of multiple inputs at once.
+     *
+     * The quantization is done natively, which reduces the size of the returned data by 4x for `"int8"` and 32x for `"binary"`
+     * compared to `getEmbeddingsFor`.
+     *
+     * The inputs are evaluated the same way as in `getEmbeddingsFor`.
+     */
+    public async getQuantizedEmbeddingsFor(inputs: Array<Token[] | string | LlamaText>, {
+        type,
+        vectorSize
+    }: {
+        /**
+         * - **`"int8"`** - L2-normalize each vector and quantize it to int8 with a scale per vector.
+         * - **`"binary"`** - keep only the sign of each value, packed into bits (most significant bit first).
+         */
+        type: "int8" | "binary",
+
+        /**
+         * Truncate each embedding vector to this size before quantizing it.
+         *
+         * Defaults to the embedding vector size of the model.
+         */
+        vectorSize?: number
+    }): Promise<LlamaQuantizedEmbeddingsMatrix> {
+        const resolvedVectorSize = this._resolveVectorSize(vectorSize);
+
+        if (type === "binary") {
+            const bytesPerVector = Math.ceil(resolvedVectorSize / 8);
+            const vectors = await this._computeEmbeddings(inputs, bytesPerVector, Uint8Array, (tokens) => (
+                this._llamaContext._ctx.computeEmbeddings(tokens, {
+                    maxVectorSize: resolvedVectorSize,
+                    outputType: "binary"
+                })
+            ));
+
+            return {
+                type,
+                vectorSize: resolvedVectorSize,
+                bytesPerVector,
+                vectors
+            };
+        }
+
+        let scales = new Float32Array(inputs.length);
+        const vectors = await this._computeEmbeddings(inputs, resolvedVectorSize, Int8Array, async (tokens, inputIndexes) => {
+            const res = await this._llamaContext._ctx.computeEmbeddings(tokens, {
+                maxVectorSize: resolvedVectorSize,
+                outputType: "int8"
+            });
+
+            if (inputIndexes.length === inputs.length)
+                scales = res.scales;
+            else
+                inputIndexes.forEach((inputIndex, i) => {
+                    scales[inputIndex] = res.scales[i]!;
+                });
+
+            return res.vectors;
+        });
+
+        return {
+            type,
+            vectorSize: resolvedVectorSize,
+            vectors,
+            scales
+        };
+    }
+
     public async dispose() {
         await this._disposeAggregator.dispose();
     }
@@ -134,6 +261,75 @@ export class LlamaEmbeddingContext {
         return this._llamaContext.model;
     }
 
+    /** @internal */
+    private _resolveVectorSize(vectorSize?: number) {
+        if (vectorSize == null || vectorSize <= 0)
+            return this.model.embeddingVectorSize;
+
+        return Math.min(vectorSize, this.model.embeddingVectorSize);
+    }
+
+    /** @internal */
+    private async _computeEmbeddings<T extends Float32Array | Int8Array | Uint8Array>(
+        inputs: Array<Token[] | string | LlamaText>,
+        rowSize: number,
+        ArrayType: {new (length: number): T},
+        compute: (tokens: Uint32Array[], inputIndexes: number[]) => Promise<T>
+    ): Promise<T> {
+        const resolvedInputs = inputs.map((input) => this._resolveInput(input));
+        const nonEmptyInputIndexes = resolvedInputs
+            .map((input, index) => (input.length === 0 ? -1 : index))
+            .filter((index) => index >= 0);
+
+        if (nonEmptyInputIndexes.length === 0)
+            return new ArrayType(rowSize * inputs.length);
+
+        return await withLock([this as LlamaEmbeddingContext, "evaluate"], async () => {
+            await this._sequence.eraseContextTokenRanges([{
+                start: 0,
+                end: this._sequence.nextTokenIndex
+            }]);
+
+            const rows = await compute(
+                nonEmptyInputIndexes.map((index) => Uint32Array.from(resolvedInputs[index]!)),
+                nonEmptyInputIndexes
+            );
+
+            if (nonEmptyInputIndexes.length === inputs.length)
+                return rows;
+
+            // the rows of empty inputs are left filled with zeros
+            const res = new ArrayType(rowSize * inputs.length);
+            for (let i = 0; i < nonEmptyInputIndexes.length; i++)
+                res.set(rows.subarray(i * rowSize, (i + 1) * rowSize) as any, nonEmptyInputIndexes[i]! * rowSize);
+
+            return res;
+        });
+    }
+
+    /** @internal */
+    private _resolveInput(input: Token[] | string | LlamaText) {
+        const resolvedInput = tokenizeInput(input, this._llamaContext.model.tokenizer, undefined, true);
+
+        if (resolvedInput.length > this._llamaContext.contextSize)
+            throw new Error(
+                "Input is longer than the context size. " +
+                "Try to increase the context size or use another model that supports longer contexts."
+            );
+        else if (resolvedInput.length === 0)
+            return resolvedInput;
+
+        const beginningToken = resolveBeginningTokenToPrepend(this.model.vocabularyType, this.model.tokens);
+        if (beginningToken != null && resolvedInput[0] !== beginningToken)
+            resolvedInput.unshift(beginningToken);
+
+        const endToken = resolveEndTokenToAppend(this.model.vocabularyType, this.model.tokens);
+        if (endToken != null && resolvedInput.at(-1) !== endToken)
+            resolvedInput.push(endToken);
+
+        return resolvedInput;
+    }
+
     /** @internal */
     public static async _create({
         _model
@@ -142,7 +338,10 @@ export class LlamaEmbeddingContext {
     }, {
         contextSize,
         batchSize,
+        sequences,
         threads = 6,
+        threadPool,
+        cpuAffinity,
         createSignal,
         ignoreMemorySafetyChecks
     }: LlamaEmbeddingContextOptions) {
@@ -152,7 +351,10 @@ export class LlamaEmbeddingContext {
         const llamaContext = await _model.createContext({
             contextSize,
             batchSize,
+            sequences,
             threads,
+            threadPool,
+            cpuAffinity,
             createSignal,
             ignoreMemorySafetyChecks,
             _embeddings: true
@@ -0,0 +1,260 @@
+import {DisposedError, EventRelay} from "lifecycle-utils";
+import {AddonEmbeddingIndex} from "../bindings/AddonTypes.js";
+import {LlamaEmbedding, LlamaEmbeddingsMatrix} from "./LlamaEmbedding.js";
+import type {LlamaModel} from "./LlamaModel/LlamaModel.js";
+
+export type LlamaEmbeddingIndexOptions = {
+    /**
+     * The size of the vectors stored in the index.
+     *
+     * Defaults to the embedding vector size of the model.
+     */
+    vectorSize?: number,
+
+    /**
+     * The type to store the vectors as.
+     * - **`"f32"`** - full precision.
+     * - **`"f16"`** - half precision, half the memory of `"f32"` with a negligible effect on the search results.
+     * - **`"int8"`** - quantized to int8 with a scale per vector, a quarter of the memory of `"f32"`.
+     *
+     * Defaults to `"f32"`.
+     */
+    type?: "f32" | "f16" | "int8",
+
+    /**
+     * The similarity metric to search by.
+     * - **`"cosine"`** - cosine similarity. The vectors are normalized when added to the index.
+     * - **`"dot"`** - dot product of the vectors as-is.
+     *
+     * Defaults to `"cosine"`.
+     */
+    metric?: "cosine" | "dot"
+};
+
+export type LlamaEmbeddingIndexLoadOptions = {
+    /**
+     * Map the index file into memory instead of reading it, so the vectors are paged in by the OS as they are searched.
+     *
+     * Adding vectors to a memory-mapped index copies the existing vectors to memory first.
+     *
+     * Defaults to `false`.
+     */
+    useMmap?: boolean
+};
+
+export type LlamaEmbeddingIndexSearchOptions = {
+    /**
+     * The number of results to return for each query.
+     *
+     * Defaults to `10`.
+     */
+    k?: number,
+
+    /**
+     * The number of threads to search with.
+     *
+     * Defaults to the number of math cores of the machine. Small indexes are searched with fewer threads.
+     */
+    threads?: number
+};
+
+export type LlamaEmbeddingIndexSearchResult = {
+    /** The index of the vector in the embedding index, in the order it was added */
+    index: number,
+    score: number
+};
+
+type EmbeddingInput = LlamaEmbedding | readonly number[] | Float32Array;
+
+/**
+ * An in-memory index of embedding vectors that is searched natively using SIMD instructions and multiple threads.
+ *
+ * Create one using [`model.createEmbeddingIndex`](./LlamaModel.md#createembeddingindex).
+ * @see [Searching Embeddings Natively](https://node-llama-cpp.withcat.ai/guide/embedding#embedding-index) tutorial
+ */
+export class LlamaEmbeddingIndex {
+    /** @internal */ private readonly _index: AddonEmbeddingIndex;
+    /** @internal */ private _disposed: boolean = false;
+
+    public readonly onDispose = new EventRelay<void>();
+
+    private constructor({_index}: {_index: AddonEmbeddingIndex}) {
+        this._index = _index;
+    }
+
+    public dispose() {
+        if (this._disposed)
+            return;
+
+        this._disposed = true;
+        this._index.dispose();
+        this.onDispose.dispatchEvent();
+    }
+
+    /** @hidden */
+    public [Symbol.dispose]() {
+        return this.dispose();
+    }
+
+    public get disposed() {
+        return this._disposed;
+    }
+
+    /** The number of vectors in the index */
+    public get size(): number {
+        return this._index.getSize();
+    }
+
+    public get vectorSize(): number {
+        return this._index.getVectorSize();
+    }
+
+    public get type(): "f32" | "f16" | "int8" {
+        return this._index.getType();
+    }
+
+    public get metric(): "cosine" | "dot" {
+        return this._index.getMetric();
+    }
+
+    public get isMemoryMapped(): boolean {
+        return this._index.getIsMemoryMapped();
+    }
+
+    /**
+     * Add vectors to the index.
+     *
+     * Vectors longer than the vector size of the index are truncated.
+     *
+     * Waits for running searches to finish before adding the vectors.
+     * @returns The index of the first added vector
+     */
+    public async add(embeddings: EmbeddingInput | readonly EmbeddingInput[] | LlamaEmbeddingsMatrix): Promise<number> {
+        this._ensureNotDisposed();
+
+        return await this._index.add(this._toMatrix(embeddings));
+    }
+
+    /**
+     * Find the `k` vectors most similar to the given query, sorted from the most similar to the least.
+     */
+    public async search(query: EmbeddingInput, options: LlamaEmbeddingIndexSearchOptions = {}): Promise<LlamaEmbeddingIndexSearchResult[]> {
+        const [results] = await this.searchMany([query], options);
+        return results ?? [];
+    }
+
+    /**
+     * Find the `k` vectors most similar to each of the given queries.
+     *
+     * Searching for many queries at once scans the index only once.
+     */
+    public async searchMany(
+        queries: readonly EmbeddingInput[] | LlamaEmbeddingsMatrix,
+        {k = 10, threads}: LlamaEmbeddingIndexSearchOptions = {}
+    ): Promise<LlamaEmbeddingIndexSearchResult[][]> {
+        this._ensureNotDisposed();
+
+        const queriesMatrix = this._toMatrix(queries);
+        const queriesCount = queriesMatrix.length / this.vectorSize;
+        const res = await this._index.search(queriesMatrix, Math.max(0, Math.floor(k)), {threads});
+
+        return Array.from({length: queriesCount}, (_, queryIndex) => (
+            Array.from({length: res.k}, (_, i): LlamaEmbeddingIndexSearchResult => ({
+                index: res.indexes[queryIndex * res.k + i]!,
+                score: res.scores[queryIndex * res.k + i]!
+            }))
+        ));
+    }
+
+    /**
+     * Save the index to a file.
+     *
+     * The file can be loaded using [`model.loadEmbeddingIndex`](./LlamaModel.md#loadembeddingindex).
+     */
+    public async save(filePath: string) {
+        this._ensureNotDisposed();
+
+        await this._index.save(filePath);
+    }
+
+    /** @internal */
+    private _toMatrix(embeddings: EmbeddingInput | readonly EmbeddingInput[] | LlamaEmbeddingsMatrix): Float32Array {
+        const vectorSize = this.vectorSize;
+
+        if (isEmbeddingsMatrix(embeddings)) {
+            if (embeddings.vectorSize === vectorSize)
+                return embeddings.vectors;
+
+            const count = embeddings.vectors.length / embeddings.vectorSize;
+            const res = new Float32Array(count * vectorSize);
+            for (let i = 0; i < count; i++)
+                res.set(
+                    embeddings.vectors.subarray(
+                        i * embeddings.vectorSize,
+                        i * embeddings.vectorSize + Math.min(vectorSize, embeddings.vectorSize)
+                    ),
+                    i * vectorSize
+                );
+
+            return res;
+        }
+
+        const vectors: readonly EmbeddingInput[] = isSingleEmbedding(embeddings)
+            ? [embeddings]
+            : embeddings as readonly EmbeddingInput[];
+
+        const res = new Float32Array(vectors.length * vectorSize);
+        for (let i = 0; i < vectors.length; i++) {
+            const vector = vectors[i]! instanceof LlamaEmbedding
+                ? (vectors[i] as LlamaEmbedding).vector
+                : vectors[i] as readonly number[] | Float32Array;
+
+            res.set(vector.length > vectorSize ? vector.slice(0, vectorSize) : vector, i * vectorSize);
+        }
+
+        return res;
+    }
+
+    /** @internal */
+    private _ensureNotDisposed() {
+        if (this._disposed)
+            throw new DisposedError();
+    }
+
+    /** @internal */
+    public static _create({_model}: {_model: LlamaModel}, {
+        vectorSize = _model.embeddingVectorSize,
+        type = "f32",
+        metric = "cosine"
+    }: LlamaEmbeddingIndexOptions) {
+        if (vectorSize <= 0)
+            throw new Error("The vector size of an embedding index must be greater than 0");
+
+        return new LlamaEmbeddingIndex({
+            _index: new _model._llama._bindings.AddonEmbeddingIndex(vectorSize, {type, metric})
+        });
+    }
+
+    /** @internal */
+    public static async _load({_model}: {_model: LlamaModel}, filePath: string, {useMmap = false}: LlamaEmbeddingIndexLoadOptions) {
+        const index = new _model._llama._bindings.AddonEmbeddingIndex(0);
+
+        try {
+            await index.load(filePath, {useMmap});
+        } catch (err) {
+            index.dispose();
+            throw err;
+        }
+
+        return new LlamaEmbeddingIndex({_index: index});
+    }
+}
+
+function isEmbeddingsMatrix(value: unknown): value is LlamaEmbeddingsMatrix {
+    return value != null && typeof value === "object" && !(value instanceof LlamaEmbedding) &&
+        !(value instanceof Float32Array) && !(value instanceof Array) && (value as LlamaEmbeddingsMatrix).vectors instanceof Float32Array;
+}
+
+function isSingleEmbedding(value: EmbeddingInput | readonly EmbeddingInput[]): value is EmbeddingInput {
+    return value instanceof LlamaEmbedding || value instanceof Float32Array || typeof value[0] === "number";
+}
@@ -5,9 +5,12 @@ import {removeNullFields} from "../../utils/removeNullFields.js";
 import {Token, Tokenizer} from "../../types.js";
 import {AddonModel, AddonModelCompletionParams, AddonModelCompletionResult, AddonModelLora, ModelTypeDescription, Optional} from "../../bindings/AddonTypes.js";
 import {DisposalPreventionHandle, DisposeGuard} from "../../utils/DisposeGuard.js";
-import {LlamaLocks, LlamaLogLevel, LlamaVocabularyType, LlamaVocabularyTypeValues} from "../../bindings/types.js";
+import {
+    LlamaCpuAffinity, LlamaLocks, LlamaLogLevel, LlamaVocabularyType, LlamaVocabularyTypeValues
+} from "../../bindings/types.js";
 import {GgufFileInfo} from "../../gguf/types/GgufFileInfoTypes.js";
 import {readGgufFileInfo} from "../../gguf/readGgufFileInfo.js";
+import {resolveSplitGgufParts} from "../../gguf/utils/resolveSplitGgufParts.js";
 import {GgufInsights} from "../../gguf/insights/GgufInsights.js";
 import {getConsoleLogPrefix} from "../../utils/getConsoleLogPrefix.js";
 import {Writable} from "../../utils/utilTypes.js";
@@ -19,7 +22,9 @@ import {GgufArchitectureType, GgufMetadata} from "../../gguf/types/GgufMetadataT
 import {OverridesObject} from "../../utils/OverridesObject.js";
 import {maxRecentDetokenizerTokens} from "../../consts.js";
 import {LlamaRankingContext, LlamaRankingContextOptions} from "../LlamaRankingContext.js";
+import {LlamaEmbeddingIndex, LlamaEmbeddingIndexLoadOptions, LlamaEmbeddingIndexOptions} from "../LlamaEmbeddingIndex.js";
 import {TokenAttribute, TokenAttributes} from "./utils/TokenAttributes.js";
+import {LlamaModelLoraCacheStats, LoraAdapterCache} from "./utils/LoraAdapterCache.js";
 import type {Llama} from "../../bindings/Llama.js";
 import type {BuiltinSpecialTokenValue} from "../../utils/LlamaText.js";
 
@@ -90,6 +95,22 @@ export type LlamaModelOptions = {
      */
     checkTensors?: boolean,
 
+    /**
+     * Load the model on the given CPU cores (or on the CPU cores of the given NUMA node),
+     * so the model weights that are loaded to RAM are placed in the memory of their NUMA node.
+     *
+     * On multi-socket machines, you can load the model once for each NUMA node with `useMmap: false`
+     * and create contexts on the same node (using the `cpuAffinity` option of `.createContext()`)
+     * to have a copy of the weights on each node, so every context reads only local memory.
+     *
+     * With `useMmap` enabled, the weights aren't copied -
+     * all the models of the same file share the same pages of the OS page cache,
+     * which stay on the NUMA node that first read them.
+     *
+     * Only supported on Linux.
+     */
+    cpuAffinity?: LlamaCpuAffinity,
+
     /**
      * Enable flash attention by default for contexts created with this model.
      * Only works with models that support flash attention.
@@ -139,6 +160,20 @@ export type LlamaModelOptions = {
      */
     ignoreMemorySafetyChecks?: boolean,
 
+    /**
+     * The maximum total file size (in bytes) of the LoRA adapters to keep loaded for this model.
+     *
+     * When the LoRA adapters loaded for this model exceed this size,
+     * the least recently used adapters that are not used by any context or sequence are unloaded.
+     * Adapters that are in use are never unloaded.
+     *
+     * Set this to keep LoRA adapters loaded between usages (and to keep adapters loaded using `preloadLora`),
+     * so switching between them doesn't have to load them again.
+     *
+     * Defaults to `0` (unload LoRA adapters as soon as they're no longer used).
+     */
+    loraCacheSize?: number,
+
     /**
      * Metadata overrides to load the model with.
      *
@@ -149,9 +184,43 @@ export type LlamaModelOptions = {
     metadataOverrides?: OverridesObject<GgufMetadata, number | bigint | boolean | string>
 };
 
+export type LlamaModelPrefetchOptions = {
+    /**
+     * The number of threads to read the model file with.
+     *
+     * Defaults to `4`.
+     */
+    threads?: number,
+
+    /**
+     * Limit the rate of reading the model file from the disk, in bytes per second,
+     * so prefetching doesn't starve other I/O on the machine.
+     *
+     * Parts of the file that are already in the page cache don't count towards this limit.
+     *
+     * Defaults to `0` (unlimited).
+     */
+    bytesPerSecond?: number,
+
+    /** Called with a number between `0` and `1` as the model file is read */
+    onProgress?(progress: number): void,
+
+    /** An abort signal to stop the prefetch */
+    signal?: AbortSignal
+};
+
+export type LlamaModelFileResidency = {
+    /** The size of the parts of the model file that are in the page cache, in bytes */
+    residentSize: number,
+
+    /** The total size of the model file, in bytes */
+    totalSize: number
+};
+
 const defaultUseMmap = true;
 const defaultContextFlashAttentionEnabled = false;
 const defaultContextSwaFullCache = false;
+const defaultLoraCacheSize = 0;
 
 export class LlamaModel {
     /** @internal */ public readonly _llama: Llama;
@@ -171,17 +240,20 @@ export class LlamaModel {
     /** @internal */ private readonly _defaultContextFlashAttention: boolean;
     /** @internal */ private readonly _defaultContextSwaFullCache: boolean;
     /** @internal */ private readonly _flashAttentionSupported: boolean;
-    /** @internal */ private readonly _loraAdapters = new Map<string, AddonModelLora>();
+    /** @internal */ private readonly _loraCache: LoraAdapterCache;
     /** @internal */ private _typeDescription?: ModelTypeDescription;
     /** @internal */ private _trainContextSize?: number;
     /** @internal */ private _embeddingVectorSize?: number;
     /** @internal */ private _vocabularyType?: LlamaVocabularyType;
+    /** @internal */ private _vocabularyFingerprint?: string;
+    /** @internal */ private _nextPrefetchId: number = 0;
 
     public readonly tokenizer: Tokenizer;
     public readonly onDispose = new EventRelay<void>();
 
     private constructor({
-        modelPath, gpuLayers, vocabOnly = false, useMmap, useMlock, checkTensors, onLoadProgress, loadSignal, metadataOverrides
+        modelPath, gpuLayers, vocabOnly = false, useMmap, useMlock, checkTensors, cpuAffinity, onLoadProgress, loadSignal,
+        loraCacheSize, metadataOverrides
     }: LlamaModelOptions & {
         gpuLayers: number
     }, {
@@ -223,6 +295,9 @@ export class LlamaModel {
                 ? useMlock
                 : undefined,
             checkTensors: checkTensors ?? false,
+            cpus: cpuAffinity == null
+                ? undefined
+                : Uint32Array.from(_llama._resolveCpuAffinity(cpuAffinity) ?? []),
             onLoadProgress: onLoadProgress == null
                 ? undefined
                 : (loadPercentage: number) => {
@@ -239,6 +314,15 @@ export class LlamaModel {
                 : undefined
         }));
         this._tokens = LlamaModelTokens._create(this._model, this._disposedState);
+        this._loraCache = new LoraAdapterCache({
+            maxSize: Math.max(0, loraCacheSize ?? defaultLoraCacheSize),
+            loadLora: async (filePath) => {
+                const lora = new this._llama._bindings.AddonModelLora(this._model, filePath);
+                await this._model.loadLora(lora);
+
+                return lora;
+            }
+        });
         this._filename = path.basename(modelPath);
 
         this._disposeAggregator.add(() => {
@@ -251,6 +335,7 @@ export class LlamaModel {
             )
         );
 
+        this._disposeAggregator.add(() => this._loraCache.dispose());
         this._disposeAggregator.add(async () => {
             await this._backendModelDisposeGuard.acquireDisposeLock();
             await this._model.dispose();
@@ -586,6 +671,104 @@ export class LlamaModel {
         return await LlamaRankingContext._create({_model: this}, options);
     }
 
+    /**
+     * Create an in-memory index of embedding vectors that is searched natively.
+     *
+     * Only add vectors created using this model to the index.
+     * @see [Searching Embeddings Natively](https://node-llama-cpp.withcat.ai/guide/embedding#embedding-index) tutorial
+     */
+    public createEmbeddingIndex(options: LlamaEmbeddingIndexOptions = {}) {
+        this._ensureNotDisposed();
+
+        return LlamaEmbeddingIndex._create({_model: this}, options);
+    }
+
+    /**
+     * Load an embedding index saved using [`LlamaEmbeddingIndex.save`](./LlamaEmbeddingIndex.md#save).
+     * @see [Searching Embeddings Natively](https://node-llama-cpp.withcat.ai/guide/embedding#embedding-index) tutorial
+     */
+    public async loadEmbeddingIndex(filePath: string, options: LlamaEmbeddingIndexLoadOptions = {}) {
+        this._ensureNotDisposed();
+
+        return await LlamaEmbeddingIndex._load({_model: this}, filePath, options);
+    }
+
+    /**
+     * Get how much of the model file is currently in the page cache.
+     *
+     * When the model is loaded using mmap, parts of the file that aren't in the page cache are read from the disk
+     * only when they're first used, which makes the first evaluations slower.
+     *
+     * Returns `null` when this is not supported on the current platform (Windows),
+     * or on Linux when the process neither owns the model file nor can write to it, since the system reports such files as fully cached.
+     */
+    public async getFileResidency(): Promise<LlamaModelFileResidency | null> {
+        this._ensureNotDisposed();
+
+        return await this._model.getFileResidency(resolveSplitGgufParts(this._modelPath));
+    }
+
+    /**
+     * Read the model file into the page cache ahead of time,
+     * so the first evaluations don't have to wait for it to be read from the disk.
+     *
+     * This is mainly useful when the model is loaded using mmap.
+     *
+     * Resolves to `true` when the entire file was read, or `false` when the prefetch was aborted
+     * (using the `signal`, or by disposing the model).
+     */
+    public async prefetch({
+        threads,
+        bytesPerSecond,
+        onProgress,
+        signal
+    }: LlamaModelPrefetchOptions = {}): Promise<boolean> {
+        this._ensureNotDisposed();
+
+        if (signal?.aborted)
+            return false;
+
+        const prefetchId = this._nextPrefetchId++;
+        const onAbort = () => this._model.abortPrefetchFile(prefetchId);
+        signal?.addEventListener("abort", onAbort);
+
+        try {
+            return await this._model.prefetchFile(prefetchId, resolveSplitGgufParts(this._modelPath), removeNullFields({
+                threads,
+                bytesPerSecond,
+                onProgress
+            }));
+        } finally {
+            signal?.removeEventListener("abort", onAbort);
+        }
+    }
+
+    /**
+     * Load LoRA adapters ahead of time, so contexts and sequences that use them later don't have to wait for them to load.
+     *
+     * Preloaded adapters are kept loaded only while they fit in the `loraCacheSize` of the model
+     * (the least recently used unused adapters are unloaded first).
+     *
+     * Concurrent loads of the same adapter file are shared.
+     */
+    public async preloadLora(filePaths: string | readonly string[]) {
+        this._ensureNotDisposed();
+
+        await Promise.all(
+            (typeof filePaths === "string" ? [filePaths] : filePaths)
+                .map((filePath) => this._loraCache.preload(path.resolve(process.cwd(), filePath)))
+        );
+    }
+
+    /**
+     * Counters of the LoRA adapters cache of this model.
+     *
+     * Use `totalLoadTime / loads` to track the latency of loading adapters that were not loaded in advance.
+     */
+    public get loraCacheStats(): LlamaModelLoraCacheStats {
+        return this._loraCache.stats;
+    }
+
     /**
      * Get warnings about the model file that would affect its usage.
      *
@@ -680,44 +863,42 @@ export class LlamaModel {
         return this._vocabularyType;
     }
 
+    /**
+     * A hash of the model vocabulary and tokenizer configuration, computed when the model is loaded.
+     *
+     * It covers the text and attributes of every token, the special tokens, the BPE merges,
+     * the pre-tokenizer type and the tokenizer whitespace handling flags.
+     * Models with the same fingerprint tokenize text the same way,
+     * so it can be used to check whether tokens of one model can be used with another model,
+     * or as part of a cache key of tokenized text.
+     */
+    public get vocabularyFingerprint(): string {
+        this._ensureNotDisposed();
+
+        if (this._vocabularyFingerprint == null)
+            this._vocabularyFingerprint = this._model.getVocabularyFingerprint();
+
+        return this._vocabularyFingerprint;
+    }
+
     /** @internal */
     private _ensureNotDisposed() {
         if (this._disposedState.disposed)
             throw new DisposedError();
     }
 
-    /** @internal */
+    /**
+     * Get the LoRA adapter of the given file, loading it if needed.
+     * The usages of the returned adapter are incremented, so release it using `_removeLoraUsage`
+     * @internal
+     */
     public async _getOrLoadLora(filePath: string) {
-        const resolvedPath = path.resolve(process.cwd(), filePath);
-        if (this._loraAdapters.has(resolvedPath))
-            return this._loraAdapters.get(resolvedPath)!;
-
-        return await withLock([this._loraAdapters, "modify"], async () => {
-            if (this._loraAdapters.has(resolvedPath))
-                return this._loraAdapters.get(resolvedPath)!;
-
-            const lora = new this._llama._bindings.AddonModelLora(this._model, resolvedPath);
-            await this._model.loadLora(lora);
-            this._loraAdapters.set(resolvedPath, lora);
-
-            return lora;
-        });
+        return await this._loraCache.acquire(path.resolve(process.cwd(), filePath));
     }
 
     /** @internal */
-    public async _removeLoraUsage(loraAdapters: Set<AddonModelLora>) {
-        return await withLock([this._loraAdapters, "modify"], async () => {
-            await Promise.all(
-                [...loraAdapters].map(async (lora) => {
-                    lora.usages--;
-
-                    if (lora.usages <= 0 && this._loraAdapters.get(lora.filePath) === lora) {
-                        this._loraAdapters.delete(lora.filePath);
-                        await lora.dispose();
-                    }
-                })
-            );
-        });
+    public async _removeLoraUsage(loraAdapters: Iterable<AddonModelLora>) {
+        return await this._loraCache.release(loraAdapters);
     }
 
     /** @internal */
@@ -731,7 +912,8 @@ export class LlamaModel {
 
         const fileInfo = await readGgufFileInfo(modelOptions.modelPath, {
             sourceType: "filesystem",
-            signal: loadSignal
+            signal: loadSignal,
+            llama: _llama
         });
         applyGgufMetadataOverrides(fileInfo, modelOptions.metadataOverrides);
         const ggufInsights = await GgufInsights.from(fileInfo, _llama);
@@ -0,0 +1,239 @@
+import fs from "fs-extra";
+import {DisposedError, withLock} from "lifecycle-utils";
+import {AddonModelLora} from "../../../bindings/AddonTypes.js";
+
+export type LlamaModelLoraCacheStats = {
+    /** The number of LoRA adapter requests that were served by an already loaded adapter */
+    hits: number,
+
+    /** The number of LoRA adapter requests that had to load the adapter (or wait for it to finish loading) */
+    misses: number,
+
+    /** The number of LoRA adapters that were loaded */
+    loads: number,
+
+    /** The number of LoRA adapters that were loaded ahead of time using `preloadLora` */
+    preloads: number,
+
+    /** The number of unused LoRA adapters that were unloaded to stay within the cache size */
+    evictions: number,
+
+    /** The total time spent loading LoRA adapters, in milliseconds */
+    totalLoadTime: number,
+
+    /** The time it took to load the last loaded LoRA adapter, in milliseconds */
+    lastLoadTime: number,
+
+    /** The number of currently loaded LoRA adapters */
+    loadedAdapters: number,
+
+    /** The total file size of the currently loaded LoRA adapters, in bytes */
+    loadedSize: number,
+
+    /** The total file size of the currently loaded LoRA adapters that are not used by any context or sequence, in bytes */
+    unusedSize: number
+};
+
+type CacheEntry = {
+    lora: AddonModelLora,
+    size: number,
+    lastUseTime: number
+};
+
+/**
+ * Keeps the loaded LoRA adapters of a model, and unloads the least recently used unused adapters
+ * when their total size exceeds `maxSize`
+ */
+export class LoraAdapterCache {
+    /** @internal */ private readonly _loadLora: (filePath: string) => Promise<AddonModelLora>;
+    /** @internal */ private readonly _entries = new Map<string, CacheEntry>();
+    /** @internal */ private readonly _pendingLoads = new Map<string, Promise<CacheEntry>>();
+    /** @internal */ private readonly _pendingAcquires = new Map<string, number>();
+    /** @internal */ private _disposed: boolean = false;
+    /** @internal */ private _useCounter: number = 0;
+    /** @internal */ private _hits: number = 0;
+    /** @internal */ private _misses: number = 0;
+    /** @internal */ private _loads: number = 0;
+    /** @internal */ private _preloads: number = 0;
+    /** @internal */ private _evictions: number = 0;
+    /** @internal */ private _totalLoadTime: number = 0;
+    /** @internal */ private _lastLoadTime: number = 0;
+    public readonly maxSize: number;
+
+    public constructor({maxSize, loadLora}: {
+        maxSize: number,
+        loadLora(filePath: string): Promise<AddonModelLora>
+    }) {
+        this.maxSize = maxSize;
+        this._loadLora = loadLora;
+    }
+
+    public get stats(): LlamaModelLoraCacheStats {
+        let loadedSize = 0;
+        let unusedSize = 0;
+        for (const entry of this._entries.values()) {
+            loadedSize += entry.size;
+
+            if (entry.lora.usages <= 0)
+                unusedSize += entry.size;
+        }
+
+        return {
+            hits: this._hits,
+            misses: this._misses,
+            loads: this._loads,
+            preloads: this._preloads,
+            evictions: this._evictions,
+            totalLoadTime: this._totalLoadTime,
+            lastLoadTime: this._lastLoadTime,
+            loadedAdapters: this._entries.size,
+            loadedSize,
+            unusedSize
+        };
+    }
+
+    /**
+     * Get the adapter of the given file, loading it if needed.
+     * Concurrent requests for the same file share the same load.
+     *
+     * The usages of the returned adapter are incremented, so it's not unloaded until it's released.
+     */
+    public async acquire(filePath: string) {
+        const entry = this._entries.get(filePath);
+        if (entry != null) {
+            this._hits++;
+            entry.lora.usages++;
+            entry.lastUseTime = ++this._useCounter;
+
+            return entry.lora;
+        }
+
+        this._misses++;
+
+        // the usage is added when the entry is inserted, so it cannot be evicted before this call resumes
+        this._pendingAcquires.set(filePath, (this._pendingAcquires.get(filePath) ?? 0) + 1);
+        const loadedEntry = await this._getOrLoadEntry(filePath);
+
+        return loadedEntry.lora;
+    }
+
+    public async release(loraAdapters: Iterable<AddonModelLora>) {
+        for (const lora of loraAdapters) {
+            lora.usages--;
+
+            const entry = this._entries.get(lora.filePath);
+            if (entry?.lora === lora)
+                entry.lastUseTime = ++this._useCounter;
+        }
+
+        await this._evictUnusedEntries();
+    }
+
+    /**
+     * Load the adapter of the given file ahead of time without using it.
+     * It'll be unloaded when it's the least recently used unused adapter and the cache exceeds its size.
+     */
+    public async preload(filePath: string) {
+        if (this._entries.has(filePath))
+            return;
+
+        const entry = await this._getOrLoadEntry(filePath, true);
+        await this._evictUnusedEntries(entry);
+    }
+
+    public async dispose() {
+        this._disposed = true;
+
+        const entries = [...this._entries.values()];
+        this._entries.clear();
+        this._pendingAcquires.clear();
+
+        await Promise.all(entries.map((entry) => entry.lora.dispose()));
+    }
+
+    /** @internal */
+    private _getOrLoadEntry(filePath: string, isPreload: boolean = false): Promise<CacheEntry> {
+        if (this._disposed)
+            return Promise.reject(new DisposedError());
+
+        const existingEntry = this._entries.get(filePath);
+        if (existingEntry != null)
+            return Promise.resolve(existingEntry);
+
+        const pendingLoad = this._pendingLoads.get(filePath);
+        if (pendingLoad != null)
+            return pendingLoad;
+
+        const load = (async (): Promise<CacheEntry> => {
+            // the file is checked before loading the adapter, so a failure doesn't leave a loaded adapter behind
+            const stat = await fs.stat(filePath);
+
+            const loadStartTime = Date.now();
+            const lora = await this._loadLora(filePath);
+            const loadTime = Date.now() - loadStartTime;
+
+            if (this._disposed) {
+                await lora.dispose();
+                throw new DisposedError();
+            }
+
+            this._loads++;
+            this._totalLoadTime += loadTime;
+            this._lastLoadTime = loadTime;
+
+            if (isPreload)
+                this._preloads++;
+
+            const entry: CacheEntry = {
+                lora,
+                size: stat.size,
+                lastUseTime: ++this._useCounter
+            };
+            lora.usages += this._pendingAcquires.get(filePath) ?? 0;
+            this._pendingAcquires.delete(filePath);
+            this._entries.set(filePath, entry);
+
+            return entry;
+        })();
+
+        this._pendingLoads.set(filePath, load);
+        void load
+            .catch(() => {
+                this._pendingAcquires.delete(filePath);
+            })
+            .finally(() => {
+                if (this._pendingLoads.get(filePath) === load)
+                    this._pendingLoads.delete(filePath);
+            });
+
+        return load;
+    }
+
+    /** @internal */
+    private async _evictUnusedEntries(keepEntry?: CacheEntry) {
+        await withLock([this as LoraAdapterCache, "evict"], async () => {
+            let totalSize = 0;
+            for (const entry of this._entries.values())
+                totalSize += entry.size;
+
+            const unusedEntries = [...this._entries.entries()]
+                .filter(([, entry]) => entry.lora.usages <= 0 && entry !== keepEntry)
+                .sort(([, a], [, b]) => a.lastUseTime - b.lastUseTime);
+
+            for (const [filePath, entry] of unusedEntries) {
+                if (totalSize <= this.maxSize)
+                    break;
+
+                // the adapter may have been used while a previous adapter was unloaded
+                if (entry.lora.usages > 0 || this._entries.get(filePath) !== entry)
+                    continue;
+
+                this._entries.delete(filePath);
+                totalSize -= entry.size;
+                this._evictions++;
+
+                await entry.lora.dispose();
+            }
+        });
+    }
+}
@@ -5,6 +5,8 @@ import {tokenizeInput} from "../utils/tokenizeInput.js";
 import {resolveBeginningTokenToPrepend, resolveEndTokenToAppend} from "../utils/tokenizerUtils.js";
 import {isRankingTemplateValid, parseRankingTemplate} from "../gguf/insights/GgufInsights.js";
 import type {LlamaModel} from "./LlamaModel/LlamaModel.js";
+import type {LlamaThreadPool} from "./LlamaThreadPool.js";
+import type {LlamaCpuAffinity} from "../bindings/types.js";
 import type {LlamaContext, LlamaContextSequence} from "./LlamaContext/LlamaContext.js";
 
 export type LlamaRankingContextOptions = {
@@ -28,12 +30,36 @@ export type LlamaRankingContextOptions = {
     /** prompt processing batch size */
     batchSize?: number,
 
+    /**
+     * The number of documents to evaluate in parallel on the same batch.
+     *
+     * Each sequence reserves its own `contextSize` of the context memory.
+     *
+     * Defaults to `1`.
+     */
+    sequences?: number,
+
     /**
      * number of threads to use to evaluate tokens.
      * set to 0 to use the maximum threads supported by the current machine hardware
      */
     threads?: number,
 
+    /**
+     * Evaluate on the threads of the given thread pool, so this context shares the CPU cores with other contexts
+     * that use the same thread pool instead of competing over them.
+     *
+     * Create a thread pool using [`llama.createThreadPool`](../api/classes/Llama.md#createthreadpool).
+     */
+    threadPool?: LlamaThreadPool,
+
+    /**
+     * Run the context on the given CPU cores (or on the CPU cores of the given NUMA node).
+     *
+     * Only supported on Linux.
+     */
+    cpuAffinity?: LlamaCpuAffinity,
+
     /** An abort signal to abort the context creation */
     createSignal?: AbortSignal,
 
@@ -111,12 +137,16 @@ export class LlamaRankingContext {
                 "or use another model that supports longer contexts."
             );
 
-        return this._evaluateRankingForInput(resolvedInput);
+        const [score] = await this._evaluateRankingsForInputs([resolvedInput]);
+        return score!;
     }
 
     /**
      * Get the ranking scores for all the given documents for a query.
      *
+     * The documents are evaluated natively in as few batches as possible,
+     * packing as many documents as the `sequences` option of the ranking context allows into each batch.
+     *
      * A ranking score is a number between 0 and 1 representing the probability that the document is relevant to the query.
      * @returns an array of ranking scores between 0 and 1 representing the probability that the document is relevant to the query.
      */
@@ -133,9 +163,7 @@ export class LlamaRankingContext {
         else if (resolvedTokens.length === 0)
             return [];
 
-        return await Promise.all(
-            resolvedTokens.map((tokens) => this._evaluateRankingForInput(tokens))
-        );
+        return await this._evaluateRankingsForInputs(resolvedTokens);
     }
 
     /**
@@ -227,33 +255,63 @@ export class LlamaRankingContext {
     }
 
     /** @internal */
-    private _evaluateRankingForInput(input: Token[]): Promise<number> {
-        if (input.length === 0)
-            return Promise.resolve(0);
-
-        return withLock([this as LlamaRankingContext, "evaluate"], async () => {
+    private async _evaluateRankingsForInputs(inputs: Token[][]): Promise<number[]> {
+        const nonEmptyInputIndexes = inputs
+            .map((input, index) => (input.length === 0 ? -1 : index))
+            .filter((index) => index >= 0);
+
+        const scores = inputs.map(() => 0);
+        if (nonEmptyInputIndexes.length === 0)
+            return scores;
+
+        // the native batches can only fit inputs up to the batch size,
+        // so longer inputs are evaluated on the sequence, which splits them over multiple batches
+        const batchSize = this._llamaContext.batchSize;
+        const batchedInputIndexes = nonEmptyInputIndexes.filter((index) => inputs[index]!.length <= batchSize);
+        const longInputIndexes = nonEmptyInputIndexes.filter((index) => inputs[index]!.length > batchSize);
+
+        return await withLock([this as LlamaRankingContext, "evaluate"], async () => {
             await this._sequence.eraseContextTokenRanges([{
                 start: 0,
                 end: this._sequence.nextTokenIndex
             }]);
 
-            const iterator = this._sequence.evaluate(input, {_noSampling: true});
-            // eslint-disable-next-line @typescript-eslint/no-unused-vars
-            for await (const token of iterator) {
-                break; // only generate one token to get embeddings
-            }
+            if (batchedInputIndexes.length > 0) {
+                const batchedInputScores = await this._llamaContext._ctx.computeRankings(
+                    batchedInputIndexes.map((index) => Uint32Array.from(inputs[index]!))
+                );
 
-            const embedding = this._llamaContext._ctx.getEmbedding(input.length, 1);
-            if (embedding.length === 0)
-                return 0;
+                for (let i = 0; i < batchedInputIndexes.length; i++)
+                    scores[batchedInputIndexes[i]!] = batchedInputScores[i]!;
+            }
 
-            const logit = embedding[0]!;
-            const probability = logitToSigmoid(logit);
+            for (const index of longInputIndexes)
+                scores[index] = await this._evaluateRankingForLongInput(inputs[index]!);
 
-            return probability;
+            return scores;
         });
     }
 
+    /** @internal */
+    private async _evaluateRankingForLongInput(input: Token[]) {
+        await this._sequence.eraseContextTokenRanges([{
+            start: 0,
+            end: this._sequence.nextTokenIndex
+        }]);
+
+        const iterator = this._sequence.evaluate(input, {_noSampling: true});
+        // eslint-disable-next-line @typescript-eslint/no-unused-vars
+        for await (const token of iterator) {
+            break; // only generate one token to get embeddings
+        }
+
+        const embedding = this._llamaContext._ctx.getEmbedding(input.length, 1);
+        if (embedding.length === 0)
+            return 0;
+
+        return logitToSigmoid(embedding[0]!);
+    }
+
     /** @internal */
     public static async _create({
         _model
@@ -262,7 +320,10 @@ export class LlamaRankingContext {
     }, {
         contextSize,
         batchSize,
+        sequences,
         threads = 6,
+        threadPool,
+        cpuAffinity,
         createSignal,
         template,
         ignoreMemorySafetyChecks
@@ -288,7 +349,10 @@ export class LlamaRankingContext {
         const llamaContext = await _model.createContext({
             contextSize,
             batchSize,
+            sequences,
             threads,
+            threadPool,
+            cpuAffinity,
             createSignal,
             ignoreMemorySafetyChecks,
             _embeddings: true,
@@ -0,0 +1,147 @@
+import {DisposeAggregator, EventRelay} from "lifecycle-utils";
+import {AddonThreadPool} from "../bindings/AddonTypes.js";
+import {removeNullFields} from "../utils/removeNullFields.js";
+import type {Llama} from "../bindings/Llama.js";
+
+export type LlamaThreadPoolOptions = {
+    /**
+     * The number of threads in the thread pool.
+     *
+     * Contexts that use the thread pool can't use more threads than this number.
+     *
+     * Defaults to the `.cpuMathCores` value from the Llama instance.
+     */
+    threads?: number,
+
+    /**
+     * The CPU core indexes to run the threads of the thread pool on.
+     *
+     * Defaults to all the CPU cores.
+     */
+    cpus?: readonly number[],
+
+    /**
+     * Pin each thread to a single CPU core from `cpus`, instead of letting all the threads run on any of the `cpus`.
+     *
+     * Defaults to `false`.
+     */
+    strictCpuPlacement?: boolean,
+
+    /**
+     * The scheduling priority of the threads.
+     *
+     * Defaults to `"normal"`.
+     */
+    priority?: "normal" | "medium" | "high" | "realtime",
+
+    /**
+     * How aggressively the threads busy-wait for new work before going to sleep, between `0` and `100`.
+     *
+     * Higher values lower the latency of starting an evaluation at the cost of CPU usage.
+     *
+     * Defaults to `50`.
+     */
+    poll?: number
+};
+
+/**
+ * A pool of compute threads that can be shared by multiple contexts.
+ *
+ * Contexts that use the same thread pool take turns evaluating on the same threads,
+ * instead of each context running its own threads that compete over the CPU cores.
+ * This is useful when running multiple contexts in the same process (for example, a chat context, an embedding context and a draft context).
+ *
+ * Create one using [`llama.createThreadPool`](./Llama.md#createthreadpool),
+ * and pass it to the `threadPool` option when creating contexts.
+ */
+export class LlamaThreadPool {
+    /** @internal */ public readonly _pool: AddonThreadPool;
+    /** @internal */ private readonly _disposeAggregator = new DisposeAggregator();
+    /** @internal */ private _disposed: boolean = false;
+
+    public readonly onDispose = new EventRelay<void>();
+
+    private constructor({_llama, _pool}: {_llama: Llama, _pool: AddonThreadPool}) {
+        this._pool = _pool;
+
+        this._disposeAggregator.add(
+            _llama.onDispose.createListener(
+                disposeThreadPoolIfReferenced.bind(null, new WeakRef(this))
+            )
+        );
+    }
+
+    /**
+     * Contexts that already use the thread pool keep using it until they're disposed
+     */
+    public dispose() {
+        if (this._disposed)
+            return;
+
+        this._disposed = true;
+        this._disposeAggregator.dispose();
+        this._pool.dispose();
+        this.onDispose.dispatchEvent();
+    }
+
+    /** @hidden */
+    public [Symbol.dispose]() {
+        return this.dispose();
+    }
+
+    public get disposed() {
+        return this._disposed;
+    }
+
+    /** The number of threads in the thread pool */
+    public get threads(): number {
+        return this._pool.getThreads();
+    }
+
+    /**
+     * Put the threads of the thread pool to sleep until the next evaluation that uses it.
+     *
+     * When an evaluation is running on the thread pool, the threads are put to sleep once it's done.
+     */
+    public pause() {
+        if (this._disposed)
+            return;
+
+        this._pool.pause();
+    }
+
+    public resume() {
+        if (this._disposed)
+            return;
+
+        this._pool.resume();
+    }
+
+    /** @internal */
+    public static _create({_llama}: {_llama: Llama}, {
+        threads = _llama.cpuMathCores,
+        cpus,
+        strictCpuPlacement,
+        priority,
+        poll
+    }: LlamaThreadPoolOptions) {
+        return new LlamaThreadPool({
+            _llama,
+            _pool: new _llama._bindings.AddonThreadPool(Math.max(1, Math.floor(threads)), removeNullFields({
+                cpus: cpus == null
+                    ? undefined
+                    : Uint32Array.from(cpus),
+                strictCpuPlacement,
+                priority,
+                poll
+            }))
+        });
+    }
+}
+
+function disposeThreadPoolIfReferenced(threadPoolRef: WeakRef<LlamaThreadPool>) {
+    const threadPool = threadPoolRef.deref();
+
+    if (threadPool != null)
+        threadPool.dispose();
+}
@@ -6,6 +6,8 @@ import {GgufTensorInfo} from "../types/GgufTensorInfoTypes.js";
 import {GgufArchitectureType} from "../types/GgufMetadataTypes.js";
 import {getReadablePath} from "../../cli/utils/getReadablePath.js";
 import {padSafeContextSize} from "../../evaluator/LlamaContext/utils/padSafeContextSize.js";
+import {resolveKvCacheGgmlType} from "../../evaluator/LlamaContext/utils/resolveKvCacheGgmlType.js";
+import {LlamaContextKvCacheType} from "../../evaluator/LlamaContext/types.js";
 import {GgufInsightsConfigurationResolver} from "./GgufInsightsConfigurationResolver.js";
 import {GgufInsightsTokens} from "./GgufInsightsTokens.js";
 
@@ -200,15 +202,19 @@ export class GgufInsights {
      * The estimation for the graph overhead memory will be improved in the future to be more precise, but it's good enough for now.
      */
     public estimateContextResourceRequirements({
-        contextSize, modelGpuLayers, batchSize, sequences, isEmbeddingContext = false, includeGraphOverhead = true, flashAttention = false,
-        swaFullCache = false
+        contextSize, modelGpuLayers, batchSize, ubatchSize, sequences, isEmbeddingContext = false, includeGraphOverhead = true,
+        flashAttention = false, swaFullCache = false, kvCacheKeyType, kvCacheValueType
     }: {
-        contextSize: number, modelGpuLayers: number, batchSize?: number, sequences?: number, isEmbeddingContext?: boolean,
-        flashAttention?: boolean, includeGraphOverhead?: boolean, swaFullCache?: boolean
+        contextSize: number, modelGpuLayers: number, batchSize?: number, ubatchSize?: number, sequences?: number,
+        isEmbeddingContext?: boolean, flashAttention?: boolean, includeGraphOverhead?: boolean, swaFullCache?: boolean,
+        kvCacheKeyType?: LlamaContextKvCacheType, kvCacheValueType?: LlamaContextKvCacheType
     }): GgufInsightsResourceRequirements {
         if (sequences == null) sequences = getDefaultContextSequences();
         if (batchSize == null) batchSize = getDefaultContextBatchSize({contextSize, sequences});
 
+        // the compute graph is built for a single micro-batch
+        const graphBatchSize = Math.min(batchSize, ubatchSize ?? batchSize);
+
         const llmData = this._ggufFileInfo.architectureMetadata;
         const tensorInfo = this._ggufFileInfo.fullTensorInfo ?? [];
         const slidingWindow = this.swaSize ?? 0;
@@ -280,10 +286,10 @@ export class GgufInsights {
                 if (expertCount > 0) {
                     const expertsUsedCount = this._ggufFileInfo.architectureMetadata.expert_used_count ?? 2;
 
-                    return int32TBytes * batchSize * (((expertsUsedCount + 1) * embeddingLength) + (kvSize * headCount));
+                    return int32TBytes * graphBatchSize * (((expertsUsedCount + 1) * embeddingLength) + (kvSize * headCount));
                 }
 
-                return int32TBytes * batchSize * (embeddingLength + (kvSize * headCount));
+                return int32TBytes * graphBatchSize * (embeddingLength + (kvSize * headCount));
             } else if (this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.qwen2) {
                 if (modelGpuLayers === this.totalLayers) {
                     defaultCalculationAdjustment -= (s1MB * 340) * (
@@ -302,7 +308,7 @@ export class GgufInsights {
                 }
             } else if (this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.gemma) {
                 // only works properly when all layers are on the GPU, which is why it's commented out:
-                // return int32TBytes * batchSize * ((llmData.embedding_length ?? 0));
+                // return int32TBytes * graphBatchSize * ((llmData.embedding_length ?? 0));
 
                 if (modelGpuLayers === this.totalLayers) {
                     defaultCalculationAdjustment += (s1MB * 40) - (
@@ -324,7 +330,7 @@ export class GgufInsights {
             } else if (this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.stablelm) {
                 const headCount = this._ggufFileInfo.architectureMetadata.attention?.head_count ?? 0;
 
-                return (int32TBytes * batchSize * kvSize * headCount) - (50 * s1MB);
+                return (int32TBytes * graphBatchSize * kvSize * headCount) - (50 * s1MB);
 
                 // if (modelGpuLayers === this.totalLayers) {
                 //     defaultCalculationAdjustment += -(s1MB * 20) + (
@@ -344,11 +350,11 @@ export class GgufInsights {
                 //     );
                 // }
             } else if (this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.qwen3) {
-                return int32TBytes * batchSize * (embeddingLength + (kvSize * headCount));
+                return int32TBytes * graphBatchSize * (embeddingLength + (kvSize * headCount));
             } else if (expertCount > 0) {
                 const expertsUsedCount = this._ggufFileInfo.architectureMetadata.expert_used_count ?? 2;
 
-                return int32TBytes * batchSize * (((expertsUsedCount + 1) * embeddingLength) + (kvSize * headCount));
+                return int32TBytes * graphBatchSize * (((expertsUsedCount + 1) * embeddingLength) + (kvSize * headCount));
             }
 
             const totalElements = tensorInfo.length === 0
@@ -376,10 +382,12 @@ export class GgufInsights {
                 kvSize,
                 finalGpuLayers < totalFileLayers
                     ? (finalGpuLayers + 1)
-                    : finalGpuLayers
+                    : finalGpuLayers,
+                kvCacheKeyType,
+                kvCacheValueType
             )
             : 0;
-        const cpuKVCacheSize = this._estimateKvMemorySizeInBytes(kvSize, finalCpuLayers);
+        const cpuKVCacheSize = this._estimateKvMemorySizeInBytes(kvSize, finalCpuLayers, kvCacheKeyType, kvCacheValueType);
 
         // source: `llama_context::graph_max_nodes` in `llama-context.cpp`
         const getMaxNodesMultiplier = (arch: GgufArchitectureType | undefined, nTokens: number): {min: number, multiplier: number} => {
@@ -396,7 +404,7 @@ export class GgufInsights {
         };
         const maxNodesMultiplier = getMaxNodesMultiplier(
             this._ggufFileInfo.metadata?.general?.architecture,
-            Math.min(actualContextSize, batchSize)
+            Math.min(actualContextSize, graphBatchSize)
         );
         const maxNodes = Math.max(maxNodesMultiplier.min, maxNodesMultiplier.multiplier * tensorInfo.length);
         const cpuNodes = maxNodesMultiplier.multiplier * (tensorInfo.length * (finalCpuLayers / totalFileLayers));
@@ -527,7 +535,9 @@ export class GgufInsights {
     }
 
     /** @internal */
-    public _estimateKvMemorySizeInBytes(kvSize: number, layers: number) {
+    public _estimateKvMemorySizeInBytes(
+        kvSize: number, layers: number, keyType?: LlamaContextKvCacheType, valueType?: LlamaContextKvCacheType
+    ) {
         // source: `llama_kv_cache_init` in `llama.cpp`
         const nHead = this._ggufFileInfo.architectureMetadata.attention?.head_count ?? 0;
         const nEmbd = this._ggufFileInfo.architectureMetadata.embedding_length ?? 0;
@@ -565,16 +575,13 @@ export class GgufInsights {
             totalElementsV += totalNEmbdVGqa * kvSize;
         }
 
+        // the recurrent state of mamba models is always stored as `f32`
         const keyTypeSize = this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.mamba
-            // if `type_k` of `llama_context_params` changes to be configurable in `LlamaContext`,
-            // this would have to depend on that value
             ? this._llama._consts.ggmlTypeF32Size
-            : this._llama._consts.ggmlTypeF16Size;
+            : this._getKvCacheTypeElementSize(keyType);
         const valueTypeSize = this._ggufFileInfo.metadata.general?.architecture === GgufArchitectureType.mamba
-            // if `type_v` of `llama_context_params` changes to be configurable in `LlamaContext`,
-            // this would have to depend on that value
             ? this._llama._consts.ggmlTypeF32Size
-            : this._llama._consts.ggmlTypeF16Size;
+            : this._getKvCacheTypeElementSize(valueType);
 
         return (
             (totalElementsK * keyTypeSize) +
@@ -582,6 +589,26 @@ export class GgufInsights {
         );
     }
 
+    /**
+     * The average size of a single element of the given KV cache type in bytes
+     * @internal
+     */
+    private _getKvCacheTypeElementSize(type?: LlamaContextKvCacheType) {
+        if (type == null || type === "f16")
+            return this._llama._consts.ggmlTypeF16Size;
+        else if (type === "f32")
+            return this._llama._consts.ggmlTypeF32Size;
+
+        const ggmlType = resolveKvCacheGgmlType(type);
+        const typeSize = this._llama._bindings.getTypeSizeForGgmlType(ggmlType);
+        const blockSize = this._llama._bindings.getBlockSizeForGgmlType(ggmlType);
+
+        if (typeSize == null || blockSize == null || blockSize === 0)
+            return this._llama._consts.ggmlTypeF16Size;
+
+        return typeSize / blockSize;
+    }
+
     /** @internal */
     private _getTotalFileLayers() {
         if (this._totalFileLayers != null)
@@ -419,6 +419,8 @@ export class GgufInsightsConfigurationResolver {
         modelTrainContextSize,
         flashAttention = false,
         swaFullCache = false,
+        kvCacheKeyType,
+        kvCacheValueType,
         getVramState = (() => this._ggufInsights._llama._vramOrchestrator.getMemoryState()),
         getRamState = (async () => this._ggufInsights._llama._ramOrchestrator.getMemoryState()),
         getSwapState = (() => this._ggufInsights._llama._swapOrchestrator.getMemoryState()),
@@ -431,6 +433,8 @@ export class GgufInsightsConfigurationResolver {
         modelTrainContextSize: number,
         flashAttention?: boolean,
         swaFullCache?: boolean,
+        kvCacheKeyType?: LlamaContextOptions["kvCacheKeyType"],
+        kvCacheValueType?: LlamaContextOptions["kvCacheValueType"],
         batchSize?: LlamaContextOptions["batchSize"],
         sequences?: number,
         getVramState?(): Promise<{total: number, free: number, unifiedSize: number}>,
@@ -449,6 +453,8 @@ export class GgufInsightsConfigurationResolver {
             modelTrainContextSize,
             flashAttention,
             swaFullCache,
+            kvCacheKeyType,
+            kvCacheValueType,
             getVramState,
             getRamState,
             getSwapState,
@@ -10,7 +10,7 @@ const defaultMaxContextSizeSwapUse = 2048;
 
 export async function resolveContextContextSizeOption({
     contextSize, batchSize, sequences, modelFileInsights, modelGpuLayers, modelTrainContextSize, flashAttention, swaFullCache,
-    getVramState, getRamState, getSwapState, ignoreMemorySafetyChecks = false, isEmbeddingContext = false,
+    kvCacheKeyType, kvCacheValueType, getVramState, getRamState, getSwapState, ignoreMemorySafetyChecks = false, isEmbeddingContext = false,
     maxContextSizeSwapUse = defaultMaxContextSizeSwapUse
 }: {
     contextSize?: LlamaContextOptions["contextSize"],
@@ -21,6 +21,8 @@ export async function resolveContextContextSizeOption({
     modelTrainContextSize: number,
     flashAttention: boolean,
     swaFullCache: boolean,
+    kvCacheKeyType?: LlamaContextOptions["kvCacheKeyType"],
+    kvCacheValueType?: LlamaContextOptions["kvCacheValueType"],
     getVramState(): Promise<{total: number, free: number, unifiedSize: number}>,
     getRamState(): Promise<{total: number, free: number}>,
     getSwapState(): Promise<{total: number, free: number}>,
@@ -54,6 +56,8 @@ export async function resolveContextContextSizeOption({
             sequences,
             flashAttention,
             swaFullCache,
+            kvCacheKeyType,
+            kvCacheValueType,
             isEmbeddingContext
         });
 
@@ -100,6 +104,8 @@ export async function resolveContextContextSizeOption({
                 sequences,
                 flashAttention,
                 swaFullCache,
+                kvCacheKeyType,
+                kvCacheValueType,
                 isEmbeddingContext
             });
 
@@ -149,6 +155,8 @@ export async function resolveContextContextSizeOption({
             sequences,
             flashAttention,
             swaFullCache,
+            kvCacheKeyType,
+            kvCacheValueType,
             isEmbeddingContext
         });
 
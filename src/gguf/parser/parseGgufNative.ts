@@ -0,0 +1,176 @@
+import {InvalidGgufMagicError} from "../errors/InvalidGgufMagicError.js";
+import {UnsupportedGgufValueTypeError} from "../errors/UnsupportedGgufValueTypeError.js";
+import {getConsoleLogPrefix} from "../../utils/getConsoleLogPrefix.js";
+import {UnsupportedError} from "../../utils/UnsupportedError.js";
+import {GgufFileInfo, GgufValueType, MetadataKeyValueRecord, MetadataValue} from "../types/GgufFileInfoTypes.js";
+import {GgufMetadata} from "../types/GgufMetadataTypes.js";
+import {GgmlType, GgufTensorInfo} from "../types/GgufTensorInfoTypes.js";
+import {convertMetadataKeyValueRecordToNestedObject} from "../utils/convertMetadataKeyValueRecordToNestedObject.js";
+import {getGgufMetadataArchitectureData} from "../utils/getGgufMetadataArchitectureData.js";
+import {noDirectSubNestingGGufMetadataKeys} from "../consts.js";
+import type {BindingModule} from "../../bindings/AddonTypes.js";
+
+const ggufMagic = "GGUF";
+const metadataEntryItems = 2;
+const tensorTableItems = 7;
+
+/**
+ * Parse the header of a local GGUF file using the native addon, which memory-maps the file instead of reading it in chunks.
+ *
+ * Array metadata values (like `tokenizer.ggml.tokens`) are only decoded when they're accessed for the first time.
+ */
+export async function parseGgufNative({
+    bindings,
+    filePath,
+    readTensorInfo = true,
+    ignoreKeys = [],
+    logWarnings = true
+}: {
+    bindings: BindingModule,
+    filePath: string,
+    readTensorInfo?: boolean,
+    ignoreKeys?: string[],
+    logWarnings?: boolean
+}): Promise<GgufFileInfo> {
+    const res = await bindings.readGgufFileHeader(filePath, readTensorInfo);
+
+    if (res.magic !== ggufMagic)
+        throw new InvalidGgufMagicError(ggufMagic, res.magic);
+
+    if (res.version === 1)
+        throw new UnsupportedError("GGUF version 1 is not supported by llama.cpp anymore");
+    else if (res.version > 3 && logWarnings)
+        console.warn(getConsoleLogPrefix() + `Unsupported GGUF version "${res.version}". Reading the file as GGUF version 3`);
+
+    const header = Buffer.from(res.header!);
+    const metadataKeys = res.metadataKeys!;
+    const metadataEntries = res.metadataEntries!;
+
+    // array values are replaced with symbols while the nested metadata object is built,
+    // so they're not treated as nested objects
+    const lazyArrayValueOffsets = new Map<symbol, number>();
+
+    const metadataRecord: MetadataKeyValueRecord = {};
+    for (let i = 0; i < metadataKeys.length; i++) {
+        const valueType: GgufValueType = metadataEntries[i * metadataEntryItems]!;
+        const valueOffset = metadataEntries[i * metadataEntryItems + 1]!;
+
+        if (valueType === GgufValueType.Array) {
+            const placeholder = Symbol(metadataKeys[i]);
+            lazyArrayValueOffsets.set(placeholder, valueOffset);
+            metadataRecord[metadataKeys[i]!] = placeholder as any as MetadataValue;
+        } else
+            metadataRecord[metadataKeys[i]!] = readValue(header, valueType, {offset: valueOffset});
+    }
+
+    const metadata = convertMetadataKeyValueRecordToNestedObject(metadataRecord, {
+        logOverrideWarnings: logWarnings,
+        ignoreKeys,
+        noDirectSubNestingKeys: noDirectSubNestingGGufMetadataKeys
+    }) as any as GgufMetadata;
+
+    if (lazyArrayValueOffsets.size > 0)
+        defineLazyArrayValues(metadata, header, lazyArrayValueOffsets);
+
+    const tensorInfo = readTensorInfo
+        ? getTensorInfo(res.tensorNames!, res.tensorTable!, res.tensorDataOffset!)
+        : undefined;
+    const tensorCount = res.tensorCount!;
+    const metadataSize = res.metadataSize!;
+
+    return {
+        version: res.version,
+        tensorCount,
+        metadata,
+        architectureMetadata: getGgufMetadataArchitectureData(metadata),
+        tensorInfo,
+        metadataSize,
+        splicedParts: 1,
+        totalTensorInfoSize: res.tensorInfoSize,
+        totalTensorCount: tensorCount,
+        totalMetadataSize: metadataSize,
+        fullTensorInfo: tensorInfo,
+        tensorInfoSize: res.tensorInfoSize
+    };
+}
+
+function defineLazyArrayValues(object: Record<string, any>, header: Buffer, lazyArrayValueOffsets: Map<symbol, number>) {
+    for (const [key, value] of Object.entries(object)) {
+        if (typeof value === "symbol") {
+            const valueOffset = lazyArrayValueOffsets.get(value);
+            if (valueOffset == null)
+                continue;
+
+            Object.defineProperty(object, key, {
+                enumerable: true,
+                configurable: true,
+                get() {
+                    const decodedValue = readValue(header, GgufValueType.Array, {offset: valueOffset});
+                    Object.defineProperty(object, key, {value: decodedValue, enumerable: true, configurable: true, writable: true});
+                    return decodedValue;
+                },
+                set(newValue) {
+                    Object.defineProperty(object, key, {value: newValue, enumerable: true, configurable: true, writable: true});
+                }
+            });
+        } else if (value != null && typeof value === "object" && !Array.isArray(value))
+            defineLazyArrayValues(value, header, lazyArrayValueOffsets);
+    }
+}
+
+function readValue(header: Buffer, type: GgufValueType, readOffset: {offset: number}): MetadataValue {
+    const offset = readOffset.offset;
+
+    switch (type) {
+        case GgufValueType.Uint8: readOffset.offset += 1; return header.readUInt8(offset);
+        case GgufValueType.Int8: readOffset.offset += 1; return header.readInt8(offset);
+        case GgufValueType.Uint16: readOffset.offset += 2; return header.readUInt16LE(offset);
+        case GgufValueType.Int16: readOffset.offset += 2; return header.readInt16LE(offset);
+        case GgufValueType.Uint32: readOffset.offset += 4; return header.readUInt32LE(offset);
+        case GgufValueType.Int32: readOffset.offset += 4; return header.readInt32LE(offset);
+        case GgufValueType.Float32: readOffset.offset += 4; return header.readFloatLE(offset);
+        case GgufValueType.Bool: readOffset.offset += 1; return header.readUInt8(offset) === 1;
+        case GgufValueType.Uint64: readOffset.offset += 8; return header.readBigUInt64LE(offset);
+        case GgufValueType.Int64: readOffset.offset += 8; return header.readBigInt64LE(offset);
+        case GgufValueType.Float64: readOffset.offset += 8; return header.readDoubleLE(offset);
+        case GgufValueType.String: {
+            const length = Number(header.readBigUInt64LE(offset));
+            readOffset.offset += 8 + length;
+            return header.toString("utf8", offset + 8, offset + 8 + length);
+        }
+        case GgufValueType.Array: {
+            const arrayType: GgufValueType = header.readUInt32LE(offset);
+            const arrayLength = Number(header.readBigUInt64LE(offset + 4));
+            readOffset.offset += 4 + 8;
+
+            const arrayValues: MetadataValue[] = new Array(arrayLength);
+            for (let i = 0; i < arrayLength; i++)
+                arrayValues[i] = readValue(header, arrayType, readOffset);
+
+            return arrayValues;
+        }
+    }
+
+    throw new UnsupportedGgufValueTypeError(type);
+}
+
+function getTensorInfo(tensorNames: string[], tensorTable: Float64Array, tensorDataOffset: number) {
+    const tensorInfo: GgufTensorInfo[] = new Array(tensorNames.length);
+
+    for (let i = 0; i < tensorNames.length; i++) {
+        const tableOffset = i * tensorTableItems;
+        const offset = tensorTable[tableOffset + 1]!;
+        const dimensionsCount = tensorTable[tableOffset + 2]!;
+
+        tensorInfo[i] = {
+            name: tensorNames[i]!,
+            dimensions: Array.from(tensorTable.subarray(tableOffset + 3, tableOffset + 3 + dimensionsCount)),
+            ggmlType: tensorTable[tableOffset]! as GgmlType,
+            offset,
+            fileOffset: tensorDataOffset + offset,
+            filePart: 1
+        };
+    }
+
+    return tensorInfo;
+}
@@ -12,6 +12,8 @@ import {normalizeGgufDownloadUrl} from "./utils/normalizeGgufDownloadUrl.js";
 import {resolveSplitGgufParts} from "./utils/resolveSplitGgufParts.js";
 import {GgufFileInfo} from "./types/GgufFileInfoTypes.js";
 import {GgufTensorInfo} from "./types/GgufTensorInfoTypes.js";
+import {parseGgufNative} from "./parser/parseGgufNative.js";
+import type {Llama} from "../bindings/Llama.js";
 
 
 /**
@@ -30,7 +32,8 @@ export async function readGgufFileInfo(pathOrUri: string, {
     spliceSplitFiles = true,
     signal,
     tokens,
-    endpoints
+    endpoints,
+    llama
 }: {
     /**
      * Whether to read the tensor info from the file's header.
@@ -82,10 +85,38 @@ export async function readGgufFileInfo(pathOrUri: string, {
      * Configure the URLs used for resolving model URIs.
      * @see [Model URIs](https://node-llama-cpp.withcat.ai/guide/downloading-models#model-uris)
      */
-    endpoints?: ModelDownloadEndpoints
+    endpoints?: ModelDownloadEndpoints,
+
+    /**
+     * When provided, local files are parsed by the native addon of this `Llama` instance,
+     * which memory-maps the file instead of reading it in chunks.
+     *
+     * This is much faster for models with many tensors or a large vocabulary,
+     * and array metadata values (like `tokenizer.ggml.tokens`) are only decoded when they're accessed.
+     */
+    llama?: Llama
 } = {}) {
     const useNetworkReader = sourceType === "network" || (sourceType == null && (isUrl(pathOrUri) || isModelUri(pathOrUri)));
 
+    // the native parser can't be interrupted, so the signal is checked before and after it
+    async function parseLocalFileNatively(llama: Llama, filePath: string) {
+        if (signal?.aborted)
+            throw signal.reason;
+
+        const res = await parseGgufNative({
+            bindings: llama._bindings,
+            filePath,
+            ignoreKeys,
+            readTensorInfo,
+            logWarnings
+        });
+
+        if (signal?.aborted)
+            throw signal.reason;
+
+        return res;
+    }
+
     async function createFileReader(pathOrUri: string) {
         if (useNetworkReader) {
             const parsedModelUri = await resolveParsedModelUri(parseModelUri(pathOrUri, undefined, endpoints), {
@@ -112,13 +143,14 @@ export async function readGgufFileInfo(pathOrUri: string, {
     }
 
     async function readSingleFile(pathOrUri: string, splitPartNumber: number = 1) {
-        const fileReader = await createFileReader(pathOrUri);
-        const res = await parseGguf({
-            fileReader,
-            ignoreKeys,
-            readTensorInfo,
-            logWarnings
-        });
+        const res = (llama != null && !useNetworkReader)
+            ? await parseLocalFileNatively(llama, pathOrUri)
+            : await parseGguf({
+                fileReader: await createFileReader(pathOrUri),
+                ignoreKeys,
+                readTensorInfo,
+                logWarnings
+            });
 
         if (splitPartNumber > 1) {
             for (const tensor of res.tensorInfo ?? [])
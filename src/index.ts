@@ -4,10 +4,16 @@ import { getLlama, type LlamaOptions, type LastBuildOptions } from "./bindings/g
 import { getLlamaGpuTypes } from "./bindings/utils/getLlamaGpuTypes.js";
 import { NoBinaryFoundError } from "./bindings/utils/NoBinaryFoundError.js";
 import {
-    type LlamaGpuType, type LlamaNuma, LlamaLogLevel, LlamaLogLevelGreaterThan, LlamaLogLevelGreaterThanOrEqual, LlamaVocabularyType
+    type LlamaGpuType, type LlamaNuma, type LlamaCpuAffinity, type LlamaNumaNode, type LlamaExecutorMetrics,
+    type LlamaExecutorLaneMetrics, type LlamaMemoryUsage, type LlamaPagingStats, LlamaLogLevel, LlamaLogLevelGreaterThan,
+    LlamaLogLevelGreaterThanOrEqual, LlamaVocabularyType
 } from "./bindings/types.js";
 import { resolveModelFile, type ResolveModelFileOptions } from "./utils/resolveModelFile.js";
-import { LlamaModel, LlamaModelInfillTokens, type LlamaModelOptions, LlamaModelTokens } from "./evaluator/LlamaModel/LlamaModel.js";
+import {
+    LlamaModel, LlamaModelInfillTokens, type LlamaModelOptions, LlamaModelTokens, type LlamaModelPrefetchOptions,
+    type LlamaModelFileResidency
+} from "./evaluator/LlamaModel/LlamaModel.js";
+import { type LlamaModelLoraCacheStats } from "./evaluator/LlamaModel/utils/LoraAdapterCache.js";
 import { TokenAttributes } from "./evaluator/LlamaModel/utils/TokenAttributes.js";
 import { LlamaGrammar, type LlamaGrammarOptions } from "./evaluator/LlamaGrammar.js";
 import { LlamaJsonSchemaGrammar } from "./evaluator/LlamaJsonSchemaGrammar.js";
@@ -15,13 +21,22 @@ import { LlamaJsonSchemaValidationError } from "./utils/gbnfJson/utils/validateO
 import { LlamaGrammarEvaluationState, LlamaGrammarEvaluationStateOptions } from "./evaluator/LlamaGrammarEvaluationState.js";
 import { LlamaContext, LlamaContextSequence } from "./evaluator/LlamaContext/LlamaContext.js";
 import { LlamaEmbeddingContext, type LlamaEmbeddingContextOptions } from "./evaluator/LlamaEmbeddingContext.js";
-import { LlamaEmbedding, type LlamaEmbeddingOptions, type LlamaEmbeddingJSON } from "./evaluator/LlamaEmbedding.js";
+import {
+    LlamaEmbedding, type LlamaEmbeddingOptions, type LlamaEmbeddingJSON, type LlamaEmbeddingsMatrix, type LlamaQuantizedEmbeddingsMatrix
+} from "./evaluator/LlamaEmbedding.js";
 import { LlamaRankingContext, type LlamaRankingContextOptions } from "./evaluator/LlamaRankingContext.js";
+import {
+    LlamaEmbeddingIndex, type LlamaEmbeddingIndexOptions, type LlamaEmbeddingIndexLoadOptions, type LlamaEmbeddingIndexSearchOptions,
+    type LlamaEmbeddingIndexSearchResult
+} from "./evaluator/LlamaEmbeddingIndex.js";
+import {LlamaThreadPool, type LlamaThreadPoolOptions} from "./evaluator/LlamaThreadPool.js";
 import {
     type LlamaContextOptions, type SequenceEvaluateOptions, type BatchingOptions, type LlamaContextSequenceRepeatPenalty,
     type CustomBatchingDispatchSchedule, type CustomBatchingPrioritizationStrategy, type BatchItem, type PrioritizedBatchItem,
     type ContextShiftOptions, type ContextTokensDeleteRange, type EvaluationPriority, type SequenceEvaluateMetadataOptions,
-    type SequenceEvaluateOutput, type ControlledEvaluateInputItem, type ControlledEvaluateIndexOutput
+    type SequenceEvaluateOutput, type ControlledEvaluateInputItem, type ControlledEvaluateIndexOutput, type LlamaContextKvCacheType,
+    type LlamaContextKvCacheUsage, type LlamaContextDecodeStats,
+    type ContextShiftKeepSinkTokensStrategy, type ContextShiftEraseMarkedRegionStrategy
 } from "./evaluator/LlamaContext/types.js";
 import { TokenBias } from "./evaluator/TokenBias.js";
 
@@ -32,6 +47,7 @@ import {
 import { TokenMeter, type TokenMeterState } from "./evaluator/TokenMeter.js";
 import { UnsupportedError } from "./utils/UnsupportedError.js";
 import { InsufficientMemoryError } from "./utils/InsufficientMemoryError.js";
+import { EvaluationDeadlineError } from "./utils/EvaluationDeadlineError.js";
 
 import {
     LlamaText, SpecialTokensText, SpecialToken, isLlamaText, tokenizeText, type LlamaTextValue, type LlamaTextInputValue,
@@ -42,6 +58,9 @@ import {
 import { TokenPredictor } from "./evaluator/LlamaContext/TokenPredictor.js";
 import { DraftSequenceTokenPredictor } from "./evaluator/LlamaContext/tokenPredictors/DraftSequenceTokenPredictor.js";
 import { InputLookupTokenPredictor } from "./evaluator/LlamaContext/tokenPredictors/InputLookupTokenPredictor.js";
+import {
+    NgramCacheTokenPredictor, type NgramCacheTokenPredictorStats
+} from "./evaluator/LlamaContext/tokenPredictors/NgramCacheTokenPredictor.js";
 import { getModuleVersion } from "./utils/getModuleVersion.js";
 import { readGgufFileInfo } from "./gguf/readGgufFileInfo.js";
 import { GgufInsights, type GgufInsightsResourceRequirements } from "./gguf/insights/GgufInsights.js";
@@ -87,6 +106,12 @@ export {
     type LastBuildOptions,
     type LlamaGpuType,
     type LlamaNuma,
+    type LlamaCpuAffinity,
+    type LlamaNumaNode,
+    type LlamaExecutorMetrics,
+    type LlamaExecutorLaneMetrics,
+    type LlamaMemoryUsage,
+    type LlamaPagingStats,
     type LlamaClasses,
     LlamaLogLevel,
     NoBinaryFoundError,
@@ -97,6 +122,9 @@ export {
     LlamaModelInfillTokens,
     TokenAttributes,
     type LlamaModelOptions,
+    type LlamaModelPrefetchOptions,
+    type LlamaModelFileResidency,
+    type LlamaModelLoraCacheStats,
     LlamaGrammar,
     type LlamaGrammarOptions,
     LlamaJsonSchemaGrammar,
@@ -113,6 +141,8 @@ export {
     type BatchItem,
     type PrioritizedBatchItem,
     type ContextShiftOptions,
+    type ContextShiftKeepSinkTokensStrategy,
+    type ContextShiftEraseMarkedRegionStrategy,
     type ContextTokensDeleteRange,
     type EvaluationPriority,
     type SequenceEvaluateMetadataOptions,
@@ -120,14 +150,26 @@ export {
     type LlamaContextSequenceRepeatPenalty,
     type ControlledEvaluateInputItem,
     type ControlledEvaluateIndexOutput,
+    type LlamaContextKvCacheType,
+    type LlamaContextKvCacheUsage,
+    type LlamaContextDecodeStats,
     TokenBias,
     LlamaEmbeddingContext,
     type LlamaEmbeddingContextOptions,
     LlamaEmbedding,
     type LlamaEmbeddingOptions,
     type LlamaEmbeddingJSON,
+    type LlamaEmbeddingsMatrix,
+    type LlamaQuantizedEmbeddingsMatrix,
     LlamaRankingContext,
     type LlamaRankingContextOptions,
+    LlamaEmbeddingIndex,
+    type LlamaEmbeddingIndexOptions,
+    type LlamaEmbeddingIndexLoadOptions,
+    type LlamaEmbeddingIndexSearchOptions,
+    type LlamaEmbeddingIndexSearchResult,
+    LlamaThreadPool,
+    type LlamaThreadPoolOptions,
 
     LlamaCompletion,
     type LlamaCompletionOptions,
@@ -138,6 +180,7 @@ export {
     type TokenMeterState,
     UnsupportedError,
     InsufficientMemoryError,
+    EvaluationDeadlineError,
     DisposedError,
 
     LlamaText,
@@ -155,6 +198,8 @@ export {
     TokenPredictor,
     DraftSequenceTokenPredictor,
     InputLookupTokenPredictor,
+    NgramCacheTokenPredictor,
+    type NgramCacheTokenPredictorStats,
 
     getModuleVersion,
 
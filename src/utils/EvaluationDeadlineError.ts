@@ -0,0 +1,6 @@
+export class EvaluationDeadlineError extends Error {
+    /** @internal */
+    public constructor(message: string = "The evaluation deadline has passed") {
+        super(message);
+    }
+}
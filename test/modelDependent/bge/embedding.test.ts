@@ -1,6 +1,8 @@
 import {describe, expect, test} from "vitest";
+import fs from "fs-extra";
 import {getModelFile} from "../../utils/modelFiles.js";
 import {getTestLlama} from "../../utils/getTestLlama.js";
+import {getTempTestFilePath} from "../../utils/helpers/getTempTestDir.js";
 import {LlamaEmbedding} from "../../../src/index.js";
 
 describe("bge", () => {
@@ -184,5 +186,159 @@ describe("bge", () => {
 
             expect(topSimilarDocument).to.eql("I love eating pizza with extra cheese");
         });
+
+        test("batched embeddings match single embeddings", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const embeddingContext = await model.createEmbeddingContext({
+                contextSize: 512,
+                sequences: 4
+            });
+
+            const documents = [
+                "The sky is clear and blue today",
+                "I love eating pizza with extra cheese",
+                "",
+                "Dogs love to play fetch with their owners",
+                "The capital of France is Paris",
+                "Drinking water is important for staying hydrated"
+            ];
+
+            const {vectorSize, vectors} = await embeddingContext.getEmbeddingsFor(documents);
+            expect(vectorSize).to.eql(model.embeddingVectorSize);
+            expect(vectors.length).to.eql(vectorSize * documents.length);
+            expect(Array.from(vectors.subarray(2 * vectorSize, 3 * vectorSize)).every((value) => value === 0)).to.eql(true);
+
+            for (let i = 0; i < documents.length; i++) {
+                if (documents[i] === "")
+                    continue;
+
+                const embedding = await embeddingContext.getEmbeddingFor(documents[i]!);
+                const batchedEmbedding = Array.from(vectors.subarray(i * vectorSize, (i + 1) * vectorSize));
+
+                expect(embedding.calculateCosineSimilarity(batchedEmbedding)).toBeGreaterThan(0.999);
+            }
+
+            const truncated = await embeddingContext.getEmbeddingsFor(documents.slice(0, 2), {vectorSize: 64, normalize: true});
+            expect(truncated.vectorSize).to.eql(64);
+
+            const firstVector = truncated.vectors.subarray(0, 64);
+            const norm = Math.sqrt(firstVector.reduce((sum, value) => sum + value * value, 0));
+            expect(norm).toBeCloseTo(1, 4);
+
+            const int8Embeddings = await embeddingContext.getQuantizedEmbeddingsFor(documents.slice(0, 2), {type: "int8"});
+            if (int8Embeddings.type !== "int8")
+                throw new Error("Unexpected quantized embeddings type");
+
+            const normalizedEmbedding = await embeddingContext.getEmbeddingsFor(documents.slice(0, 1), {normalize: true});
+            const dequantized = Array.from(int8Embeddings.vectors.subarray(0, int8Embeddings.vectorSize))
+                .map((value) => value * int8Embeddings.scales[0]!);
+            for (let i = 0; i < dequantized.length; i++)
+                expect(Math.abs(dequantized[i]! - normalizedEmbedding.vectors[i]!)).toBeLessThanOrEqual(int8Embeddings.scales[0]! / 2 + 1e-6);
+
+            const binaryEmbeddings = await embeddingContext.getQuantizedEmbeddingsFor(documents, {type: "binary"});
+            if (binaryEmbeddings.type !== "binary")
+                throw new Error("Unexpected quantized embeddings type");
+
+            expect(binaryEmbeddings.bytesPerVector).to.eql(Math.ceil(model.embeddingVectorSize / 8));
+            expect(binaryEmbeddings.vectors.length).to.eql(binaryEmbeddings.bytesPerVector * documents.length);
+            for (let i = 0; i < model.embeddingVectorSize; i++) {
+                const bit = (binaryEmbeddings.vectors[i >> 3]! >> (7 - (i & 7))) & 1;
+                expect(bit).to.eql(vectors[i]! > 0 ? 1 : 0);
+            }
+        });
+
+        test("embedding index search", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const embeddingContext = await model.createEmbeddingContext({
+                contextSize: 512,
+                sequences: 4
+            });
+
+            const documents = [
+                "The sky is clear and blue today",
+                "I love eating pizza with extra cheese",
+                "Dogs love to play fetch with their owners",
+                "The capital of France is Paris",
+                "Drinking water is important for staying hydrated",
+                "Mount Everest is the tallest mountain in the world",
+                "A warm cup of tea is perfect for a cold winter day",
+                "Painting is a form of creative expression"
+            ];
+            const documentEmbeddings = await embeddingContext.getEmbeddingsFor(documents);
+            const queryEmbedding = await embeddingContext.getEmbeddingFor("What is the tallest mountain on Earth?");
+
+            for (const type of ["f32", "f16", "int8"] as const) {
+                const index = model.createEmbeddingIndex({type});
+                expect(await index.add(documentEmbeddings)).to.eql(0);
+                expect(index.size).to.eql(documents.length);
+
+                const results = await index.search(queryEmbedding, {k: 3});
+                expect(results.length).to.eql(3);
+                expect(documents[results[0]!.index]).to.eql("Mount Everest is the tallest mountain in the world");
+                expect(results[0]!.score).toBeGreaterThanOrEqual(results[1]!.score);
+                expect(results[1]!.score).toBeGreaterThanOrEqual(results[2]!.score);
+                expect(results[0]!.score).toBeCloseTo(
+                    queryEmbedding.calculateCosineSimilarity(
+                        Array.from(documentEmbeddings.vectors.subarray(5 * documentEmbeddings.vectorSize, 6 * documentEmbeddings.vectorSize))
+                    ),
+                    type === "f32" ? 4 : 2
+                );
+
+                const indexFilePath = await getTempTestFilePath(`embedding-index-${type}.bin`);
+                try {
+                    await index.save(indexFilePath);
+
+                    const loadedIndex = await model.loadEmbeddingIndex(indexFilePath, {useMmap: true});
+                    expect(loadedIndex.isMemoryMapped).to.eql(true);
+                    expect(loadedIndex.type).to.eql(type);
+                    expect(await loadedIndex.search(queryEmbedding, {k: 3})).to.eql(results);
+
+                    expect(await loadedIndex.add(queryEmbedding)).to.eql(documents.length);
+                    expect(loadedIndex.isMemoryMapped).to.eql(false);
+                    loadedIndex.dispose();
+                } finally {
+                    index.dispose();
+                    await fs.remove(indexFilePath);
+                }
+            }
+        });
+
+        test("embedding index rejects a file header with overflowing sizes", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-small-en-v1.5-q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+
+            // `count * vectorSize * 4` wraps around to a small number in 64 bits
+            const header = Buffer.alloc(32);
+            header.write("NLEI", 0, "ascii");
+            header.writeUInt32LE(1, 4); // version
+            header.writeUInt32LE(0, 8); // f32
+            header.writeUInt32LE(0, 12); // cosine
+            header.writeUInt32LE(2 ** 31, 16); // vector size
+            header.writeBigUInt64LE(2n ** 31n, 24); // count
+
+            const indexFilePath = await getTempTestFilePath("embedding-index-overflow.bin");
+            try {
+                await fs.writeFile(indexFilePath, Buffer.concat([header, Buffer.alloc(64)]));
+
+                for (const useMmap of [false, true])
+                    await expect(model.loadEmbeddingIndex(indexFilePath, {useMmap})).rejects.toThrow("header is invalid");
+            } finally {
+                await fs.remove(indexFilePath);
+            }
+        });
     });
 });
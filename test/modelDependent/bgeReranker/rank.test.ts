@@ -114,6 +114,73 @@ describe("bgeReranker", () => {
             `);
         });
 
+        test("rank all packed on multiple sequences", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-reranker-v2-m3-Q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const rankingContext = await model.createRankingContext({
+                contextSize: 512,
+                sequences: 4
+            });
+
+            const documents = [
+                "The sky is clear and blue today",
+                "I love eating pizza with extra cheese",
+                "Dogs love to play fetch with their owners",
+                "The capital of France is Paris",
+                "",
+                "Mount Everest is the tallest mountain in the world",
+                "A warm cup of tea is perfect for a cold winter day"
+            ];
+
+            const query = "Tell me a geographical fact";
+
+            const ranks = await rankingContext.rankAll(query, documents);
+            expect(ranks.length).to.eql(documents.length);
+
+            for (let i = 0; i < documents.length; i++) {
+                const rank = await rankingContext.rank(query, documents[i]!);
+                expect(simplifyScore(ranks[i]!)).to.eql(simplifyScore(rank));
+            }
+        });
+
+        test("rank all with documents longer than the batch size", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("bge-reranker-v2-m3-Q8_0.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const rankingContext = await model.createRankingContext({
+                contextSize: 512,
+                batchSize: 32
+            });
+
+            const documents = [
+                "The capital of France is Paris",
+                "Mount Everest is the tallest mountain in the world, " +
+                "rising 8,849 meters above sea level on the border between Nepal and the Tibet Autonomous Region of China, " +
+                "and it was first summited in 1953 by Edmund Hillary and Tenzing Norgay"
+            ];
+
+            const query = "Tell me a geographical fact";
+
+            expect(model.tokenize(documents[1]!).length).to.be.greaterThan(32);
+
+            const ranks = await rankingContext.rankAll(query, documents);
+            expect(ranks.length).to.eql(documents.length);
+
+            for (const rank of ranks) {
+                expect(rank).to.be.gte(0);
+                expect(rank).to.be.lte(1);
+            }
+
+            expect(await rankingContext.rank(query, documents[1]!)).to.eql(ranks[1]);
+        });
+
         test("rank and sort", {timeout: 1000 * 60 * 60 * 2}, async (test) => {
             if (process.platform !== "darwin" && process.arch !== "arm64")
                 test.skip(); // the scores are a bit different on different platforms, so skipping on other platforms due to flakiness
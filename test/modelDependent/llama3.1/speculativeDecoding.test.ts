@@ -0,0 +1,56 @@
+import {describe, expect, test} from "vitest";
+import {DraftSequenceTokenPredictor, LlamaCompletion} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama 3.1", () => {
+    describe("speculative decoding", () => {
+        test("native drafting doesn't change greedy output", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3.1-8B-Instruct.Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 2048,
+                sequences: 2
+            });
+            const draftContext = await model.createContext({
+                contextSize: 2048
+            });
+
+            const prompt = "Here is a list of sweet fruits:\n* ";
+            const generateOptions = {
+                maxTokens: 48,
+                repeatPenalty: {
+                    penalty: 1.2,
+                    lastTokens: 16
+                }
+            } as const;
+
+            const plainSequence = context.getSequence();
+            const plainRes = await new LlamaCompletion({contextSequence: plainSequence})
+                .generateCompletion(prompt, generateOptions);
+
+            const draftSequence = draftContext.getSequence();
+            const speculativeSequence = context.getSequence({
+                tokenPredictor: new DraftSequenceTokenPredictor(draftSequence, {
+                    native: true,
+                    maxTokens: 8
+                })
+            });
+            const speculativeRes = await new LlamaCompletion({contextSequence: speculativeSequence})
+                .generateCompletion(prompt, generateOptions);
+
+            expect(speculativeRes).to.eql(plainRes);
+
+            const {validated, refuted, used} = speculativeSequence.tokenPredictions;
+            expect(validated).to.be.greaterThan(0);
+            expect(used).to.be.lessThanOrEqual(validated);
+
+            // the draft sequence runs the same model with the same sampling options, so most drafts should be accepted
+            expect(validated).to.be.greaterThanOrEqual(refuted);
+        });
+    });
+});
@@ -1,4 +1,5 @@
-import { describe, test } from "vitest";
+import { describe, expect, test } from "vitest";
+import { ControlledEvaluateInputItem, LlamaContextSequence, Token } from "../../../src/index.js";
 import { getModelFile } from "../../utils/modelFiles.js";
 import { getTestLlama } from "../../utils/getTestLlama.js";
 
@@ -107,4 +108,107 @@ describe("llama 3", () => {
             });
         });
     });
+
+    describe("sequence lora", () => {
+        test("sequences with different adapters in the same batch", { timeout: 1000 * 60 * 60 * 2 }, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3-8B-Instruct-Q4_K_M.gguf");
+            const loraPath = await getModelFile("lora-Llama-3-Instruct-abliteration-LoRA-8B-f16.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 1024,
+                sequences: 2
+            });
+            const loraSequence = context.getSequence();
+            const plainSequence = context.getSequence();
+            await loraSequence.setLora(loraPath);
+
+            const tokens = model.tokenize("How do I pick a lock? Here is a step by step guide:");
+
+            // both sequences are evaluated in a single batch, decoded in a group for each set of adapters
+            const [loraProbabilities, plainProbabilities] = await Promise.all([
+                getNextTokenProbabilities(loraSequence, tokens),
+                getNextTokenProbabilities(plainSequence, tokens)
+            ]);
+
+            expect(loraProbabilities).not.to.eql(plainProbabilities);
+
+            await plainSequence.clearHistory();
+            const soloPlainProbabilities = await getNextTokenProbabilities(plainSequence, tokens);
+            expectProbabilitiesToBeClose(soloPlainProbabilities, plainProbabilities);
+
+            await context.dispose();
+            await model.dispose();
+        });
+
+        test("aborting a batch with different adapters rolls back all sequences", { timeout: 1000 * 60 * 60 * 2 }, async () => {
+            const modelPath = await getModelFile("Meta-Llama-3-8B-Instruct-Q4_K_M.gguf");
+            const loraPath = await getModelFile("lora-Llama-3-Instruct-abliteration-LoRA-8B-f16.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 2048,
+                batchSize: 2048,
+                sequences: 2
+            });
+            const loraSequence = context.getSequence();
+            const plainSequence = context.getSequence();
+            await loraSequence.setLora(loraPath);
+
+            const tokens = model.tokenize("The quick brown fox jumps over the lazy dog. ".repeat(60));
+            const expectedPlainProbabilities = await getNextTokenProbabilities(plainSequence, tokens);
+            await plainSequence.clearHistory();
+
+            // the plain sequence is aborted while the batch is being decoded,
+            // which may happen after the group of the lora sequence was already decoded
+            const abortController = new AbortController();
+            const evaluations = Promise.allSettled([
+                loraSequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, -1)),
+                plainSequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, -1), {signal: abortController.signal})
+            ]);
+            setTimeout(() => abortController.abort(), 20);
+            const [loraResult, plainResult] = await evaluations;
+
+            expect(loraResult.status).to.eql("fulfilled");
+            expect(loraSequence.nextTokenIndex).to.eql(tokens.length - 1);
+
+            if (plainResult.status === "rejected") {
+                expect(plainSequence.nextTokenIndex).to.eql(0);
+                expectProbabilitiesToBeClose(await getNextTokenProbabilities(plainSequence, tokens), expectedPlainProbabilities);
+            } else {
+                expect(plainSequence.nextTokenIndex).to.eql(tokens.length - 1);
+                expectProbabilitiesToBeClose(await getNextTokenProbabilities(plainSequence, tokens.slice(-1)), expectedPlainProbabilities);
+            }
+
+            await context.dispose();
+            await model.dispose();
+        });
+    });
 });
+
+async function getNextTokenProbabilities(sequence: LlamaContextSequence, tokens: Token[]) {
+    const input: ControlledEvaluateInputItem[] = tokens.slice();
+    input[input.length - 1] = [tokens.at(-1)!, {
+        generateNext: {
+            probabilities: true
+        }
+    }];
+
+    const res = await sequence.controlledEvaluate(input);
+
+    // only the top probabilities are compared
+    return [...res.at(-1)!.next!.probabilities!.entries()].slice(0, 10);
+}
+
+function expectProbabilitiesToBeClose(actual: [Token, number][], expected: [Token, number][]) {
+    expect(actual.map(([token]) => token)).to.eql(expected.map(([token]) => token));
+
+    for (let i = 0; i < actual.length; i++)
+        expect(actual[i]![1]).toBeCloseTo(expected[i]![1], 3);
+}
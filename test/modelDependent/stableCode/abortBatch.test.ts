@@ -0,0 +1,61 @@
+import {describe, expect, test} from "vitest";
+import {LlamaCompletion} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("abort batch", () => {
+        test("aborting one sequence mid-batch doesn't affect the other sequences", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 4096,
+                batchSize: 2048,
+                sequences: 3
+            });
+
+            const prompt = "const arrayFromOneToTwenty = [1, 2, 3,";
+            const abortedTokens = model.tokenize("function add(a, b) {\n    return a + b;\n}\n\n".repeat(60));
+
+            const expectedCompletion = await new LlamaCompletion({contextSequence: context.getSequence()})
+                .generateCompletion(prompt, {maxTokens: 24});
+
+            const sequence = context.getSequence();
+            const abortedSequence = context.getSequence();
+            const completion = new LlamaCompletion({contextSequence: sequence});
+
+            // both evaluations are decoded in the same batch, which is aborted while it's being decoded
+            const abortController = new AbortController();
+            const completionPromise = completion.generateCompletion(prompt, {maxTokens: 24});
+            const abortedEvaluationPromise = abortedSequence.evaluateWithoutGeneratingNewTokens(abortedTokens, {
+                signal: abortController.signal
+            });
+            setTimeout(() => abortController.abort(), 20);
+
+            const [completionResult, abortedResult] = await Promise.allSettled([completionPromise, abortedEvaluationPromise]);
+
+            expect(completionResult.status).to.eql("fulfilled");
+            expect((completionResult as PromiseFulfilledResult<string>).value).to.eql(expectedCompletion);
+
+            if (abortedResult.status === "rejected") {
+                // the tokens the aborted batch stored in the KV cache are removed
+                expect(abortedSequence.nextTokenIndex).to.eql(0);
+                expect(abortedSequence.contextTokens).to.eql([]);
+            } else
+                expect(abortedSequence.nextTokenIndex).to.eql(abortedTokens.length);
+
+            // the aborted sequence is usable afterward
+            await abortedSequence.clearHistory();
+            const res = await new LlamaCompletion({contextSequence: abortedSequence})
+                .generateCompletion(prompt, {maxTokens: 24});
+            expect(res).to.eql(expectedCompletion);
+
+            await context.dispose();
+            await model.dispose();
+        });
+    });
+});
@@ -0,0 +1,74 @@
+import {describe, expect, test} from "vitest";
+import {LlamaContext, LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("batch buffer", () => {
+        test("the batch buffer grows up to the batch size and is released on dispose", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 1024,
+                batchSize: 128
+            });
+            const sequence = context.getSequence();
+
+            const getBatchMemorySize = (targetContext: LlamaContext) => (
+                llama.getMemoryUsage({contexts: [targetContext]}).contexts[0]!.batchSize
+            );
+            const tokens = model.tokenize(
+                "function add(a, b) {\n    return a + b;\n}\n\n".repeat(16) + "const arrayFromOneToTwenty = [1, 2, 3,"
+            );
+            expect(tokens.length).to.be.greaterThan(128 + 4);
+
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, 4));
+            const smallBatchMemorySize = getBatchMemorySize(context);
+            expect(smallBatchMemorySize).to.be.greaterThan(0);
+
+            // a smaller batch reuses the existing buffer
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(4, 6));
+            expect(getBatchMemorySize(context)).to.eql(smallBatchMemorySize);
+
+            // batches larger than the batch size are split, so the buffer grows only up to the batch size
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(6, -1));
+            const largeBatchMemorySize = getBatchMemorySize(context);
+            expect(largeBatchMemorySize).to.be.greaterThan(smallBatchMemorySize);
+
+            const res = await generateTokens(sequence, tokens.at(-1)!, 16);
+
+            await sequence.clearHistory();
+            context._ctx.disposeBatch();
+            expect(getBatchMemorySize(context)).to.eql(0);
+
+            // the decoding after growing the buffer produces the same tokens as with a new buffer of the full batch size
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, -1));
+            expect(getBatchMemorySize(context)).to.eql(largeBatchMemorySize);
+
+            const res2 = await generateTokens(sequence, tokens.at(-1)!, 16);
+            expect(res2).to.eql(res);
+
+            await context.dispose();
+            expect(getBatchMemorySize(context)).to.eql(0);
+
+            await model.dispose();
+        });
+    });
+});
+
+async function generateTokens(sequence: LlamaContextSequence, token: Token, maxTokens: number) {
+    const res: Token[] = [];
+
+    for await (const generatedToken of sequence.evaluate([token], {temperature: 0})) {
+        res.push(generatedToken);
+
+        if (res.length >= maxTokens)
+            break;
+    }
+
+    return res;
+}
@@ -0,0 +1,60 @@
+import {describe, expect, test} from "vitest";
+import {LlamaContextSequence, Token} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("defragment KV cache", () => {
+        test("sequence tokens survive a defragmentation", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 1024
+            });
+            const sequence = context.getSequence();
+
+            const tokens = model.tokenize("function add(a, b) {\n    return a + b;\n}\n\n".repeat(8) + "const arrayFromOneToTwenty = [1, 2, 3,");
+
+            // erasing a range from the middle of the sequence leaves free cells between its cells
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, -1));
+            await sequence.eraseContextTokenRanges([{start: 10, end: 60}]);
+            const expectedTokens = await generateTokens(sequence, tokens.at(-1)!, 16);
+
+            await sequence.clearHistory();
+            await sequence.evaluateWithoutGeneratingNewTokens(tokens.slice(0, -1));
+            await sequence.eraseContextTokenRanges([{start: 10, end: 60}]);
+
+            const contextTokens = sequence.contextTokens.slice();
+            const nextTokenIndex = sequence.nextTokenIndex;
+
+            await context.defragmentKvCache();
+
+            expect(sequence.contextTokens).to.eql(contextTokens);
+            expect(sequence.nextTokenIndex).to.eql(nextTokenIndex);
+            expect(context.getKvCacheUsage().sequences[0]).to.eql(nextTokenIndex);
+
+            const res = await generateTokens(sequence, tokens.at(-1)!, 16);
+            expect(res).to.eql(expectedTokens);
+
+            await context.dispose();
+            await model.dispose();
+        });
+    });
+});
+
+async function generateTokens(sequence: LlamaContextSequence, token: Token, maxTokens: number) {
+    const res: Token[] = [];
+
+    for await (const generatedToken of sequence.evaluate([token], {temperature: 0})) {
+        res.push(generatedToken);
+
+        if (res.length >= maxTokens)
+            break;
+    }
+
+    return res;
+}
@@ -0,0 +1,121 @@
+import {describe, expect, test} from "vitest";
+import {LlamaCompletion, NgramCacheTokenPredictor} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("n-gram cache token predictor", () => {
+        test("learned n-grams produce drafts, and learning stops after dispose", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 2048,
+                sequences: 3
+            });
+
+            const prompt = "const arrayFromOneToTwenty = [1, 2, 3,";
+            const tokenPredictor = new NgramCacheTokenPredictor({
+                minCount: 1
+            });
+            const sequence = context.getSequence({tokenPredictor});
+            const completion = new LlamaCompletion({contextSequence: sequence});
+
+            const res = await completion.generateCompletion(prompt, {maxTokens: 24});
+            await sequence.clearHistory();
+            const res2 = await completion.generateCompletion(prompt, {maxTokens: 24});
+
+            expect(res2).to.eql(res);
+
+            const stats = tokenPredictor.getCacheStats()!;
+            expect(stats.learnedTokens).to.be.greaterThan(0);
+            expect(stats.draftedTokens).to.be.greaterThan(0);
+            expect(stats.acceptedTokens).to.be.greaterThan(0);
+            expect(sequence.tokenPredictions.validated).to.be.greaterThan(0);
+
+            completion.dispose({disposeSequence: true});
+            tokenPredictor.dispose();
+
+            // generating without an undisposed cache of the model shouldn't learn into the shared cache
+            const plainSequence = context.getSequence();
+            await new LlamaCompletion({contextSequence: plainSequence})
+                .generateCompletion("function add(a, b) {", {maxTokens: 24});
+
+            const tokenPredictor2 = new NgramCacheTokenPredictor({
+                minCount: 1
+            });
+            const sequence2 = context.getSequence({tokenPredictor: tokenPredictor2});
+            const completion2 = new LlamaCompletion({contextSequence: sequence2});
+            await completion2.generateCompletion(prompt, {maxTokens: 1});
+
+            // the cache is shared by the vocabulary, so the new predictor sees the counters of the previous one.
+            // only the single token generated with the new predictor is learned, and none of the tokens generated without it
+            const stats2 = tokenPredictor2.getCacheStats()!;
+            expect(stats2.learnedTokens).to.be.greaterThanOrEqual(stats.learnedTokens);
+            expect(stats2.learnedTokens).to.be.lessThanOrEqual(stats.learnedTokens + 1);
+        });
+
+        test("the cache is resized by later predictors and freed with the model", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const prompt = "const arrayFromOneToTwenty = [1, 2, 3,";
+
+            const model = await llama.loadModel({
+                modelPath
+            });
+            const context = await model.createContext({
+                contextSize: 2048,
+                sequences: 2
+            });
+
+            const tokenPredictor = new NgramCacheTokenPredictor({
+                minCount: 1,
+                maxMemorySize: 1024 * 1024
+            });
+            const sequence = context.getSequence({tokenPredictor});
+            await new LlamaCompletion({contextSequence: sequence}).generateCompletion(prompt, {maxTokens: 24});
+
+            const stats = tokenPredictor.getCacheStats()!;
+            expect(stats.learnedTokens).to.be.greaterThan(0);
+            expect(stats.memorySize).to.be.lessThanOrEqual(1024 * 1024);
+
+            const tokenPredictor2 = new NgramCacheTokenPredictor({
+                minCount: 1,
+                maxMemorySize: 2 * 1024 * 1024
+            });
+            const sequence2 = context.getSequence({tokenPredictor: tokenPredictor2});
+            await new LlamaCompletion({contextSequence: sequence2}).generateCompletion(prompt, {maxTokens: 1});
+
+            const stats2 = tokenPredictor2.getCacheStats()!;
+            expect(stats2.memorySize).to.be.greaterThan(1024 * 1024);
+            expect(stats2.learnedTokens).to.be.greaterThan(stats.learnedTokens);
+
+            tokenPredictor.dispose();
+            tokenPredictor2.dispose();
+            await model.dispose();
+
+            // the previous cache was freed with the model, so a new model starts with an empty cache
+            const model2 = await llama.loadModel({
+                modelPath
+            });
+            const context2 = await model2.createContext({
+                contextSize: 2048
+            });
+            const tokenPredictor3 = new NgramCacheTokenPredictor({
+                minCount: 1
+            });
+            const sequence3 = context2.getSequence({tokenPredictor: tokenPredictor3});
+            await new LlamaCompletion({contextSequence: sequence3}).generateCompletion(prompt, {maxTokens: 1});
+
+            const stats3 = tokenPredictor3.getCacheStats()!;
+            expect(stats3.learnedTokens).to.be.lessThanOrEqual(1);
+
+            tokenPredictor3.dispose();
+            await model2.dispose();
+        });
+    });
+});
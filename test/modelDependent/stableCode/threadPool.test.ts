@@ -0,0 +1,55 @@
+import {describe, expect, test} from "vitest";
+import {LlamaCompletion} from "../../../src/index.js";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("thread pool", () => {
+        test("contexts that share a thread pool all complete", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                gpuLayers: 0
+            });
+            const threadPool = llama.createThreadPool({
+                threads: 4
+            });
+            const context = await model.createContext({
+                contextSize: 1024,
+                threadPool
+            });
+            const context2 = await model.createContext({
+                contextSize: 1024,
+                threadPool
+            });
+
+            const completion = new LlamaCompletion({contextSequence: context.getSequence()});
+            const completion2 = new LlamaCompletion({contextSequence: context2.getSequence()});
+
+            const resultsPromise = Promise.all([
+                completion.generateCompletion("const arrayFromOneToTwenty = [1, 2, 3,", {maxTokens: 10}),
+                completion2.generateCompletion("const arrayFromOneToTwenty = [1, 2, 3,", {maxTokens: 10})
+            ]);
+
+            // pausing and resuming doesn't wait for the running evaluations, and doesn't stop them
+            threadPool.pause();
+            threadPool.resume();
+
+            const [res, res2] = await resultsPromise;
+
+            expect(res.length).to.be.greaterThan(0);
+            expect(res2).to.eql(res);
+
+            // the contexts keep using the thread pool after it's disposed
+            threadPool.dispose();
+            const res3 = await completion.generateCompletion("const arrayFromOneToTen = [1, 2, 3,", {maxTokens: 4});
+            expect(res3.length).to.be.greaterThan(0);
+
+            await context2.dispose();
+            await context.dispose();
+            await model.dispose();
+        });
+    });
+});
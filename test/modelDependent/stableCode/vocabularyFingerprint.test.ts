@@ -0,0 +1,89 @@
+import {describe, expect, test} from "vitest";
+import {getModelFile} from "../../utils/modelFiles.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("stableCode", () => {
+    describe("vocabulary fingerprint", () => {
+        test("same vocabulary has the same fingerprint", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+            const model2 = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+
+            expect(model.vocabularyFingerprint).to.match(/^[0-9a-f]{16}$/);
+            expect(model2.vocabularyFingerprint).to.eql(model.vocabularyFingerprint);
+
+            await model2.dispose();
+            await model.dispose();
+        });
+
+        test("tokenizer configuration changes the fingerprint", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+            const preTokenizerModel = await llama.loadModel({
+                modelPath,
+                vocabOnly: true,
+                metadataOverrides: {
+                    tokenizer: {
+                        ggml: {
+                            pre: model.fileInfo.metadata.tokenizer.ggml.pre === "gpt-2"
+                                ? "default"
+                                : "gpt-2"
+                        }
+                    }
+                }
+            });
+            const addBosModel = await llama.loadModel({
+                modelPath,
+                vocabOnly: true,
+                metadataOverrides: {
+                    tokenizer: {
+                        ggml: {
+                            "add_bos_token": !model.tokens.shouldPrependBosToken
+                        }
+                    }
+                }
+            });
+
+            expect(preTokenizerModel.vocabularyFingerprint).not.to.eql(model.vocabularyFingerprint);
+            expect(addBosModel.vocabularyFingerprint).not.to.eql(model.vocabularyFingerprint);
+            expect(addBosModel.vocabularyFingerprint).not.to.eql(preTokenizerModel.vocabularyFingerprint);
+
+            await addBosModel.dispose();
+            await preTokenizerModel.dispose();
+            await model.dispose();
+        });
+
+        test("different vocabularies have different fingerprints", {timeout: 1000 * 60 * 60 * 2}, async () => {
+            const modelPath = await getModelFile("stable-code-3b-Q5_K_M.gguf");
+            const otherModelPath = await getModelFile("codegemma-2b-Q4_K_M.gguf");
+            const llama = await getTestLlama();
+
+            const model = await llama.loadModel({
+                modelPath,
+                vocabOnly: true
+            });
+            const otherModel = await llama.loadModel({
+                modelPath: otherModelPath,
+                vocabOnly: true
+            });
+
+            expect(otherModel.vocabularyFingerprint).not.to.eql(model.vocabularyFingerprint);
+
+            await otherModel.dispose();
+            await model.dispose();
+        });
+    });
+});
@@ -0,0 +1,234 @@
+import {describe, expect, test} from "vitest";
+import fs from "fs-extra";
+import {parseGguf} from "../../../src/gguf/parser/parseGguf.js";
+import {parseGgufNative} from "../../../src/gguf/parser/parseGgufNative.js";
+import {readGgufFileInfo} from "../../../src/gguf/readGgufFileInfo.js";
+import {GgufFsFileReader} from "../../../src/gguf/fileReaders/GgufFsFileReader.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+import {getTempTestFilePath} from "../../utils/helpers/getTempTestDir.js";
+
+describe("gguf", () => {
+    describe("native parser", () => {
+        test("parses the same file info as the TypeScript parser", async () => {
+            const llama = await getTestLlama();
+            const filePath = await writeTestGgufFile();
+
+            const expected = await parseGguf({
+                fileReader: new GgufFsFileReader({filePath})
+            });
+            const res = await parseGgufNative({
+                bindings: llama._bindings,
+                filePath
+            });
+
+            expect(res.metadata).to.eql(expected.metadata);
+            expect(res.tensorInfo).to.eql(expected.tensorInfo);
+            expect(res.tensorCount).to.eql(expected.tensorCount);
+            expect(res.metadataSize).to.eql(expected.metadataSize);
+            expect(res.tensorInfoSize).to.eql(expected.tensorInfoSize);
+            expect(res.architectureMetadata).to.eql(expected.architectureMetadata);
+
+            const metadata = res.metadata as any;
+            expect(typeof metadata.test.uint64).to.eql("bigint");
+            expect(typeof metadata.test.int64).to.eql("bigint");
+            expect(typeof metadata.test.uint32).to.eql("number");
+            expect(typeof metadata.test.float64).to.eql("number");
+            expect(typeof metadata.test.uint64Array[0]).to.eql("bigint");
+            expect(typeof res.tensorInfo![0]!.fileOffset).to.eql("number");
+            expect(res.tensorInfo!.map((tensor) => tensor.fileOffset % 64)).to.eql(res.tensorInfo!.map(() => 0));
+
+            await fs.remove(filePath);
+        });
+
+        test("parses the same file info as the TypeScript parser without tensor info", async () => {
+            const llama = await getTestLlama();
+            const filePath = await writeTestGgufFile();
+
+            const expected = await parseGguf({
+                fileReader: new GgufFsFileReader({filePath}),
+                readTensorInfo: false
+            });
+            const res = await parseGgufNative({
+                bindings: llama._bindings,
+                filePath,
+                readTensorInfo: false
+            });
+
+            expect(res.metadata).to.eql(expected.metadata);
+            expect(res.tensorInfo).to.eql(undefined);
+            expect(res.metadataSize).to.eql(expected.metadataSize);
+
+            await fs.remove(filePath);
+        });
+
+        test("an aborted signal rejects a native read", async () => {
+            const llama = await getTestLlama();
+            const filePath = await writeTestGgufFile();
+            const abortController = new AbortController();
+            abortController.abort(new Error("aborted"));
+
+            await expect(readGgufFileInfo(filePath, {llama, signal: abortController.signal})).rejects.toThrow("aborted");
+
+            await fs.remove(filePath);
+        });
+
+        test("rejects deeply nested arrays", async () => {
+            const llama = await getTestLlama();
+            const nestingDepth = 100000;
+
+            const key = Buffer.from("test.nestedArray", "utf8");
+            const header = Buffer.alloc(4 + 4 + 8 + 8 + 8 + key.length + 4);
+            let offset = header.write("GGUF", 0, "latin1");
+            offset = header.writeUInt32LE(3, offset);
+            offset = header.writeBigUInt64LE(0n, offset);
+            offset = header.writeBigUInt64LE(1n, offset);
+            offset = header.writeBigUInt64LE(BigInt(key.length), offset);
+            offset += key.copy(header, offset);
+            header.writeUInt32LE(valueType.array, offset);
+
+            // every level is an array with a single item of an array type
+            const nestedArrays = Buffer.alloc(nestingDepth * (4 + 8));
+            for (let i = 0; i < nestingDepth; i++) {
+                nestedArrays.writeUInt32LE(valueType.array, i * 12);
+                nestedArrays.writeBigUInt64LE(1n, i * 12 + 4);
+            }
+
+            const filePath = await getTempTestFilePath("nativeParserNestedArrays.gguf");
+            await fs.writeFile(filePath, Buffer.concat([header, nestedArrays]));
+
+            await expect(parseGgufNative({
+                bindings: llama._bindings,
+                filePath
+            })).rejects.toThrow("Unsupported GGUF value");
+
+            await fs.remove(filePath);
+        });
+    });
+});
+
+const valueType = {
+    uint8: 0,
+    int8: 1,
+    uint16: 2,
+    int16: 3,
+    uint32: 4,
+    int32: 5,
+    float32: 6,
+    bool: 7,
+    string: 8,
+    array: 9,
+    uint64: 10,
+    int64: 11,
+    float64: 12
+} as const;
+
+type TestValue = {type: Exclude<keyof typeof valueType, "array">, value: number | bigint | boolean | string} | {
+    type: "array",
+    itemType: Exclude<keyof typeof valueType, "array">,
+    value: (number | bigint | boolean | string)[]
+};
+
+async function writeTestGgufFile() {
+    const metadata: Record<string, TestValue> = {
+        "general.architecture": {type: "string", value: "llama"},
+        "general.name": {type: "string", value: "native parser test ✓"},
+        "general.alignment": {type: "uint32", value: 64},
+        "llama.context_length": {type: "uint32", value: 4096},
+        "llama.rope.freq_base": {type: "float32", value: 10000},
+        "test.uint8": {type: "uint8", value: 255},
+        "test.int8": {type: "int8", value: -128},
+        "test.uint16": {type: "uint16", value: 65535},
+        "test.int16": {type: "int16", value: -32768},
+        "test.uint32": {type: "uint32", value: 4294967295},
+        "test.int32": {type: "int32", value: -2147483648},
+        "test.float32": {type: "float32", value: 0.5},
+        "test.float64": {type: "float64", value: Math.PI},
+        "test.bool": {type: "bool", value: true},
+        "test.uint64": {type: "uint64", value: 2n ** 63n + 5n},
+        "test.int64": {type: "int64", value: -(2n ** 62n)},
+        "test.emptyString": {type: "string", value: ""},
+        "test.uint64Array": {type: "array", itemType: "uint64", value: [1n, 2n ** 60n]},
+        "test.emptyArray": {type: "array", itemType: "int32", value: []},
+        "tokenizer.ggml.tokens": {type: "array", itemType: "string", value: ["<s>", "</s>", "hello", " world"]},
+        "tokenizer.ggml.scores": {type: "array", itemType: "float32", value: [0, 0, -1.5, -2.25]}
+    };
+    const tensors = [
+        {name: "token_embd.weight", dimensions: [64, 4], ggmlType: 1, offset: 0},
+        {name: "blk.0.attn_norm.weight", dimensions: [64], ggmlType: 0, offset: 512},
+        {name: "output.weight", dimensions: [64, 4, 1, 1], ggmlType: 1, offset: 768}
+    ];
+
+    const chunks: Buffer[] = [];
+    const writeUint32 = (value: number) => {
+        const buffer = Buffer.alloc(4);
+        buffer.writeUInt32LE(value);
+        chunks.push(buffer);
+    };
+    const writeUint64 = (value: number | bigint) => {
+        const buffer = Buffer.alloc(8);
+        buffer.writeBigUInt64LE(BigInt(value));
+        chunks.push(buffer);
+    };
+    const writeString = (value: string) => {
+        const buffer = Buffer.from(value, "utf8");
+        writeUint64(buffer.length);
+        chunks.push(buffer);
+    };
+    const writeScalar = (type: Exclude<keyof typeof valueType, "array">, value: number | bigint | boolean | string) => {
+        if (type === "string")
+            return writeString(value as string);
+
+        const buffer = Buffer.alloc(8);
+        let length = 0;
+        switch (type) {
+            case "uint8": length = buffer.writeUInt8(value as number); break;
+            case "int8": length = buffer.writeInt8(value as number); break;
+            case "uint16": length = buffer.writeUInt16LE(value as number); break;
+            case "int16": length = buffer.writeInt16LE(value as number); break;
+            case "uint32": length = buffer.writeUInt32LE(value as number); break;
+            case "int32": length = buffer.writeInt32LE(value as number); break;
+            case "float32": length = buffer.writeFloatLE(value as number); break;
+            case "float64": length = buffer.writeDoubleLE(value as number); break;
+            case "bool": length = buffer.writeUInt8(value ? 1 : 0); break;
+            case "uint64": length = buffer.writeBigUInt64LE(value as bigint); break;
+            case "int64": length = buffer.writeBigInt64LE(value as bigint); break;
+        }
+        chunks.push(buffer.subarray(0, length));
+    };
+
+    chunks.push(Buffer.from("GGUF", "latin1"));
+    writeUint32(3);
+    writeUint64(tensors.length);
+    writeUint64(Object.keys(metadata).length);
+
+    for (const [key, item] of Object.entries(metadata)) {
+        writeString(key);
+        writeUint32(valueType[item.type]);
+
+        if (item.type === "array") {
+            writeUint32(valueType[item.itemType]);
+            writeUint64(item.value.length);
+            for (const value of item.value)
+                writeScalar(item.itemType, value);
+        } else
+            writeScalar(item.type, item.value);
+    }
+
+    for (const tensor of tensors) {
+        writeString(tensor.name);
+        writeUint32(tensor.dimensions.length);
+        for (const dimension of tensor.dimensions)
+            writeUint64(dimension);
+
+        writeUint32(tensor.ggmlType);
+        writeUint64(tensor.offset);
+    }
+
+    // tensor data, after the alignment padding
+    chunks.push(Buffer.alloc(64 + 1024));
+
+    const filePath = await getTempTestFilePath("nativeParser.gguf");
+    await fs.writeFile(filePath, Buffer.concat(chunks));
+
+    return filePath;
+}
@@ -0,0 +1,144 @@
+import path from "path";
+import {describe, expect, test} from "vitest";
+import fs from "fs-extra";
+import {LoraAdapterCache} from "../../../src/evaluator/LlamaModel/utils/LoraAdapterCache.js";
+import {AddonModelLora} from "../../../src/bindings/AddonTypes.js";
+import {getTempTestDir} from "../../utils/helpers/getTempTestDir.js";
+
+describe("LoraAdapterCache", () => {
+    test("an acquired adapter isn't evicted before it's returned", async () => {
+        const filePaths = await createAdapterFiles(["a.gguf", "b.gguf"], 10);
+        const loras = createFakeLoraLoader({gated: true});
+        const cache = new LoraAdapterCache({maxSize: 0, loadLora: loras.load});
+
+        // the preload evicts all the other unused adapters as soon as both loads finish
+        const acquirePromise = cache.acquire(filePaths[0]!);
+        const preloadPromise = cache.preload(filePaths[1]!);
+        await loras.waitForLoads(2);
+        loras.openGate();
+
+        const [lora] = await Promise.all([acquirePromise, preloadPromise]);
+
+        expect(lora.disposed).to.eql(false);
+        expect(lora.usages).to.eql(1);
+
+        await cache.dispose();
+    });
+
+    test("concurrent acquires of a loading adapter are all counted", async () => {
+        const [filePath] = await createAdapterFiles(["a.gguf"], 10);
+        const loras = createFakeLoraLoader();
+        const cache = new LoraAdapterCache({maxSize: 0, loadLora: loras.load});
+
+        const [lora1, lora2] = await Promise.all([
+            cache.acquire(filePath!),
+            cache.acquire(filePath!)
+        ]);
+
+        expect(lora1).to.equal(lora2);
+        expect(lora1.usages).to.eql(2);
+        expect(loras.loaded.length).to.eql(1);
+
+        await cache.release([lora1]);
+        expect(lora1.disposed).to.eql(false);
+
+        await cache.release([lora2]);
+        expect(lora1.disposed).to.eql(true);
+        expect(cache.stats.evictions).to.eql(1);
+
+        await cache.dispose();
+    });
+
+    test("a failed file stat doesn't load the adapter", async () => {
+        const tempDir = await getTempTestDir();
+        const loras = createFakeLoraLoader();
+        const cache = new LoraAdapterCache({maxSize: 100, loadLora: loras.load});
+
+        await expect(cache.acquire(path.join(tempDir, "missing-lora-adapter.gguf"))).rejects.toThrow();
+        expect(loras.loaded.length).to.eql(0);
+        expect(cache.stats.loadedAdapters).to.eql(0);
+
+        await cache.dispose();
+    });
+
+    test("dispose unloads all the adapters", async () => {
+        const filePaths = await createAdapterFiles(["a.gguf", "b.gguf"], 10);
+        const loras = createFakeLoraLoader();
+        const cache = new LoraAdapterCache({maxSize: 100, loadLora: loras.load});
+
+        await cache.acquire(filePaths[0]!);
+        await cache.preload(filePaths[1]!);
+        expect(loras.loaded.length).to.eql(2);
+
+        await cache.dispose();
+
+        expect(loras.loaded.every((lora) => lora.disposed)).to.eql(true);
+        expect(cache.stats.loadedAdapters).to.eql(0);
+    });
+
+    test("an adapter that finishes loading after dispose is unloaded", async () => {
+        const [filePath] = await createAdapterFiles(["a.gguf"], 10);
+        const loras = createFakeLoraLoader();
+        const cache = new LoraAdapterCache({maxSize: 100, loadLora: loras.load});
+
+        const acquirePromise = cache.acquire(filePath!);
+        await cache.dispose();
+
+        await expect(acquirePromise).rejects.toThrow();
+        expect(loras.loaded.every((lora) => lora.disposed)).to.eql(true);
+    });
+});
+
+async function createAdapterFiles(fileNames: string[], size: number) {
+    const tempDir = path.join(await getTempTestDir(), "loraAdapterCache-" + Math.random().toString(36).slice(2, 10));
+    await fs.ensureDir(tempDir);
+
+    return await Promise.all(
+        fileNames.map(async (fileName) => {
+            const filePath = path.join(tempDir, fileName);
+            await fs.writeFile(filePath, Buffer.alloc(size));
+            return filePath;
+        })
+    );
+}
+
+function createFakeLoraLoader({gated = false}: {gated?: boolean} = {}) {
+    const loaded: AddonModelLora[] = [];
+    let pendingLoads = 0;
+    let openGate: () => void = () => {};
+    const gate = new Promise<void>((accept) => {
+        openGate = accept;
+    });
+
+    return {
+        loaded,
+        openGate,
+        async waitForLoads(count: number) {
+            while (pendingLoads < count)
+                await new Promise((accept) => setTimeout(accept, 1));
+        },
+        async load(filePath: string): Promise<AddonModelLora> {
+            pendingLoads++;
+
+            if (gated)
+                await gate;
+            else
+                await new Promise((accept) => setTimeout(accept, 10));
+
+            let disposed = false;
+            const lora: AddonModelLora = {
+                usages: 0,
+                filePath,
+                get disposed() {
+                    return disposed;
+                },
+                async dispose() {
+                    disposed = true;
+                }
+            };
+            loaded.push(lora);
+
+            return lora;
+        }
+    };
+}
@@ -0,0 +1,69 @@
+import {describe, expect, test} from "vitest";
+import {
+    chunkedPrefillStrategy
+} from "../../../src/evaluator/LlamaContext/utils/batchItemsPrioritizationStrategies/chunkedPrefillStrategy.js";
+import {BatchItem} from "../../../src/evaluator/LlamaContext/types.js";
+import {Token} from "../../../src/types.js";
+
+function createItem(length: number, logits: "last" | "all", evaluationPriority: number = 5): BatchItem {
+    const tokens = Array.from({length}, (_, index) => index as Token);
+    const itemLogits: (true | undefined)[] = [];
+
+    if (logits === "all")
+        itemLogits.push(...tokens.map(() => true as const));
+    else
+        itemLogits[length - 1] = true;
+
+    return {tokens, logits: itemLogits, evaluationPriority};
+}
+
+describe("llamaEvaluator", () => {
+    describe("chunkedPrefillStrategy", () => {
+        test("generation steps are included before prompt chunks", () => {
+            const prompt = createItem(8000, "last");
+            const generation1 = createItem(1, "last");
+            const generation2 = createItem(1, "last");
+            const validation = createItem(4, "all");
+
+            const res = chunkedPrefillStrategy({
+                items: [prompt, generation1, generation2, validation],
+                size: 512
+            });
+
+            expect(res.map(({item, processAmount}) => [item, processAmount])).toEqual([
+                [generation1, 1],
+                [generation2, 1],
+                [validation, 4],
+                [prompt, 506]
+            ]);
+        });
+
+        test("prompt chunks are filled by evaluation priority", () => {
+            const lowPriorityPrompt = createItem(300, "last", 1);
+            const highPriorityPrompt = createItem(300, "last", 9);
+
+            const res = chunkedPrefillStrategy({
+                items: [lowPriorityPrompt, highPriorityPrompt],
+                size: 512
+            });
+
+            expect(res.map(({item, processAmount}) => [item, processAmount])).toEqual([
+                [highPriorityPrompt, 300],
+                [lowPriorityPrompt, 212]
+            ]);
+        });
+
+        test("never exceeds the batch size", () => {
+            const generations = Array.from({length: 6}, () => createItem(1, "last"));
+            const prompt = createItem(100, "last");
+
+            const res = chunkedPrefillStrategy({
+                items: [...generations, prompt],
+                size: 4
+            });
+
+            expect(res.reduce((sum, {processAmount}) => sum + processAmount, 0)).toBe(4);
+            expect(res.every(({item}) => item !== prompt)).toBe(true);
+        });
+    });
+});
@@ -0,0 +1,78 @@
+import {describe, expect, test} from "vitest";
+import {getContextShiftDeleteRanges} from "../../../src/evaluator/LlamaContext/utils/getContextShiftDeleteRanges.js";
+import {Token} from "../../../src/types.js";
+
+const bosToken = 1 as Token;
+
+function createTokens(...tokens: number[]) {
+    return tokens as Token[];
+}
+
+describe("llamaEvaluator", () => {
+    describe("getContextShiftDeleteRanges", () => {
+        const contextTokens = createTokens(1, 10, 11, 12, 100, 13, 14, 101, 15, 16, 17, 18);
+
+        test("eraseBeginning keeps the BOS token", () => {
+            expect(getContextShiftDeleteRanges("eraseBeginning", {contextTokens, size: 3, bosToken})).toEqual([{start: 1, end: 4}]);
+            expect(getContextShiftDeleteRanges("eraseBeginning", {contextTokens: contextTokens.slice(1), size: 3, bosToken}))
+                .toEqual([{start: 0, end: 3}]);
+        });
+
+        test("keepSinkTokens erases the oldest tokens after the sink tokens", () => {
+            expect(getContextShiftDeleteRanges({type: "keepSinkTokens"}, {contextTokens, size: 3, bosToken}))
+                .toEqual([{start: 4, end: 7}]);
+            expect(getContextShiftDeleteRanges({type: "keepSinkTokens", sinkTokens: 2}, {contextTokens, size: 3, bosToken}))
+                .toEqual([{start: 2, end: 5}]);
+        });
+
+        test("keepSinkTokens keeps fewer sink tokens when needed to free up the requested size", () => {
+            expect(getContextShiftDeleteRanges({type: "keepSinkTokens", sinkTokens: 6}, {contextTokens, size: 10, bosToken}))
+                .toEqual([{start: 2, end: 12}]);
+        });
+
+        test("eraseMarkedRegion erases the marked region including the markers", () => {
+            expect(
+                getContextShiftDeleteRanges({
+                    type: "eraseMarkedRegion",
+                    startMarker: createTokens(100),
+                    endMarker: createTokens(101)
+                }, {contextTokens, size: 1, bosToken})
+            ).toEqual([{start: 4, end: 8}]);
+        });
+
+        test("eraseMarkedRegion erases the oldest tokens as well when the region is too small", () => {
+            expect(
+                getContextShiftDeleteRanges({
+                    type: "eraseMarkedRegion",
+                    startMarker: createTokens(100),
+                    endMarker: createTokens(101)
+                }, {contextTokens, size: 6, bosToken})
+            ).toEqual([{start: 1, end: 3}, {start: 4, end: 8}]);
+            expect(
+                getContextShiftDeleteRanges({
+                    type: "eraseMarkedRegion",
+                    startMarker: createTokens(100),
+                    endMarker: createTokens(101)
+                }, {contextTokens, size: 8, bosToken})
+            ).toEqual([{start: 1, end: 9}]);
+            expect(
+                getContextShiftDeleteRanges({
+                    type: "eraseMarkedRegion",
+                    startMarker: createTokens(100),
+                    endMarker: createTokens(101),
+                    sinkTokens: 4
+                }, {contextTokens, size: 6, bosToken})
+            ).toEqual([{start: 4, end: 10}]);
+        });
+
+        test("eraseMarkedRegion falls back to erasing the oldest tokens", () => {
+            expect(
+                getContextShiftDeleteRanges({
+                    type: "eraseMarkedRegion",
+                    startMarker: createTokens(101),
+                    endMarker: createTokens(100)
+                }, {contextTokens, size: 2, bosToken})
+            ).toEqual([{start: 1, end: 3}]);
+        });
+    });
+});
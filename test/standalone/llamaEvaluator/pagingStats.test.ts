@@ -0,0 +1,29 @@
+import {describe, expect, test} from "vitest";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("llama", () => {
+    describe("paging stats", () => {
+        test("rates are only available from the second call", async () => {
+            const llama = await getTestLlama();
+
+            const stats = llama.getPagingStats();
+            expect(stats.majorPageFaultRate).to.eql(null);
+            expect(stats.swapInRate).to.eql(null);
+
+            await new Promise((resolve) => setTimeout(resolve, 20));
+
+            const stats2 = llama.getPagingStats();
+            if (stats.majorPageFaults != null) {
+                expect(stats2.majorPageFaults).to.be.gte(stats.majorPageFaults);
+                expect(stats2.majorPageFaultRate).to.be.gte(0);
+            }
+
+            if (process.platform === "linux" && stats.swappedInPages != null)
+                expect(stats2.swapInRate).to.be.gte(0);
+            else if (process.platform !== "linux") {
+                expect(stats2.swappedInPages).to.eql(null);
+                expect(stats2.swapInRate).to.eql(null);
+            }
+        });
+    });
+});
@@ -0,0 +1,131 @@
+import {describe, expect, test} from "vitest";
+import {AddonTokenLookupIndex} from "../../../src/bindings/AddonTypes.js";
+import {getTestLlama} from "../../utils/getTestLlama.js";
+
+describe("token lookup index", () => {
+    test("predictions match a brute-force search", async () => {
+        const llama = await getTestLlama();
+        const random = createRandom(1234);
+
+        for (let i = 0; i < 300; i++) {
+            const vocabularySize = 2 + Math.floor(random() * 6);
+            const inputTokens = randomTokens(random, Math.floor(random() * 80), vocabularySize);
+            const stateTokens = randomTokens(random, 1 + Math.floor(random() * 30), vocabularySize);
+            const options = randomOptions(random);
+
+            const index = new llama._bindings.AddonTokenLookupIndex();
+            try {
+                index.setInputTokens(Uint32Array.from(inputTokens));
+                index.setStateTokens(Uint32Array.from(stateTokens));
+
+                expect(predict(index, options), JSON.stringify({inputTokens, stateTokens, options}))
+                    .to.eql(bruteForcePredict(inputTokens, stateTokens, options));
+            } finally {
+                index.dispose();
+            }
+        }
+    });
+
+    test("predictions match a brute-force search after incremental updates", async () => {
+        const llama = await getTestLlama();
+        const random = createRandom(5678);
+
+        for (let i = 0; i < 50; i++) {
+            const vocabularySize = 2 + Math.floor(random() * 4);
+            const options = randomOptions(random);
+            const inputTokens = randomTokens(random, Math.floor(random() * 20), vocabularySize);
+            const stateTokens = randomTokens(random, 1 + Math.floor(random() * 10), vocabularySize);
+
+            const index = new llama._bindings.AddonTokenLookupIndex();
+            try {
+                index.setInputTokens(Uint32Array.from(inputTokens));
+                index.setStateTokens(Uint32Array.from(stateTokens));
+
+                for (let step = 0; step < 20; step++) {
+                    if (random() < 0.3) {
+                        // extending the input keeps the existing index
+                        inputTokens.push(...randomTokens(random, 1 + Math.floor(random() * 5), vocabularySize));
+                        index.setInputTokens(Uint32Array.from(inputTokens));
+                    } else {
+                        const newTokens = randomTokens(random, 1 + Math.floor(random() * 3), vocabularySize);
+                        stateTokens.push(...newTokens);
+                        index.pushStateTokens(Uint32Array.from(newTokens));
+                    }
+
+                    expect(predict(index, options), JSON.stringify({inputTokens, stateTokens, options}))
+                        .to.eql(bruteForcePredict(inputTokens, stateTokens, options));
+                }
+            } finally {
+                index.dispose();
+            }
+        }
+    });
+});
+
+type PredictOptions = {
+    patternMinLength: number,
+    patternMaxLength: number,
+    predictionMinLength: number,
+    predictionMaxLength: number
+};
+
+function predict(index: AddonTokenLookupIndex, {
+    patternMinLength, patternMaxLength, predictionMinLength, predictionMaxLength
+}: PredictOptions) {
+    return Array.from(index.predict(patternMinLength, patternMaxLength, predictionMinLength, predictionMaxLength));
+}
+
+/**
+ * Find the longest suffix of the state tokens that appears in the input tokens and has enough tokens after its earliest appearance,
+ * and return the tokens that follow that appearance
+ */
+function bruteForcePredict(inputTokens: number[], stateTokens: number[], {
+    patternMinLength, patternMaxLength, predictionMinLength, predictionMaxLength
+}: PredictOptions) {
+    const maxLength = patternMaxLength > 0
+        ? Math.min(patternMaxLength, stateTokens.length)
+        : stateTokens.length;
+
+    for (let length = maxLength; length >= Math.max(1, patternMinLength); length--) {
+        const pattern = stateTokens.slice(stateTokens.length - length);
+
+        for (let start = 0; start + length <= inputTokens.length; start++) {
+            if (!pattern.every((token, i) => inputTokens[start + i] === token))
+                continue;
+
+            const continuation = inputTokens.slice(start + length);
+            if (continuation.length >= Math.max(1, predictionMinLength))
+                return continuation.slice(0, predictionMaxLength);
+
+            // later appearances have shorter continuations
+            break;
+        }
+    }
+
+    return [];
+}
+
+function randomOptions(random: () => number): PredictOptions {
+    return {
+        patternMinLength: Math.floor(random() * 4),
+        patternMaxLength: random() < 0.5 ? 0 : 1 + Math.floor(random() * 6),
+        predictionMinLength: Math.floor(random() * 4),
+        predictionMaxLength: 1 + Math.floor(random() * 6)
+    };
+}
+
+function randomTokens(random: () => number, length: number, vocabularySize: number) {
+    return Array.from({length}, () => Math.floor(random() * vocabularySize));
+}
+
+function createRandom(seed: number) {
+    let state = seed;
+
+    // mulberry32
+    return () => {
+        state = (state + 0x6D2B79F5) | 0;
+        let t = Math.imul(state ^ (state >>> 15), 1 | state);
+        t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
@@ -0,0 +1,70 @@
+import path from "path";
+import {describe, expect, test} from "vitest";
+import {tuneContextThreads} from "../../../src/evaluator/LlamaContext/utils/tuneContextThreads.js";
+import {AddonContext} from "../../../src/bindings/AddonTypes.js";
+import type {LlamaModel} from "../../../src/evaluator/LlamaModel/LlamaModel.js";
+
+describe("tuneContextThreads", () => {
+    test("models of different files with the same name are tuned separately", async () => {
+        const ctx = createFakeContext();
+        const fileName = "model-" + Math.random().toString(36).slice(2, 10) + ".gguf";
+        const model = createFakeModel(path.resolve("models", "a", fileName), 1000);
+        const otherModel = createFakeModel(path.resolve("models", "b", fileName), 1000);
+
+        await tuneContextThreads({ctx: ctx.ctx, model, maxThreads: 8, batchSize: 512});
+        await tuneContextThreads({ctx: ctx.ctx, model: otherModel, maxThreads: 8, batchSize: 512});
+
+        expect(model.filename).to.eql(otherModel.filename);
+        expect(ctx.tuneCalls).to.eql(2);
+    });
+
+    test("the same model file is only tuned once", async () => {
+        const ctx = createFakeContext();
+        const modelPath = path.resolve("models", "model-" + Math.random().toString(36).slice(2, 10) + ".gguf");
+
+        const res = await tuneContextThreads({ctx: ctx.ctx, model: createFakeModel(modelPath, 1000), maxThreads: 8, batchSize: 512});
+        const res2 = await tuneContextThreads({ctx: ctx.ctx, model: createFakeModel(modelPath, 1000), maxThreads: 8, batchSize: 512});
+
+        expect(res2).to.eql(res);
+        expect(ctx.tuneCalls).to.eql(1);
+
+        // a different file at the same path has to be tuned again
+        await tuneContextThreads({ctx: ctx.ctx, model: createFakeModel(modelPath, 2000), maxThreads: 8, batchSize: 512});
+        expect(ctx.tuneCalls).to.eql(2);
+    });
+});
+
+function createFakeContext() {
+    const res = {
+        tuneCalls: 0,
+        ctx: {
+            async tuneThreads(candidates: Uint32Array) {
+                res.tuneCalls++;
+
+                // more threads are faster
+                const times = Float64Array.from(candidates, (threads) => 1000 / threads);
+                return {batchTimes: times, generationTimes: times};
+            }
+        } as unknown as AddonContext
+    };
+
+    return res;
+}
+
+function createFakeModel(modelPath: string, size: number) {
+    return {
+        modelPath,
+        filename: path.basename(modelPath),
+        size,
+        gpuLayers: 0,
+        _llama: {
+            gpu: false
+        },
+        tokens: {
+            bos: 1
+        },
+        tokenize() {
+            return [1];
+        }
+    } as unknown as LlamaModel;
+}